@@ -0,0 +1,176 @@
+#include "AmbientOcclusionBaker.h"
+#include "VkMesh.h"
+
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <glm/gtc/constants.hpp>
+
+// Integer hash (lowbias32), decorrelates sample rotations of neighbouring vertices
+static uint32_t hashVertex(uint32_t value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= value >> 15;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+uint64_t AmbientOcclusionBaker::bake(Mesh* meshes, int meshCount, const AmbientOcclusionSettings& settings)
+{
+	if (meshCount <= 0)
+	{
+		return 0;
+	}
+
+	// BVH over every mesh of the model, vertices are read once (mesh getters return copies)
+	TriangleBvh bvh;
+	vector<vector<glm::vec3>> positions(meshCount);
+	vector<vector<glm::vec3>> normals(meshCount);
+	vector<uint32_t> vertexOffsets(meshCount + 1, 0);
+	for (int i = 0; i < meshCount; i++)
+	{
+		positions[i] = meshes[i].getVertices();
+		normals[i] = meshes[i].getNormals();
+		if (normals[i].size() != positions[i].size())
+		{
+			throw runtime_error("Failed to bake ambient occlusion, mesh " + meshes[i].name + " has no normals.");
+		}
+		bvh.addTriangles(positions[i], meshes[i].getIndices(), MESH_INDEX_BASE, glm::mat4(1.0f));
+		vertexOffsets[i + 1] = vertexOffsets[i] + static_cast<uint32_t>(positions[i].size());
+	}
+	bvh.build();
+
+	// Ray length and surface offset follow model size
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	bvh.getBounds(&boundsMin, &boundsMax);
+	float diagonal = glm::length(boundsMax - boundsMin);
+	float maxDistance = settings.maxDistance > 0.0f ? settings.maxDistance : diagonal * AO_DISTANCE_SCALE;
+	float bias = diagonal * AO_BIAS_SCALE;
+	uint32_t rayCount = std::max(1u, (settings.rayCount + BVH_PACKET_SIZE - 1) / BVH_PACKET_SIZE) * BVH_PACKET_SIZE;
+
+	// Every vertex is written by one worker only, so results need no synchronization
+	vector<vector<float>> occlusion(meshCount);
+	for (int i = 0; i < meshCount; i++)
+	{
+		occlusion[i].resize(positions[i].size(), 1.0f);
+	}
+
+	uint32_t vertexCount = vertexOffsets[meshCount];
+	std::atomic<uint32_t> nextVertex(0);
+	auto worker = [&]()
+	{
+		while (true)
+		{
+			uint32_t first = nextVertex.fetch_add(AO_VERTICES_PER_JOB);
+			if (first >= vertexCount)
+			{
+				return;
+			}
+			uint32_t last = std::min(vertexCount, first + AO_VERTICES_PER_JOB);
+
+			int mesh = static_cast<int>(std::upper_bound(vertexOffsets.begin(), vertexOffsets.end(), first) - vertexOffsets.begin()) - 1;
+			for (uint32_t v = first; v < last; v++)
+			{
+				while (v >= vertexOffsets[mesh + 1])
+				{
+					mesh++;
+				}
+				uint32_t vertex = v - vertexOffsets[mesh];
+				occlusion[mesh][vertex] = traceVertex(bvh, positions[mesh][vertex], normals[mesh][vertex], v, rayCount, maxDistance, bias);
+			}
+		}
+	};
+
+	uint32_t threadCount = settings.threadCount > 0 ? settings.threadCount : std::max(1u, thread::hardware_concurrency());
+	threadCount = std::min(threadCount, (vertexCount + AO_VERTICES_PER_JOB - 1) / AO_VERTICES_PER_JOB);
+	vector<thread> workers;
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		workers.push_back(thread(worker));
+	}
+	worker();
+	for (auto& workerThread : workers)
+	{
+		workerThread.join();
+	}
+
+	for (int i = 0; i < meshCount; i++)
+	{
+		meshes[i].setAmbientOcclusion(occlusion[i]);
+	}
+
+	return (uint64_t)vertexCount * rayCount;
+}
+
+float AmbientOcclusionBaker::traceVertex(const TriangleBvh& bvh, const glm::vec3& position, const glm::vec3& normal, uint32_t vertexIndex,
+	uint32_t rayCount, float maxDistance, float bias)
+{
+	float normalLength = glm::length(normal);
+	if (normalLength <= 0.0f)
+	{
+		return 1.0f;
+	}
+	glm::vec3 n = normal / normalLength;
+
+	// Orthonormal basis around normal (Duff et al., no branch on normal direction besides sign)
+	float sign = copysignf(1.0f, n.z);
+	float a = -1.0f / (sign + n.z);
+	float b = n.x * n.y * a;
+	glm::vec3 tangent(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	glm::vec3 bitangent(b, sign + n.y * n.y * a, -n.y);
+
+	uint32_t hash = hashVertex(vertexIndex);
+	glm::vec2 rotation((hash & 0xffff) / 65536.0f, (hash >> 16) / 65536.0f);
+	glm::vec3 origin = position + n * bias;
+
+	RayPacket packet;
+	for (int lane = 0; lane < BVH_PACKET_SIZE; lane++)
+	{
+		packet.originX[lane] = origin.x;
+		packet.originY[lane] = origin.y;
+		packet.originZ[lane] = origin.z;
+		packet.maxDistance[lane] = maxDistance;
+	}
+
+	uint32_t hits = 0;
+	for (uint32_t sample = 0; sample < rayCount; sample += BVH_PACKET_SIZE)
+	{
+		// Cosine weighted directions, so unoccluded fraction of rays already is the cosine weighted visibility
+		for (int lane = 0; lane < BVH_PACKET_SIZE; lane++)
+		{
+			glm::vec2 point = getSamplePoint(sample + lane, rayCount, rotation);
+			float radius = sqrtf(point.x);
+			float angle = 2.0f * glm::pi<float>() * point.y;
+			glm::vec3 direction = tangent * (radius * cosf(angle)) + bitangent * (radius * sinf(angle)) + n * sqrtf(std::max(0.0f, 1.0f - point.x));
+			packet.directionX[lane] = direction.x;
+			packet.directionY[lane] = direction.y;
+			packet.directionZ[lane] = direction.z;
+		}
+
+		uint32_t hitMask = bvh.occluded(packet, (1u << BVH_PACKET_SIZE) - 1);
+		for (; hitMask != 0; hitMask &= hitMask - 1)
+		{
+			hits++;
+		}
+	}
+
+	return 1.0f - (float)hits / (float)rayCount;
+}
+
+glm::vec2 AmbientOcclusionBaker::getSamplePoint(uint32_t sample, uint32_t sampleCount, const glm::vec2& rotation)
+{
+	// Van der Corput radical inverse in base 2
+	uint32_t bits = sample;
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555u) << 1) | ((bits & 0xaaaaaaaau) >> 1);
+	bits = ((bits & 0x33333333u) << 2) | ((bits & 0xccccccccu) >> 2);
+	bits = ((bits & 0x0f0f0f0fu) << 4) | ((bits & 0xf0f0f0f0u) >> 4);
+	bits = ((bits & 0x00ff00ffu) << 8) | ((bits & 0xff00ff00u) >> 8);
+
+	glm::vec2 point((sample + 0.5f) / (float)sampleCount, (float)bits * 2.3283064365386963e-10f);
+	return glm::fract(point + rotation);
+}
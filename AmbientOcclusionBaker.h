@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "TriangleBvh.h"
+#include "Mesh.h"
+
+// Default quality of baked ambient occlusion
+#define AO_RAY_COUNT				64			// rays per vertex, rounded up to a multiple of BVH_PACKET_SIZE
+#define AO_DISTANCE_SCALE			0.1f		// ray length relative to bounding box diagonal of the model
+#define AO_BIAS_SCALE				0.0001f		// ray origins move off the surface by this part of bounding box diagonal
+#define AO_VERTICES_PER_JOB			256			// vertices a worker takes at once
+
+struct AmbientOcclusionSettings
+{
+	uint32_t rayCount = AO_RAY_COUNT;
+	float maxDistance = 0.0f;					// model units, 0 derives it from model bounds (AO_DISTANCE_SCALE)
+	uint32_t threadCount = 0;					// 0 uses every hardware thread
+};
+
+// Offline per vertex ambient occlusion: rays over cosine weighted hemisphere of each vertex are traced against BVH of
+// all model's meshes (so meshes occlude each other) in packets of BVH_PACKET_SIZE, vertices are spread over worker
+// threads. Runs on CPU only, result is stored in meshes and streamed into vertex buffers by the renderer
+class AmbientOcclusionBaker
+{
+
+public:
+	// Bakes all meshes of one model (mesh space is model space), returns number of rays traced
+	static uint64_t bake(Mesh* meshes, int meshCount, const AmbientOcclusionSettings& settings);
+
+private:
+	// Fraction of rays leaving the hemisphere of position without hitting anything
+	static float traceVertex(const TriangleBvh& bvh, const glm::vec3& position, const glm::vec3& normal, uint32_t vertexIndex,
+		uint32_t rayCount, float maxDistance, float bias);
+	// Low discrepancy point of sample set (Hammersley), shifted by per vertex rotation so neighbours don't share patterns
+	static glm::vec2 getSamplePoint(uint32_t sample, uint32_t sampleCount, const glm::vec2& rotation);
+};
@@ -0,0 +1,651 @@
+#include "Animation.h"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <cfloat>
+
+// SSE2 is baseline on x64 (and default target of 32 bit MSVC builds), other targets use scalar loops
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+#define SMALLEST_THREE_RANGE	0.70710678f		// components other than the largest one lie within +-1/sqrt(2)
+
+// Result = a interpolated towards b per joint, weights holds rotation, translation and scale arrays of pose stride.
+// Rotations use normalized lerp along the shortest arc, result may alias a or b
+static void interpolatePoses(const AnimationPose& a, const AnimationPose& b, const float* weights, AnimationPose* result)
+{
+	size_t stride = a.stride;
+	const float* rotationWeights = weights;
+	const float* translationWeights = weights + stride;
+	const float* scaleWeights = weights + 2 * stride;
+
+	const float* ax = a.channel(POSE_ROTATION_X);
+	const float* ay = a.channel(POSE_ROTATION_Y);
+	const float* az = a.channel(POSE_ROTATION_Z);
+	const float* aw = a.channel(POSE_ROTATION_W);
+	const float* bx = b.channel(POSE_ROTATION_X);
+	const float* by = b.channel(POSE_ROTATION_Y);
+	const float* bz = b.channel(POSE_ROTATION_Z);
+	const float* bw = b.channel(POSE_ROTATION_W);
+	float* rx = result->channel(POSE_ROTATION_X);
+	float* ry = result->channel(POSE_ROTATION_Y);
+	float* rz = result->channel(POSE_ROTATION_Z);
+	float* rw = result->channel(POSE_ROTATION_W);
+
+#ifdef ANIMATION_SSE
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	for (size_t i = 0; i < stride; i += ANIMATION_SIMD_WIDTH)
+	{
+		__m128 t = _mm_loadu_ps(rotationWeights + i);
+		__m128 x0 = _mm_loadu_ps(ax + i);
+		__m128 y0 = _mm_loadu_ps(ay + i);
+		__m128 z0 = _mm_loadu_ps(az + i);
+		__m128 w0 = _mm_loadu_ps(aw + i);
+		__m128 x1 = _mm_loadu_ps(bx + i);
+		__m128 y1 = _mm_loadu_ps(by + i);
+		__m128 z1 = _mm_loadu_ps(bz + i);
+		__m128 w1 = _mm_loadu_ps(bw + i);
+
+		// Flip b to a's hemisphere
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, x1), _mm_mul_ps(y0, y1)), _mm_add_ps(_mm_mul_ps(z0, z1), _mm_mul_ps(w0, w1)));
+		__m128 sign = _mm_and_ps(dot, signMask);
+		x1 = _mm_xor_ps(x1, sign);
+		y1 = _mm_xor_ps(y1, sign);
+		z1 = _mm_xor_ps(z1, sign);
+		w1 = _mm_xor_ps(w1, sign);
+
+		__m128 x = _mm_add_ps(x0, _mm_mul_ps(_mm_sub_ps(x1, x0), t));
+		__m128 y = _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), t));
+		__m128 z = _mm_add_ps(z0, _mm_mul_ps(_mm_sub_ps(z1, z0), t));
+		__m128 w = _mm_add_ps(w0, _mm_mul_ps(_mm_sub_ps(w1, w0), t));
+		__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+		__m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+		_mm_storeu_ps(rx + i, _mm_mul_ps(x, invLength));
+		_mm_storeu_ps(ry + i, _mm_mul_ps(y, invLength));
+		_mm_storeu_ps(rz + i, _mm_mul_ps(z, invLength));
+		_mm_storeu_ps(rw + i, _mm_mul_ps(w, invLength));
+	}
+
+	for (int c = POSE_TRANSLATION_X; c < POSE_CHANNEL_COUNT; c++)
+	{
+		const float* channelWeights = c < POSE_SCALE_X ? translationWeights : scaleWeights;
+		const float* va = a.channel((AnimationPoseChannel)c);
+		const float* vb = b.channel((AnimationPoseChannel)c);
+		float* vr = result->channel((AnimationPoseChannel)c);
+		for (size_t i = 0; i < stride; i += ANIMATION_SIMD_WIDTH)
+		{
+			__m128 v0 = _mm_loadu_ps(va + i);
+			__m128 v1 = _mm_loadu_ps(vb + i);
+			_mm_storeu_ps(vr + i, _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), _mm_loadu_ps(channelWeights + i))));
+		}
+	}
+#else
+	for (size_t i = 0; i < stride; i++)
+	{
+		float t = rotationWeights[i];
+		float dot = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i] + aw[i] * bw[i];
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		float x = ax[i] + (bx[i] * sign - ax[i]) * t;
+		float y = ay[i] + (by[i] * sign - ay[i]) * t;
+		float z = az[i] + (bz[i] * sign - az[i]) * t;
+		float w = aw[i] + (bw[i] * sign - aw[i]) * t;
+		float invLength = 1.0f / sqrt(x * x + y * y + z * z + w * w);
+		rx[i] = x * invLength;
+		ry[i] = y * invLength;
+		rz[i] = z * invLength;
+		rw[i] = w * invLength;
+	}
+
+	for (int c = POSE_TRANSLATION_X; c < POSE_CHANNEL_COUNT; c++)
+	{
+		const float* channelWeights = c < POSE_SCALE_X ? translationWeights : scaleWeights;
+		const float* va = a.channel((AnimationPoseChannel)c);
+		const float* vb = b.channel((AnimationPoseChannel)c);
+		float* vr = result->channel((AnimationPoseChannel)c);
+		for (size_t i = 0; i < stride; i++)
+		{
+			vr[i] = va[i] + (vb[i] - va[i]) * channelWeights[i];
+		}
+	}
+#endif
+}
+
+// Same interpolation the sampler performs, used to measure error of reduced tracks
+static glm::vec4 interpolateKey(AnimationTrackType type, const glm::vec4& a, const glm::vec4& b, float t)
+{
+	if (type != ANIMATION_TRACK_ROTATION)
+	{
+		return glm::mix(a, b, t);
+	}
+	glm::vec4 target = glm::dot(a, b) < 0.0f ? -b : b;
+	return glm::normalize(glm::mix(a, target, t));
+}
+
+static float keyError(AnimationTrackType type, const glm::vec4& a, const glm::vec4& b)
+{
+	if (type != ANIMATION_TRACK_ROTATION)
+	{
+		return glm::length(glm::vec3(a) - glm::vec3(b));
+	}
+	// Angle between rotations
+	float dot = std::min(std::fabs(glm::dot(glm::normalize(a), glm::normalize(b))), 1.0f);
+	return 2.0f * acos(dot);
+}
+
+static uint16_t quantize(float value, float bits)
+{
+	return static_cast<uint16_t>(std::min(std::max(value, 0.0f), 1.0f) * bits + 0.5f);
+}
+
+void AnimationPose::resize(size_t count)
+{
+	this->jointCount = count;
+	this->stride = (count + ANIMATION_SIMD_WIDTH - 1) / ANIMATION_SIMD_WIDTH * ANIMATION_SIMD_WIDTH;
+	this->values.assign(POSE_CHANNEL_COUNT * this->stride, 0.0f);
+	std::fill_n(channel(POSE_ROTATION_W), this->stride, 1.0f);
+	std::fill_n(channel(POSE_SCALE_X), 3 * this->stride, 1.0f);
+}
+
+float* AnimationPose::channel(AnimationPoseChannel poseChannel)
+{
+	return this->values.data() + poseChannel * this->stride;
+}
+
+const float* AnimationPose::channel(AnimationPoseChannel poseChannel) const
+{
+	return this->values.data() + poseChannel * this->stride;
+}
+
+void AnimationPose::setJoint(size_t joint, const glm::mat4& localTransform)
+{
+	glm::vec3 scale = glm::vec3(glm::length(glm::vec3(localTransform[0])), glm::length(glm::vec3(localTransform[1])),
+		glm::length(glm::vec3(localTransform[2])));
+	glm::mat3 rotationMatrix = glm::mat3(
+		glm::vec3(localTransform[0]) / std::max(scale.x, FLT_MIN),
+		glm::vec3(localTransform[1]) / std::max(scale.y, FLT_MIN),
+		glm::vec3(localTransform[2]) / std::max(scale.z, FLT_MIN));
+	glm::quat rotation = glm::normalize(glm::quat_cast(rotationMatrix));
+
+	channel(POSE_ROTATION_X)[joint] = rotation.x;
+	channel(POSE_ROTATION_Y)[joint] = rotation.y;
+	channel(POSE_ROTATION_Z)[joint] = rotation.z;
+	channel(POSE_ROTATION_W)[joint] = rotation.w;
+	channel(POSE_TRANSLATION_X)[joint] = localTransform[3].x;
+	channel(POSE_TRANSLATION_Y)[joint] = localTransform[3].y;
+	channel(POSE_TRANSLATION_Z)[joint] = localTransform[3].z;
+	channel(POSE_SCALE_X)[joint] = scale.x;
+	channel(POSE_SCALE_Y)[joint] = scale.y;
+	channel(POSE_SCALE_Z)[joint] = scale.z;
+}
+
+void AnimationPose::toLocalTransforms(std::vector<glm::mat4>* localTransforms) const
+{
+	localTransforms->resize(this->jointCount);
+	for (size_t i = 0; i < this->jointCount; i++)
+	{
+		glm::quat rotation = glm::quat(channel(POSE_ROTATION_W)[i], channel(POSE_ROTATION_X)[i], channel(POSE_ROTATION_Y)[i],
+			channel(POSE_ROTATION_Z)[i]);
+
+		// Scale, then rotate, then translate
+		glm::mat4 transform = glm::mat4_cast(rotation);
+		transform[0] *= channel(POSE_SCALE_X)[i];
+		transform[1] *= channel(POSE_SCALE_Y)[i];
+		transform[2] *= channel(POSE_SCALE_Z)[i];
+		transform[3] = glm::vec4(channel(POSE_TRANSLATION_X)[i], channel(POSE_TRANSLATION_Y)[i], channel(POSE_TRANSLATION_Z)[i], 1.0f);
+		(*localTransforms)[i] = transform;
+	}
+}
+
+void Skeleton::buildRestPose()
+{
+	this->restPose.resize(this->restTransforms.size());
+	for (size_t i = 0; i < this->restTransforms.size(); i++)
+	{
+		this->restPose.setJoint(i, this->restTransforms[i]);
+	}
+}
+
+int Skeleton::findJoint(const std::string& name) const
+{
+	for (size_t i = 0; i < this->jointNames.size(); i++)
+	{
+		if (this->jointNames[i] == name)
+		{
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+
+void Skeleton::computeModelTransforms(const std::vector<glm::mat4>& localTransforms, std::vector<glm::mat4>* modelTransforms) const
+{
+	modelTransforms->resize(localTransforms.size());
+	for (size_t i = 0; i < localTransforms.size(); i++)
+	{
+		int parent = this->parents[i];
+		(*modelTransforms)[i] = parent >= 0 ? (*modelTransforms)[parent] * localTransforms[i] : localTransforms[i];
+	}
+
+	// Rest transform of root is not part of the model's own placement (renderer applies model transform on top)
+	if (!modelTransforms->empty())
+	{
+		glm::mat4 rootInverse = glm::inverse(this->restTransforms[0]);
+		for (auto& transform : *modelTransforms)
+		{
+			transform = rootInverse * transform;
+		}
+	}
+}
+
+AnimationClip::AnimationClip()
+{
+	this->duration = 0.0f;
+}
+
+AnimationClip::AnimationClip(const std::string& name, float duration, std::vector<AnimationChannel> channels)
+{
+	this->name = name;
+	this->duration = duration;
+	this->channels = std::move(channels);
+}
+
+AnimationClip::~AnimationClip()
+{
+}
+
+const std::string& AnimationClip::getName() const
+{
+	return this->name;
+}
+
+float AnimationClip::getDuration() const
+{
+	return this->duration;
+}
+
+const std::vector<AnimationChannel>& AnimationClip::getChannels() const
+{
+	return this->channels;
+}
+
+void AnimationClip::sample(float time, const Skeleton& skeleton, std::vector<glm::mat4>* localTransforms) const
+{
+	*localTransforms = skeleton.restTransforms;
+	if (this->duration > 0.0f)
+	{
+		time = fmod(time, this->duration);
+		time = time < 0.0f ? time + this->duration : time;
+	}
+
+	for (const auto& channel : this->channels)
+	{
+		float blend;
+		glm::vec3 position = glm::vec3(0.0f);
+		if (!channel.positions.empty())
+		{
+			size_t key = findKey(channel.positionTimes, time, &blend);
+			size_t next = std::min(key + 1, channel.positions.size() - 1);
+			position = glm::mix(channel.positions[key], channel.positions[next], blend);
+		}
+
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		if (!channel.rotations.empty())
+		{
+			size_t key = findKey(channel.rotationTimes, time, &blend);
+			size_t next = std::min(key + 1, channel.rotations.size() - 1);
+			rotation = glm::slerp(channel.rotations[key], channel.rotations[next], blend);
+		}
+
+		glm::vec3 scale = glm::vec3(1.0f);
+		if (!channel.scales.empty())
+		{
+			size_t key = findKey(channel.scaleTimes, time, &blend);
+			size_t next = std::min(key + 1, channel.scales.size() - 1);
+			scale = glm::mix(channel.scales[key], channel.scales[next], blend);
+		}
+
+		// Scale, then rotate, then translate
+		glm::mat4 transform = glm::mat4_cast(glm::normalize(rotation));
+		transform[0] *= scale.x;
+		transform[1] *= scale.y;
+		transform[2] *= scale.z;
+		transform[3] = glm::vec4(position, 1.0f);
+		(*localTransforms)[channel.joint] = transform;
+	}
+}
+
+size_t AnimationClip::findKey(const std::vector<float>& times, float time, float* blend)
+{
+	*blend = 0.0f;
+	if (times.size() < 2 || time <= times.front())
+	{
+		return 0;
+	}
+	if (time >= times.back())
+	{
+		return times.size() - 1;
+	}
+
+	// First key after time, keys are sorted by time
+	size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+	size_t key = next - 1;
+	float span = times[next] - times[key];
+	*blend = span > 0.0f ? (time - times[key]) / span : 0.0f;
+	return key;
+}
+
+CompressedAnimationClip::CompressedAnimationClip()
+{
+	this->duration = 0.0f;
+}
+
+CompressedAnimationClip::CompressedAnimationClip(const AnimationClip& clip, const Skeleton& skeleton, const AnimationCompressionSettings& settings)
+{
+	if (skeleton.restPose.jointCount != skeleton.restTransforms.size())
+	{
+		throw std::runtime_error("Failed to compress animation clip, skeleton has no rest pose!");
+	}
+
+	this->name = clip.getName();
+	this->duration = clip.getDuration();
+
+	const AnimationPose& rest = skeleton.restPose;
+	for (const auto& channel : clip.getChannels())
+	{
+		int joint = channel.joint;
+
+		std::vector<glm::vec4> values;
+		for (const auto& rotation : channel.rotations)
+		{
+			values.push_back(glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w));
+		}
+		glm::vec4 restValue = glm::vec4(rest.channel(POSE_ROTATION_X)[joint], rest.channel(POSE_ROTATION_Y)[joint],
+			rest.channel(POSE_ROTATION_Z)[joint], rest.channel(POSE_ROTATION_W)[joint]);
+		addTrack(joint, ANIMATION_TRACK_ROTATION, channel.rotationTimes, values, restValue, settings.rotationError);
+
+		values.clear();
+		for (const auto& position : channel.positions)
+		{
+			values.push_back(glm::vec4(position, 0.0f));
+		}
+		restValue = glm::vec4(rest.channel(POSE_TRANSLATION_X)[joint], rest.channel(POSE_TRANSLATION_Y)[joint],
+			rest.channel(POSE_TRANSLATION_Z)[joint], 0.0f);
+		addTrack(joint, ANIMATION_TRACK_TRANSLATION, channel.positionTimes, values, restValue, settings.translationError);
+
+		values.clear();
+		for (const auto& scale : channel.scales)
+		{
+			values.push_back(glm::vec4(scale, 0.0f));
+		}
+		restValue = glm::vec4(rest.channel(POSE_SCALE_X)[joint], rest.channel(POSE_SCALE_Y)[joint], rest.channel(POSE_SCALE_Z)[joint], 0.0f);
+		addTrack(joint, ANIMATION_TRACK_SCALE, channel.scaleTimes, values, restValue, settings.scaleError);
+	}
+
+	this->tracks.shrink_to_fit();
+	this->keyTimes.shrink_to_fit();
+	this->keyValues.shrink_to_fit();
+}
+
+CompressedAnimationClip::~CompressedAnimationClip()
+{
+}
+
+const std::string& CompressedAnimationClip::getName() const
+{
+	return this->name;
+}
+
+float CompressedAnimationClip::getDuration() const
+{
+	return this->duration;
+}
+
+size_t CompressedAnimationClip::getKeyCount() const
+{
+	return this->keyTimes.size();
+}
+
+size_t CompressedAnimationClip::getMemorySize() const
+{
+	return this->tracks.size() * sizeof(Track) + (this->keyTimes.size() + this->keyValues.size()) * sizeof(uint16_t);
+}
+
+void CompressedAnimationClip::addTrack(int joint, AnimationTrackType type, const std::vector<float>& times, const std::vector<glm::vec4>& values,
+	const glm::vec4& restValue, float maxError)
+{
+	if (values.empty())
+	{
+		return;
+	}
+
+	Track track = {};
+	track.joint = static_cast<uint16_t>(joint);
+	track.type = static_cast<uint16_t>(type);
+	if (type != ANIMATION_TRACK_ROTATION)
+	{
+		glm::vec3 minimum = glm::vec3(values[0]);
+		glm::vec3 maximum = glm::vec3(values[0]);
+		for (const auto& value : values)
+		{
+			minimum = glm::min(minimum, glm::vec3(value));
+			maximum = glm::max(maximum, glm::vec3(value));
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			track.rangeMin[c] = minimum[c];
+			track.rangeExtent[c] = maximum[c] - minimum[c];
+		}
+	}
+
+	// Errors are measured against decoded keys, so bounds include quantization
+	size_t count = values.size();
+	std::vector<uint16_t> encoded(3 * count);
+	std::vector<glm::vec4> decoded(count);
+	std::vector<float> quantizedTimes(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		encodeKey(track, values[i], &encoded[3 * i]);
+		decoded[i] = decodeKey(track, &encoded[3 * i]);
+		quantizedTimes[i] = floor(quantizeTime(times[i]) + 0.5f);
+	}
+
+	// Tracks that never leave the rest value are dropped, constant tracks keep a single key
+	bool atRest = true;
+	bool constant = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		atRest = atRest && keyError(type, restValue, values[i]) <= maxError;
+		constant = constant && keyError(type, decoded[0], values[i]) <= maxError;
+	}
+	if (atRest)
+	{
+		return;
+	}
+
+	// Greedy line fit: extend the segment from the last kept key until one of the removed keys leaves error bounds
+	std::vector<size_t> kept = { 0 };
+	if (!constant)
+	{
+		size_t anchor = 0;
+		for (size_t end = 2; end < count; end++)
+		{
+			float span = quantizedTimes[end] - quantizedTimes[anchor];
+			for (size_t k = anchor + 1; k < end; k++)
+			{
+				float blend = span > 0.0f ? (quantizedTimes[k] - quantizedTimes[anchor]) / span : 0.0f;
+				if (keyError(type, interpolateKey(type, decoded[anchor], decoded[end], blend), values[k]) > maxError)
+				{
+					anchor = end - 1;
+					kept.push_back(anchor);
+					break;
+				}
+			}
+		}
+		if (count > 1)
+		{
+			kept.push_back(count - 1);
+		}
+	}
+
+	track.firstKey = static_cast<uint32_t>(this->keyTimes.size());
+	track.keyCount = static_cast<uint32_t>(kept.size());
+	for (size_t key : kept)
+	{
+		this->keyTimes.push_back(static_cast<uint16_t>(quantizedTimes[key]));
+		this->keyValues.insert(this->keyValues.end(), &encoded[3 * key], &encoded[3 * key] + 3);
+	}
+	this->tracks.push_back(track);
+}
+
+float CompressedAnimationClip::quantizeTime(float time) const
+{
+	if (this->duration <= 0.0f)
+	{
+		return 0.0f;
+	}
+	return std::min(std::max(time / this->duration, 0.0f), 1.0f) * 65535.0f;
+}
+
+void CompressedAnimationClip::encodeKey(const Track& track, const glm::vec4& value, uint16_t* encoded)
+{
+	if (track.type != ANIMATION_TRACK_ROTATION)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float normalized = track.rangeExtent[c] > 0.0f ? (value[c] - track.rangeMin[c]) / track.rangeExtent[c] : 0.0f;
+			encoded[c] = quantize(normalized, 65535.0f);
+		}
+		return;
+	}
+
+	// Smallest three: largest component is dropped (made positive, q and -q are the same rotation) and rebuilt from
+	// the others, its index goes to the top bits of the first two values
+	glm::vec4 rotation = glm::normalize(value);
+	int largest = 0;
+	for (int c = 1; c < 4; c++)
+	{
+		if (std::fabs(rotation[c]) > std::fabs(rotation[largest]))
+		{
+			largest = c;
+		}
+	}
+	float sign = rotation[largest] < 0.0f ? -1.0f : 1.0f;
+
+	int slot = 0;
+	for (int c = 0; c < 4; c++)
+	{
+		if (c != largest)
+		{
+			float normalized = (rotation[c] * sign + SMALLEST_THREE_RANGE) / (2.0f * SMALLEST_THREE_RANGE);
+			encoded[slot++] = quantize(normalized, 32767.0f);
+		}
+	}
+	encoded[0] |= (largest & 1) << 15;
+	encoded[1] |= (largest >> 1) << 15;
+}
+
+glm::vec4 CompressedAnimationClip::decodeKey(const Track& track, const uint16_t* encoded)
+{
+	glm::vec4 value = glm::vec4(0.0f);
+	if (track.type != ANIMATION_TRACK_ROTATION)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			value[c] = track.rangeMin[c] + encoded[c] / 65535.0f * track.rangeExtent[c];
+		}
+		return value;
+	}
+
+	int largest = (encoded[0] >> 15) | ((encoded[1] >> 15) << 1);
+	int slot = 0;
+	float sumSquares = 0.0f;
+	for (int c = 0; c < 4; c++)
+	{
+		if (c != largest)
+		{
+			value[c] = (encoded[slot++] & 0x7FFF) / 32767.0f * (2.0f * SMALLEST_THREE_RANGE) - SMALLEST_THREE_RANGE;
+			sumSquares += value[c] * value[c];
+		}
+	}
+	value[largest] = std::sqrt(std::max(1.0f - sumSquares, 0.0f));
+	return value;
+}
+
+AnimationSampler::AnimationSampler()
+{
+}
+
+AnimationSampler::~AnimationSampler()
+{
+}
+
+void AnimationSampler::sample(const CompressedAnimationClip& clip, float time, const Skeleton& skeleton, AnimationPose* pose)
+{
+	// Joints without tracks interpolate rest pose to itself
+	*pose = skeleton.restPose;
+	this->nextKeys = skeleton.restPose;
+	size_t stride = pose->stride;
+	this->weights.assign(ANIMATION_TRACK_TYPE_COUNT * stride, 0.0f);
+
+	if (clip.duration > 0.0f)
+	{
+		time = fmod(time, clip.duration);
+		time = time < 0.0f ? time + clip.duration : time;
+	}
+	float keyTime = clip.quantizeTime(time);
+
+	// Decode keys around time, interpolation of all joints happens at once below
+	for (const auto& track : clip.tracks)
+	{
+		const uint16_t* times = clip.keyTimes.data() + track.firstKey;
+		const uint16_t* values = clip.keyValues.data() + 3 * track.firstKey;
+		size_t key = 0;
+		size_t next = 0;
+		float blend = 0.0f;
+		if (track.keyCount > 1 && keyTime > times[0])
+		{
+			if (keyTime >= times[track.keyCount - 1])
+			{
+				key = next = track.keyCount - 1;
+			}
+			else
+			{
+				next = std::upper_bound(times, times + track.keyCount, keyTime) - times;
+				key = next - 1;
+				float span = static_cast<float>(times[next] - times[key]);
+				blend = span > 0.0f ? (keyTime - times[key]) / span : 0.0f;
+			}
+		}
+
+		glm::vec4 value = CompressedAnimationClip::decodeKey(track, values + 3 * key);
+		glm::vec4 nextValue = CompressedAnimationClip::decodeKey(track, values + 3 * next);
+		AnimationPoseChannel firstChannel = track.type == ANIMATION_TRACK_ROTATION ? POSE_ROTATION_X
+			: track.type == ANIMATION_TRACK_TRANSLATION ? POSE_TRANSLATION_X : POSE_SCALE_X;
+		int channelCount = track.type == ANIMATION_TRACK_ROTATION ? 4 : 3;
+		for (int c = 0; c < channelCount; c++)
+		{
+			pose->channel((AnimationPoseChannel)(firstChannel + c))[track.joint] = value[c];
+			this->nextKeys.channel((AnimationPoseChannel)(firstChannel + c))[track.joint] = nextValue[c];
+		}
+		this->weights[track.type * stride + track.joint] = blend;
+	}
+
+	interpolatePoses(*pose, this->nextKeys, this->weights.data(), pose);
+}
+
+void AnimationSampler::blend(const AnimationPose& a, const AnimationPose& b, float weight, AnimationPose* result)
+{
+	if (a.jointCount != b.jointCount)
+	{
+		throw std::runtime_error("Failed to blend animation poses of different skeletons!");
+	}
+	if (result->jointCount != a.jointCount)
+	{
+		result->resize(a.jointCount);
+	}
+	this->weights.assign(ANIMATION_TRACK_TYPE_COUNT * a.stride, weight);
+	interpolatePoses(a, b, this->weights.data(), result);
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Joints evaluated per SIMD operation by AnimationSampler, pose arrays are padded to a multiple of it
+#define ANIMATION_SIMD_WIDTH		4
+
+// Default error bounds of clip compression, checked at every raw key
+#define ANIMATION_ROTATION_ERROR	0.0005f		// radians
+#define ANIMATION_TRANSLATION_ERROR	0.0001f		// model units
+#define ANIMATION_SCALE_ERROR		0.0001f
+
+// Float arrays of AnimationPose, one value per joint each
+enum AnimationPoseChannel
+{
+	POSE_ROTATION_X,
+	POSE_ROTATION_Y,
+	POSE_ROTATION_Z,
+	POSE_ROTATION_W,
+	POSE_TRANSLATION_X,
+	POSE_TRANSLATION_Y,
+	POSE_TRANSLATION_Z,
+	POSE_SCALE_X,
+	POSE_SCALE_Y,
+	POSE_SCALE_Z,
+	POSE_CHANNEL_COUNT
+};
+
+// Local transforms of all joints as rotation, translation and scale in structure of arrays layout, so samplers
+// and blends process several joints per instruction
+struct AnimationPose
+{
+	size_t jointCount = 0;
+	size_t stride = 0;							// joint count padded to ANIMATION_SIMD_WIDTH
+	std::vector<float> values;					// POSE_CHANNEL_COUNT arrays of stride floats
+
+	// Resets all joints (and padding) to identity
+	void resize(size_t count);
+	float* channel(AnimationPoseChannel poseChannel);
+	const float* channel(AnimationPoseChannel poseChannel) const;
+
+	// Decomposes local transform into joint's rotation, translation and scale
+	void setJoint(size_t joint, const glm::mat4& localTransform);
+	void toLocalTransforms(std::vector<glm::mat4>* localTransforms) const;
+};
+
+// Node hierarchy of an imported model, joints are the nodes animation clips and skins refer to
+struct Skeleton
+{
+	std::vector<std::string> jointNames;
+	std::vector<int> parents;					// -1 for roots, parents always precede their children
+	std::vector<glm::mat4> restTransforms;		// local transforms used by joints without animation channel
+	AnimationPose restPose;						// restTransforms decomposed, built by buildRestPose
+
+	void buildRestPose();
+	int findJoint(const std::string& name) const;
+	// Local transforms to model space (relative to rest pose of the first root, so skins stay where their bind pose puts them)
+	void computeModelTransforms(const std::vector<glm::mat4>& localTransforms, std::vector<glm::mat4>* modelTransforms) const;
+};
+
+// Keys of one animated joint, times are in seconds
+struct AnimationChannel
+{
+	int joint;
+	std::vector<float> positionTimes;
+	std::vector<glm::vec3> positions;
+	std::vector<float> rotationTimes;
+	std::vector<glm::quat> rotations;
+	std::vector<float> scaleTimes;
+	std::vector<glm::vec3> scales;
+};
+
+class AnimationClip
+{
+
+public:
+	AnimationClip();
+	AnimationClip(const std::string& name, float duration, std::vector<AnimationChannel> channels);
+	~AnimationClip();
+
+	const std::string& getName() const;
+	float getDuration() const;
+	const std::vector<AnimationChannel>& getChannels() const;
+
+	// Local transforms of all skeleton joints at given time (wrapped to clip duration)
+	void sample(float time, const Skeleton& skeleton, std::vector<glm::mat4>* localTransforms) const;
+
+private:
+	std::string name;
+	float duration;
+	std::vector<AnimationChannel> channels;
+
+	// Key before time and blend factor towards the next one
+	static size_t findKey(const std::vector<float>& times, float time, float* blend);
+};
+
+// Largest error compression may introduce at raw keys, keys that interpolation reproduces within it are removed
+struct AnimationCompressionSettings
+{
+	float rotationError = ANIMATION_ROTATION_ERROR;
+	float translationError = ANIMATION_TRANSLATION_ERROR;
+	float scaleError = ANIMATION_SCALE_ERROR;
+};
+
+enum AnimationTrackType
+{
+	ANIMATION_TRACK_ROTATION,
+	ANIMATION_TRACK_TRANSLATION,
+	ANIMATION_TRACK_SCALE,
+	ANIMATION_TRACK_TYPE_COUNT
+};
+
+// Clip with reduced and quantized keys: 16 bit key times, rotations as smallest three components, translations and
+// scales relative to their track's range. Every key takes 8 bytes (raw Assimp keys take 24 to 32)
+class CompressedAnimationClip
+{
+
+public:
+	CompressedAnimationClip();
+	// Skeleton's rest pose has to be built, tracks that stay at rest values within error bounds are dropped
+	CompressedAnimationClip(const AnimationClip& clip, const Skeleton& skeleton, const AnimationCompressionSettings& settings);
+	~CompressedAnimationClip();
+
+	const std::string& getName() const;
+	float getDuration() const;
+	size_t getKeyCount() const;
+	// Bytes of track headers and keys
+	size_t getMemorySize() const;
+
+private:
+	friend class AnimationSampler;
+
+	struct Track
+	{
+		uint16_t joint;
+		uint16_t type;							// AnimationTrackType
+		uint32_t firstKey;						// index of first key time, its value starts at 3 * firstKey
+		uint32_t keyCount;
+		float rangeMin[3];						// dequantization range of translation and scale values
+		float rangeExtent[3];
+	};
+
+	std::string name;
+	float duration;
+	std::vector<Track> tracks;
+	std::vector<uint16_t> keyTimes;				// normalized to duration
+	std::vector<uint16_t> keyValues;			// 3 per key
+
+	void addTrack(int joint, AnimationTrackType type, const std::vector<float>& times, const std::vector<glm::vec4>& values,
+		const glm::vec4& restValue, float maxError);
+	float quantizeTime(float time) const;
+
+	static void encodeKey(const Track& track, const glm::vec4& value, uint16_t* encoded);
+	// Rotations decode to quaternion x, y, z, w, translations and scales to x, y, z
+	static glm::vec4 decodeKey(const Track& track, const uint16_t* encoded);
+};
+
+// Samples compressed clips and blends poses several joints at a time. Keeps scratch buffers between calls, so
+// every thread animating characters should use its own sampler
+class AnimationSampler
+{
+
+public:
+	AnimationSampler();
+	~AnimationSampler();
+
+	// Local pose of all skeleton joints at given time (wrapped to clip duration)
+	void sample(const CompressedAnimationClip& clip, float time, const Skeleton& skeleton, AnimationPose* pose);
+	// Pose a blended towards pose b by weight (0 gives a), result may be one of the inputs
+	void blend(const AnimationPose& a, const AnimationPose& b, float weight, AnimationPose* result);
+
+private:
+	AnimationPose nextKeys;						// keys following the sampled time
+	std::vector<float> weights;					// interpolation weights of rotation, translation and scale arrays
+};
@@ -0,0 +1,374 @@
+#include "CascadedShadows.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+CascadedShadows::CascadedShadows()
+{
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->uniformRing = nullptr;
+	this->atlasFormat = VK_FORMAT_UNDEFINED;
+	this->atlasImage = VK_NULL_HANDLE;
+	this->atlasImageMemory = VK_NULL_HANDLE;
+	this->atlasImageView = VK_NULL_HANDLE;
+	this->atlasSampler = VK_NULL_HANDLE;
+	this->atlasRendered = false;
+	this->atlasLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	this->lightDirection = glm::normalize(glm::vec3(0.4f, 0.8f, 0.6f));
+	this->cameraView = glm::mat4(1.0f);
+	this->shadowDataOffset = 0;
+
+	for (auto& cascade : this->cascades)
+	{
+		cascade.lightView = glm::mat4(1.0f);
+		cascade.lightProjection = glm::mat4(1.0f);
+		cascade.radius = 0.0f;
+		cascade.splitDistance = 0.0f;
+		cascade.casterHash = 0;
+		cascade.renderedHash = 0;
+		cascade.animatedCasters = false;
+		cascade.dirty = true;					// atlas content is undefined until first render
+		cascade.viewProjectionOffset = 0;
+	}
+}
+
+CascadedShadows::~CascadedShadows()
+{
+}
+
+void CascadedShadows::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkFormat depthFormat, UniformRingAllocator* uniformRing)
+{
+	this->logicalDevice = logicalDevice;
+	this->uniformRing = uniformRing;
+	this->atlasFormat = depthFormat;
+
+	// ATLAS IMAGE
+	// Persistent (not a graph transient), cached cascades must survive between frames
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.extent = { SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 1 };
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.format = depthFormat;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateImage(logicalDevice, &imageCreateInfo, nullptr, &this->atlasImage);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create shadow atlas Image.");
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(logicalDevice, this->atlasImage, &memoryRequirements);
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = memoryRequirements.size;
+	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	result = vkAllocateMemory(logicalDevice, &memoryAllocInfo, nullptr, &this->atlasImageMemory);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to allocate memory for shadow atlas.");
+	}
+	vkBindImageMemory(logicalDevice, this->atlasImage, this->atlasImageMemory, 0);
+
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = this->atlasImage;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = depthFormat;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(logicalDevice, &viewCreateInfo, nullptr, &this->atlasImageView);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create shadow atlas Image View.");
+	}
+
+	// COMPARISON SAMPLER
+	// Linear filtering of comparison results gives 2x2 PCF for free
+	VkSamplerCreateInfo samplerCreateInfo = {};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.compareEnable = VK_TRUE;
+	samplerCreateInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	samplerCreateInfo.minLod = 0.0f;
+	samplerCreateInfo.maxLod = 0.0f;
+	samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+	result = vkCreateSampler(logicalDevice, &samplerCreateInfo, nullptr, &this->atlasSampler);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create shadow atlas Sampler.");
+	}
+}
+
+void CascadedShadows::cleanup()
+{
+	if (this->atlasImage == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroySampler(this->logicalDevice, this->atlasSampler, nullptr);
+	vkDestroyImageView(this->logicalDevice, this->atlasImageView, nullptr);
+	vkDestroyImage(this->logicalDevice, this->atlasImage, nullptr);
+	vkFreeMemory(this->logicalDevice, this->atlasImageMemory, nullptr);
+	this->atlasImage = VK_NULL_HANDLE;
+}
+
+void CascadedShadows::setLightDirection(glm::vec3 direction)
+{
+	// Cascades see the change through their light matrices and get re-rendered
+	this->lightDirection = glm::normalize(direction);
+}
+
+glm::vec3 CascadedShadows::getLightDirection()
+{
+	return this->lightDirection;
+}
+
+void CascadedShadows::beginFrame(const glm::mat4& view, float fovY, float aspect, float nearPlane)
+{
+	this->cameraView = view;
+	glm::mat4 inverseView = glm::inverse(view);
+
+	// Light looks along -lightDirection, up vector must not be parallel to it
+	glm::vec3 up = fabs(this->lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), -this->lightDirection, up);
+
+	float tanHalfY = tan(fovY * 0.5f);
+	float tanHalfX = tanHalfY * aspect;
+	float sliceNear = nearPlane;
+
+	for (int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+	{
+		Cascade& cascade = this->cascades[i];
+
+		// Practical split scheme, logarithmic splits keep texel density even, uniform ones keep far cascades from being too thin
+		float fraction = (float)(i + 1) / SHADOW_CASCADE_COUNT;
+		float logSplit = nearPlane * pow(SHADOW_DISTANCE / nearPlane, fraction);
+		float uniformSplit = nearPlane + (SHADOW_DISTANCE - nearPlane) * fraction;
+		float sliceFar = SHADOW_SPLIT_LAMBDA * logSplit + (1.0f - SHADOW_SPLIT_LAMBDA) * uniformSplit;
+
+		// Bounding sphere of frustum slice, its size doesn't change with camera rotation (so texels don't swim)
+		glm::vec3 viewCenter = glm::vec3(0.0f, 0.0f, -(sliceNear + sliceFar) * 0.5f);
+		float radius = 0.0f;
+		for (float distance : { sliceNear, sliceFar })
+		{
+			glm::vec3 corner = glm::vec3(tanHalfX * distance, tanHalfY * distance, -distance);
+			radius = std::max(radius, glm::length(corner - viewCenter));
+		}
+		radius = ceil(radius * 16.0f) / 16.0f;
+
+		// Sphere center is snapped to texel grid in light space, so camera movement moves shadow by whole texels only
+		float texelSize = 2.0f * radius / SHADOW_CASCADE_SIZE;
+		glm::vec3 lightCenter = glm::vec3(lightRotation * inverseView * glm::vec4(viewCenter, 1.0f));
+		lightCenter = glm::floor(lightCenter / texelSize) * texelSize;
+
+		// Light camera sits behind the sphere, far enough to catch casters outside of it
+		glm::vec3 eye = lightCenter + glm::vec3(0.0f, 0.0f, radius + SHADOW_CASTER_DISTANCE);
+		cascade.lightView = glm::translate(glm::mat4(1.0f), -eye) * lightRotation;
+		cascade.lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + SHADOW_CASTER_DISTANCE);
+		// Same Y flip as scene projection, keeps winding (and back face culling) consistent
+		cascade.lightProjection[1][1] *= -1;
+		cascade.radius = radius;
+		cascade.splitDistance = sliceFar;
+
+		glm::mat4 lightViewProjection = cascade.lightProjection * cascade.lightView;
+		cascade.casterHash = hashBytes(&lightViewProjection, sizeof(lightViewProjection));
+		cascade.animatedCasters = false;
+		cascade.drawList.clear();
+
+		sliceNear = sliceFar;
+	}
+}
+
+void CascadedShadows::addCaster(const DrawCommand& draw, const glm::mat4& model, glm::vec3 worldCenter, float worldRadius, bool animated)
+{
+	for (auto& cascade : this->cascades)
+	{
+		if (!isCasterInCascade(cascade, worldCenter, worldRadius))
+		{
+			continue;
+		}
+
+		// Geometry and transform identify caster, object index and pipeline only say how this frame draws it
+		cascade.casterHash = hashBytes(&draw.vertexBuffer, sizeof(draw.vertexBuffer), cascade.casterHash);
+		cascade.casterHash = hashBytes(&draw.indexBuffer, sizeof(draw.indexBuffer), cascade.casterHash);
+		cascade.casterHash = hashBytes(&draw.indexCount, sizeof(draw.indexCount), cascade.casterHash);
+		cascade.casterHash = hashBytes(&model, sizeof(model), cascade.casterHash);
+		cascade.animatedCasters = cascade.animatedCasters || animated;
+
+		// Distance from light camera, casters are drawn front to back
+		glm::vec4 lightPosition = cascade.lightView * glm::vec4(worldCenter, 1.0f);
+		cascade.drawList.add(draw, -lightPosition.z);
+	}
+}
+
+void CascadedShadows::endFrame()
+{
+	bool rendered = false;
+	for (auto& cascade : this->cascades)
+	{
+		// Tile is cached while nothing it depends on changed, otherwise it is rendered this frame
+		cascade.dirty = !this->atlasRendered || cascade.animatedCasters || cascade.casterHash != cascade.renderedHash;
+		if (cascade.dirty)
+		{
+			cascade.drawList.sort();
+			cascade.renderedHash = cascade.casterHash;
+			rendered = true;
+		}
+
+		UboProjectionView lightViewProjection = {};
+		lightViewProjection.projection = cascade.lightProjection;
+		lightViewProjection.view = cascade.lightView;
+		cascade.viewProjectionOffset = this->uniformRing->push(lightViewProjection);
+	}
+
+	// First frame renders every cascade, from then on atlas starts frames in shader read layout
+	this->atlasLayout = this->atlasRendered ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	this->atlasRendered = this->atlasRendered || rendered;
+
+	// Lookups start from view space position, so camera inverse is folded into cascade matrices
+	ShadowData shadowData = {};
+	glm::mat4 inverseView = glm::inverse(this->cameraView);
+	float tileScale = 1.0f / SHADOW_ATLAS_TILES;
+	for (int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+	{
+		const Cascade& cascade = this->cascades[i];
+		glm::vec2 tileOffset = glm::vec2((float)(i % SHADOW_ATLAS_TILES), (float)(i / SHADOW_ATLAS_TILES)) * tileScale;
+
+		// Clip space xy (-1..1) to uv of cascade's tile
+		glm::mat4 tileMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(tileOffset + 0.5f * tileScale, 0.0f))
+			* glm::scale(glm::mat4(1.0f), glm::vec3(0.5f * tileScale, 0.5f * tileScale, 1.0f));
+
+		shadowData.cascadeMatrices[i] = tileMatrix * cascade.lightProjection * cascade.lightView * inverseView;
+		shadowData.tileRects[i] = glm::vec4(tileOffset, tileOffset + tileScale);
+		shadowData.splitDistances[i] = cascade.splitDistance;
+		shadowData.texelSizes[i] = 2.0f * cascade.radius / SHADOW_CASCADE_SIZE;
+	}
+	shadowData.lightDirection = glm::vec4(glm::normalize(glm::mat3(this->cameraView) * this->lightDirection), 0.0f);
+	shadowData.atlasTexelSize = glm::vec4(1.0f / SHADOW_ATLAS_SIZE, 0.0f, 0.0f, 0.0f);
+
+	this->shadowDataOffset = this->uniformRing->push(shadowData);
+}
+
+bool CascadedShadows::hasDirtyCascades()
+{
+	for (const auto& cascade : this->cascades)
+	{
+		if (cascade.dirty)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CascadedShadows::isCascadeDirty(int cascade)
+{
+	return this->cascades[cascade].dirty;
+}
+
+DrawList& CascadedShadows::getCascadeDrawList(int cascade)
+{
+	return this->cascades[cascade].drawList;
+}
+
+VkRect2D CascadedShadows::getCascadeRect(int cascade)
+{
+	VkRect2D rect = {};
+	rect.offset.x = (cascade % SHADOW_ATLAS_TILES) * SHADOW_CASCADE_SIZE;
+	rect.offset.y = (cascade / SHADOW_ATLAS_TILES) * SHADOW_CASCADE_SIZE;
+	rect.extent = { SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE };
+	return rect;
+}
+
+uint32_t CascadedShadows::getCascadeViewProjectionOffset(int cascade)
+{
+	return this->cascades[cascade].viewProjectionOffset;
+}
+
+uint32_t CascadedShadows::getShadowDataOffset()
+{
+	return this->shadowDataOffset;
+}
+
+int CascadedShadows::getRenderedCascadeCount()
+{
+	int count = 0;
+	for (const auto& cascade : this->cascades)
+	{
+		count += cascade.dirty ? 1 : 0;
+	}
+	return count;
+}
+
+VkImage CascadedShadows::getAtlasImage()
+{
+	return this->atlasImage;
+}
+
+VkImageView CascadedShadows::getAtlasImageView()
+{
+	return this->atlasImageView;
+}
+
+VkFormat CascadedShadows::getAtlasFormat()
+{
+	return this->atlasFormat;
+}
+
+VkImageLayout CascadedShadows::getAtlasLayout()
+{
+	return this->atlasLayout;
+}
+
+DescriptorBinding CascadedShadows::getShadowDataBinding(uint32_t binding)
+{
+	DescriptorBinding shadowDataBinding = {};
+	shadowDataBinding.binding = binding;
+	shadowDataBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	shadowDataBinding.bufferInfo.buffer = this->uniformRing->getBuffer();
+	shadowDataBinding.bufferInfo.offset = 0;
+	shadowDataBinding.bufferInfo.range = sizeof(ShadowData);
+	return shadowDataBinding;
+}
+
+DescriptorBinding CascadedShadows::getAtlasBinding(uint32_t binding)
+{
+	DescriptorBinding atlasBinding = {};
+	atlasBinding.binding = binding;
+	atlasBinding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	atlasBinding.imageInfo.sampler = this->atlasSampler;
+	atlasBinding.imageInfo.imageView = this->atlasImageView;
+	atlasBinding.imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	return atlasBinding;
+}
+
+bool CascadedShadows::isCasterInCascade(const Cascade& cascade, glm::vec3 worldCenter, float worldRadius)
+{
+	// Sphere against light camera box (camera looks down -Z, box spans from eye to far plane)
+	glm::vec3 lightPosition = glm::vec3(cascade.lightView * glm::vec4(worldCenter, 1.0f));
+	float extent = cascade.radius + worldRadius;
+	float farPlane = 2.0f * cascade.radius + SHADOW_CASTER_DISTANCE;
+
+	return fabs(lightPosition.x) <= extent && fabs(lightPosition.y) <= extent
+		&& lightPosition.z <= worldRadius && lightPosition.z >= -farPlane - worldRadius;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <array>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "DescriptorAllocator.h"
+#include "UniformRingAllocator.h"
+#include "DrawList.h"
+
+// Cascades are tiles of one depth atlas (must match shaders/shadows.glsl)
+#define SHADOW_CASCADE_COUNT		4
+#define SHADOW_CASCADE_SIZE			2048		// texels per cascade side
+#define SHADOW_ATLAS_TILES			2			// tiles per atlas side
+#define SHADOW_ATLAS_SIZE			(SHADOW_CASCADE_SIZE * SHADOW_ATLAS_TILES)
+
+#define SHADOW_DISTANCE				150.0f		// view distance covered by cascades, nothing farther is shadowed
+#define SHADOW_SPLIT_LAMBDA			0.8f		// blend of logarithmic (1) and uniform (0) cascade splits
+#define SHADOW_CASTER_DISTANCE		100.0f		// how far towards the light casters outside of cascade are still caught
+#define SHADOW_DEPTH_BIAS_CONSTANT	1.25f
+#define SHADOW_DEPTH_BIAS_SLOPE		1.75f
+
+// Shadow uniform data (std140 layout of ShadowData in shaders/shadows.glsl)
+struct ShadowData
+{
+	glm::mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];	// view space position to atlas uv (xy) and depth (z)
+	glm::vec4 tileRects[SHADOW_CASCADE_COUNT];			// atlas uv min (xy) and max (zw) of cascade tile
+	glm::vec4 splitDistances;							// far view distance of each cascade
+	glm::vec4 texelSizes;								// world size of shadow texel of each cascade
+	glm::vec4 lightDirection;							// view space direction towards the light
+	glm::vec4 atlasTexelSize;							// x: 1 / atlas size
+};
+
+// Cascaded shadow maps of the directional light. Cascades are fitted to camera frustum slices and snapped
+// to texels, each cascade culls its own casters and is re-rendered only when its light matrix or casters changed.
+class CascadedShadows
+{
+
+public:
+	CascadedShadows();
+	~CascadedShadows();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkFormat depthFormat, UniformRingAllocator* uniformRing);
+	void cleanup();
+
+	// World space direction towards the light
+	void setLightDirection(glm::vec3 direction);
+	glm::vec3 getLightDirection();
+
+	// Fits cascades to camera and clears caster lists (call once per frame before casters are added)
+	void beginFrame(const glm::mat4& view, float fovY, float aspect, float nearPlane);
+	// Adds draw to every cascade whose volume the caster's bounding sphere touches
+	// (animated casters change shape every frame, so their cascades are never reused)
+	void addCaster(const DrawCommand& draw, const glm::mat4& model, glm::vec3 worldCenter, float worldRadius, bool animated = false);
+	// Sorts caster lists, marks cascades that changed since they were rendered and uploads shadow data to uniform ring
+	void endFrame();
+
+	bool hasDirtyCascades();
+	bool isCascadeDirty(int cascade);
+	DrawList& getCascadeDrawList(int cascade);
+	VkRect2D getCascadeRect(int cascade);					// tile of cascade in atlas
+	uint32_t getCascadeViewProjectionOffset(int cascade);	// dynamic offset of cascade's UboProjectionView
+	uint32_t getShadowDataOffset();
+	int getRenderedCascadeCount();							// cascades rendered this frame (others reused)
+
+	// Atlas is kept between frames (cached cascades), it is read only outside of shadow pass
+	VkImage getAtlasImage();
+	VkImageView getAtlasImageView();
+	VkFormat getAtlasFormat();
+	VkImageLayout getAtlasLayout();							// layout atlas is in when this frame starts
+
+	DescriptorBinding getShadowDataBinding(uint32_t binding);
+	DescriptorBinding getAtlasBinding(uint32_t binding);
+
+private:
+	struct Cascade
+	{
+		glm::mat4 lightView;
+		glm::mat4 lightProjection;
+		float radius;
+		float splitDistance;
+		DrawList drawList;
+		uint64_t casterHash;				// light matrices and casters of this frame
+		uint64_t renderedHash;				// what atlas tile currently holds
+		bool animatedCasters;				// some caster of this frame is animated
+		bool dirty;
+		uint32_t viewProjectionOffset;
+	};
+
+	VkDevice logicalDevice;
+	UniformRingAllocator* uniformRing;
+
+	VkFormat atlasFormat;
+	VkImage atlasImage;
+	VkDeviceMemory atlasImageMemory;
+	VkImageView atlasImageView;
+	VkSampler atlasSampler;					// comparison sampler (hardware PCF)
+	bool atlasRendered;
+	VkImageLayout atlasLayout;
+
+	glm::vec3 lightDirection;
+	glm::mat4 cameraView;
+	std::array<Cascade, SHADOW_CASCADE_COUNT> cascades;
+	uint32_t shadowDataOffset;
+
+	bool isCasterInCascade(const Cascade& cascade, glm::vec3 worldCenter, float worldRadius);
+};
@@ -0,0 +1,548 @@
+#include "ClusterCulling.h"
+
+#include <cmath>
+
+ClusterCulling::ClusterCulling()
+{
+	this->physicalDevice = VK_NULL_HANDLE;
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->transferQueue = VK_NULL_HANDLE;
+	this->transferCommandPool = VK_NULL_HANDLE;
+	this->pipelineManager = nullptr;
+	this->descriptorAllocator = nullptr;
+	this->uniformRing = nullptr;
+	this->reverseZ = false;
+	this->meshletBuffer = VK_NULL_HANDLE;
+	this->meshletBufferMemory = VK_NULL_HANDLE;
+	this->meshletCount = 0;
+	this->indirectBuffer = VK_NULL_HANDLE;
+	this->indirectBufferMemory = VK_NULL_HANDLE;
+	this->indirectSliceSize = 0;
+	this->hizImage = VK_NULL_HANDLE;
+	this->hizImageMemory = VK_NULL_HANDLE;
+	this->hizImageView = VK_NULL_HANDLE;
+	this->hizSampler = VK_NULL_HANDLE;
+	this->depthExtent = {};
+	this->hizExtent = {};
+	this->hizLevelCount = 0;
+	this->hizLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	this->hizBuilt = false;
+	this->hizView = glm::mat4(1.0f);
+	this->cullingPipelineLayout = VK_NULL_HANDLE;
+	this->cullingSetLayout = VK_NULL_HANDLE;
+	this->cullingDescriptorSet = VK_NULL_HANDLE;
+	this->hizPipelineLayout = VK_NULL_HANDLE;
+	this->hizSetLayout = VK_NULL_HANDLE;
+	this->commandCount = 0;
+	this->maxDrawMeshlets = 0;
+	this->cullingDataOffset = 0;
+	this->objectDataOffset = 0;
+	this->clusterDrawOffset = 0;
+	this->indirectOffset = 0;
+	this->frameIndex = 0;
+	this->hizResource = RENDER_GRAPH_NO_RESOURCE;
+}
+
+ClusterCulling::~ClusterCulling()
+{
+}
+
+void ClusterCulling::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+	VkExtent2D depthExtent, bool reverseZ, const string& cullingShader, const string& hizShader, ShaderCompiler* shaderCompiler,
+	PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache, DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing)
+{
+	this->physicalDevice = physicalDevice;
+	this->logicalDevice = logicalDevice;
+	this->transferQueue = transferQueue;
+	this->transferCommandPool = transferCommandPool;
+	this->reverseZ = reverseZ;
+	this->cullingShader = cullingShader;
+	this->hizShader = hizShader;
+	this->pipelineManager = pipelineManager;
+	this->descriptorAllocator = descriptorAllocator;
+	this->uniformRing = uniformRing;
+
+	// MESHLET BUFFER
+	createBuffer(physicalDevice, logicalDevice, MAX_MESHLETS * sizeof(Meshlet), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->meshletBuffer, &this->meshletBufferMemory);
+
+	// INDIRECT BUFFER
+	// Slices are aligned like ring allocations, so slice offset is valid as dynamic storage offset
+	VkDeviceSize alignment = uniformRing->getAlignment();
+	this->indirectSliceSize = (getIndirectBufferSize() + alignment - 1) / alignment * alignment;
+	createBuffer(physicalDevice, logicalDevice, this->indirectSliceSize * MAX_FRAMES_IN_FLIGHT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->indirectBuffer, &this->indirectBufferMemory);
+
+	createHiZ(depthExtent);
+
+	// CULLING LAYOUT AND SET
+	LayoutOverrides overrides = {};
+	overrides.dynamicUniformBuffers = true;
+	overrides.dynamicStorageBuffers = true;
+
+	ShaderReflection cullingReflection = ShaderReflection::reflect(shaderCompiler->compile(cullingShader));
+	vector<VkDescriptorSetLayout> setLayouts;
+	this->cullingPipelineLayout = layoutCache->getReflectedLayout(cullingReflection, overrides, &setLayouts);
+	if (setLayouts.empty())
+	{
+		throw runtime_error("Failed to create cluster culling layout, shader must use culling buffers in set 0.");
+	}
+	// Set is written by setObjectBuffer
+	this->cullingSetLayout = setLayouts[0];
+
+	// HI-Z LAYOUT
+	// Sets are written per frame, level 0 reads depth transient whose view changes with graph's transient plan
+	ShaderReflection hizReflection = ShaderReflection::reflect(shaderCompiler->compile(hizShader));
+	setLayouts.clear();
+	this->hizPipelineLayout = layoutCache->getReflectedLayout(hizReflection, {}, &setLayouts);
+	if (setLayouts.empty())
+	{
+		throw runtime_error("Failed to create Hi-Z layout, shader must use pyramid images in set 0.");
+	}
+	this->hizSetLayout = setLayouts[0];
+
+	// Compiled up front, first frame shouldn't wait for them
+	pipelineManager->getComputePipeline(cullingShader, this->cullingPipelineLayout, { reverseZ ? 1 : 0 });
+	pipelineManager->getComputePipeline(hizShader, this->hizPipelineLayout, { reverseZ ? 1 : 0 });
+}
+
+void ClusterCulling::cleanup()
+{
+	// Layouts and sets are owned by layout cache and descriptor allocator, pipelines by pipeline manager
+	if (this->meshletBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroySampler(this->logicalDevice, this->hizSampler, nullptr);
+	for (auto levelView : this->hizLevelViews)
+	{
+		vkDestroyImageView(this->logicalDevice, levelView, nullptr);
+	}
+	this->hizLevelViews.clear();
+	vkDestroyImageView(this->logicalDevice, this->hizImageView, nullptr);
+	vkDestroyImage(this->logicalDevice, this->hizImage, nullptr);
+	vkFreeMemory(this->logicalDevice, this->hizImageMemory, nullptr);
+
+	vkDestroyBuffer(this->logicalDevice, this->indirectBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->indirectBufferMemory, nullptr);
+
+	vkDestroyBuffer(this->logicalDevice, this->meshletBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->meshletBufferMemory, nullptr);
+	this->meshletBuffer = VK_NULL_HANDLE;
+}
+
+uint32_t ClusterCulling::addMeshlets(const vector<Meshlet>& meshlets)
+{
+	uint32_t firstMeshlet = this->meshletCount;
+	if (meshlets.empty())
+	{
+		return firstMeshlet;
+	}
+	if (this->meshletCount + meshlets.size() > MAX_MESHLETS)
+	{
+		throw runtime_error("Too many meshlets uploaded, raise MAX_MESHLETS.");
+	}
+
+	// Meshes are uploaded at load time, so plain staging copy is good enough
+	VkDeviceSize size = meshlets.size() * sizeof(Meshlet);
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(this->physicalDevice, this->logicalDevice, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, size, 0, &data);
+	memcpy(data, meshlets.data(), (size_t)size);
+	vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+
+	copyBuffer(this->logicalDevice, this->transferQueue, this->transferCommandPool, stagingBuffer, this->meshletBuffer,
+		size, firstMeshlet * sizeof(Meshlet));
+
+	vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, stagingBufferMemory, nullptr);
+
+	this->meshletCount += static_cast<uint32_t>(meshlets.size());
+	return firstMeshlet;
+}
+
+void ClusterCulling::setObjectBuffer(VkBuffer objectBuffer, VkDeviceSize objectRange)
+{
+	DescriptorBinding cullingDataBinding = {};
+	cullingDataBinding.binding = 0;
+	cullingDataBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	cullingDataBinding.bufferInfo.buffer = this->uniformRing->getBuffer();
+	cullingDataBinding.bufferInfo.offset = 0;
+	cullingDataBinding.bufferInfo.range = sizeof(CullingData);
+
+	// Renderer's object buffer (models of this frame)
+	DescriptorBinding objectBinding = {};
+	objectBinding.binding = 1;
+	objectBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectBinding.bufferInfo.buffer = objectBuffer;
+	objectBinding.bufferInfo.offset = 0;
+	objectBinding.bufferInfo.range = objectRange;
+
+	DescriptorBinding drawBinding = {};
+	drawBinding.binding = 2;
+	drawBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	drawBinding.bufferInfo.buffer = this->uniformRing->getBuffer();
+	drawBinding.bufferInfo.offset = 0;
+	drawBinding.bufferInfo.range = MAX_CULLED_DRAWS * sizeof(ClusterDraw);
+
+	DescriptorBinding meshletBinding = {};
+	meshletBinding.binding = 3;
+	meshletBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	meshletBinding.bufferInfo.buffer = this->meshletBuffer;
+	meshletBinding.bufferInfo.offset = 0;
+	meshletBinding.bufferInfo.range = MAX_MESHLETS * sizeof(Meshlet);
+
+	DescriptorBinding indirectBinding = {};
+	indirectBinding.binding = 4;
+	indirectBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	indirectBinding.bufferInfo.buffer = this->indirectBuffer;
+	indirectBinding.bufferInfo.offset = 0;
+	indirectBinding.bufferInfo.range = getIndirectBufferSize();
+
+	DescriptorBinding hizBinding = {};
+	hizBinding.binding = 5;
+	hizBinding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	hizBinding.imageInfo.sampler = this->hizSampler;
+	hizBinding.imageInfo.imageView = this->hizImageView;
+	hizBinding.imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	this->cullingDescriptorSet = this->descriptorAllocator->getCachedSet(this->cullingSetLayout,
+		{ cullingDataBinding, objectBinding, drawBinding, meshletBinding, indirectBinding, hizBinding });
+}
+
+void ClusterCulling::beginFrame()
+{
+	this->draws.clear();
+	this->hizResource = RENDER_GRAPH_NO_RESOURCE;
+	this->commandCount = 0;
+	this->maxDrawMeshlets = 0;
+}
+
+bool ClusterCulling::addDraw(DrawCommand* draw, uint32_t firstMeshlet, uint32_t meshletCount)
+{
+	// Count slots and command range are fixed per frame, once they run out draws are recorded without culling
+	if (this->draws.size() == MAX_CULLED_DRAWS || this->commandCount + meshletCount > MAX_CLUSTER_COMMANDS)
+	{
+		return false;
+	}
+
+	draw->clusterDrawIndex = static_cast<uint32_t>(this->draws.size());
+	draw->firstClusterCommand = this->commandCount;
+	draw->meshletCount = meshletCount;
+
+	ClusterDraw clusterDraw = {};
+	clusterDraw.objectIndex = draw->objectIndex;
+	clusterDraw.firstMeshlet = firstMeshlet;
+	clusterDraw.meshletCount = meshletCount;
+	clusterDraw.firstCommand = this->commandCount;
+	clusterDraw.vertexOffset = draw->vertexOffset;
+	this->draws.push_back(clusterDraw);
+
+	this->commandCount += meshletCount;
+	this->maxDrawMeshlets = std::max(this->maxDrawMeshlets, meshletCount);
+	return true;
+}
+
+void ClusterCulling::endFrame(uint32_t frameIndex, const glm::mat4& view, const glm::mat4& projection, float nearPlane, uint32_t objectDataOffset)
+{
+	this->frameIndex = frameIndex;
+	this->objectDataOffset = objectDataOffset;
+	this->indirectOffset = static_cast<uint32_t>(frameIndex * this->indirectSliceSize);
+
+	// Whole range is allocated, descriptor range covers MAX_CULLED_DRAWS draws from the dynamic offset
+	RingAllocation drawAllocation = this->uniformRing->allocate(MAX_CULLED_DRAWS * sizeof(ClusterDraw));
+	memcpy(drawAllocation.data, this->draws.data(), this->draws.size() * sizeof(ClusterDraw));
+	this->clusterDrawOffset = drawAllocation.offset;
+
+	CullingData cullingData = {};
+	cullingData.view = view;
+	cullingData.previousView = this->hizView;
+
+	// Side planes from rows of projection (Gribb-Hartmann), in view space because projection alone is used
+	glm::vec4 row0 = glm::vec4(projection[0][0], projection[1][0], projection[2][0], projection[3][0]);
+	glm::vec4 row1 = glm::vec4(projection[0][1], projection[1][1], projection[2][1], projection[3][1]);
+	glm::vec4 row3 = glm::vec4(projection[0][3], projection[1][3], projection[2][3], projection[3][3]);
+	glm::vec4 planes[4] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1 };
+	for (int i = 0; i < 4; i++)
+	{
+		cullingData.frustumPlanes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+	}
+
+	cullingData.projection = glm::vec4(projection[0][0], projection[1][1], projection[2][2], projection[3][2]);
+	cullingData.hizSize = glm::vec4((float)this->hizExtent.width, (float)this->hizExtent.height, (float)this->hizLevelCount, 0.0f);
+	// Pyramid of last frame is only usable if that frame built it (it holds depth seen from previous view)
+	cullingData.params = glm::vec4(nearPlane, this->hizBuilt ? 1.0f : 0.0f, 0.0f, 0.0f);
+	this->cullingDataOffset = this->uniformRing->push(cullingData);
+
+	this->hizView = view;
+	this->hizBuilt = false;
+}
+
+RenderGraphResource ClusterCulling::addCullingPass(RenderGraph& renderGraph)
+{
+	RenderGraphResource commands = renderGraph.importBuffer("clusterCommands", this->indirectBuffer);
+
+	// Pyramid is read here and rewritten by Hi-Z pass at frame end, so earlier frame's build must be finished
+	RenderGraphImageDesc hizDesc = {};
+	hizDesc.format = VK_FORMAT_R32_SFLOAT;
+	hizDesc.extent = this->hizExtent;
+	this->hizResource = renderGraph.importImage("hiz", this->hizImage, this->hizImageView, hizDesc, this->hizLayout,
+		VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	// Counts are accumulated with atomics, so they start at zero every frame
+	RenderGraphPass& resetPass = renderGraph.addComputePass("clusterCountReset");
+	resetPass.writeTransfer(commands);
+	resetPass.setExecute([this](VkCommandBuffer commandBuffer)
+	{
+		vkCmdFillBuffer(commandBuffer, this->indirectBuffer, this->indirectOffset, getCommandOffset(), 0);
+	});
+
+	RenderGraphPass& cullingPass = renderGraph.addComputePass("clusterCulling");
+	cullingPass.readTexture(this->hizResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	cullingPass.writeStorage(commands);
+	cullingPass.setExecute([this](VkCommandBuffer commandBuffer)
+	{
+		if (this->draws.empty())
+		{
+			return;
+		}
+
+		// Pipeline is requested every frame, so it follows reloads of culling shader
+		VkPipeline pipeline = this->pipelineManager->getComputePipeline(this->cullingShader, this->cullingPipelineLayout, { this->reverseZ ? 1 : 0 });
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+		uint32_t dynamicOffsets[] = { this->cullingDataOffset, this->objectDataOffset, this->clusterDrawOffset, 0, this->indirectOffset };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullingPipelineLayout, 0, 1, &this->cullingDescriptorSet,
+			5, dynamicOffsets);
+
+		// Row of groups per draw, groups past draw's meshlet count exit right away
+		uint32_t groupCountX = (this->maxDrawMeshlets + CLUSTER_CULLING_GROUP_SIZE - 1) / CLUSTER_CULLING_GROUP_SIZE;
+		vkCmdDispatch(commandBuffer, groupCountX, static_cast<uint32_t>(this->draws.size()), 1);
+	});
+
+	return commands;
+}
+
+void ClusterCulling::addHiZPass(RenderGraph& renderGraph, RenderGraphResource depth)
+{
+	// Pyramid was imported by culling pass of this frame, which has to read it before it is rebuilt
+	if (this->hizResource == RENDER_GRAPH_NO_RESOURCE)
+	{
+		throw runtime_error("Failed to add Hi-Z pass, culling pass must be added first.");
+	}
+
+	RenderGraphPass& hizPass = renderGraph.addComputePass("hizBuild");
+	hizPass.readTexture(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	hizPass.writeStorage(this->hizResource);
+	hizPass.setExecute([this, &renderGraph, depth](VkCommandBuffer commandBuffer)
+	{
+		recordHiZ(commandBuffer, renderGraph.getImageView(depth));
+	});
+}
+
+IndirectDrawSource ClusterCulling::getIndirectSource()
+{
+	IndirectDrawSource source = {};
+	source.buffer = this->indirectBuffer;
+	source.countOffset = this->indirectOffset;
+	source.commandOffset = this->indirectOffset + getCommandOffset();
+	return source;
+}
+
+void ClusterCulling::createHiZ(VkExtent2D depthExtent)
+{
+	// Power of two pyramid, so every level is exactly half of the previous one (level 0 footprint in depth buffer is up to 3x3 texels)
+	this->depthExtent = depthExtent;
+	this->hizExtent.width = 1;
+	this->hizExtent.height = 1;
+	while (this->hizExtent.width * 2 <= depthExtent.width)
+	{
+		this->hizExtent.width *= 2;
+	}
+	while (this->hizExtent.height * 2 <= depthExtent.height)
+	{
+		this->hizExtent.height *= 2;
+	}
+	this->hizLevelCount = 1;
+	while ((std::max(this->hizExtent.width, this->hizExtent.height) >> this->hizLevelCount) > 0)
+	{
+		this->hizLevelCount++;
+	}
+
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.extent = { this->hizExtent.width, this->hizExtent.height, 1 };
+	imageCreateInfo.mipLevels = this->hizLevelCount;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateImage(this->logicalDevice, &imageCreateInfo, nullptr, &this->hizImage);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create Hi-Z Image.");
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(this->logicalDevice, this->hizImage, &memoryRequirements);
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = memoryRequirements.size;
+	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(this->physicalDevice, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	result = vkAllocateMemory(this->logicalDevice, &memoryAllocInfo, nullptr, &this->hizImageMemory);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to allocate memory for Hi-Z pyramid.");
+	}
+	vkBindImageMemory(this->logicalDevice, this->hizImage, this->hizImageMemory, 0);
+
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = this->hizImage;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = this->hizLevelCount;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(this->logicalDevice, &viewCreateInfo, nullptr, &this->hizImageView);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create Hi-Z Image View.");
+	}
+
+	// Storage image descriptors can address one level only
+	this->hizLevelViews.resize(this->hizLevelCount);
+	for (uint32_t level = 0; level < this->hizLevelCount; level++)
+	{
+		viewCreateInfo.subresourceRange.baseMipLevel = level;
+		viewCreateInfo.subresourceRange.levelCount = 1;
+		result = vkCreateImageView(this->logicalDevice, &viewCreateInfo, nullptr, &this->hizLevelViews[level]);
+		if (result != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create Hi-Z level Image View.");
+		}
+	}
+
+	// Shaders fetch exact texels, sampler is only required by combined image sampler descriptors
+	VkSamplerCreateInfo samplerCreateInfo = {};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.minLod = 0.0f;
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	result = vkCreateSampler(this->logicalDevice, &samplerCreateInfo, nullptr, &this->hizSampler);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create Hi-Z Sampler.");
+	}
+}
+
+void ClusterCulling::recordHiZ(VkCommandBuffer commandBuffer, VkImageView depthView)
+{
+	// Graph leaves pyramid in its final layout from now on
+	this->hizBuilt = true;
+	this->hizLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkPipeline pipeline = this->pipelineManager->getComputePipeline(this->hizShader, this->hizPipelineLayout, { this->reverseZ ? 1 : 0 });
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	// Must match HiZParams push constant block of hiz_downsample.comp
+	struct HiZParams
+	{
+		glm::ivec2 sourceSize;
+		glm::ivec2 destinationSize;
+		int32_t level;
+	};
+
+	glm::ivec2 sourceSize = glm::ivec2(0);
+	for (uint32_t level = 0; level < this->hizLevelCount; level++)
+	{
+		glm::ivec2 destinationSize = glm::ivec2(std::max(this->hizExtent.width >> level, 1u), std::max(this->hizExtent.height >> level, 1u));
+
+		DescriptorBinding depthBinding = {};
+		depthBinding.binding = 0;
+		depthBinding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		depthBinding.imageInfo.sampler = this->hizSampler;
+		depthBinding.imageInfo.imageView = depthView;
+		depthBinding.imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		// Level 0 reads depth buffer, its source binding only has to be valid
+		DescriptorBinding sourceBinding = {};
+		sourceBinding.binding = 1;
+		sourceBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		sourceBinding.imageInfo.imageView = this->hizLevelViews[level > 0 ? level - 1 : 0];
+		sourceBinding.imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		DescriptorBinding destinationBinding = {};
+		destinationBinding.binding = 2;
+		destinationBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		destinationBinding.imageInfo.imageView = this->hizLevelViews[level];
+		destinationBinding.imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorSet descriptorSet = this->descriptorAllocator->allocateFrame(this->frameIndex, this->hizSetLayout,
+			{ depthBinding, sourceBinding, destinationBinding });
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->hizPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+		HiZParams params = {};
+		params.sourceSize = level > 0 ? sourceSize : glm::ivec2(this->depthExtent.width, this->depthExtent.height);
+		params.destinationSize = destinationSize;
+		params.level = static_cast<int32_t>(level);
+		vkCmdPushConstants(commandBuffer, this->hizPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZParams), &params);
+
+		vkCmdDispatch(commandBuffer, (destinationSize.x + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (destinationSize.y + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+		// Next level reads this one (levels are one graph resource, so barriers between them are recorded here)
+		if (level + 1 < this->hizLevelCount)
+		{
+			VkImageMemoryBarrier levelBarrier = {};
+			levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			levelBarrier.image = this->hizImage;
+			levelBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			levelBarrier.subresourceRange.baseMipLevel = level;
+			levelBarrier.subresourceRange.levelCount = 1;
+			levelBarrier.subresourceRange.baseArrayLayer = 0;
+			levelBarrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &levelBarrier);
+		}
+
+		sourceSize = destinationSize;
+	}
+}
+
+VkDeviceSize ClusterCulling::getCommandOffset()
+{
+	return MAX_CULLED_DRAWS * sizeof(uint32_t);
+}
+
+VkDeviceSize ClusterCulling::getIndirectBufferSize()
+{
+	return getCommandOffset() + MAX_CLUSTER_COMMANDS * sizeof(VkDrawIndexedIndirectCommand);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "UniformRingAllocator.h"
+#include "PipelineManager.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "RenderGraph.h"
+#include "FrameScheduler.h"
+#include "DrawList.h"
+#include "MeshletBuilder.h"
+
+// Limits of cluster culling (must match shaders/cluster_culling.comp)
+#define MAX_MESHLETS				262144		// meshlets of all uploaded meshes (meshlet buffer capacity)
+#define MAX_CULLED_DRAWS			4096		// cluster culled draws per frame (one count slot each), further draws are drawn whole
+#define MAX_CLUSTER_COMMANDS		131072		// meshlets of all draws of a frame (indirect command capacity)
+#define CLUSTER_CULLING_GROUP_SIZE	64			// local size of culling shader
+#define HIZ_GROUP_SIZE				8			// local size (both dimensions) of Hi-Z downsample shader
+
+// Culls meshlets of every draw on GPU (frustum, normal cone and occlusion against Hi-Z pyramid of previous frame's depth)
+// and writes indirect draws of survivors, each draw is then recorded as one indirect count draw
+class ClusterCulling
+{
+
+public:
+	ClusterCulling();
+	~ClusterCulling();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+		VkExtent2D depthExtent, bool reverseZ, const string& cullingShader, const string& hizShader, ShaderCompiler* shaderCompiler,
+		PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache, DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing);
+	void cleanup();
+
+	// Uploads meshlets to meshlet buffer, returns index of the first one
+	uint32_t addMeshlets(const vector<Meshlet>& meshlets);
+
+	// Renderer's object buffer (range of one frame's objects), set again whenever renderer grows it
+	void setObjectBuffer(VkBuffer objectBuffer, VkDeviceSize objectRange);
+
+	// Starts new frame's draw list
+	void beginFrame();
+	// Assigns draw a count slot and command range for its meshlets, false when frame's capacity is used up (draw stays whole)
+	bool addDraw(DrawCommand* draw, uint32_t firstMeshlet, uint32_t meshletCount);
+	// Uploads draws and culling data to uniform ring (objects are read from renderer's object buffer)
+	void endFrame(uint32_t frameIndex, const glm::mat4& view, const glm::mat4& projection, float nearPlane, uint32_t objectDataOffset);
+
+	// Declares count reset and culling passes, returned buffer holds indirect commands (read it with readIndirect)
+	RenderGraphResource addCullingPass(RenderGraph& renderGraph);
+	// Declares Hi-Z build from final depth of the frame, pyramid is used for occlusion culling in the next frame
+	void addHiZPass(RenderGraph& renderGraph, RenderGraphResource depth);
+
+	IndirectDrawSource getIndirectSource();
+
+private:
+	// std430 layouts of culling shader buffers
+	struct ClusterDraw
+	{
+		uint32_t objectIndex;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		uint32_t firstCommand;
+		int32_t vertexOffset;
+		uint32_t padding[3];
+	};
+
+	// std140 layout of CullingData
+	struct CullingData
+	{
+		glm::mat4 view;
+		glm::mat4 previousView;				// camera Hi-Z pyramid was rendered with
+		glm::vec4 frustumPlanes[4];			// view space side planes (xyz normal pointing inside, w distance)
+		glm::vec4 projection;				// x: projection[0][0], y: projection[1][1], z: projection[2][2], w: projection[3][2]
+		glm::vec4 hizSize;					// xy: pyramid size, z: level count
+		glm::vec4 params;					// x: near plane, y: 1 when pyramid is valid (occlusion test enabled)
+	};
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice logicalDevice;
+	VkQueue transferQueue;
+	VkCommandPool transferCommandPool;
+	PipelineManager* pipelineManager;
+	DescriptorAllocator* descriptorAllocator;
+	UniformRingAllocator* uniformRing;
+	string cullingShader;
+	string hizShader;
+	bool reverseZ;
+
+	// Meshlets of all meshes, appended on upload
+	VkBuffer meshletBuffer;
+	VkDeviceMemory meshletBufferMemory;
+	uint32_t meshletCount;
+
+	// Draw counts followed by commands, each frame in flight has its own slice
+	VkBuffer indirectBuffer;
+	VkDeviceMemory indirectBufferMemory;
+	VkDeviceSize indirectSliceSize;
+
+	// Hi-Z pyramid (farthest depth of every texel's footprint), kept for next frame
+	VkImage hizImage;
+	VkDeviceMemory hizImageMemory;
+	VkImageView hizImageView;					// all levels, sampled by culling
+	vector<VkImageView> hizLevelViews;			// single levels, written by downsample
+	VkSampler hizSampler;
+	VkExtent2D depthExtent;
+	VkExtent2D hizExtent;
+	uint32_t hizLevelCount;
+	VkImageLayout hizLayout;					// layout pyramid is in when frame starts
+	bool hizBuilt;								// pyramid was built by last recorded frame
+	glm::mat4 hizView;
+	RenderGraphResource hizResource;			// pyramid in graph of current frame
+
+	VkPipelineLayout cullingPipelineLayout;
+	VkDescriptorSetLayout cullingSetLayout;
+	VkDescriptorSet cullingDescriptorSet;		// written once object buffer is known
+	VkPipelineLayout hizPipelineLayout;
+	VkDescriptorSetLayout hizSetLayout;
+
+	// Current frame
+	vector<ClusterDraw> draws;
+	uint32_t frameIndex;
+	uint32_t commandCount;
+	uint32_t maxDrawMeshlets;
+	uint32_t cullingDataOffset;					// dynamic offsets
+	uint32_t objectDataOffset;
+	uint32_t clusterDrawOffset;
+	uint32_t indirectOffset;
+
+	void createHiZ(VkExtent2D depthExtent);
+	void recordHiZ(VkCommandBuffer commandBuffer, VkImageView depthView);
+
+	static VkDeviceSize getCommandOffset();		// commands follow count slots
+	static VkDeviceSize getIndirectBufferSize();
+};
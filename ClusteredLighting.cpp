@@ -0,0 +1,204 @@
+#include "ClusteredLighting.h"
+
+#include <cmath>
+
+ClusteredLighting::ClusteredLighting()
+{
+	this->physicalDevice = VK_NULL_HANDLE;
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->pipelineManager = nullptr;
+	this->uniformRing = nullptr;
+	this->clusterBuffer = VK_NULL_HANDLE;
+	this->clusterBufferMemory = VK_NULL_HANDLE;
+	this->clusterSliceSize = 0;
+	this->pipelineLayout = VK_NULL_HANDLE;
+	this->descriptorSet = VK_NULL_HANDLE;
+	this->lightBufferOffset = 0;
+	this->clusterBufferOffset = 0;
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+}
+
+void ClusteredLighting::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, const string& clusteringShader, ShaderCompiler* shaderCompiler,
+	PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache, DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing)
+{
+	this->physicalDevice = physicalDevice;
+	this->logicalDevice = logicalDevice;
+	this->clusteringShader = clusteringShader;
+	this->pipelineManager = pipelineManager;
+	this->uniformRing = uniformRing;
+
+	// CLUSTER BUFFER
+	// Slices are aligned like ring allocations, so slice offset is valid as dynamic storage offset
+	VkDeviceSize alignment = uniformRing->getAlignment();
+	this->clusterSliceSize = (getClusterBufferSize() + alignment - 1) / alignment * alignment;
+	createBuffer(physicalDevice, logicalDevice, this->clusterSliceSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->clusterBuffer, &this->clusterBufferMemory);
+
+	// CLUSTERING LAYOUT AND SET
+	// Compute shader declares the same bindings as scene set, both point into the same buffers
+	ShaderReflection reflection = ShaderReflection::reflect(shaderCompiler->compile(clusteringShader));
+	LayoutOverrides overrides = {};
+	overrides.dynamicStorageBuffers = true;
+
+	vector<VkDescriptorSetLayout> setLayouts;
+	this->pipelineLayout = layoutCache->getReflectedLayout(reflection, overrides, &setLayouts);
+	if (setLayouts.empty())
+	{
+		throw runtime_error("Failed to create light clustering layout, shader must use light buffers in set 0.");
+	}
+
+	this->descriptorSet = descriptorAllocator->getCachedSet(setLayouts[0], { getLightBinding(2), getClusterBinding(3) });
+
+	// Compiled up front, first frame shouldn't wait for it
+	pipelineManager->getComputePipeline(clusteringShader, this->pipelineLayout);
+}
+
+void ClusteredLighting::cleanup()
+{
+	// Layout and set are owned by layout cache and descriptor allocator, pipeline by pipeline manager
+	if (this->clusterBuffer != VK_NULL_HANDLE)
+	{
+		vkDestroyBuffer(this->logicalDevice, this->clusterBuffer, nullptr);
+		vkFreeMemory(this->logicalDevice, this->clusterBufferMemory, nullptr);
+		this->clusterBuffer = VK_NULL_HANDLE;
+	}
+	this->lights.clear();
+}
+
+bool ClusteredLighting::addLight(int lightId, const Light& light)
+{
+	if (this->lights.find(lightId) != this->lights.end() || this->lights.size() == MAX_LIGHTS)
+	{
+		return false;
+	}
+
+	this->lights[lightId] = light;
+	return true;
+}
+
+bool ClusteredLighting::updateLight(int lightId, const Light& light)
+{
+	auto existing = this->lights.find(lightId);
+	if (existing == this->lights.end())
+	{
+		return false;
+	}
+
+	existing->second = light;
+	return true;
+}
+
+bool ClusteredLighting::removeLight(int lightId)
+{
+	return this->lights.erase(lightId) > 0;
+}
+
+int ClusteredLighting::getLightCount()
+{
+	return static_cast<int>(this->lights.size());
+}
+
+void ClusteredLighting::update(uint32_t frameIndex, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent, float nearPlane)
+{
+	// Whole range is allocated, descriptor range covers MAX_LIGHTS lights from the dynamic offset
+	RingAllocation allocation = this->uniformRing->allocate(getLightBufferSize());
+	this->lightBufferOffset = allocation.offset;
+	this->clusterBufferOffset = static_cast<uint32_t>(frameIndex * this->clusterSliceSize);
+
+	// Slice of view distance d is log(d) * scale + bias, so slices grow with distance like clusters' width does
+	float farPlane = LIGHT_CLUSTER_FAR_PLANE;
+	float sliceScale = CLUSTER_COUNT_Z / log(farPlane / nearPlane);
+
+	LightBufferHeader* header = static_cast<LightBufferHeader*>(allocation.data);
+	header->lightCount = glm::uvec4(static_cast<uint32_t>(this->lights.size()), 0, 0, 0);
+	header->tileSize = glm::vec4(
+		(float)((extent.width + CLUSTER_COUNT_X - 1) / CLUSTER_COUNT_X),
+		(float)((extent.height + CLUSTER_COUNT_Y - 1) / CLUSTER_COUNT_Y),
+		1.0f / extent.width,
+		1.0f / extent.height);
+	header->projection = glm::vec4(projection[0][0], projection[1][1], sliceScale, -log(nearPlane) * sliceScale);
+	header->depthRange = glm::vec4(nearPlane, farPlane, 0.0f, 0.0f);
+
+	// Lights go to view space on CPU, clustering and shading then work without any matrix
+	GpuLight* gpuLights = reinterpret_cast<GpuLight*>(header + 1);
+	glm::mat3 viewRotation = glm::mat3(view);
+	int lightIndex = 0;
+	for (const auto& lightKeyValue : this->lights)
+	{
+		const Light& light = lightKeyValue.second;
+		GpuLight& gpuLight = gpuLights[lightIndex++];
+
+		gpuLight.positionRadius = glm::vec4(glm::vec3(view * glm::vec4(light.position, 1.0f)), light.radius);
+		gpuLight.colorIntensity = glm::vec4(light.color, light.intensity);
+		gpuLight.directionOuterCos = glm::vec4(glm::normalize(viewRotation * light.direction), cos(light.outerConeAngle));
+		gpuLight.innerCosType = glm::vec4(cos(light.innerConeAngle), (float)light.type, 0.0f, 0.0f);
+	}
+}
+
+RenderGraphResource ClusteredLighting::addClusteringPass(RenderGraph& renderGraph)
+{
+	RenderGraphResource clusters = renderGraph.importBuffer("lightClusters", this->clusterBuffer);
+
+	// Every cluster's list is rewritten whole, so buffer needs no clearing between frames
+	RenderGraphPass& pass = renderGraph.addComputePass("lightClustering");
+	pass.writeStorage(clusters);
+	pass.setExecute([this](VkCommandBuffer commandBuffer)
+	{
+		// Pipeline is requested every frame, so it follows reloads of clustering shader
+		VkPipeline pipeline = this->pipelineManager->getComputePipeline(this->clusteringShader, this->pipelineLayout);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+		uint32_t dynamicOffsets[] = { this->lightBufferOffset, this->clusterBufferOffset };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSet, 2, dynamicOffsets);
+
+		vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + LIGHT_CLUSTERING_GROUP_SIZE - 1) / LIGHT_CLUSTERING_GROUP_SIZE, 1, 1);
+	});
+
+	return clusters;
+}
+
+DescriptorBinding ClusteredLighting::getLightBinding(uint32_t binding)
+{
+	DescriptorBinding lightBinding = {};
+	lightBinding.binding = binding;
+	lightBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	lightBinding.bufferInfo.buffer = this->uniformRing->getBuffer();
+	lightBinding.bufferInfo.offset = 0;
+	lightBinding.bufferInfo.range = getLightBufferSize();
+	return lightBinding;
+}
+
+DescriptorBinding ClusteredLighting::getClusterBinding(uint32_t binding)
+{
+	DescriptorBinding clusterBinding = {};
+	clusterBinding.binding = binding;
+	clusterBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	clusterBinding.bufferInfo.buffer = this->clusterBuffer;
+	clusterBinding.bufferInfo.offset = 0;
+	clusterBinding.bufferInfo.range = getClusterBufferSize();
+	return clusterBinding;
+}
+
+uint32_t ClusteredLighting::getLightBufferOffset()
+{
+	return this->lightBufferOffset;
+}
+
+uint32_t ClusteredLighting::getClusterBufferOffset()
+{
+	return this->clusterBufferOffset;
+}
+
+VkDeviceSize ClusteredLighting::getLightBufferSize()
+{
+	return sizeof(LightBufferHeader) + MAX_LIGHTS * sizeof(GpuLight);
+}
+
+VkDeviceSize ClusteredLighting::getClusterBufferSize()
+{
+	// Light count and fixed size index list per cluster
+	return CLUSTER_COUNT * sizeof(uint32_t) * (1 + MAX_LIGHTS_PER_CLUSTER);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "UniformRingAllocator.h"
+#include "PipelineManager.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "RenderGraph.h"
+#include "FrameScheduler.h"
+
+// Cluster grid (must match shaders/clustered_lighting.glsl)
+#define CLUSTER_COUNT_X				16
+#define CLUSTER_COUNT_Y				9
+#define CLUSTER_COUNT_Z				24			// exponential depth slices
+#define CLUSTER_COUNT				(CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z)
+#define MAX_LIGHTS_PER_CLUSTER		128			// further lights of a crowded cluster are dropped
+
+#define MAX_LIGHTS					4096		// lights uploaded per frame (range of light buffer descriptor)
+#define LIGHT_CLUSTER_FAR_PLANE		500.0f		// distance covered by depth slices, farther fragments use the last slice
+#define LIGHT_CLUSTERING_GROUP_SIZE	64			// local size of clustering compute shader
+
+enum LightType
+{
+	LIGHT_TYPE_POINT = 0,
+	LIGHT_TYPE_SPOT = 1
+};
+
+// Light in world space
+struct Light
+{
+	LightType type = LIGHT_TYPE_POINT;
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);		// spot lights only
+	glm::vec3 color = glm::vec3(1.0f);
+	float intensity = 1.0f;
+	float radius = 10.0f;									// range, light has no effect beyond it
+	float innerConeAngle = 0.0f;							// spot lights only, half angles in radians
+	float outerConeAngle = 0.5f;
+};
+
+// Bins point and spot lights into view space clusters every frame (compute pass), so fragments
+// only loop over lights of their own cluster instead of all lights in the scene
+class ClusteredLighting
+{
+
+public:
+	ClusteredLighting();
+	~ClusteredLighting();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, const string& clusteringShader, ShaderCompiler* shaderCompiler,
+		PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache, DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing);
+	void cleanup();
+
+	bool addLight(int lightId, const Light& light);
+	bool updateLight(int lightId, const Light& light);
+	bool removeLight(int lightId);
+	int getLightCount();
+
+	// Uploads lights transformed to view space into the uniform ring (call once per frame after ring's beginFrame)
+	void update(uint32_t frameIndex, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent, float nearPlane);
+	// Declares clustering compute pass, returned cluster buffer must be read by passes that shade with lights
+	RenderGraphResource addClusteringPass(RenderGraph& renderGraph);
+
+	// Bindings of scene set (whole light and cluster buffers, frame slices are selected with dynamic offsets)
+	DescriptorBinding getLightBinding(uint32_t binding);
+	DescriptorBinding getClusterBinding(uint32_t binding);
+	uint32_t getLightBufferOffset();
+	uint32_t getClusterBufferOffset();
+
+private:
+	// std430 layouts of shader buffers
+	struct GpuLight
+	{
+		glm::vec4 positionRadius;
+		glm::vec4 colorIntensity;
+		glm::vec4 directionOuterCos;
+		glm::vec4 innerCosType;
+	};
+
+	struct LightBufferHeader
+	{
+		glm::uvec4 lightCount;
+		glm::vec4 tileSize;					// xy: tile size in pixels, zw: 1 / viewport size
+		glm::vec4 projection;				// x: projection[0][0], y: projection[1][1], z: slice scale, w: slice bias
+		glm::vec4 depthRange;				// x: near, y: far distance covered by clusters
+	};
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice logicalDevice;
+	PipelineManager* pipelineManager;
+	UniformRingAllocator* uniformRing;
+	string clusteringShader;
+
+	std::map<int, Light> lights;
+
+	// Light lists are written by GPU, each frame in flight has its own slice
+	VkBuffer clusterBuffer;
+	VkDeviceMemory clusterBufferMemory;
+	VkDeviceSize clusterSliceSize;
+
+	VkPipelineLayout pipelineLayout;			// reflected from clustering shader
+	VkDescriptorSet descriptorSet;
+
+	uint32_t lightBufferOffset;					// dynamic offsets of current frame
+	uint32_t clusterBufferOffset;
+
+	static VkDeviceSize getLightBufferSize();
+	static VkDeviceSize getClusterBufferSize();
+};
@@ -0,0 +1,265 @@
+#include "DescriptorAllocator.h"
+
+bool DescriptorBinding::operator==(const DescriptorBinding& other) const
+{
+	return binding == other.binding && type == other.type
+		&& bufferInfo.buffer == other.bufferInfo.buffer
+		&& bufferInfo.offset == other.bufferInfo.offset
+		&& bufferInfo.range == other.bufferInfo.range
+		&& imageInfo.sampler == other.imageInfo.sampler
+		&& imageInfo.imageView == other.imageInfo.imageView
+		&& imageInfo.imageLayout == other.imageInfo.imageLayout;
+}
+
+bool DescriptorAllocator::SetCacheKey::operator==(const SetCacheKey& other) const
+{
+	return layout == other.layout && bindings == other.bindings;
+}
+
+size_t DescriptorAllocator::SetCacheKeyHash::operator()(const SetCacheKey& key) const
+{
+	size_t seed = 0;
+	hashCombine(seed, key.layout);
+	for (const auto& binding : key.bindings)
+	{
+		hashCombine(seed, binding.binding);
+		hashCombine(seed, binding.type);
+		hashCombine(seed, binding.bufferInfo.buffer);
+		hashCombine(seed, binding.bufferInfo.offset);
+		hashCombine(seed, binding.bufferInfo.range);
+		hashCombine(seed, binding.imageInfo.sampler);
+		hashCombine(seed, binding.imageInfo.imageView);
+		hashCombine(seed, binding.imageInfo.imageLayout);
+	}
+	return seed;
+}
+
+DescriptorAllocator::DescriptorAllocator()
+{
+	this->logicalDevice = VK_NULL_HANDLE;
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+}
+
+void DescriptorAllocator::init(VkDevice logicalDevice, uint32_t frameCount, std::vector<DescriptorPoolSizeRatio> poolSizeRatios)
+{
+	this->logicalDevice = logicalDevice;
+	this->poolSizeRatios = poolSizeRatios;
+	this->framePools.resize(frameCount);
+}
+
+void DescriptorAllocator::cleanup()
+{
+	// Destroying pools frees all sets allocated from them
+	destroyChain(this->persistentPools);
+	for (auto& chain : this->framePools)
+	{
+		destroyChain(chain);
+	}
+	this->framePools.clear();
+	this->setCache.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	return allocateFromChain(this->persistentPools, layout);
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFrame(uint32_t frameIndex, VkDescriptorSetLayout layout)
+{
+	return allocateFromChain(this->framePools[frameIndex], layout);
+}
+
+VkDescriptorSet DescriptorAllocator::getCachedSet(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	SetCacheKey key = { layout, bindings };
+
+	auto cached = this->setCache.find(key);
+	if (cached != this->setCache.end())
+	{
+		return cached->second;
+	}
+
+	VkDescriptorSet descriptorSet = allocate(layout);
+	writeBindings(descriptorSet, key.bindings);
+
+	this->setCache[key] = descriptorSet;
+
+	return descriptorSet;
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFrame(uint32_t frameIndex, VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	VkDescriptorSet descriptorSet = allocateFrame(frameIndex, layout);
+	writeBindings(descriptorSet, bindings);
+	return descriptorSet;
+}
+
+void DescriptorAllocator::writeBindings(VkDescriptorSet descriptorSet, const std::vector<DescriptorBinding>& bindings)
+{
+	// Infos are referenced by writes, so they are taken from bindings (alive until update)
+	std::vector<VkWriteDescriptorSet> setWrites(bindings.size());
+	for (int i = 0; i < bindings.size(); i++)
+	{
+		const DescriptorBinding& binding = bindings[i];
+
+		setWrites[i] = {};
+		setWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[i].dstSet = descriptorSet;
+		setWrites[i].dstBinding = binding.binding;
+		setWrites[i].dstArrayElement = 0;
+		setWrites[i].descriptorType = binding.type;
+		setWrites[i].descriptorCount = 1;
+
+		bool isImageBinding = binding.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+			|| binding.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+			|| binding.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+			|| binding.type == VK_DESCRIPTOR_TYPE_SAMPLER
+			|| binding.type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		if (isImageBinding)
+		{
+			setWrites[i].pImageInfo = &binding.imageInfo;
+		}
+		else
+		{
+			setWrites[i].pBufferInfo = &binding.bufferInfo;
+		}
+	}
+	vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+}
+
+void DescriptorAllocator::resetFrame(uint32_t frameIndex)
+{
+	resetChain(this->framePools[frameIndex]);
+}
+
+void DescriptorAllocator::setFrameCount(uint32_t frameCount)
+{
+	// Chains of removed frames are destroyed, new frames get empty chains
+	for (uint32_t i = frameCount; i < this->framePools.size(); i++)
+	{
+		destroyChain(this->framePools[i]);
+	}
+	this->framePools.resize(frameCount);
+}
+
+int DescriptorAllocator::getPoolCount()
+{
+	int count = this->persistentPools.fullPools.size() + this->persistentPools.readyPools.size();
+	for (const auto& chain : this->framePools)
+	{
+		count += chain.fullPools.size() + chain.readyPools.size();
+	}
+	return count;
+}
+
+int DescriptorAllocator::getCachedSetCount()
+{
+	return this->setCache.size();
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount)
+{
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const auto& sizeRatio : this->poolSizeRatios)
+	{
+		VkDescriptorPoolSize poolSize = {};
+		poolSize.type = sizeRatio.type;
+		poolSize.descriptorCount = std::max(1u, static_cast<uint32_t>(sizeRatio.ratio * setCount));
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	createInfo.maxSets = setCount;
+	createInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	createInfo.pPoolSizes = poolSizes.data();
+
+	VkDescriptorPool pool;
+	VkResult result = vkCreateDescriptorPool(this->logicalDevice, &createInfo, nullptr, &pool);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create descriptor pool.");
+	}
+
+	return pool;
+}
+
+VkDescriptorPool DescriptorAllocator::getPool(PoolChain& chain)
+{
+	// Reuse pool that still has free space
+	if (!chain.readyPools.empty())
+	{
+		VkDescriptorPool pool = chain.readyPools.back();
+		chain.readyPools.pop_back();
+		return pool;
+	}
+
+	// Otherwise chain a new (bigger) pool
+	VkDescriptorPool pool = createPool(chain.setsPerPool);
+	chain.setsPerPool = std::min(chain.setsPerPool * 2, (uint32_t)DESCRIPTOR_POOL_MAX_SETS);
+	return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFromChain(PoolChain& chain, VkDescriptorSetLayout layout)
+{
+	VkDescriptorPool pool = getPool(chain);
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet descriptorSet;
+	VkResult result = vkAllocateDescriptorSets(this->logicalDevice, &allocInfo, &descriptorSet);
+
+	// Pool is exhausted, so mark it as full and try again with the next one
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		chain.fullPools.push_back(pool);
+
+		pool = getPool(chain);
+		allocInfo.descriptorPool = pool;
+		result = vkAllocateDescriptorSets(this->logicalDevice, &allocInfo, &descriptorSet);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to allocate descriptor set.");
+	}
+
+	chain.readyPools.push_back(pool);
+	return descriptorSet;
+}
+
+void DescriptorAllocator::resetChain(PoolChain& chain)
+{
+	for (auto pool : chain.readyPools)
+	{
+		vkResetDescriptorPool(this->logicalDevice, pool, 0);
+	}
+	for (auto pool : chain.fullPools)
+	{
+		vkResetDescriptorPool(this->logicalDevice, pool, 0);
+		chain.readyPools.push_back(pool);
+	}
+	chain.fullPools.clear();
+}
+
+void DescriptorAllocator::destroyChain(PoolChain& chain)
+{
+	for (auto pool : chain.readyPools)
+	{
+		vkDestroyDescriptorPool(this->logicalDevice, pool, nullptr);
+	}
+	for (auto pool : chain.fullPools)
+	{
+		vkDestroyDescriptorPool(this->logicalDevice, pool, nullptr);
+	}
+	chain.readyPools.clear();
+	chain.fullPools.clear();
+	chain.setsPerPool = DESCRIPTOR_POOL_INITIAL_SETS;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+#define DESCRIPTOR_POOL_INITIAL_SETS	64			// sets in first pool of a chain
+#define DESCRIPTOR_POOL_MAX_SETS		4096		// each next chained pool doubles its size up to this value
+
+// Amount of descriptors of given type reserved per set in a pool
+struct DescriptorPoolSizeRatio
+{
+	VkDescriptorType type;
+	float ratio;
+};
+
+// Single binding of a descriptor set (what is written to the set on creation)
+struct DescriptorBinding
+{
+	uint32_t binding;
+	VkDescriptorType type;
+	VkDescriptorBufferInfo bufferInfo;		// used for buffer descriptor types
+	VkDescriptorImageInfo imageInfo;		// used for image/sampler descriptor types
+
+	bool operator==(const DescriptorBinding& other) const;
+};
+
+class DescriptorAllocator
+{
+
+public:
+	DescriptorAllocator();
+	~DescriptorAllocator();
+
+	void init(VkDevice logicalDevice, uint32_t frameCount, std::vector<DescriptorPoolSizeRatio> poolSizeRatios);
+	void cleanup();
+
+	// Allocates set that lives until allocator cleanup
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	// Allocates set that lives until pools of given frame are reset
+	VkDescriptorSet allocateFrame(uint32_t frameIndex, VkDescriptorSetLayout layout);
+	// Frame set with given bindings written (for sets referencing resources that change between frames)
+	VkDescriptorSet allocateFrame(uint32_t frameIndex, VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	// Returns persistent set with given bindings written, reusing already created set with the same bindings
+	VkDescriptorSet getCachedSet(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+
+	// Recycles all sets allocated for the frame (frame's previous submission must be completed)
+	void resetFrame(uint32_t frameIndex);
+	// Changes number of per frame pool chains (all frames must be completed)
+	void setFrameCount(uint32_t frameCount);
+
+	int getPoolCount();
+	int getCachedSetCount();
+
+private:
+	// Pools of the same purpose, new pool is chained once all others are exhausted
+	struct PoolChain
+	{
+		std::vector<VkDescriptorPool> fullPools;
+		std::vector<VkDescriptorPool> readyPools;
+		uint32_t setsPerPool = DESCRIPTOR_POOL_INITIAL_SETS;
+	};
+
+	struct SetCacheKey
+	{
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorBinding> bindings;
+
+		bool operator==(const SetCacheKey& other) const;
+	};
+
+	struct SetCacheKeyHash
+	{
+		size_t operator()(const SetCacheKey& key) const;
+	};
+
+	VkDevice logicalDevice;
+	std::vector<DescriptorPoolSizeRatio> poolSizeRatios;
+
+	PoolChain persistentPools;
+	std::vector<PoolChain> framePools;
+	std::unordered_map<SetCacheKey, VkDescriptorSet, SetCacheKeyHash> setCache;
+
+	VkDescriptorPool createPool(uint32_t setCount);
+	VkDescriptorPool getPool(PoolChain& chain);
+	VkDescriptorSet allocateFromChain(PoolChain& chain, VkDescriptorSetLayout layout);
+	void resetChain(PoolChain& chain);
+	void destroyChain(PoolChain& chain);
+	void writeBindings(VkDescriptorSet descriptorSet, const std::vector<DescriptorBinding>& bindings);
+};
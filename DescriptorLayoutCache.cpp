@@ -0,0 +1,271 @@
+#include "DescriptorLayoutCache.h"
+
+#include <algorithm>
+
+bool DescriptorLayoutCache::SetLayoutKey::operator==(const SetLayoutKey& other) const
+{
+	if (bindings.size() != other.bindings.size() || bindingFlags != other.bindingFlags)
+	{
+		return false;
+	}
+	for (int i = 0; i < bindings.size(); i++)
+	{
+		const auto& a = bindings[i];
+		const auto& b = other.bindings[i];
+		if (a.binding != b.binding || a.descriptorType != b.descriptorType
+			|| a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t DescriptorLayoutCache::SetLayoutKeyHash::operator()(const SetLayoutKey& key) const
+{
+	size_t seed = 0;
+	for (const auto& binding : key.bindings)
+	{
+		hashCombine(seed, binding.binding);
+		hashCombine(seed, binding.descriptorType);
+		hashCombine(seed, binding.descriptorCount);
+		hashCombine(seed, binding.stageFlags);
+	}
+	for (auto flags : key.bindingFlags)
+	{
+		hashCombine(seed, flags);
+	}
+	return seed;
+}
+
+bool DescriptorLayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const
+{
+	if (setLayouts != other.setLayouts || pushConstantRanges.size() != other.pushConstantRanges.size())
+	{
+		return false;
+	}
+	for (int i = 0; i < pushConstantRanges.size(); i++)
+	{
+		const auto& a = pushConstantRanges[i];
+		const auto& b = other.pushConstantRanges[i];
+		if (a.stageFlags != b.stageFlags || a.offset != b.offset || a.size != b.size)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t DescriptorLayoutCache::PipelineLayoutKeyHash::operator()(const PipelineLayoutKey& key) const
+{
+	size_t seed = 0;
+	for (auto setLayout : key.setLayouts)
+	{
+		hashCombine(seed, setLayout);
+	}
+	for (const auto& range : key.pushConstantRanges)
+	{
+		hashCombine(seed, range.stageFlags);
+		hashCombine(seed, range.offset);
+		hashCombine(seed, range.size);
+	}
+	return seed;
+}
+
+DescriptorLayoutCache::DescriptorLayoutCache()
+{
+	this->logicalDevice = VK_NULL_HANDLE;
+}
+
+DescriptorLayoutCache::~DescriptorLayoutCache()
+{
+}
+
+void DescriptorLayoutCache::init(VkDevice logicalDevice)
+{
+	this->logicalDevice = logicalDevice;
+}
+
+void DescriptorLayoutCache::cleanup()
+{
+	lock_guard<mutex> lock(this->cacheMutex);
+
+	for (auto& layout : this->pipelineLayouts)
+	{
+		vkDestroyPipelineLayout(this->logicalDevice, layout.second, nullptr);
+	}
+	this->pipelineLayouts.clear();
+
+	for (auto& layout : this->setLayouts)
+	{
+		vkDestroyDescriptorSetLayout(this->logicalDevice, layout.second, nullptr);
+	}
+	this->setLayouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::getSetLayout(const vector<VkDescriptorSetLayoutBinding>& bindings, const vector<VkDescriptorBindingFlags>& bindingFlags)
+{
+	// Bindings are sorted, so the same set declared in different order maps to the same layout
+	SetLayoutKey key = {};
+	vector<int> order(bindings.size());
+	for (int i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	sort(order.begin(), order.end(), [&bindings](int a, int b) { return bindings[a].binding < bindings[b].binding; });
+	for (int i : order)
+	{
+		key.bindings.push_back(bindings[i]);
+		key.bindings.back().pImmutableSamplers = nullptr;
+		if (!bindingFlags.empty())
+		{
+			key.bindingFlags.push_back(bindingFlags[i]);
+		}
+	}
+
+	lock_guard<mutex> lock(this->cacheMutex);
+
+	auto cached = this->setLayouts.find(key);
+	if (cached != this->setLayouts.end())
+	{
+		return cached->second;
+	}
+
+	// Bindings updated after bind can only live in sets from UPDATE_AFTER_BIND pools
+	bool updateAfterBind = false;
+	for (auto flags : key.bindingFlags)
+	{
+		updateAfterBind |= (flags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) != 0;
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCreateInfo.bindingCount = static_cast<uint32_t>(key.bindingFlags.size());
+	bindingFlagsCreateInfo.pBindingFlags = key.bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	createInfo.pNext = key.bindingFlags.empty() ? nullptr : &bindingFlagsCreateInfo;
+	createInfo.flags = updateAfterBind ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT : 0;
+	createInfo.bindingCount = static_cast<uint32_t>(key.bindings.size());
+	createInfo.pBindings = key.bindings.data();
+
+	VkDescriptorSetLayout layout;
+	VkResult result = vkCreateDescriptorSetLayout(this->logicalDevice, &createInfo, nullptr, &layout);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create Descriptor Set Layout.");
+	}
+
+	this->setLayouts[key] = layout;
+	return layout;
+}
+
+VkPipelineLayout DescriptorLayoutCache::getPipelineLayout(const vector<VkDescriptorSetLayout>& setLayouts, const vector<VkPushConstantRange>& pushConstantRanges)
+{
+	PipelineLayoutKey key = { setLayouts, pushConstantRanges };
+
+	lock_guard<mutex> lock(this->cacheMutex);
+
+	auto cached = this->pipelineLayouts.find(key);
+	if (cached != this->pipelineLayouts.end())
+	{
+		return cached->second;
+	}
+
+	VkPipelineLayoutCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	createInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	createInfo.pSetLayouts = setLayouts.data();
+	createInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	createInfo.pPushConstantRanges = pushConstantRanges.data();
+
+	VkPipelineLayout layout;
+	VkResult result = vkCreatePipelineLayout(this->logicalDevice, &createInfo, nullptr, &layout);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create Pipeline Layout.");
+	}
+
+	this->pipelineLayouts[key] = layout;
+	return layout;
+}
+
+VkPipelineLayout DescriptorLayoutCache::getReflectedLayout(const ShaderReflection& reflection, const LayoutOverrides& overrides,
+	vector<VkDescriptorSetLayout>* setLayouts)
+{
+	// Sets skipped by shaders still need (empty) layout, set numbers are indices into pipeline layout
+	uint32_t setCount = reflection.getSetCount();
+	vector<vector<VkDescriptorSetLayoutBinding>> setBindings(setCount);
+	vector<vector<VkDescriptorBindingFlags>> setBindingFlags(setCount);
+	vector<bool> setHasFlags(setCount, false);
+
+	for (const auto& reflected : reflection.bindings)
+	{
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = reflected.binding;
+		binding.descriptorType = reflected.type;
+		binding.descriptorCount = reflected.count;
+		binding.stageFlags = reflected.stageFlags;
+		binding.pImmutableSamplers = nullptr;
+
+		if (overrides.dynamicUniformBuffers && binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		{
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		}
+		if (overrides.dynamicStorageBuffers && binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+		{
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		}
+
+		VkDescriptorBindingFlags flags = 0;
+		if (reflected.count == 0)
+		{
+			if (overrides.maxRuntimeArraySize == 0)
+			{
+				throw runtime_error("Failed to create reflected layout, shader uses runtime sized array at set "
+					+ to_string(reflected.set) + " binding " + to_string(reflected.binding) + " but no size is given.");
+			}
+
+			// Runtime sized arrays are bindless tables, actual size is given on set allocation
+			binding.descriptorCount = overrides.maxRuntimeArraySize;
+			flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+				| VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
+				| VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+			setHasFlags[reflected.set] = true;
+		}
+
+		setBindings[reflected.set].push_back(binding);
+		setBindingFlags[reflected.set].push_back(flags);
+	}
+
+	vector<VkDescriptorSetLayout> layouts(setCount);
+	for (uint32_t set = 0; set < setCount; set++)
+	{
+		layouts[set] = getSetLayout(setBindings[set], setHasFlags[set] ? setBindingFlags[set] : vector<VkDescriptorBindingFlags>());
+	}
+
+	vector<VkPushConstantRange> pushConstantRanges;
+	if (reflection.pushConstantRange.size > 0)
+	{
+		pushConstantRanges.push_back(reflection.pushConstantRange);
+	}
+
+	if (setLayouts != nullptr)
+	{
+		*setLayouts = layouts;
+	}
+	return getPipelineLayout(layouts, pushConstantRanges);
+}
+
+int DescriptorLayoutCache::getSetLayoutCount()
+{
+	lock_guard<mutex> lock(this->cacheMutex);
+	return static_cast<int>(this->setLayouts.size());
+}
+
+int DescriptorLayoutCache::getPipelineLayoutCount()
+{
+	lock_guard<mutex> lock(this->cacheMutex);
+	return static_cast<int>(this->pipelineLayouts.size());
+}
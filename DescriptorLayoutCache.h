@@ -0,0 +1,73 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "ShaderReflection.h"
+
+// Decisions reflection can't make from shader code alone
+struct LayoutOverrides
+{
+	bool dynamicUniformBuffers = false;				// uniform buffers are bound with dynamic offsets
+	bool dynamicStorageBuffers = false;				// storage buffers are bound with dynamic offsets
+	uint32_t maxRuntimeArraySize = 0;				// descriptor count of runtime sized arrays (bindless, variable count)
+};
+
+// Creates descriptor set layouts and pipeline layouts, identical layouts are created only once and shared
+class DescriptorLayoutCache
+{
+
+public:
+	DescriptorLayoutCache();
+	~DescriptorLayoutCache();
+
+	void init(VkDevice logicalDevice);
+	void cleanup();
+
+	VkDescriptorSetLayout getSetLayout(const vector<VkDescriptorSetLayoutBinding>& bindings, const vector<VkDescriptorBindingFlags>& bindingFlags = {});
+	VkPipelineLayout getPipelineLayout(const vector<VkDescriptorSetLayout>& setLayouts, const vector<VkPushConstantRange>& pushConstantRanges);
+	// Builds layouts of all sets (index is set number) and pipeline layout from reflected shader interface
+	VkPipelineLayout getReflectedLayout(const ShaderReflection& reflection, const LayoutOverrides& overrides,
+		vector<VkDescriptorSetLayout>* setLayouts = nullptr);
+
+	int getSetLayoutCount();
+	int getPipelineLayoutCount();
+
+private:
+	struct SetLayoutKey
+	{
+		vector<VkDescriptorSetLayoutBinding> bindings;
+		vector<VkDescriptorBindingFlags> bindingFlags;
+
+		bool operator==(const SetLayoutKey& other) const;
+	};
+
+	struct SetLayoutKeyHash
+	{
+		size_t operator()(const SetLayoutKey& key) const;
+	};
+
+	struct PipelineLayoutKey
+	{
+		vector<VkDescriptorSetLayout> setLayouts;
+		vector<VkPushConstantRange> pushConstantRanges;
+
+		bool operator==(const PipelineLayoutKey& other) const;
+	};
+
+	struct PipelineLayoutKeyHash
+	{
+		size_t operator()(const PipelineLayoutKey& key) const;
+	};
+
+	VkDevice logicalDevice;
+
+	mutex cacheMutex;
+	unordered_map<SetLayoutKey, VkDescriptorSetLayout, SetLayoutKeyHash> setLayouts;
+	unordered_map<PipelineLayoutKey, VkPipelineLayout, PipelineLayoutKeyHash> pipelineLayouts;
+};
@@ -0,0 +1,237 @@
+#include "DrawList.h"
+
+#include <cstring>
+
+#define DRAW_KEY_BUFFER_SHIFT	0
+#define DRAW_KEY_TEXTURE_SHIFT	(DRAW_KEY_BUFFER_SHIFT + DRAW_KEY_BUFFER_BITS)
+#define DRAW_KEY_LAYER_SHIFT	(64 - DRAW_KEY_LAYER_BITS)
+
+DrawList::DrawList()
+{
+	this->stats = {};
+}
+
+DrawList::~DrawList()
+{
+}
+
+void DrawList::clear()
+{
+	this->draws.clear();
+	this->items.clear();
+}
+
+void DrawList::add(const DrawCommand& draw, float viewDepth, DrawLayer layer)
+{
+	SortItem item = {};
+	item.key = makeKey(draw, viewDepth, layer);
+	item.drawIndex = static_cast<uint32_t>(this->draws.size());
+	this->items.push_back(item);
+	this->draws.push_back(draw);
+}
+
+void DrawList::sort()
+{
+	this->stats = {};
+
+	// LSD radix sort, 8 bits per pass. Stable, so equal keys keep submission order.
+	size_t count = this->items.size();
+	this->sortScratch.resize(count);
+
+	SortItem* source = this->items.data();
+	SortItem* destination = this->sortScratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t histogram[256] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			histogram[(source[i].key >> shift) & 0xFF]++;
+		}
+
+		// All keys share this digit (e.g. unused high bits), pass would only copy
+		if (count == 0 || histogram[(source[0].key >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			uint32_t digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			destination[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+		}
+		std::swap(source, destination);
+	}
+
+	if (source != this->items.data())
+	{
+		this->items.swap(this->sortScratch);
+	}
+}
+
+void DrawList::record(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkShaderStageFlags pushConstantStages,
+	const IndirectDrawSource* indirect)
+{
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+	bool pushed = false;
+	int pushedTextureIndex = 0;
+
+	for (const auto& item : this->items)
+	{
+		const DrawCommand& draw = this->draws[item.drawIndex];
+
+		if (draw.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+			boundPipeline = draw.pipeline;
+			this->stats.pipelineBinds++;
+		}
+
+		if (draw.vertexBuffer != boundVertexBuffer)
+		{
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, &offset);
+			boundVertexBuffer = draw.vertexBuffer;
+			this->stats.vertexBufferBinds++;
+		}
+
+		if (draw.indexBuffer != boundIndexBuffer)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			boundIndexBuffer = draw.indexBuffer;
+			this->stats.indexBufferBinds++;
+		}
+
+		// Push constants stay valid across pipeline binds, all pipelines share the layout
+		if (!pushed || draw.textureIndex != pushedTextureIndex)
+		{
+			PushModel pushModel = {};
+			pushModel.textureIndex = draw.textureIndex;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, 0, sizeof(PushModel), &pushModel);
+			pushed = true;
+			pushedTextureIndex = draw.textureIndex;
+			this->stats.pushConstantUpdates++;
+		}
+
+		// Per object data is found through instance index, so no descriptor set has to be rebound
+		if (indirect != nullptr && draw.meshletCount > 0)
+		{
+			// GPU decides how many of draw's clusters are drawn, commands carry object index as first instance
+			vkCmdDrawIndexedIndirectCount(commandBuffer, indirect->buffer,
+				indirect->commandOffset + draw.firstClusterCommand * sizeof(VkDrawIndexedIndirectCommand),
+				indirect->buffer, indirect->countOffset + draw.clusterDrawIndex * sizeof(uint32_t),
+				draw.meshletCount, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, 0, draw.vertexOffset, draw.objectIndex);
+		}
+		this->stats.draws++;
+	}
+}
+
+void DrawList::recordDepth(VkCommandBuffer commandBuffer, VkPipeline depthPipeline)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPipeline);
+	this->stats.pipelineBinds++;
+
+	VkBuffer boundPositionBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+
+	for (const auto& item : this->items)
+	{
+		const DrawCommand& draw = this->draws[item.drawIndex];
+
+		if (draw.positionBuffer != boundPositionBuffer)
+		{
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.positionBuffer, &offset);
+			boundPositionBuffer = draw.positionBuffer;
+			this->stats.vertexBufferBinds++;
+		}
+
+		if (draw.indexBuffer != boundIndexBuffer)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			boundIndexBuffer = draw.indexBuffer;
+			this->stats.indexBufferBinds++;
+		}
+
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, 0, draw.vertexOffset, draw.objectIndex);
+		this->stats.draws++;
+	}
+}
+
+uint32_t DrawList::getDrawCount()
+{
+	return static_cast<uint32_t>(this->draws.size());
+}
+
+DrawListStats DrawList::getStats()
+{
+	return this->stats;
+}
+
+uint64_t DrawList::makeKey(const DrawCommand& draw, float viewDepth, DrawLayer layer)
+{
+	uint64_t pipelineId = getId(this->pipelineIds, (uint64_t)draw.pipeline, DRAW_KEY_PIPELINE_BITS);
+	uint64_t bufferId = getId(this->bufferIds, (uint64_t)draw.vertexBuffer, DRAW_KEY_BUFFER_BITS);
+	uint64_t textureId = static_cast<uint64_t>(draw.textureIndex + 1) & ((1ull << DRAW_KEY_TEXTURE_BITS) - 1);
+	uint64_t depth = quantizeDepth(viewDepth);
+
+	uint64_t key = ((uint64_t)layer << DRAW_KEY_LAYER_SHIFT)
+		| (textureId << DRAW_KEY_TEXTURE_SHIFT)
+		| (bufferId << DRAW_KEY_BUFFER_SHIFT);
+
+	if (layer == DRAW_LAYER_TRANSPARENT)
+	{
+		// Blending needs far to near order, state is sorted only within equal depth
+		uint64_t farToNear = ((1ull << DRAW_KEY_DEPTH_BITS) - 1) - depth;
+		key |= farToNear << (DRAW_KEY_LAYER_SHIFT - DRAW_KEY_DEPTH_BITS);
+		key |= pipelineId << (DRAW_KEY_LAYER_SHIFT - DRAW_KEY_DEPTH_BITS - DRAW_KEY_PIPELINE_BITS);
+	}
+	else
+	{
+		// Pipeline changes are most expensive, within pipeline near objects go first to fail depth test of hidden ones
+		key |= pipelineId << (DRAW_KEY_LAYER_SHIFT - DRAW_KEY_PIPELINE_BITS);
+		key |= depth << (DRAW_KEY_LAYER_SHIFT - DRAW_KEY_PIPELINE_BITS - DRAW_KEY_DEPTH_BITS);
+	}
+
+	return key;
+}
+
+uint32_t DrawList::getId(unordered_map<uint64_t, uint32_t>& ids, uint64_t handle, uint32_t bits)
+{
+	auto id = ids.find(handle);
+	if (id != ids.end())
+	{
+		return id->second;
+	}
+
+	// Ids wrap when field overflows, draws then only sort less tightly
+	uint32_t newId = static_cast<uint32_t>(ids.size()) & ((1u << bits) - 1);
+	ids[handle] = newId;
+	return newId;
+}
+
+uint32_t DrawList::quantizeDepth(float viewDepth)
+{
+	// Bits of positive float grow with its value, top bits keep exponent and a part of mantissa
+	// (precision relative to distance, like depth buffer)
+	if (!(viewDepth > 0.0f))
+	{
+		return 0;
+	}
+	uint32_t bits;
+	memcpy(&bits, &viewDepth, sizeof(float));
+	return bits >> (32 - DRAW_KEY_DEPTH_BITS);
+}
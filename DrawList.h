@@ -0,0 +1,104 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <unordered_map>
+#include "VulkanUtils.h"
+
+// SORT KEY LAYOUT (most significant first)
+// opaque:      layer | pipeline | depth (front to back) | texture | buffers
+// transparent: layer | depth (back to front) | pipeline | texture | buffers
+#define DRAW_KEY_LAYER_BITS		2
+#define DRAW_KEY_PIPELINE_BITS	12
+#define DRAW_KEY_DEPTH_BITS		16
+#define DRAW_KEY_TEXTURE_BITS	14
+#define DRAW_KEY_BUFFER_BITS	20
+
+enum DrawLayer
+{
+	DRAW_LAYER_OPAQUE = 0,
+	DRAW_LAYER_TRANSPARENT = 1
+};
+
+// Everything needed to record one draw
+struct DrawCommand
+{
+	VkPipeline pipeline;
+	VkBuffer vertexBuffer;
+	VkBuffer positionBuffer;					// position only stream for depth only passes
+	VkBuffer indexBuffer;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	int textureIndex;							// pushed as push constant, -1 for untextured
+	uint32_t objectIndex;						// index into per object data, passed as first instance
+
+	// Cluster culled draws (meshlets surviving culling are drawn from indirect commands the culling pass wrote)
+	uint32_t clusterDrawIndex;					// slot of draw's command count
+	uint32_t firstClusterCommand;				// first indirect command of draw's range
+	uint32_t meshletCount;						// size of the range (upper bound of command count), 0 if draw isn't cluster culled
+};
+
+// Indirect commands and counts of cluster culled draws (both in one buffer)
+struct IndirectDrawSource
+{
+	VkBuffer buffer;
+	VkDeviceSize commandOffset;					// offset of command 0
+	VkDeviceSize countOffset;					// offset of count 0
+};
+
+// State changes recorded since last sort()
+struct DrawListStats
+{
+	uint32_t draws;
+	uint32_t pipelineBinds;
+	uint32_t vertexBufferBinds;
+	uint32_t indexBufferBinds;
+	uint32_t pushConstantUpdates;
+};
+
+// Collects draws of a frame, orders them by packed 64-bit state key and records them
+// binding only state that differs from previous draw
+class DrawList
+{
+
+public:
+	DrawList();
+	~DrawList();
+
+	void clear();
+	// viewDepth is distance along view direction, used for front to back (opaque) or back to front (transparent) order
+	void add(const DrawCommand& draw, float viewDepth, DrawLayer layer = DRAW_LAYER_OPAQUE);
+	void sort();
+	// Expects bound pipeline layout compatible sets, push constant range holds PushModel.
+	// With indirect source every cluster culled draw is replaced by indirect draw of its surviving clusters.
+	void record(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkShaderStageFlags pushConstantStages,
+		const IndirectDrawSource* indirect = nullptr);
+	// Records all draws with one depth only pipeline from position streams (same order, materials ignored)
+	void recordDepth(VkCommandBuffer commandBuffer, VkPipeline depthPipeline);
+
+	uint32_t getDrawCount();
+	DrawListStats getStats();
+
+private:
+	struct SortItem
+	{
+		uint64_t key;
+		uint32_t drawIndex;
+	};
+
+	vector<DrawCommand> draws;
+	vector<SortItem> items;
+	vector<SortItem> sortScratch;				// radix sort ping-pong buffer, kept between frames
+
+	// Handles mapped to small ids that fit into key fields (ids are stable for renderer lifetime)
+	unordered_map<uint64_t, uint32_t> pipelineIds;
+	unordered_map<uint64_t, uint32_t> bufferIds;
+
+	DrawListStats stats;
+
+	uint64_t makeKey(const DrawCommand& draw, float viewDepth, DrawLayer layer);
+	static uint32_t getId(unordered_map<uint64_t, uint32_t>& ids, uint64_t handle, uint32_t bits);
+	static uint32_t quantizeDepth(float viewDepth);
+};
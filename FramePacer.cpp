@@ -0,0 +1,135 @@
+#include "FramePacer.h"
+
+#ifdef _WIN32
+// Default Windows timer resolution is ~15.6ms, which makes every sleep overshoot the frame
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+FramePacer::FramePacer()
+{
+	this->mode = FramePacingMode::LIMITED;
+	this->targetFrameDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
+	this->firstFrame = true;
+	this->sleepMargin = std::chrono::microseconds(FRAME_PACER_SLEEP_MARGIN_US);
+	this->lastFrameTime = 0.0;
+	this->lastWaitTime = 0.0;
+
+#ifdef _WIN32
+	timeBeginPeriod(1);
+#endif
+}
+
+FramePacer::~FramePacer()
+{
+	// Timer resolution is system wide, it stays raised until every process that requested it ends its period
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::setTargetFps(double targetFps)
+{
+	// No target rate leaves the mode alone, frames are just not waited for until a positive target is set again
+	this->targetFrameDuration = targetFps > 0.0
+		? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps))
+		: Clock::duration::zero();
+	// Start new schedule from the next frame
+	this->firstFrame = true;
+}
+
+void FramePacer::setMode(FramePacingMode mode)
+{
+	this->mode = mode;
+	this->firstFrame = true;
+}
+
+FramePacingMode FramePacer::getMode()
+{
+	return this->mode;
+}
+
+bool FramePacer::isLowLatency()
+{
+	return this->mode == FramePacingMode::LOW_LATENCY;
+}
+
+float FramePacer::beginFrame()
+{
+	Clock::time_point waitStart = Clock::now();
+
+	if (this->firstFrame)
+	{
+		this->previousFrameStart = waitStart;
+		this->nextFrameStart = waitStart;
+		this->firstFrame = false;
+	}
+
+	if (isPaced())
+	{
+		waitUntil(this->nextFrameStart);
+
+		// Deadlines are advanced by fixed step, so rounding errors don't accumulate into drift.
+		// If we fell behind by more than a frame, schedule restarts from now instead of rushing to catch up.
+		this->nextFrameStart += this->targetFrameDuration;
+		Clock::time_point now = Clock::now();
+		if (now > this->nextFrameStart)
+		{
+			this->nextFrameStart = now + this->targetFrameDuration;
+		}
+	}
+
+	Clock::time_point frameStart = Clock::now();
+	this->lastWaitTime = std::chrono::duration<double>(frameStart - waitStart).count();
+	this->lastFrameTime = std::chrono::duration<double>(frameStart - this->previousFrameStart).count();
+	this->previousFrameStart = frameStart;
+
+	return static_cast<float>(this->lastFrameTime);
+}
+
+double FramePacer::getTargetFps()
+{
+	return isPaced() ? 1.0 / std::chrono::duration<double>(this->targetFrameDuration).count() : 0.0;
+}
+
+double FramePacer::getLastFrameTime()
+{
+	return this->lastFrameTime;
+}
+
+double FramePacer::getLastWaitTime()
+{
+	return this->lastWaitTime;
+}
+
+bool FramePacer::isPaced()
+{
+	return this->mode != FramePacingMode::UNLIMITED && this->targetFrameDuration > Clock::duration::zero();
+}
+
+void FramePacer::waitUntil(Clock::time_point deadline)
+{
+	// SLEEP while far from deadline, tracking how much each sleep overshoots
+	Clock::duration remaining = deadline - Clock::now();
+	while (remaining > this->sleepMargin)
+	{
+		Clock::duration sleepTime = std::min(remaining - this->sleepMargin, Clock::duration(std::chrono::microseconds(FRAME_PACER_SLEEP_SLICE_US)));
+
+		Clock::time_point sleepStart = Clock::now();
+		std::this_thread::sleep_for(sleepTime);
+		Clock::duration oversleep = Clock::now() - sleepStart - sleepTime;
+
+		// Margin grows immediately on worse oversleep and slowly decays back otherwise
+		this->sleepMargin = std::max(oversleep, this->sleepMargin - this->sleepMargin / 64);
+		this->sleepMargin = std::max(this->sleepMargin, Clock::duration(std::chrono::microseconds(100)));
+
+		remaining = deadline - Clock::now();
+	}
+
+	// SPIN for the remaining part, sleep can't be trusted to wake up that precisely
+	while (Clock::now() < deadline)
+	{
+		std::this_thread::yield();
+	}
+}
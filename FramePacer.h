@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#define FRAME_PACER_SLEEP_MARGIN_US		2000	// initial guess of how much sleep may overshoot (refined at runtime)
+#define FRAME_PACER_SLEEP_SLICE_US		1000	// single sleep call duration while far from deadline
+
+enum class FramePacingMode
+{
+	UNLIMITED,		// frames start as soon as previous one is submitted
+	LIMITED,		// frames start at fixed target rate
+	LOW_LATENCY		// fixed target rate, caller also waits on in-flight fence before sampling input
+};
+
+// Keeps frames at target rate by sleeping most of the wait and spinning only on the last part of it
+class FramePacer
+{
+
+public:
+	FramePacer();
+	~FramePacer();
+	FramePacer(const FramePacer&) = delete;				// owns a timer resolution request
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	void setTargetFps(double targetFps);			// 0 or less removes target rate, mode is kept
+	void setMode(FramePacingMode mode);
+	FramePacingMode getMode();
+	bool isLowLatency();
+
+	// Blocks until next frame should start and returns time passed since previous frame start (in seconds)
+	float beginFrame();
+
+	double getTargetFps();
+	double getLastFrameTime();			// seconds
+	double getLastWaitTime();			// seconds spent waiting in beginFrame
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	FramePacingMode mode;
+	Clock::duration targetFrameDuration;		// zero when there is no target rate
+
+	Clock::time_point nextFrameStart;
+	Clock::time_point previousFrameStart;
+	bool firstFrame;
+
+	// Estimated oversleep of the OS scheduler, spinning starts once remaining time is below this value
+	Clock::duration sleepMargin;
+
+	double lastFrameTime;
+	double lastWaitTime;
+
+	bool isPaced();						// mode limits rate and there is a target rate
+	void waitUntil(Clock::time_point deadline);
+};
@@ -0,0 +1,229 @@
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler()
+{
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->queueFamilyIndex = 0;
+	this->timelineSemaphore = VK_NULL_HANDLE;
+	this->submittedValue = 0;
+	this->frameIndex = 0;
+	this->pendingCpuWaitTime = 0.0;
+	this->lastCpuWaitTime = 0.0;
+}
+
+FrameScheduler::~FrameScheduler()
+{
+}
+
+void FrameScheduler::init(VkDevice logicalDevice, uint32_t queueFamilyIndex, uint32_t framesInFlight)
+{
+	this->logicalDevice = logicalDevice;
+	this->queueFamilyIndex = queueFamilyIndex;
+
+	// Timeline semaphore counts completed frames, frame slot is free once counter reached its last submitted value
+	VkSemaphoreTypeCreateInfo typeCreateInfo = {};
+	typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semCreateInfo = {};
+	semCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semCreateInfo.pNext = &typeCreateInfo;
+
+	VkResult result = vkCreateSemaphore(this->logicalDevice, &semCreateInfo, nullptr, &this->timelineSemaphore);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create frame timeline semaphore.");
+	}
+
+	createFrames(framesInFlight);
+}
+
+void FrameScheduler::cleanup()
+{
+	waitIdle();
+	destroyFrames();
+	vkDestroySemaphore(this->logicalDevice, this->timelineSemaphore, nullptr);
+}
+
+FrameContext& FrameScheduler::beginFrame()
+{
+	FrameContext& frame = this->frames[this->frameIndex];
+
+	waitForValue(frame.timelineValue);
+	flushDeletionQueue(frame);
+
+	// All command buffers of the frame are recorded from scratch, so the whole pool is reset at once
+	vkResetCommandPool(this->logicalDevice, frame.commandPool, 0);
+
+	return frame;
+}
+
+void FrameScheduler::submitFrame(VkQueue queue, VkSemaphore renderFinished, VkPipelineStageFlags waitStage)
+{
+	FrameContext& frame = this->frames[this->frameIndex];
+	frame.timelineValue = ++this->submittedValue;
+
+	// Binary semaphore signal value is ignored, but values array must match signal semaphore count
+	std::array<VkSemaphore, 2> signalSemaphores = { this->timelineSemaphore, renderFinished };
+	std::array<uint64_t, 2> signalValues = { frame.timelineValue, 0 };
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &frame.imageAvailable;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+	VkResult result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to submit Comand buffer to Graphics Queue.");
+	}
+
+	this->lastCpuWaitTime = this->pendingCpuWaitTime;
+	this->pendingCpuWaitTime = 0.0;
+
+	this->frameIndex = (this->frameIndex + 1) % this->frames.size();
+}
+
+void FrameScheduler::waitForCurrentFrame()
+{
+	waitForValue(this->frames[this->frameIndex].timelineValue);
+}
+
+void FrameScheduler::waitIdle()
+{
+	waitForValue(this->submittedValue);
+}
+
+void FrameScheduler::deferDestroy(function<void()> destroyFunction)
+{
+	this->frames[this->frameIndex].deletionQueue.push_back(destroyFunction);
+}
+
+void FrameScheduler::setFramesInFlight(uint32_t framesInFlight)
+{
+	if (framesInFlight == this->frames.size())
+	{
+		return;
+	}
+
+	waitIdle();
+	destroyFrames();
+	createFrames(framesInFlight);
+}
+
+uint32_t FrameScheduler::getFrameIndex()
+{
+	return this->frameIndex;
+}
+
+uint32_t FrameScheduler::getFramesInFlight()
+{
+	return static_cast<uint32_t>(this->frames.size());
+}
+
+double FrameScheduler::getLastCpuWaitTime()
+{
+	return this->lastCpuWaitTime;
+}
+
+void FrameScheduler::createFrames(uint32_t framesInFlight)
+{
+	if (framesInFlight < 1 || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+	{
+		throw runtime_error("Unsupported number of frames in flight.");
+	}
+
+	this->frames.resize(framesInFlight);
+	this->frameIndex = 0;
+
+	for (auto& frame : this->frames)
+	{
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;				// buffers are short lived (re-recorded every frame)
+		poolInfo.queueFamilyIndex = this->queueFamilyIndex;
+
+		VkResult result = vkCreateCommandPool(this->logicalDevice, &poolInfo, nullptr, &frame.commandPool);
+		if (result != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create frame Command Pool.");
+		}
+
+		VkCommandBufferAllocateInfo cbAllocInfo = {};
+		cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbAllocInfo.commandPool = frame.commandPool;
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbAllocInfo.commandBufferCount = 1;
+
+		result = vkAllocateCommandBuffers(this->logicalDevice, &cbAllocInfo, &frame.commandBuffer);
+		if (result != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to allocate frame command buffer.");
+		}
+
+		VkSemaphoreCreateInfo semCreateInfo = {};
+		semCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		result = vkCreateSemaphore(this->logicalDevice, &semCreateInfo, nullptr, &frame.imageAvailable);
+		if (result != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create frame semaphore.");
+		}
+
+		// Nothing submitted from this slot yet, so it is free right away
+		frame.timelineValue = this->submittedValue;
+	}
+}
+
+void FrameScheduler::destroyFrames()
+{
+	for (auto& frame : this->frames)
+	{
+		flushDeletionQueue(frame);
+		vkDestroySemaphore(this->logicalDevice, frame.imageAvailable, nullptr);
+		vkDestroyCommandPool(this->logicalDevice, frame.commandPool, nullptr);
+	}
+	this->frames.clear();
+}
+
+void FrameScheduler::waitForValue(uint64_t value)
+{
+	uint64_t completedValue;
+	vkGetSemaphoreCounterValue(this->logicalDevice, this->timelineSemaphore, &completedValue);
+	if (completedValue >= value)
+	{
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &this->timelineSemaphore;
+	waitInfo.pValues = &value;
+
+	auto waitStart = chrono::steady_clock::now();
+	vkWaitSemaphores(this->logicalDevice, &waitInfo, numeric_limits<uint64_t>::max());
+	this->pendingCpuWaitTime += chrono::duration<double>(chrono::steady_clock::now() - waitStart).count();
+}
+
+void FrameScheduler::flushDeletionQueue(FrameContext& frame)
+{
+	// Destroy in reverse order of deferring (later resources may depend on earlier ones)
+	for (auto it = frame.deletionQueue.rbegin(); it != frame.deletionQueue.rend(); it++)
+	{
+		(*it)();
+	}
+	frame.deletionQueue.clear();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <array>
+#include <limits>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+#define DEFAULT_FRAMES_IN_FLIGHT	2
+#define MAX_FRAMES_IN_FLIGHT		4		// upper bound of runtime configurable frames in flight
+
+// Resources owned by a single frame in flight (reused once GPU finished previous frame in the same slot)
+struct FrameContext
+{
+	VkCommandPool commandPool;						// reset as a whole when frame starts
+	VkCommandBuffer commandBuffer;
+	VkSemaphore imageAvailable;						// binary semaphore signalled by swapchain image acquire
+	uint64_t timelineValue = 0;						// timeline value signalled by last submission of this frame
+	vector<function<void()>> deletionQueue;			// destroys resources once GPU stopped using them
+};
+
+// Paces frames in flight with a single timeline semaphore instead of per frame fences
+class FrameScheduler
+{
+
+public:
+	FrameScheduler();
+	~FrameScheduler();
+
+	void init(VkDevice logicalDevice, uint32_t queueFamilyIndex, uint32_t framesInFlight);
+	void cleanup();
+
+	// Waits until GPU is done with the next frame slot, flushes its deletion queue and resets its command pool
+	FrameContext& beginFrame();
+	// Submits frame's command buffer, waiting for acquired image and signalling timeline (and given binary semaphore for present)
+	void submitFrame(VkQueue queue, VkSemaphore renderFinished, VkPipelineStageFlags waitStage);
+
+	// Blocks until GPU is done with the frame slot beginFrame() is going to use
+	void waitForCurrentFrame();
+	// Blocks until all submitted frames are done
+	void waitIdle();
+
+	// Destroys given resource once frame that is being recorded now is completed
+	void deferDestroy(function<void()> destroyFunction);
+
+	// Recreates frame slots (waits for GPU to be idle)
+	void setFramesInFlight(uint32_t framesInFlight);
+
+	uint32_t getFrameIndex();
+	uint32_t getFramesInFlight();
+	double getLastCpuWaitTime();			// seconds CPU spent waiting on GPU during last frame
+
+private:
+	VkDevice logicalDevice;
+	uint32_t queueFamilyIndex;
+
+	VkSemaphore timelineSemaphore;
+	uint64_t submittedValue;				// last value submission will signal
+
+	vector<FrameContext> frames;
+	uint32_t frameIndex;
+
+	double pendingCpuWaitTime;
+	double lastCpuWaitTime;
+
+	void createFrames(uint32_t framesInFlight);
+	void destroyFrames();
+	void waitForValue(uint64_t value);
+	void flushDeletionQueue(FrameContext& frame);
+};
@@ -0,0 +1,371 @@
+#include "GpuSkinning.h"
+
+#include <cmath>
+
+GpuSkinning::GpuSkinning()
+{
+	this->physicalDevice = VK_NULL_HANDLE;
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->transferQueue = VK_NULL_HANDLE;
+	this->transferCommandPool = VK_NULL_HANDLE;
+	this->pipelineManager = nullptr;
+	this->uniformRing = nullptr;
+	this->bindPoseBuffer = VK_NULL_HANDLE;
+	this->bindPoseBufferMemory = VK_NULL_HANDLE;
+	this->vertexCount = 0;
+	this->vertexBuffer = VK_NULL_HANDLE;
+	this->vertexBufferMemory = VK_NULL_HANDLE;
+	this->positionBuffer = VK_NULL_HANDLE;
+	this->positionBufferMemory = VK_NULL_HANDLE;
+	this->pipelineLayout = VK_NULL_HANDLE;
+	this->descriptorSet = VK_NULL_HANDLE;
+	this->frameIndex = 0;
+	this->matrixOffset = 0;
+}
+
+GpuSkinning::~GpuSkinning()
+{
+}
+
+void GpuSkinning::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+	const string& skinningShader, ShaderCompiler* shaderCompiler, PipelineManager* pipelineManager,
+	DescriptorLayoutCache* layoutCache, DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing)
+{
+	this->physicalDevice = physicalDevice;
+	this->logicalDevice = logicalDevice;
+	this->transferQueue = transferQueue;
+	this->transferCommandPool = transferCommandPool;
+	this->skinningShader = skinningShader;
+	this->pipelineManager = pipelineManager;
+	this->uniformRing = uniformRing;
+
+	// BUFFERS
+	createBuffer(physicalDevice, logicalDevice, MAX_SKINNED_VERTICES * sizeof(SkinVertex), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->bindPoseBuffer, &this->bindPoseBufferMemory);
+
+	// Output streams are both storage (written by skinning) and vertex buffers (read by draws)
+	VkBufferUsageFlags outputUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	createBuffer(physicalDevice, logicalDevice, (VkDeviceSize)MAX_FRAMES_IN_FLIGHT * MAX_SKINNED_VERTICES * sizeof(Vertex), outputUsage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->vertexBuffer, &this->vertexBufferMemory);
+	createBuffer(physicalDevice, logicalDevice, (VkDeviceSize)MAX_FRAMES_IN_FLIGHT * MAX_SKINNED_VERTICES * sizeof(glm::vec3), outputUsage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->positionBuffer, &this->positionBufferMemory);
+
+	// SKINNING LAYOUT AND SET
+	ShaderReflection reflection = ShaderReflection::reflect(shaderCompiler->compile(skinningShader));
+	LayoutOverrides overrides = {};
+	overrides.dynamicStorageBuffers = true;
+
+	vector<VkDescriptorSetLayout> setLayouts;
+	this->pipelineLayout = layoutCache->getReflectedLayout(reflection, overrides, &setLayouts);
+	if (setLayouts.empty())
+	{
+		throw runtime_error("Failed to create skinning layout, shader must use skinning buffers in set 0.");
+	}
+
+	DescriptorBinding matrixBinding = {};
+	matrixBinding.binding = 0;
+	matrixBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	matrixBinding.bufferInfo.buffer = uniformRing->getBuffer();
+	matrixBinding.bufferInfo.offset = 0;
+	matrixBinding.bufferInfo.range = MAX_SKIN_MATRICES * sizeof(glm::mat4);
+
+	DescriptorBinding bindPoseBinding = {};
+	bindPoseBinding.binding = 1;
+	bindPoseBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	bindPoseBinding.bufferInfo.buffer = this->bindPoseBuffer;
+	bindPoseBinding.bufferInfo.offset = 0;
+	bindPoseBinding.bufferInfo.range = VK_WHOLE_SIZE;
+
+	DescriptorBinding vertexBinding = {};
+	vertexBinding.binding = 2;
+	vertexBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	vertexBinding.bufferInfo.buffer = this->vertexBuffer;
+	vertexBinding.bufferInfo.offset = 0;
+	vertexBinding.bufferInfo.range = VK_WHOLE_SIZE;
+
+	DescriptorBinding positionBinding = {};
+	positionBinding.binding = 3;
+	positionBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	positionBinding.bufferInfo.buffer = this->positionBuffer;
+	positionBinding.bufferInfo.offset = 0;
+	positionBinding.bufferInfo.range = VK_WHOLE_SIZE;
+
+	this->descriptorSet = descriptorAllocator->getCachedSet(setLayouts[0], { matrixBinding, bindPoseBinding, vertexBinding, positionBinding });
+
+	// Compiled up front, first frame shouldn't wait for it
+	pipelineManager->getComputePipeline(skinningShader, this->pipelineLayout);
+}
+
+void GpuSkinning::cleanup()
+{
+	// Layout and set are owned by layout cache and descriptor allocator, pipeline by pipeline manager
+	if (this->bindPoseBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyBuffer(this->logicalDevice, this->positionBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->positionBufferMemory, nullptr);
+	vkDestroyBuffer(this->logicalDevice, this->vertexBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->vertexBufferMemory, nullptr);
+	vkDestroyBuffer(this->logicalDevice, this->bindPoseBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->bindPoseBufferMemory, nullptr);
+	this->bindPoseBuffer = VK_NULL_HANDLE;
+	this->skins.clear();
+}
+
+int GpuSkinning::addSkin(const vector<Vertex>& vertices, const vector<glm::uvec4>& jointIndices, const vector<glm::vec4>& jointWeights,
+	const vector<int>& skinJoints, const vector<glm::mat4>& inverseBindMatrices)
+{
+	if (jointIndices.size() != vertices.size() || jointWeights.size() != vertices.size() || skinJoints.size() != inverseBindMatrices.size())
+	{
+		throw runtime_error("Failed to add skin, influences don't match vertices or joints.");
+	}
+	if (this->vertexCount + vertices.size() > MAX_SKINNED_VERTICES)
+	{
+		throw runtime_error("Too many skinned vertices, raise MAX_SKINNED_VERTICES.");
+	}
+
+	Skin skin = {};
+	skin.firstVertex = this->vertexCount;
+	skin.vertexCount = static_cast<uint32_t>(vertices.size());
+	skin.skinJoints = skinJoints;
+	skin.inverseBindMatrices = inverseBindMatrices;
+	skin.skinMatrices.assign(skinJoints.size(), glm::mat4(1.0f));
+
+	// Bounds of vertices each joint moves, posed mesh stays within union of the posed spheres
+	// (blended vertex is a weighted average of points lying in spheres of its joints)
+	vector<glm::vec3> boundsMin(skinJoints.size(), glm::vec3(FLT_MAX));
+	vector<glm::vec3> boundsMax(skinJoints.size(), glm::vec3(-FLT_MAX));
+	glm::vec3 staticMin = glm::vec3(FLT_MAX);
+	glm::vec3 staticMax = glm::vec3(-FLT_MAX);
+
+	vector<SkinVertex> skinVertices(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		skinVertices[i].position = glm::vec4(vertices[i].pos, 1.0f);
+		skinVertices[i].normal = glm::vec4(vertices[i].normal, 0.0f);
+		skinVertices[i].joints = jointIndices[i];
+		skinVertices[i].weights = jointWeights[i];
+
+		bool influenced = false;
+		for (int k = 0; k < 4; k++)
+		{
+			if (jointWeights[i][k] <= 0.0f)
+			{
+				continue;
+			}
+			if (jointIndices[i][k] >= skinJoints.size())
+			{
+				throw runtime_error("Failed to add skin, vertex references missing joint.");
+			}
+			boundsMin[jointIndices[i][k]] = glm::min(boundsMin[jointIndices[i][k]], vertices[i].pos);
+			boundsMax[jointIndices[i][k]] = glm::max(boundsMax[jointIndices[i][k]], vertices[i].pos);
+			influenced = true;
+		}
+
+		// Shader keeps vertices without influences in bind pose
+		if (!influenced)
+		{
+			staticMin = glm::min(staticMin, vertices[i].pos);
+			staticMax = glm::max(staticMax, vertices[i].pos);
+		}
+	}
+
+	skin.jointBounds.resize(skinJoints.size());
+	for (size_t joint = 0; joint < skinJoints.size(); joint++)
+	{
+		glm::vec3 center = (boundsMin[joint] + boundsMax[joint]) * 0.5f;
+		skin.jointBounds[joint] = boundsMin[joint].x <= boundsMax[joint].x
+			? glm::vec4(center, glm::length(boundsMax[joint] - center)) : glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+	}
+	glm::vec3 staticCenter = (staticMin + staticMax) * 0.5f;
+	skin.staticBounds = staticMin.x <= staticMax.x ? glm::vec4(staticCenter, glm::length(staticMax - staticCenter)) : glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+
+	// Skinning only writes positions and normals, colors and uvs of every output slice are written once here
+	uploadToBuffer(this->bindPoseBuffer, skin.firstVertex * sizeof(SkinVertex), skinVertices.data(), skinVertices.size() * sizeof(SkinVertex));
+	for (uint32_t slice = 0; slice < MAX_FRAMES_IN_FLIGHT; slice++)
+	{
+		VkDeviceSize sliceVertex = (VkDeviceSize)slice * MAX_SKINNED_VERTICES + skin.firstVertex;
+		uploadToBuffer(this->vertexBuffer, sliceVertex * sizeof(Vertex), vertices.data(), vertices.size() * sizeof(Vertex));
+	}
+
+	this->vertexCount += skin.vertexCount;
+	this->skins.push_back(skin);
+	return static_cast<int>(this->skins.size() - 1);
+}
+
+void GpuSkinning::setPose(int skin, const vector<glm::mat4>& jointTransforms)
+{
+	Skin& target = this->skins[skin];
+	for (size_t i = 0; i < target.skinJoints.size(); i++)
+	{
+		int joint = target.skinJoints[i];
+		if (joint < 0 || joint >= (int)jointTransforms.size())
+		{
+			throw runtime_error("Failed to set pose, skin references joint outside of skeleton.");
+		}
+		target.skinMatrices[i] = jointTransforms[joint] * target.inverseBindMatrices[i];
+	}
+}
+
+void GpuSkinning::getBounds(int skin, glm::vec3* center, float* radius)
+{
+	const Skin& source = this->skins[skin];
+
+	// Box around posed spheres gives center, radius then covers the farthest sphere
+	vector<glm::vec4> spheres;
+	spheres.reserve(source.jointBounds.size() + 1);
+	for (size_t i = 0; i < source.jointBounds.size(); i++)
+	{
+		const glm::vec4& bounds = source.jointBounds[i];
+		if (bounds.w < 0.0f)
+		{
+			continue;
+		}
+
+		const glm::mat4& matrix = source.skinMatrices[i];
+		float scale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+		spheres.push_back(glm::vec4(glm::vec3(matrix * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w * scale));
+	}
+	if (source.staticBounds.w >= 0.0f)
+	{
+		spheres.push_back(source.staticBounds);
+	}
+
+	if (spheres.empty())
+	{
+		*center = glm::vec3(0.0f);
+		*radius = 0.0f;
+		return;
+	}
+
+	glm::vec3 boxMin = glm::vec3(FLT_MAX);
+	glm::vec3 boxMax = glm::vec3(-FLT_MAX);
+	for (const auto& sphere : spheres)
+	{
+		boxMin = glm::min(boxMin, glm::vec3(sphere) - sphere.w);
+		boxMax = glm::max(boxMax, glm::vec3(sphere) + sphere.w);
+	}
+
+	*center = (boxMin + boxMax) * 0.5f;
+	*radius = 0.0f;
+	for (const auto& sphere : spheres)
+	{
+		*radius = std::max(*radius, glm::length(glm::vec3(sphere) - *center) + sphere.w);
+	}
+}
+
+void GpuSkinning::beginFrame(uint32_t frameIndex)
+{
+	this->frameIndex = frameIndex;
+	this->drawSkins.clear();
+	this->drawParams.clear();
+}
+
+int32_t GpuSkinning::addDraw(int skin)
+{
+	const Skin& source = this->skins[skin];
+	uint32_t firstMatrix = this->drawParams.empty() ? 0 : this->drawParams.back().firstMatrix
+		+ static_cast<uint32_t>(this->skins[this->drawSkins.back()].skinMatrices.size());
+	if (firstMatrix + source.skinMatrices.size() > MAX_SKIN_MATRICES)
+	{
+		throw runtime_error("Too many skin matrices to draw, raise MAX_SKIN_MATRICES.");
+	}
+
+	SkinParams params = {};
+	params.firstVertex = source.firstVertex;
+	params.vertexCount = source.vertexCount;
+	params.outputVertex = this->frameIndex * MAX_SKINNED_VERTICES + source.firstVertex;
+	params.firstMatrix = firstMatrix;
+
+	this->drawSkins.push_back(skin);
+	this->drawParams.push_back(params);
+	return static_cast<int32_t>(params.outputVertex);
+}
+
+void GpuSkinning::endFrame()
+{
+	if (this->drawSkins.empty())
+	{
+		return;
+	}
+
+	// Whole range is allocated, descriptor range covers MAX_SKIN_MATRICES matrices from the dynamic offset
+	RingAllocation allocation = this->uniformRing->allocate(MAX_SKIN_MATRICES * sizeof(glm::mat4));
+	glm::mat4* matrices = static_cast<glm::mat4*>(allocation.data);
+	this->matrixOffset = allocation.offset;
+
+	for (size_t i = 0; i < this->drawSkins.size(); i++)
+	{
+		const Skin& skin = this->skins[this->drawSkins[i]];
+		memcpy(matrices + this->drawParams[i].firstMatrix, skin.skinMatrices.data(), skin.skinMatrices.size() * sizeof(glm::mat4));
+	}
+}
+
+int GpuSkinning::getDrawCount()
+{
+	return static_cast<int>(this->drawSkins.size());
+}
+
+SkinnedStreams GpuSkinning::addSkinningPass(RenderGraph& renderGraph)
+{
+	SkinnedStreams streams = {};
+	streams.vertices = renderGraph.importBuffer("skinnedVertices", this->vertexBuffer);
+	streams.positions = renderGraph.importBuffer("skinnedPositions", this->positionBuffer);
+
+	// Each frame in flight writes its own slice, so no earlier frame's draws can still be reading it
+	RenderGraphPass& pass = renderGraph.addComputePass("skinning");
+	pass.writeStorage(streams.vertices);
+	pass.writeStorage(streams.positions);
+	pass.setExecute([this](VkCommandBuffer commandBuffer)
+	{
+		// Pipeline is requested every frame, so it follows reloads of skinning shader
+		VkPipeline pipeline = this->pipelineManager->getComputePipeline(this->skinningShader, this->pipelineLayout);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+		uint32_t dynamicOffsets[] = { this->matrixOffset, 0, 0, 0 };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSet, 4, dynamicOffsets);
+
+		for (const auto& params : this->drawParams)
+		{
+			vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinParams), &params);
+			vkCmdDispatch(commandBuffer, (params.vertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, 1, 1);
+		}
+	});
+
+	return streams;
+}
+
+VkBuffer GpuSkinning::getVertexBuffer()
+{
+	return this->vertexBuffer;
+}
+
+VkBuffer GpuSkinning::getPositionBuffer()
+{
+	return this->positionBuffer;
+}
+
+void GpuSkinning::uploadToBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(this->physicalDevice, this->logicalDevice, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+
+	void* mapped;
+	vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, size, 0, &mapped);
+	memcpy(mapped, data, (size_t)size);
+	vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+
+	copyBuffer(this->logicalDevice, this->transferQueue, this->transferCommandPool, stagingBuffer, buffer, size, offset);
+
+	vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, stagingBufferMemory, nullptr);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cfloat>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "UniformRingAllocator.h"
+#include "PipelineManager.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "RenderGraph.h"
+#include "FrameScheduler.h"
+#include "VkMesh.h"
+
+// Limits of GPU skinning (must match shaders/skinning.comp)
+#define MAX_SKINNED_VERTICES		262144		// bind pose vertices of all skins (output buffers hold this many per frame in flight)
+#define MAX_SKIN_MATRICES			2048		// skin matrices of all skins drawn in one frame
+#define SKINNING_GROUP_SIZE			64			// local size of skinning shader
+
+// Skinning output of the frame, read as vertex buffers by every pass drawing skinned meshes
+struct SkinnedStreams
+{
+	RenderGraphResource vertices;				// whole Vertex stream
+	RenderGraphResource positions;				// position stream of depth only passes
+};
+
+// Skins meshes once per frame in a compute pass. Output has the layout of regular vertex streams, so depth, shadow
+// and color passes draw skinned meshes with their usual pipelines (each frame in flight writes its own output slice).
+class GpuSkinning
+{
+
+public:
+	GpuSkinning();
+	~GpuSkinning();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+		const string& skinningShader, ShaderCompiler* shaderCompiler, PipelineManager* pipelineManager,
+		DescriptorLayoutCache* layoutCache, DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing);
+	void cleanup();
+
+	// Uploads bind pose and influences of mesh, returns skin index
+	int addSkin(const vector<Vertex>& vertices, const vector<glm::uvec4>& jointIndices, const vector<glm::vec4>& jointWeights,
+		const vector<int>& skinJoints, const vector<glm::mat4>& inverseBindMatrices);
+	// Model space transforms of all skeleton joints (skin picks its joints)
+	void setPose(int skin, const vector<glm::mat4>& jointTransforms);
+	// Bounding sphere of current pose in mesh space
+	void getBounds(int skin, glm::vec3* center, float* radius);
+
+	// Starts new frame's skin list
+	void beginFrame(uint32_t frameIndex);
+	// Queues skin for this frame, returns index of its first vertex in output streams
+	int32_t addDraw(int skin);
+	// Uploads skin matrices of queued skins to uniform ring
+	void endFrame();
+	int getDrawCount();
+
+	// Declares skinning pass, returned streams have to be read by passes drawing skinned meshes
+	SkinnedStreams addSkinningPass(RenderGraph& renderGraph);
+
+	VkBuffer getVertexBuffer();
+	VkBuffer getPositionBuffer();
+
+private:
+	// std430 layout of BindPose vertices in skinning shader
+	struct SkinVertex
+	{
+		glm::vec4 position;
+		glm::vec4 normal;
+		glm::uvec4 joints;
+		glm::vec4 weights;
+	};
+
+	// Must match SkinParams push constant block of skinning shader
+	struct SkinParams
+	{
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint32_t outputVertex;
+		uint32_t firstMatrix;
+	};
+
+	struct Skin
+	{
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		vector<int> skinJoints;
+		vector<glm::mat4> inverseBindMatrices;
+		vector<glm::vec4> jointBounds;			// sphere of vertices each joint influences (bind pose, radius < 0 if none)
+		glm::vec4 staticBounds;					// sphere of vertices without influences (mesh space, radius < 0 if none)
+		vector<glm::mat4> skinMatrices;			// current pose (bind pose until first setPose)
+	};
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice logicalDevice;
+	VkQueue transferQueue;
+	VkCommandPool transferCommandPool;
+	PipelineManager* pipelineManager;
+	UniformRingAllocator* uniformRing;
+	string skinningShader;
+
+	// Bind pose of all skins, appended on upload
+	VkBuffer bindPoseBuffer;
+	VkDeviceMemory bindPoseBufferMemory;
+	uint32_t vertexCount;
+
+	// Skinned vertices, one slice of MAX_SKINNED_VERTICES per frame in flight
+	VkBuffer vertexBuffer;
+	VkDeviceMemory vertexBufferMemory;
+	VkBuffer positionBuffer;
+	VkDeviceMemory positionBufferMemory;
+
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSet descriptorSet;
+
+	vector<Skin> skins;
+
+	// Current frame
+	uint32_t frameIndex;
+	vector<int> drawSkins;
+	vector<SkinParams> drawParams;
+	uint32_t matrixOffset;						// dynamic offset of skin matrices
+
+	void uploadToBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+};
@@ -0,0 +1,329 @@
+#include "ImpostorBaker.h"
+
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+ImpostorBaker::ImpostorBaker()
+{
+	this->physicalDevice = VK_NULL_HANDLE;
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->graphicsQueue = VK_NULL_HANDLE;
+	this->graphicsCommandPool = VK_NULL_HANDLE;
+	this->depthFormat = VK_FORMAT_UNDEFINED;
+	this->pipelineManager = nullptr;
+	this->bakePipelineLayout = VK_NULL_HANDLE;
+	this->bakePushConstantStages = 0;
+}
+
+ImpostorBaker::~ImpostorBaker()
+{
+}
+
+void ImpostorBaker::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue graphicsQueue, VkCommandPool graphicsCommandPool,
+	VkFormat depthFormat, const string& bakeVertexShader, const string& bakeFragmentShader, uint32_t maxBindlessTextures,
+	ShaderCompiler* shaderCompiler, PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache)
+{
+	this->physicalDevice = physicalDevice;
+	this->logicalDevice = logicalDevice;
+	this->graphicsQueue = graphicsQueue;
+	this->graphicsCommandPool = graphicsCommandPool;
+	this->depthFormat = depthFormat;
+	this->pipelineManager = pipelineManager;
+
+	// Bakes are waited for, so graph can destroy replaced transients right away (no frame scheduler)
+	this->bakeGraph.init(physicalDevice, logicalDevice, nullptr);
+
+	// BAKE LAYOUT
+	// Texture set is reflected with renderer's bindless size, so layout cache hands out renderer's set layout and its set can be bound
+	ShaderReflection reflection = ShaderReflection::merge({
+		ShaderReflection::reflect(shaderCompiler->compile(bakeVertexShader)),
+		ShaderReflection::reflect(shaderCompiler->compile(bakeFragmentShader)) });
+
+	LayoutOverrides overrides = {};
+	overrides.maxRuntimeArraySize = maxBindlessTextures;
+
+	vector<VkDescriptorSetLayout> setLayouts;
+	this->bakePipelineLayout = layoutCache->getReflectedLayout(reflection, overrides, &setLayouts);
+	if (setLayouts.size() < 2)
+	{
+		throw runtime_error("Failed to create impostor bake layout, bake shaders must use texture set 1.");
+	}
+	this->bakePushConstantStages = reflection.pushConstantRange.stageFlags;
+
+	// BAKE PIPELINE STATE
+	// Regular mesh vertices, render pass is known once bake graph is compiled
+	VertexLayout vertexLayout = {};
+	vertexLayout.stride = sizeof(Vertex);
+	vertexLayout.attributes = {
+		{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) },
+		{ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) },
+		{ 2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) },
+		{ 3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) }
+	};
+
+	this->bakePipelineState.vertexShader = bakeVertexShader;
+	this->bakePipelineState.fragmentShader = bakeFragmentShader;
+	this->bakePipelineState.vertexLayout = vertexLayout;
+	this->bakePipelineState.cullMode = VK_CULL_MODE_NONE;
+	this->bakePipelineState.colorAttachmentCount = 2;
+	this->bakePipelineState.depthCompareOp = VK_COMPARE_OP_LESS;
+	this->bakePipelineState.layout = this->bakePipelineLayout;
+	this->bakePipelineState.specializationConstants = { MATERIAL_VARIANT_GENERIC };
+}
+
+void ImpostorBaker::cleanup()
+{
+	// Layout is owned by layout cache, pipeline by pipeline manager, render pass and depth by bake graph
+	if (this->logicalDevice == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	this->bakeGraph.cleanup();
+	for (auto& impostor : this->impostors)
+	{
+		vkDestroyImageView(this->logicalDevice, impostor.albedoImageView, nullptr);
+		vkDestroyImage(this->logicalDevice, impostor.albedoImage, nullptr);
+		vkFreeMemory(this->logicalDevice, impostor.albedoImageMemory, nullptr);
+		vkDestroyImageView(this->logicalDevice, impostor.normalImageView, nullptr);
+		vkDestroyImage(this->logicalDevice, impostor.normalImage, nullptr);
+		vkFreeMemory(this->logicalDevice, impostor.normalImageMemory, nullptr);
+	}
+	this->impostors.clear();
+	this->logicalDevice = VK_NULL_HANDLE;
+}
+
+int ImpostorBaker::bake(const vector<VkMesh*>& meshes, VkDescriptorSet bindlessDescriptorSet)
+{
+	if (meshes.empty())
+	{
+		throw runtime_error("Failed to bake impostor, model has no meshes.");
+	}
+
+	// Sphere around bounding spheres of all meshes, grown one mesh at a time
+	Impostor impostor = {};
+	impostor.center = meshes[0]->getBoundsCenter();
+	impostor.radius = meshes[0]->getBoundsRadius();
+	for (size_t i = 1; i < meshes.size(); i++)
+	{
+		glm::vec3 center = meshes[i]->getBoundsCenter();
+		float radius = meshes[i]->getBoundsRadius();
+		float distance = glm::length(center - impostor.center);
+		if (distance + radius <= impostor.radius)
+		{
+			continue;
+		}
+		if (distance + impostor.radius <= radius)
+		{
+			impostor.center = center;
+			impostor.radius = radius;
+			continue;
+		}
+		float grownRadius = (distance + impostor.radius + radius) * 0.5f;
+		impostor.center += (center - impostor.center) * ((grownRadius - impostor.radius) / distance);
+		impostor.radius = grownRadius;
+	}
+	impostor.albedoTexture = -1;
+	impostor.normalTexture = -1;
+
+	createAtlasImage(IMPOSTOR_ALBEDO_FORMAT, &impostor.albedoImage, &impostor.albedoImageMemory, &impostor.albedoImageView);
+	createAtlasImage(IMPOSTOR_NORMAL_FORMAT, &impostor.normalImage, &impostor.normalImageMemory, &impostor.normalImageView);
+
+	// Views are rendered straight into atlases, graph leaves them ready for sampling (depth is graph's transient)
+	this->bakeGraph.reset();
+
+	RenderGraphImageDesc atlasDesc = {};
+	atlasDesc.format = IMPOSTOR_ALBEDO_FORMAT;
+	atlasDesc.extent = { IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE };
+	RenderGraphResource albedo = this->bakeGraph.importImage("impostorAlbedo", impostor.albedoImage, impostor.albedoImageView, atlasDesc,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	atlasDesc.format = IMPOSTOR_NORMAL_FORMAT;
+	RenderGraphResource normal = this->bakeGraph.importImage("impostorNormal", impostor.normalImage, impostor.normalImageView, atlasDesc,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	RenderGraphImageDesc depthDesc = {};
+	depthDesc.format = this->depthFormat;
+	depthDesc.extent = { IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE };
+	RenderGraphResource depth = this->bakeGraph.createImage("impostorDepth", depthDesc);
+
+	// Texels no view covers stay transparent (alpha is coverage)
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	RenderGraphPass& bakePass = this->bakeGraph.addGraphicsPass("impostorBake");
+	bakePass.writeColor(albedo, { 0.0f, 0.0f, 0.0f, 0.0f });
+	bakePass.writeColor(normal, { 0.5f, 0.5f, 0.5f, 0.0f });
+	bakePass.writeDepth(depth, 1.0f);
+	bakePass.setExecute([this, &pipeline, &meshes, bindlessDescriptorSet, &impostor](VkCommandBuffer commandBuffer)
+	{
+		recordBake(commandBuffer, pipeline, meshes, bindlessDescriptorSet, impostor.center, impostor.radius);
+	});
+	this->bakeGraph.compile();
+
+	// Every bake compiles to the same cached render pass, so only the first bake creates the pipeline
+	this->bakePipelineState.renderPass = this->bakeGraph.getRenderPass("impostorBake");
+	pipeline = this->pipelineManager->getPipelineBlocking(this->bakePipelineState);
+
+	// Models are added outside of frames, bake is submitted right away like mesh uploads
+	VkCommandBuffer commandBuffer = beginCommandBuffer(this->logicalDevice, this->graphicsCommandPool);
+	this->bakeGraph.execute(commandBuffer);
+	endAndSubmitCommandBuffer(this->logicalDevice, this->graphicsCommandPool, this->graphicsQueue, commandBuffer);
+
+	this->impostors.push_back(impostor);
+	return static_cast<int>(this->impostors.size()) - 1;
+}
+
+VkImageView ImpostorBaker::getAlbedoView(int impostor)
+{
+	return this->impostors[impostor].albedoImageView;
+}
+
+VkImageView ImpostorBaker::getNormalView(int impostor)
+{
+	return this->impostors[impostor].normalImageView;
+}
+
+void ImpostorBaker::setTextures(int impostor, int albedoTexture, int normalTexture)
+{
+	this->impostors[impostor].albedoTexture = albedoTexture;
+	this->impostors[impostor].normalTexture = normalTexture;
+}
+
+void ImpostorBaker::getBounds(int impostor, glm::vec3* center, float* radius)
+{
+	*center = this->impostors[impostor].center;
+	*radius = this->impostors[impostor].radius;
+}
+
+void ImpostorBaker::recordDraw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkShaderStageFlags pushConstantStages,
+	const ImpostorDraw& draw)
+{
+	const Impostor& impostor = this->impostors[draw.impostor];
+
+	ImpostorParams params = {};
+	params.bounds = glm::vec4(impostor.center, impostor.radius);
+	params.albedoTexture = impostor.albedoTexture;
+	params.normalTexture = impostor.normalTexture;
+	vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, 0, sizeof(ImpostorParams), &params);
+
+	// Two triangles built from vertex index, object data is selected by first instance like in regular draws
+	vkCmdDraw(commandBuffer, 6, 1, 0, draw.objectIndex);
+}
+
+void ImpostorBaker::recordBake(VkCommandBuffer commandBuffer, VkPipeline pipeline, const vector<VkMesh*>& meshes,
+	VkDescriptorSet bindlessDescriptorSet, glm::vec3 center, float radius)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->bakePipelineLayout,
+		1, 1, &bindlessDescriptorSet, 0, nullptr);
+
+	// Views keep one empty texel at their borders, so filtering never pulls in neighbouring views
+	float extent = radius * IMPOSTOR_CELL_SIZE / (IMPOSTOR_CELL_SIZE - 2.0f);
+
+	for (uint32_t cellY = 0; cellY < IMPOSTOR_GRID_SIZE; cellY++)
+	{
+		for (uint32_t cellX = 0; cellX < IMPOSTOR_GRID_SIZE; cellX++)
+		{
+			// Orthographic camera outside of bounds looking at their center (up axis switches near the poles)
+			glm::vec3 direction = getViewDirection(cellX, cellY);
+			glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+			glm::mat4 view = glm::lookAt(center + direction * (2.0f * radius), center, up);
+			glm::mat4 projection = glm::orthoRH_ZO(-extent, extent, -extent, extent, 0.5f * radius, 3.5f * radius);
+			projection[1][1] *= -1;				// up is at the top of the cell, as in renderer's projection
+
+			VkViewport viewport = {};
+			viewport.x = (float)(cellX * IMPOSTOR_CELL_SIZE);
+			viewport.y = (float)(cellY * IMPOSTOR_CELL_SIZE);
+			viewport.width = (float)IMPOSTOR_CELL_SIZE;
+			viewport.height = (float)IMPOSTOR_CELL_SIZE;
+			viewport.minDepth = 0.0f;
+			viewport.maxDepth = 1.0f;
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+			VkRect2D scissor = {};
+			scissor.offset = { (int32_t)(cellX * IMPOSTOR_CELL_SIZE), (int32_t)(cellY * IMPOSTOR_CELL_SIZE) };
+			scissor.extent = { IMPOSTOR_CELL_SIZE, IMPOSTOR_CELL_SIZE };
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+			for (VkMesh* mesh : meshes)
+			{
+				BakeParams params = {};
+				params.textureIndex = mesh->getTextureIndex();
+				params.viewProjection = projection * view;
+				vkCmdPushConstants(commandBuffer, this->bakePipelineLayout, this->bakePushConstantStages, 0, sizeof(BakeParams), &params);
+
+				VkBuffer vertexBuffer = mesh->getVertexBuffer();
+				VkDeviceSize offset = 0;
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+				vkCmdBindIndexBuffer(commandBuffer, mesh->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh->getIndexCount()), 1, 0, -MESH_INDEX_BASE, 0);
+			}
+		}
+	}
+}
+
+void ImpostorBaker::createAtlasImage(VkFormat format, VkImage* image, VkDeviceMemory* imageMemory, VkImageView* imageView)
+{
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.extent = { IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE, 1 };
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.format = format;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateImage(this->logicalDevice, &imageCreateInfo, nullptr, image);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create impostor atlas Image.");
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(this->logicalDevice, *image, &memoryRequirements);
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = memoryRequirements.size;
+	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(this->physicalDevice, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	result = vkAllocateMemory(this->logicalDevice, &memoryAllocInfo, nullptr, imageMemory);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to allocate memory for impostor atlas.");
+	}
+	vkBindImageMemory(this->logicalDevice, *image, *imageMemory, 0);
+
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = *image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = format;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(this->logicalDevice, &viewCreateInfo, nullptr, imageView);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create impostor atlas Image View.");
+	}
+}
+
+glm::vec3 ImpostorBaker::getViewDirection(uint32_t cellX, uint32_t cellY)
+{
+	// Cell center in -1..1, lower half of octahedron is folded over the diagonals
+	glm::vec2 encoded = (glm::vec2((float)cellX, (float)cellY) + 0.5f) / (float)IMPOSTOR_GRID_SIZE * 2.0f - 1.0f;
+	glm::vec3 direction(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+	if (direction.z < 0.0f)
+	{
+		float x = direction.x;
+		direction.x = (1.0f - std::fabs(direction.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		direction.y = (1.0f - std::fabs(x)) * (direction.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(direction);
+}
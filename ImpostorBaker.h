@@ -0,0 +1,111 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "DescriptorLayoutCache.h"
+#include "PipelineManager.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "RenderGraph.h"
+#include "VkMesh.h"
+
+// Atlas layout of baked impostors (must match shaders/impostor.glsl)
+#define IMPOSTOR_GRID_SIZE			8			// views per atlas side, view directions are octahedral map of the sphere
+#define IMPOSTOR_CELL_SIZE			64			// pixels of one view
+#define IMPOSTOR_ATLAS_SIZE			(IMPOSTOR_GRID_SIZE * IMPOSTOR_CELL_SIZE)
+#define IMPOSTOR_ALBEDO_FORMAT		VK_FORMAT_R8G8B8A8_UNORM				// base color, alpha is coverage
+#define IMPOSTOR_NORMAL_FORMAT		VK_FORMAT_A2B10G10R10_UNORM_PACK32		// model space normal mapped to 0..1
+
+// Impostor drawn in place of a model this frame
+struct ImpostorDraw
+{
+	int impostor;
+	uint32_t objectIndex;						// object data of the model (gives its transform)
+	float viewDepth;
+};
+
+// Renders static models from IMPOSTOR_GRID_SIZE^2 directions into per model atlases of base color and normal.
+// Bakes run through an offscreen render graph of their own (its render pass is compiled once and reused by every
+// bake), the model is then drawn as one camera facing quad showing the view nearest to the camera direction
+class ImpostorBaker
+{
+
+public:
+	ImpostorBaker();
+	~ImpostorBaker();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue graphicsQueue, VkCommandPool graphicsCommandPool,
+		VkFormat depthFormat, const string& bakeVertexShader, const string& bakeFragmentShader, uint32_t maxBindlessTextures,
+		ShaderCompiler* shaderCompiler, PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache);
+	void cleanup();
+
+	// Bakes meshes of one model (mesh space is model space), textured meshes sample renderer's bindless set. Returns impostor index
+	int bake(const vector<VkMesh*>& meshes, VkDescriptorSet bindlessDescriptorSet);
+	// Atlases are sampled through renderer's bindless array, renderer registers views and passes their slots back
+	VkImageView getAlbedoView(int impostor);
+	VkImageView getNormalView(int impostor);
+	void setTextures(int impostor, int albedoTexture, int normalTexture);
+	// Bounding sphere the views were baked around (model space)
+	void getBounds(int impostor, glm::vec3* center, float* radius);
+
+	// Draws quad of impostor (impostor pipeline and scene sets are bound by caller), push constant range holds PushImpostor
+	void recordDraw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkShaderStageFlags pushConstantStages,
+		const ImpostorDraw& draw);
+
+private:
+	// Must match PushBake block of shaders/impostor_bake.vert (texture index first, it is PushModel of material.glsl)
+	struct BakeParams
+	{
+		int32_t textureIndex;
+		int32_t padding[3];
+		glm::mat4 viewProjection;
+	};
+
+	// Must match PushImpostor block of shaders/impostor.glsl
+	struct ImpostorParams
+	{
+		glm::vec4 bounds;						// xyz: center, w: radius
+		int32_t albedoTexture;
+		int32_t normalTexture;
+	};
+
+	struct Impostor
+	{
+		VkImage albedoImage;
+		VkDeviceMemory albedoImageMemory;
+		VkImageView albedoImageView;
+		VkImage normalImage;
+		VkDeviceMemory normalImageMemory;
+		VkImageView normalImageView;
+		glm::vec3 center;
+		float radius;
+		int albedoTexture;
+		int normalTexture;
+	};
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice logicalDevice;
+	VkQueue graphicsQueue;
+	VkCommandPool graphicsCommandPool;
+	VkFormat depthFormat;
+	PipelineManager* pipelineManager;
+
+	RenderGraph bakeGraph;
+	PipelineState bakePipelineState;
+	VkPipelineLayout bakePipelineLayout;
+	VkShaderStageFlags bakePushConstantStages;
+
+	vector<Impostor> impostors;
+
+	void recordBake(VkCommandBuffer commandBuffer, VkPipeline pipeline, const vector<VkMesh*>& meshes,
+		VkDescriptorSet bindlessDescriptorSet, glm::vec3 center, float radius);
+	void createAtlasImage(VkFormat format, VkImage* image, VkDeviceMemory* imageMemory, VkImageView* imageView);
+
+	// Direction from model towards camera of view cell (x, y), same mapping as shaders/impostor.glsl
+	static glm::vec3 getViewDirection(uint32_t cellX, uint32_t cellY);
+};
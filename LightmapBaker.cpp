@@ -0,0 +1,951 @@
+#include "LightmapBaker.h"
+#include "VkMesh.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <glm/gtc/constants.hpp>
+
+#define LIGHTMAP_NORMAL_POWER		32.0f		// denoiser's normal edge stopping exponent
+#define LIGHTMAP_DILATION_PASSES	(LIGHTMAP_CHART_PADDING + 2)	// fills padding and chart texels whose centers no triangle covers
+#define LIGHTMAP_PACKING_ATTEMPTS	16
+#define LIGHTMAP_COVERAGE_EPSILON	0.0001f		// texel centers on triangle edges belong to the triangle
+
+// Integer hash (lowbias32), seeds random sequences of texels
+static uint32_t hashValue(uint32_t value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= value >> 15;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+// Uniform float in [0, 1), advances state
+static float nextRandom(uint32_t* state)
+{
+	*state = hashValue(*state + 0x9e3779b9u);
+	return (float)(*state >> 8) * (1.0f / 16777216.0f);
+}
+
+// Cosine weighted direction around normal
+static glm::vec3 sampleHemisphere(const glm::vec3& normal, uint32_t* state)
+{
+	// Orthonormal basis around normal (Duff et al.)
+	float sign = copysignf(1.0f, normal.z);
+	float a = -1.0f / (sign + normal.z);
+	float b = normal.x * normal.y * a;
+	glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+	glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+
+	float u = nextRandom(state);
+	float radius = sqrtf(u);
+	float angle = 2.0f * glm::pi<float>() * nextRandom(state);
+	return tangent * (radius * cosf(angle)) + bitangent * (radius * sinf(angle)) + normal * sqrtf(std::max(0.0f, 1.0f - u));
+}
+
+// Runs work on threadCount threads (calling thread is worker 0) and waits for all of them
+static void runWorkers(uint32_t threadCount, const function<void(uint32_t)>& work)
+{
+	vector<thread> workers;
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		workers.push_back(thread(work, i));
+	}
+	work(0);
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+// Tiles are dealt to workers in contiguous runs (neighbouring texels trace through the same BVH nodes), workers take
+// tiles from the front of their own queue and steal from the back of other queues once theirs runs dry. No tile is
+// added while baking, so all queues being empty means the bake is done
+class TileScheduler
+{
+
+public:
+	TileScheduler(uint32_t tileCount, uint32_t workerCount)
+	{
+		for (uint32_t i = 0; i < workerCount; i++)
+		{
+			this->queues.push_back(unique_ptr<Queue>(new Queue()));
+		}
+		for (uint32_t tile = 0; tile < tileCount; tile++)
+		{
+			this->queues[(uint64_t)tile * workerCount / tileCount]->tiles.push_back(tile);
+		}
+	}
+
+	bool next(uint32_t worker, uint32_t* tile)
+	{
+		{
+			Queue& own = *this->queues[worker];
+			lock_guard<mutex> lock(own.lock);
+			if (!own.tiles.empty())
+			{
+				*tile = own.tiles.front();
+				own.tiles.pop_front();
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < this->queues.size(); i++)
+		{
+			Queue& victim = *this->queues[(worker + i) % this->queues.size()];
+			lock_guard<mutex> lock(victim.lock);
+			if (!victim.tiles.empty())
+			{
+				*tile = victim.tiles.back();
+				victim.tiles.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	struct Queue
+	{
+		mutex lock;
+		deque<uint32_t> tiles;
+	};
+
+	vector<unique_ptr<Queue>> queues;
+};
+
+LightmapStats LightmapBaker::bake(Mesh* meshes, int meshCount, const LightmapSettings& settings)
+{
+	LightmapStats stats = {};
+	if (meshCount <= 0)
+	{
+		return stats;
+	}
+
+	// Texel density and ray offsets follow model size
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	for (int i = 0; i < meshCount; i++)
+	{
+		for (const auto& position : meshes[i].getVertices())
+		{
+			boundsMin = glm::min(boundsMin, position);
+			boundsMax = glm::max(boundsMax, position);
+		}
+	}
+	float diagonal = glm::length(boundsMax - boundsMin);
+	if (!(diagonal > 0.0f))
+	{
+		return stats;
+	}
+	float texelsPerUnit = settings.texelsPerUnit > 0.0f ? settings.texelsPerUnit : LIGHTMAP_DIAGONAL_TEXELS / diagonal;
+	float bias = diagonal * LIGHTMAP_BIAS_SCALE;
+
+	// CHARTS
+	// UVs come first, splitting vertices at seams changes meshes
+	vector<Target> targets;
+	for (int i = 0; i < meshCount; i++)
+	{
+		if (meshes[i].hasSkin())
+		{
+			continue;
+		}
+
+		Target target = {};
+		target.mesh = i;
+		uint32_t chartCount = 0;
+		if (!generateUvs(&meshes[i], texelsPerUnit, &target, &chartCount))
+		{
+			continue;
+		}
+		rasterizeTexels(&meshes[i], &target);
+		stats.chartCount += chartCount;
+		targets.push_back(std::move(target));
+	}
+	if (targets.empty())
+	{
+		return stats;
+	}
+
+	// Every mesh occludes and reflects light (skinned ones in bind pose)
+	TriangleBvh bvh;
+	for (int i = 0; i < meshCount; i++)
+	{
+		bvh.addTriangles(meshes[i].getVertices(), meshes[i].getIndices(), MESH_INDEX_BASE, glm::mat4(1.0f));
+	}
+	bvh.build();
+
+	LightmapSettings traceSettings = settings;
+	traceSettings.sunDirection = glm::normalize(settings.sunDirection);
+	uint32_t sampleCount = std::max(1u, (settings.sampleCount + BVH_PACKET_SIZE - 1) / BVH_PACKET_SIZE) * BVH_PACKET_SIZE;
+
+	// TRACE
+	struct Tile
+	{
+		uint32_t target;
+		uint32_t x;
+		uint32_t y;
+	};
+	vector<Tile> tiles;
+	for (uint32_t t = 0; t < targets.size(); t++)
+	{
+		for (uint32_t y = 0; y < targets[t].height; y += LIGHTMAP_TILE_SIZE)
+		{
+			for (uint32_t x = 0; x < targets[t].width; x += LIGHTMAP_TILE_SIZE)
+			{
+				tiles.push_back({ t, x, y });
+			}
+		}
+	}
+
+	uint32_t threadCount = settings.threadCount > 0 ? settings.threadCount : std::max(1u, thread::hardware_concurrency());
+	threadCount = std::min(threadCount, static_cast<uint32_t>(tiles.size()));
+	TileScheduler scheduler(static_cast<uint32_t>(tiles.size()), threadCount);
+	std::atomic<uint64_t> rayCount(0);
+	runWorkers(threadCount, [&](uint32_t worker)
+	{
+		uint64_t workerRays = 0;
+		uint32_t tileIndex;
+		while (scheduler.next(worker, &tileIndex))
+		{
+			const Tile& tile = tiles[tileIndex];
+			Target& target = targets[tile.target];
+			uint32_t meshSeed = hashValue(settings.seed + hashValue(static_cast<uint32_t>(target.mesh)));
+			uint32_t lastY = std::min(target.height, tile.y + LIGHTMAP_TILE_SIZE);
+			uint32_t lastX = std::min(target.width, tile.x + LIGHTMAP_TILE_SIZE);
+			for (uint32_t y = tile.y; y < lastY; y++)
+			{
+				for (uint32_t x = tile.x; x < lastX; x++)
+				{
+					uint32_t index = y * target.width + x;
+					if (target.texels[index].chart < 0)
+					{
+						continue;
+					}
+					workerRays += traceTexel(bvh, target.texels[index], hashValue(meshSeed ^ index), traceSettings, sampleCount, bias,
+						&target.direct[index], &target.indirect[index]);
+				}
+			}
+		}
+		rayCount += workerRays;
+	});
+	stats.rayCount = rayCount;
+
+	// DENOISE AND COMPRESS
+	for (auto& target : targets)
+	{
+		denoise(&target, threadCount);
+
+		vector<glm::vec3> irradiance(target.texels.size());
+		for (size_t i = 0; i < irradiance.size(); i++)
+		{
+			irradiance[i] = target.direct[i] + target.indirect[i];
+			stats.texelCount += target.texels[i].chart >= 0 ? 1 : 0;
+		}
+		dilate(target, &irradiance);
+		meshes[target.mesh].setLightmap(compress(target, irradiance));
+		stats.lightmapCount++;
+	}
+
+	return stats;
+}
+
+vector<uint8_t> LightmapBaker::decodeBlocks(const MeshLightmap& lightmap)
+{
+	vector<uint8_t> texels((size_t)lightmap.width * lightmap.height * 4);
+	uint32_t blocksX = lightmap.width / 4;
+	uint32_t blocksY = lightmap.height / 4;
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			const uint8_t* block = &lightmap.blocks[((size_t)by * blocksX + bx) * 8];
+			uint16_t color0 = (uint16_t)(block[0] | (block[1] << 8));
+			uint16_t color1 = (uint16_t)(block[2] | (block[3] << 8));
+
+			// 565 endpoints expanded to 8 bits, 3 color mode (with black) when color0 <= color1
+			glm::vec3 palette[4];
+			uint16_t endpoints[2] = { color0, color1 };
+			for (int e = 0; e < 2; e++)
+			{
+				uint32_t r = (endpoints[e] >> 11) & 31;
+				uint32_t g = (endpoints[e] >> 5) & 63;
+				uint32_t b = endpoints[e] & 31;
+				palette[e] = glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+			}
+			if (color0 > color1)
+			{
+				palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+				palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+			}
+			else
+			{
+				palette[2] = (palette[0] + palette[1]) * 0.5f;
+				palette[3] = glm::vec3(0.0f);
+			}
+
+			for (uint32_t y = 0; y < 4; y++)
+			{
+				for (uint32_t x = 0; x < 4; x++)
+				{
+					glm::vec3 color = palette[(block[4 + y] >> (2 * x)) & 3];
+					uint8_t* texel = &texels[(((size_t)by * 4 + y) * lightmap.width + bx * 4 + x) * 4];
+					texel[0] = (uint8_t)(color.r + 0.5f);
+					texel[1] = (uint8_t)(color.g + 0.5f);
+					texel[2] = (uint8_t)(color.b + 0.5f);
+					texel[3] = 255;
+				}
+			}
+		}
+	}
+	return texels;
+}
+
+bool LightmapBaker::generateUvs(Mesh* mesh, float texelsPerUnit, Target* target, uint32_t* chartCount)
+{
+	auto positions = mesh->getVertices();
+	auto indices = mesh->getIndices();
+	uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return false;
+	}
+	for (uint32_t index : indices)
+	{
+		if (index < MESH_INDEX_BASE || index - MESH_INDEX_BASE >= vertexCount)
+		{
+			throw runtime_error("Failed to generate lightmap UVs, index " + to_string(index) + " is out of vertex range.");
+		}
+	}
+
+	// Triangles are grouped by dominant axis of their normal (6 projection directions)
+	vector<uint8_t> groups(triangleCount);
+	vector<uint32_t> parents(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 a = positions[indices[t * 3] - MESH_INDEX_BASE];
+		glm::vec3 b = positions[indices[t * 3 + 1] - MESH_INDEX_BASE];
+		glm::vec3 c = positions[indices[t * 3 + 2] - MESH_INDEX_BASE];
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		glm::vec3 magnitude = glm::abs(normal);
+		int axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : (magnitude.y >= magnitude.z ? 1 : 2);
+		groups[t] = (uint8_t)(axis * 2 + (normal[axis] < 0.0f ? 1 : 0));
+		parents[t] = t;
+	}
+
+	// CHARTS
+	// Union find over edges shared by triangles of the same group, smaller root wins so charts don't depend on hash order
+	auto findRoot = [&](uint32_t t)
+	{
+		while (parents[t] != t)
+		{
+			parents[t] = parents[parents[t]];
+			t = parents[t];
+		}
+		return t;
+	};
+	unordered_map<uint64_t, uint32_t> edgeTriangles;
+	edgeTriangles.reserve((size_t)triangleCount * 3);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v0 = indices[t * 3 + k];
+			uint32_t v1 = indices[t * 3 + (k + 1) % 3];
+			uint64_t key = ((uint64_t)std::min(v0, v1) << 32) | std::max(v0, v1);
+			auto edge = edgeTriangles.emplace(key, t);
+			if (!edge.second && groups[edge.first->second] == groups[t])
+			{
+				uint32_t rootA = findRoot(t);
+				uint32_t rootB = findRoot(edge.first->second);
+				parents[std::max(rootA, rootB)] = std::min(rootA, rootB);
+			}
+		}
+	}
+
+	// Charts are numbered in order of their first triangle
+	vector<int> rootCharts(triangleCount, -1);
+	target->triangleCharts.resize(triangleCount);
+	uint32_t charts = 0;
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		uint32_t root = findRoot(t);
+		if (rootCharts[root] < 0)
+		{
+			rootCharts[root] = static_cast<int>(charts++);
+		}
+		target->triangleCharts[t] = rootCharts[root];
+	}
+
+	// Charts are projected along their group's axis
+	auto project = [](const glm::vec3& position, int group)
+	{
+		int axis = group / 2;
+		return glm::vec2(position[(axis + 1) % 3], position[(axis + 2) % 3]);
+	};
+	vector<int> chartGroups(charts);
+	vector<glm::vec2> chartMins(charts, glm::vec2(FLT_MAX));
+	vector<glm::vec2> chartMaxs(charts, glm::vec2(-FLT_MAX));
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		int chart = target->triangleCharts[t];
+		chartGroups[chart] = groups[t];
+		for (int k = 0; k < 3; k++)
+		{
+			glm::vec2 uv = project(positions[indices[t * 3 + k] - MESH_INDEX_BASE], groups[t]);
+			chartMins[chart] = glm::min(chartMins[chart], uv);
+			chartMaxs[chart] = glm::max(chartMaxs[chart], uv);
+		}
+	}
+
+	// PACKING
+	// Shelves of charts sorted by height, density drops until atlas fits LIGHTMAP_MAX_SIZE
+	vector<glm::uvec2> boxSizes(charts);
+	vector<glm::uvec2> boxOffsets(charts);
+	vector<uint32_t> order(charts);
+	uint32_t width = 0;
+	uint32_t height = 0;
+	bool packed = false;
+	for (int attempt = 0; attempt < LIGHTMAP_PACKING_ATTEMPTS && !packed; attempt++)
+	{
+		uint64_t totalArea = 0;
+		uint32_t widestBox = 0;
+		for (uint32_t c = 0; c < charts; c++)
+		{
+			glm::vec2 extent = (chartMaxs[c] - chartMins[c]) * texelsPerUnit;
+			boxSizes[c] = glm::uvec2((uint32_t)ceilf(extent.x), (uint32_t)ceilf(extent.y)) + glm::uvec2(1 + 2 * LIGHTMAP_CHART_PADDING);
+			totalArea += (uint64_t)boxSizes[c].x * boxSizes[c].y;
+			widestBox = std::max(widestBox, boxSizes[c].x);
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			return boxSizes[a].y != boxSizes[b].y ? boxSizes[a].y > boxSizes[b].y : boxSizes[a].x > boxSizes[b].x;
+		});
+
+		uint32_t shelfWidth = std::max(widestBox, (uint32_t)ceil(sqrt((double)totalArea) * 1.1));
+		uint32_t x = 0;
+		uint32_t y = 0;
+		uint32_t shelfHeight = 0;
+		for (uint32_t c : order)
+		{
+			if (x + boxSizes[c].x > shelfWidth)
+			{
+				y += shelfHeight;
+				x = 0;
+				shelfHeight = 0;
+			}
+			boxOffsets[c] = glm::uvec2(x, y);
+			x += boxSizes[c].x;
+			shelfHeight = std::max(shelfHeight, boxSizes[c].y);
+		}
+
+		// BC1 blocks are 4x4 texels
+		width = (shelfWidth + 3) & ~3u;
+		height = (y + shelfHeight + 3) & ~3u;
+		packed = width <= LIGHTMAP_MAX_SIZE && height <= LIGHTMAP_MAX_SIZE;
+		if (!packed)
+		{
+			texelsPerUnit *= 0.9f * LIGHTMAP_MAX_SIZE / (float)std::max(width, height);
+		}
+	}
+	if (!packed)
+	{
+		return false;
+	}
+
+	// SEAMS
+	// Vertex gets a copy for every chart it's used by, triangles of one chart are visited together
+	vector<uint32_t> chartFirstTriangle(charts + 1, 0);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		chartFirstTriangle[target->triangleCharts[t] + 1]++;
+	}
+	for (uint32_t c = 0; c < charts; c++)
+	{
+		chartFirstTriangle[c + 1] += chartFirstTriangle[c];
+	}
+	vector<uint32_t> chartTriangles(triangleCount);
+	vector<uint32_t> chartFill(chartFirstTriangle.begin(), chartFirstTriangle.end() - 1);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		chartTriangles[chartFill[target->triangleCharts[t]]++] = t;
+	}
+
+	vector<int> vertexCharts(vertexCount, -1);
+	vector<uint32_t> vertexCopies(vertexCount, 0);
+	vector<uint32_t> sourceVertices;
+	vector<glm::vec2> lightmapUvs;
+	vector<uint32_t> remappedIndices(indices.size());
+	glm::vec2 atlasSize((float)width, (float)height);
+	for (uint32_t c = 0; c < charts; c++)
+	{
+		// Content starts half a texel into the box, so even charts without area cover a texel center
+		glm::vec2 origin = glm::vec2(boxOffsets[c]) + glm::vec2(LIGHTMAP_CHART_PADDING + 0.5f);
+		for (uint32_t i = chartFirstTriangle[c]; i < chartFirstTriangle[c + 1]; i++)
+		{
+			uint32_t t = chartTriangles[i];
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t vertex = indices[t * 3 + k] - MESH_INDEX_BASE;
+				if (vertexCharts[vertex] != (int)c)
+				{
+					vertexCharts[vertex] = (int)c;
+					vertexCopies[vertex] = static_cast<uint32_t>(sourceVertices.size());
+					sourceVertices.push_back(vertex);
+					glm::vec2 texelPosition = origin + (project(positions[vertex], chartGroups[c]) - chartMins[c]) * texelsPerUnit;
+					lightmapUvs.push_back(texelPosition / atlasSize);
+				}
+				remappedIndices[t * 3 + k] = vertexCopies[vertex] + MESH_INDEX_BASE;
+			}
+		}
+	}
+	mesh->remapVertices(sourceVertices, remappedIndices);
+	mesh->setLightmapUvs(lightmapUvs);
+
+	target->width = width;
+	target->height = height;
+	target->texelSize = 1.0f / texelsPerUnit;
+	target->texels.assign((size_t)width * height, { glm::vec3(0.0f), glm::vec3(0.0f), -1 });
+	target->direct.assign(target->texels.size(), glm::vec3(0.0f));
+	target->indirect.assign(target->texels.size(), glm::vec3(0.0f));
+	*chartCount = charts;
+	return true;
+}
+
+void LightmapBaker::rasterizeTexels(Mesh* mesh, Target* target)
+{
+	auto positions = mesh->getVertices();
+	auto normals = mesh->getNormals();
+	auto indices = mesh->getIndices();
+	auto lightmapUvs = mesh->getLightmapUvs();
+	glm::vec2 atlasSize((float)target->width, (float)target->height);
+
+	// Texels whose centers lie inside a triangle (first triangle wins on shared edges)
+	for (size_t t = 0; t * 3 + 2 < indices.size(); t++)
+	{
+		uint32_t vertices[3];
+		glm::vec2 points[3];
+		for (int k = 0; k < 3; k++)
+		{
+			vertices[k] = indices[t * 3 + k] - MESH_INDEX_BASE;
+			points[k] = lightmapUvs[vertices[k]] * atlasSize;
+		}
+		float area = (points[1].x - points[0].x) * (points[2].y - points[0].y) - (points[1].y - points[0].y) * (points[2].x - points[0].x);
+		if (fabsf(area) <= FLT_MIN)
+		{
+			continue;
+		}
+		glm::vec3 faceNormal = glm::normalize(glm::cross(positions[vertices[1]] - positions[vertices[0]], positions[vertices[2]] - positions[vertices[0]]));
+
+		glm::vec2 pointsMin = glm::min(glm::min(points[0], points[1]), points[2]);
+		glm::vec2 pointsMax = glm::max(glm::max(points[0], points[1]), points[2]);
+		uint32_t firstX = (uint32_t)std::max(0.0f, floorf(pointsMin.x));
+		uint32_t firstY = (uint32_t)std::max(0.0f, floorf(pointsMin.y));
+		uint32_t lastX = std::min(target->width - 1, (uint32_t)std::max(0.0f, ceilf(pointsMax.x)));
+		uint32_t lastY = std::min(target->height - 1, (uint32_t)std::max(0.0f, ceilf(pointsMax.y)));
+		for (uint32_t y = firstY; y <= lastY; y++)
+		{
+			for (uint32_t x = firstX; x <= lastX; x++)
+			{
+				Texel& texel = target->texels[(size_t)y * target->width + x];
+				if (texel.chart >= 0)
+				{
+					continue;
+				}
+
+				// Barycentrics from edge functions
+				glm::vec2 center((float)x + 0.5f, (float)y + 0.5f);
+				float w0 = ((points[2].x - points[1].x) * (center.y - points[1].y) - (points[2].y - points[1].y) * (center.x - points[1].x)) / area;
+				float w1 = ((points[0].x - points[2].x) * (center.y - points[2].y) - (points[0].y - points[2].y) * (center.x - points[2].x)) / area;
+				float w2 = 1.0f - w0 - w1;
+				if (w0 < -LIGHTMAP_COVERAGE_EPSILON || w1 < -LIGHTMAP_COVERAGE_EPSILON || w2 < -LIGHTMAP_COVERAGE_EPSILON)
+				{
+					continue;
+				}
+
+				texel.position = positions[vertices[0]] * w0 + positions[vertices[1]] * w1 + positions[vertices[2]] * w2;
+				glm::vec3 normal = normals.empty() ? faceNormal : normals[vertices[0]] * w0 + normals[vertices[1]] * w1 + normals[vertices[2]] * w2;
+				texel.normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : faceNormal;
+				texel.chart = target->triangleCharts[t];
+			}
+		}
+	}
+}
+
+uint32_t LightmapBaker::traceTexel(const TriangleBvh& bvh, const Texel& texel, uint32_t texelSeed, const LightmapSettings& settings,
+	uint32_t sampleCount, float bias, glm::vec3* direct, glm::vec3* indirect)
+{
+	glm::vec3 texelOrigin = texel.position + texel.normal * bias;
+	uint32_t rays = 0;
+
+	// Sun is a single direction, one shadow ray gives exact (noise free) direct light
+	RayPacket shadowPacket = {};
+	float sunCosine = glm::dot(texel.normal, settings.sunDirection);
+	*direct = glm::vec3(0.0f);
+	if (sunCosine > 0.0f)
+	{
+		for (int lane = 0; lane < BVH_PACKET_SIZE; lane++)
+		{
+			shadowPacket.originX[lane] = texelOrigin.x;
+			shadowPacket.originY[lane] = texelOrigin.y;
+			shadowPacket.originZ[lane] = texelOrigin.z;
+			shadowPacket.directionX[lane] = settings.sunDirection.x;
+			shadowPacket.directionY[lane] = settings.sunDirection.y;
+			shadowPacket.directionZ[lane] = settings.sunDirection.z;
+			shadowPacket.maxDistance[lane] = FLT_MAX;
+		}
+		if (bvh.occluded(shadowPacket, 1) == 0)
+		{
+			*direct = settings.sunColor * sunCosine;
+		}
+		rays++;
+	}
+
+	// Paths run in groups of BVH_PACKET_SIZE, so shadow rays of every bounce are traced as one packet. Path value is in
+	// irradiance units: escaped paths add sky, every hit multiplies by albedo and adds sun reaching the hit point
+	glm::vec3 sum(0.0f);
+	for (uint32_t first = 0; first < sampleCount; first += BVH_PACKET_SIZE)
+	{
+		glm::vec3 origins[BVH_PACKET_SIZE];
+		glm::vec3 normals[BVH_PACKET_SIZE];
+		glm::vec3 weights[BVH_PACKET_SIZE];
+		glm::vec3 sunLight[BVH_PACKET_SIZE];
+		uint32_t states[BVH_PACKET_SIZE];
+		uint32_t aliveMask = (1u << BVH_PACKET_SIZE) - 1;
+		for (int lane = 0; lane < BVH_PACKET_SIZE; lane++)
+		{
+			origins[lane] = texelOrigin;
+			normals[lane] = texel.normal;
+			weights[lane] = glm::vec3(1.0f);
+			states[lane] = hashValue(texelSeed + first + lane);
+		}
+
+		for (uint32_t bounce = 0; bounce < settings.bounceCount && aliveMask != 0; bounce++)
+		{
+			uint32_t shadowMask = 0;
+			for (int lane = 0; lane < BVH_PACKET_SIZE; lane++)
+			{
+				if ((aliveMask & (1u << lane)) == 0)
+				{
+					continue;
+				}
+
+				glm::vec3 direction = sampleHemisphere(normals[lane], &states[lane]);
+				RayHit hit;
+				rays++;
+				if (!bvh.intersect(origins[lane], direction, FLT_MAX, &hit))
+				{
+					sum += weights[lane] * settings.skyColor;
+					aliveMask &= ~(1u << lane);
+					continue;
+				}
+
+				// Surfaces are two sided, normal faces the arriving ray
+				glm::vec3 hitNormal = glm::dot(hit.normal, direction) > 0.0f ? -hit.normal : hit.normal;
+				origins[lane] = origins[lane] + direction * hit.distance + hitNormal * bias;
+				normals[lane] = hitNormal;
+				weights[lane] *= settings.albedo;
+
+				float cosine = glm::dot(hitNormal, settings.sunDirection);
+				if (cosine > 0.0f)
+				{
+					sunLight[lane] = weights[lane] * settings.sunColor * cosine;
+					shadowPacket.originX[lane] = origins[lane].x;
+					shadowPacket.originY[lane] = origins[lane].y;
+					shadowPacket.originZ[lane] = origins[lane].z;
+					shadowPacket.directionX[lane] = settings.sunDirection.x;
+					shadowPacket.directionY[lane] = settings.sunDirection.y;
+					shadowPacket.directionZ[lane] = settings.sunDirection.z;
+					shadowPacket.maxDistance[lane] = FLT_MAX;
+					shadowMask |= 1u << lane;
+					rays++;
+				}
+			}
+
+			uint32_t litMask = shadowMask & ~bvh.occluded(shadowPacket, shadowMask);
+			for (int lane = 0; lane < BVH_PACKET_SIZE; lane++)
+			{
+				if (litMask & (1u << lane))
+				{
+					sum += sunLight[lane];
+				}
+			}
+		}
+	}
+	*indirect = sum / (float)sampleCount;
+
+	return rays;
+}
+
+void LightmapBaker::denoise(Target* target, uint32_t threadCount)
+{
+	// B3 spline kernel of a-trous wavelet transform
+	const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	vector<glm::vec3> source = target->indirect;
+	vector<glm::vec3> result(source.size());
+	for (int pass = 0; pass < LIGHTMAP_DENOISE_PASSES; pass++)
+	{
+		int step = 1 << pass;
+		float planeScale = 1.0f / (target->texelSize * step);
+
+		// Texels only read the previous pass, rows are filtered in parallel with identical results
+		std::atomic<uint32_t> nextRow(0);
+		runWorkers(threadCount, [&](uint32_t)
+		{
+			for (uint32_t y = nextRow++; y < target->height; y = nextRow++)
+			{
+				for (uint32_t x = 0; x < target->width; x++)
+				{
+					size_t index = (size_t)y * target->width + x;
+					const Texel& center = target->texels[index];
+					if (center.chart < 0)
+					{
+						result[index] = source[index];
+						continue;
+					}
+
+					// Neighbours have to lie in the same chart, face the same way and lie in the same plane
+					glm::vec3 sum(0.0f);
+					float weightSum = 0.0f;
+					for (int dy = -2; dy <= 2; dy++)
+					{
+						int sy = (int)y + dy * step;
+						if (sy < 0 || sy >= (int)target->height)
+						{
+							continue;
+						}
+						for (int dx = -2; dx <= 2; dx++)
+						{
+							int sx = (int)x + dx * step;
+							if (sx < 0 || sx >= (int)target->width)
+							{
+								continue;
+							}
+							size_t neighbourIndex = (size_t)sy * target->width + sx;
+							const Texel& neighbour = target->texels[neighbourIndex];
+							if (neighbour.chart != center.chart)
+							{
+								continue;
+							}
+
+							float planeDistance = glm::dot(neighbour.position - center.position, center.normal) * planeScale;
+							float weight = kernel[dx + 2] * kernel[dy + 2];
+							weight *= powf(std::max(0.0f, glm::dot(center.normal, neighbour.normal)), LIGHTMAP_NORMAL_POWER);
+							weight *= expf(-planeDistance * planeDistance);
+							sum += source[neighbourIndex] * weight;
+							weightSum += weight;
+						}
+					}
+					result[index] = weightSum > 0.0f ? sum / weightSum : source[index];
+				}
+			}
+		});
+		std::swap(source, result);
+	}
+	target->indirect = source;
+}
+
+void LightmapBaker::dilate(const Target& target, vector<glm::vec3>* irradiance)
+{
+	// Texels outside of charts take average of filled neighbours, filled texels are never overwritten
+	vector<uint8_t> filled(target.texels.size());
+	for (size_t i = 0; i < filled.size(); i++)
+	{
+		filled[i] = target.texels[i].chart >= 0 ? 1 : 0;
+	}
+
+	for (int pass = 0; pass < LIGHTMAP_DILATION_PASSES; pass++)
+	{
+		vector<glm::vec3> next = *irradiance;
+		vector<uint8_t> nextFilled = filled;
+		for (uint32_t y = 0; y < target.height; y++)
+		{
+			for (uint32_t x = 0; x < target.width; x++)
+			{
+				size_t index = (size_t)y * target.width + x;
+				if (filled[index])
+				{
+					continue;
+				}
+
+				glm::vec3 sum(0.0f);
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int sx = (int)x + dx;
+						int sy = (int)y + dy;
+						if (sx < 0 || sy < 0 || sx >= (int)target.width || sy >= (int)target.height)
+						{
+							continue;
+						}
+						size_t neighbourIndex = (size_t)sy * target.width + sx;
+						if (filled[neighbourIndex])
+						{
+							sum += (*irradiance)[neighbourIndex];
+							count++;
+						}
+					}
+				}
+				if (count > 0)
+				{
+					next[index] = sum / (float)count;
+					nextFilled[index] = 1;
+				}
+			}
+		}
+		std::swap(*irradiance, next);
+		std::swap(filled, nextFilled);
+	}
+}
+
+MeshLightmap LightmapBaker::compress(const Target& target, const vector<glm::vec3>& irradiance)
+{
+	MeshLightmap lightmap;
+	lightmap.width = target.width;
+	lightmap.height = target.height;
+
+	// Brightest channel maps to 1, shader multiplies by scale again
+	float maxValue = 0.0f;
+	for (const auto& value : irradiance)
+	{
+		maxValue = std::max(maxValue, std::max(value.r, std::max(value.g, value.b)));
+	}
+	lightmap.scale = maxValue > 0.0f ? maxValue : 1.0f;
+
+	// sRGB encoding spends more of BC1's 565 precision on dark values (sampler decodes it back to linear)
+	uint32_t blocksX = target.width / 4;
+	uint32_t blocksY = target.height / 4;
+	lightmap.blocks.resize((size_t)blocksX * blocksY * 8);
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			glm::vec3 colors[16];
+			for (uint32_t y = 0; y < 4; y++)
+			{
+				for (uint32_t x = 0; x < 4; x++)
+				{
+					glm::vec3 linear = glm::clamp(irradiance[((size_t)by * 4 + y) * target.width + bx * 4 + x] / lightmap.scale, 0.0f, 1.0f);
+					glm::vec3 encoded;
+					for (int c = 0; c < 3; c++)
+					{
+						encoded[c] = linear[c] <= 0.0031308f ? linear[c] * 12.92f : 1.055f * powf(linear[c], 1.0f / 2.4f) - 0.055f;
+					}
+					colors[y * 4 + x] = encoded;
+				}
+			}
+			encodeBlock(colors, &lightmap.blocks[((size_t)by * blocksX + bx) * 8]);
+		}
+	}
+	return lightmap;
+}
+
+void LightmapBaker::encodeBlock(const glm::vec3* colors, uint8_t* block)
+{
+	// Endpoints at the ends of colors' principal axis (covariance power iteration)
+	glm::vec3 mean(0.0f);
+	for (int i = 0; i < 16; i++)
+	{
+		mean += colors[i];
+	}
+	mean /= 16.0f;
+
+	float covariance[6] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		glm::vec3 d = colors[i] - mean;
+		covariance[0] += d.r * d.r;
+		covariance[1] += d.r * d.g;
+		covariance[2] += d.r * d.b;
+		covariance[3] += d.g * d.g;
+		covariance[4] += d.g * d.b;
+		covariance[5] += d.b * d.b;
+	}
+	glm::vec3 axis(1.0f);
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		axis = glm::vec3(covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+			covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+			covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+		float length = glm::length(axis);
+		axis = length > 1e-12f ? axis / length : glm::vec3(0.57735027f);
+	}
+
+	float tMin = FLT_MAX;
+	float tMax = -FLT_MAX;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = glm::dot(colors[i] - mean, axis);
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+
+	auto quantize = [](const glm::vec3& color)
+	{
+		glm::vec3 clamped = glm::clamp(color, 0.0f, 1.0f);
+		return (uint16_t)(((uint32_t)(clamped.r * 31.0f + 0.5f) << 11) | ((uint32_t)(clamped.g * 63.0f + 0.5f) << 5) | (uint32_t)(clamped.b * 31.0f + 0.5f));
+	};
+	auto expand = [](uint16_t color)
+	{
+		uint32_t r = (color >> 11) & 31;
+		uint32_t g = (color >> 5) & 63;
+		uint32_t b = color & 31;
+		return glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2))) / 255.0f;
+	};
+
+	// Four color mode needs color0 > color1, equal endpoints leave every index at color0
+	uint16_t color0 = quantize(mean + axis * tMax);
+	uint16_t color1 = quantize(mean + axis * tMin);
+	if (color0 < color1)
+	{
+		std::swap(color0, color1);
+	}
+
+	uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		glm::vec3 palette[4];
+		palette[0] = expand(color0);
+		palette[1] = expand(color1);
+		palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+		palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			uint32_t best = 0;
+			float bestDistance = FLT_MAX;
+			for (uint32_t p = 0; p < 4; p++)
+			{
+				glm::vec3 d = colors[i] - palette[p];
+				float distance = glm::dot(d, d);
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (2 * i);
+		}
+	}
+
+	block[0] = (uint8_t)(color0 & 0xff);
+	block[1] = (uint8_t)(color0 >> 8);
+	block[2] = (uint8_t)(color1 & 0xff);
+	block[3] = (uint8_t)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+	{
+		block[4 + i] = (uint8_t)(indices >> (8 * i));
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "TriangleBvh.h"
+#include "Mesh.h"
+
+// Default quality and limits of baked lightmaps
+#define LIGHTMAP_DIAGONAL_TEXELS		512			// texels along bounding box diagonal of the model (default texel density)
+#define LIGHTMAP_MAX_SIZE				1024		// larger atlases are packed again at lower density
+#define LIGHTMAP_CHART_PADDING			1			// texels around every chart, filled by dilation (bilinear filtering stays in chart)
+#define LIGHTMAP_SAMPLE_COUNT			128			// paths per texel, rounded up to a multiple of BVH_PACKET_SIZE
+#define LIGHTMAP_BOUNCE_COUNT			3			// path segments after the texel (1 gives sky and sun reflected once)
+#define LIGHTMAP_TILE_SIZE				16			// texels per side of scheduler tile
+#define LIGHTMAP_DENOISE_PASSES			3			// a-trous iterations (5x5 kernel, step doubles every pass)
+#define LIGHTMAP_BIAS_SCALE				0.0001f		// ray origins move off the surface by this part of bounding box diagonal
+
+// Lighting of static scene, defaults match shaders/lighting.glsl and renderer's default directional light
+struct LightmapSettings
+{
+	glm::vec3 sunDirection = glm::vec3(0.4f, 0.8f, 0.6f);		// model space, towards the light
+	glm::vec3 sunColor = glm::vec3(1.0f);
+	glm::vec3 skyColor = glm::vec3(0.1f);						// irradiance of unoccluded sky
+	glm::vec3 albedo = glm::vec3(0.8f);							// reflectance of surfaces light bounces off
+	float texelsPerUnit = 0.0f;									// 0 derives density from model bounds (LIGHTMAP_DIAGONAL_TEXELS)
+	uint32_t sampleCount = LIGHTMAP_SAMPLE_COUNT;
+	uint32_t bounceCount = LIGHTMAP_BOUNCE_COUNT;
+	uint32_t threadCount = 0;									// 0 uses every hardware thread
+	uint32_t seed = 0;											// same seed and inputs give bit identical lightmaps
+};
+
+struct LightmapStats
+{
+	uint32_t lightmapCount;
+	uint32_t chartCount;
+	uint32_t texelCount;						// texels covered by charts
+	uint64_t rayCount;
+};
+
+// Bakes sun, sky and their bounces into per mesh lightmaps on CPU. Charts are box projected groups of connected
+// triangles (vertices are split at chart seams) packed into one atlas per mesh. Texels are path traced against BVH
+// of all model's meshes, tiles of all atlases are dealt to worker threads which steal from each other once their
+// own tiles run out. Every texel's random sequence depends on texel and seed only, so results don't depend on
+// thread count. Noisy indirect light is denoised with edge stopping a-trous filter, atlases are BC1 compressed.
+// Point and spot lights stay dynamic (clustered lighting adds them on top of lightmap)
+class LightmapBaker
+{
+
+public:
+	// Bakes all static meshes of one model (mesh space is model space), skinned meshes are left without lightmap
+	static LightmapStats bake(Mesh* meshes, int meshCount, const LightmapSettings& settings);
+	// RGBA8 (sRGB) texels of BC1 compressed lightmap, for devices that can't sample BC formats
+	static vector<uint8_t> decodeBlocks(const MeshLightmap& lightmap);
+
+private:
+	// Texel of mesh's atlas, chart is -1 for texels no triangle covers
+	struct Texel
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		int chart;
+	};
+
+	// Atlas of one mesh while baking, direct sun is kept apart so only indirect light is denoised
+	struct Target
+	{
+		int mesh;
+		uint32_t width;
+		uint32_t height;
+		float texelSize;						// model units per texel
+		vector<int> triangleCharts;
+		vector<Texel> texels;
+		vector<glm::vec3> direct;
+		vector<glm::vec3> indirect;
+	};
+
+	// Builds lightmap UVs of mesh (returns false when charts don't fit LIGHTMAP_MAX_SIZE)
+	static bool generateUvs(Mesh* mesh, float texelsPerUnit, Target* target, uint32_t* chartCount);
+	static void rasterizeTexels(Mesh* mesh, Target* target);
+	// Returns number of rays traced, settings' sun direction has to be normalized
+	static uint32_t traceTexel(const TriangleBvh& bvh, const Texel& texel, uint32_t texelSeed, const LightmapSettings& settings,
+		uint32_t sampleCount, float bias, glm::vec3* direct, glm::vec3* indirect);
+	static void denoise(Target* target, uint32_t threadCount);
+	static void dilate(const Target& target, vector<glm::vec3>* irradiance);
+	static MeshLightmap compress(const Target& target, const vector<glm::vec3>& irradiance);
+	static void encodeBlock(const glm::vec3* colors, uint8_t* block);
+};
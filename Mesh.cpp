@@ -38,3 +38,101 @@ std::vector<uint32_t> Mesh::getIndices()
 {
     return this->indices;
 }
+
+void Mesh::setSkin(std::vector<glm::uvec4> jointIndices, std::vector<glm::vec4> jointWeights,
+    std::vector<int> skinJoints, std::vector<glm::mat4> inverseBindMatrices)
+{
+    this->jointIndices = jointIndices;
+    this->jointWeights = jointWeights;
+    this->skinJoints = skinJoints;
+    this->inverseBindMatrices = inverseBindMatrices;
+}
+
+bool Mesh::hasSkin()
+{
+    return !this->skinJoints.empty();
+}
+
+std::vector<glm::uvec4> Mesh::getJointIndices()
+{
+    return this->jointIndices;
+}
+
+std::vector<glm::vec4> Mesh::getJointWeights()
+{
+    return this->jointWeights;
+}
+
+std::vector<int> Mesh::getSkinJoints()
+{
+    return this->skinJoints;
+}
+
+std::vector<glm::mat4> Mesh::getInverseBindMatrices()
+{
+    return this->inverseBindMatrices;
+}
+
+void Mesh::setAmbientOcclusion(std::vector<float> ambientOcclusion)
+{
+    this->ambientOcclusion = ambientOcclusion;
+}
+
+std::vector<float> Mesh::getAmbientOcclusion()
+{
+    return this->ambientOcclusion;
+}
+
+void Mesh::setLightmapUvs(std::vector<glm::vec2> lightmapUvs)
+{
+    this->lightmapUvs = lightmapUvs;
+}
+
+std::vector<glm::vec2> Mesh::getLightmapUvs()
+{
+    return this->lightmapUvs;
+}
+
+void Mesh::setLightmap(MeshLightmap lightmap)
+{
+    this->lightmap = lightmap;
+}
+
+bool Mesh::hasLightmap()
+{
+    return !this->lightmap.blocks.empty() && this->lightmapUvs.size() == this->vertices.size();
+}
+
+const MeshLightmap& Mesh::getLightmap()
+{
+    return this->lightmap;
+}
+
+// Copies per vertex attributes array can have (optional ones are empty)
+template<typename T>
+static std::vector<T> remapAttribute(const std::vector<T>& values, const std::vector<uint32_t>& sourceVertices)
+{
+    if (values.empty())
+    {
+        return values;
+    }
+
+    std::vector<T> remapped(sourceVertices.size());
+    for (size_t i = 0; i < sourceVertices.size(); i++)
+    {
+        remapped[i] = values[sourceVertices[i]];
+    }
+    return remapped;
+}
+
+void Mesh::remapVertices(const std::vector<uint32_t>& sourceVertices, std::vector<uint32_t> indices)
+{
+    this->vertices = remapAttribute(this->vertices, sourceVertices);
+    this->normals = remapAttribute(this->normals, sourceVertices);
+    this->texCoords = remapAttribute(this->texCoords, sourceVertices);
+    this->jointIndices = remapAttribute(this->jointIndices, sourceVertices);
+    this->jointWeights = remapAttribute(this->jointWeights, sourceVertices);
+    this->ambientOcclusion = remapAttribute(this->ambientOcclusion, sourceVertices);
+    this->lightmapUvs = remapAttribute(this->lightmapUvs, sourceVertices);
+    this->indices = indices;
+}
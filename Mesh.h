@@ -3,6 +3,16 @@
 #include <glm/glm.hpp>
 #include <string>
 #include <vector>
+#include <cstdint>
+
+// Baked lighting of a mesh as BC1 blocks (8 bytes per 4x4 texels, sRGB encoded), texels hold irradiance divided by scale
+struct MeshLightmap
+{
+    uint32_t width = 0;                                 // multiples of 4
+    uint32_t height = 0;
+    float scale = 1.0f;
+    std::vector<uint8_t> blocks;
+};
 
 class Mesh
 {
@@ -22,6 +32,29 @@ public:
     std::vector<glm::vec3> getNormals();
 	std::vector<uint32_t> getIndices();
 
+    // Skin (up to 4 influences per vertex, indices refer to skin joints)
+    void setSkin(std::vector<glm::uvec4> jointIndices, std::vector<glm::vec4> jointWeights,
+        std::vector<int> skinJoints, std::vector<glm::mat4> inverseBindMatrices);
+    bool hasSkin();
+    std::vector<glm::uvec4> getJointIndices();
+    std::vector<glm::vec4> getJointWeights();
+    std::vector<int> getSkinJoints();                   // skeleton joint of every skin joint
+    std::vector<glm::mat4> getInverseBindMatrices();    // mesh space to skin joint space
+
+    // Baked ambient occlusion per vertex (1 for unoccluded), empty when model wasn't baked
+    void setAmbientOcclusion(std::vector<float> ambientOcclusion);
+    std::vector<float> getAmbientOcclusion();
+
+    // Second UV set addressing mesh's lightmap (charts never overlap), empty when mesh has no lightmap
+    void setLightmapUvs(std::vector<glm::vec2> lightmapUvs);
+    std::vector<glm::vec2> getLightmapUvs();
+    void setLightmap(MeshLightmap lightmap);
+    bool hasLightmap();
+    const MeshLightmap& getLightmap();
+
+    // Rebuilds vertices, vertex i copies every attribute of vertex sourceVertices[i] (used to split vertices at UV seams)
+    void remapVertices(const std::vector<uint32_t>& sourceVertices, std::vector<uint32_t> indices);
+
     // Copy assignment operator
     Mesh& operator=(const Mesh& other) {
         if (this != &other) {
@@ -31,6 +64,13 @@ public:
             indices = other.indices;
             texCoords = other.texCoords;
             normals = other.normals;
+            jointIndices = other.jointIndices;
+            jointWeights = other.jointWeights;
+            skinJoints = other.skinJoints;
+            inverseBindMatrices = other.inverseBindMatrices;
+            ambientOcclusion = other.ambientOcclusion;
+            lightmapUvs = other.lightmapUvs;
+            lightmap = other.lightmap;
             textureIndex = other.textureIndex;
         }
         return *this;
@@ -45,6 +85,13 @@ public:
             indices = std::move(other.indices);
             texCoords = std::move(other.texCoords);
             normals = std::move(other.normals);
+            jointIndices = std::move(other.jointIndices);
+            jointWeights = std::move(other.jointWeights);
+            skinJoints = std::move(other.skinJoints);
+            inverseBindMatrices = std::move(other.inverseBindMatrices);
+            ambientOcclusion = std::move(other.ambientOcclusion);
+            lightmapUvs = std::move(other.lightmapUvs);
+            lightmap = std::move(other.lightmap);
             textureIndex = other.textureIndex;
         }
         return *this;
@@ -55,5 +102,12 @@ private:
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec2> texCoords;
 	std::vector<uint32_t> indices;
+	std::vector<glm::uvec4> jointIndices;
+	std::vector<glm::vec4> jointWeights;
+	std::vector<int> skinJoints;
+	std::vector<glm::mat4> inverseBindMatrices;
+	std::vector<float> ambientOcclusion;
+	std::vector<glm::vec2> lightmapUvs;
+	MeshLightmap lightmap;
 };
 
@@ -0,0 +1,175 @@
+#include "MeshletBuilder.h"
+#include "VkMesh.h"
+
+#include <cmath>
+
+vector<Meshlet> MeshletBuilder::build(const vector<Vertex>& vertices, vector<uint32_t>* indices, uint32_t indexBase)
+{
+	vector<Meshlet> meshlets;
+	uint32_t triangleCount = static_cast<uint32_t>(indices->size() / 3);
+	uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+	if (triangleCount == 0)
+	{
+		return meshlets;
+	}
+
+	// Triangles of each vertex (offsets into flat adjacency list)
+	vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t index : *indices)
+	{
+		if (index < indexBase || index - indexBase >= vertexCount)
+		{
+			throw runtime_error("Failed to build meshlets, index " + to_string(index) + " is out of vertex range.");
+		}
+		adjacencyOffsets[index - indexBase + 1]++;
+	}
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+	}
+	vector<uint32_t> adjacency(indices->size());
+	vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t i = 0; i < indices->size(); i++)
+	{
+		adjacency[adjacencyFill[(*indices)[i] - indexBase]++] = i / 3;
+	}
+
+	vector<uint32_t> reordered;
+	reordered.reserve(indices->size());
+	vector<bool> emitted(triangleCount, false);
+	vector<uint32_t> vertexMeshlet(vertexCount, UINT32_MAX);		// meshlet that already holds the vertex
+	vector<uint32_t> candidates;
+
+	uint32_t seed = 0;
+	while (true)
+	{
+		// New meshlet starts at first triangle left in submission order
+		while (seed < triangleCount && emitted[seed])
+		{
+			seed++;
+		}
+		if (seed == triangleCount)
+		{
+			break;
+		}
+
+		uint32_t meshletIndex = static_cast<uint32_t>(meshlets.size());
+		uint32_t firstIndex = static_cast<uint32_t>(reordered.size());
+		uint32_t meshletVertices = 0;
+		uint32_t meshletTriangles = 0;
+		candidates.clear();
+
+		// Grows greedily by triangles adjacent to meshlet that add fewest new vertices, so meshlet stays compact
+		// (tight bounds and normal cone cull better)
+		uint32_t triangle = seed;
+		while (triangle != UINT32_MAX)
+		{
+			emitted[triangle] = true;
+			meshletTriangles++;
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t index = (*indices)[triangle * 3 + corner];
+				uint32_t vertex = index - indexBase;
+				reordered.push_back(index);
+				if (vertexMeshlet[vertex] != meshletIndex)
+				{
+					vertexMeshlet[vertex] = meshletIndex;
+					meshletVertices++;
+					candidates.insert(candidates.end(), adjacency.begin() + adjacencyOffsets[vertex], adjacency.begin() + adjacencyOffsets[vertex + 1]);
+				}
+			}
+
+			triangle = UINT32_MAX;
+			if (meshletTriangles == MESHLET_MAX_TRIANGLES)
+			{
+				break;
+			}
+
+			uint32_t bestNewVertices = 4;
+			size_t kept = 0;
+			for (size_t i = 0; i < candidates.size(); i++)
+			{
+				uint32_t candidate = candidates[i];
+				if (emitted[candidate])
+				{
+					continue;
+				}
+				candidates[kept++] = candidate;
+
+				uint32_t newVertices = 0;
+				for (uint32_t corner = 0; corner < 3; corner++)
+				{
+					newVertices += vertexMeshlet[(*indices)[candidate * 3 + corner] - indexBase] != meshletIndex ? 1 : 0;
+				}
+				if (newVertices < bestNewVertices && meshletVertices + newVertices <= MESHLET_MAX_VERTICES)
+				{
+					bestNewVertices = newVertices;
+					triangle = candidate;
+				}
+			}
+			candidates.resize(kept);
+		}
+
+		Meshlet meshlet = computeBounds(vertices, reordered.data() + firstIndex, meshletTriangles, indexBase);
+		meshlet.firstIndex = firstIndex;
+		meshlet.indexCount = meshletTriangles * 3;
+		meshlets.push_back(meshlet);
+	}
+
+	indices->swap(reordered);
+	return meshlets;
+}
+
+Meshlet MeshletBuilder::computeBounds(const vector<Vertex>& vertices, const uint32_t* indices, uint32_t triangleCount, uint32_t indexBase)
+{
+	Meshlet meshlet = {};
+
+	// Sphere around bounding box center (same as whole mesh bounds)
+	glm::vec3 minPos = vertices[indices[0] - indexBase].pos;
+	glm::vec3 maxPos = minPos;
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		minPos = glm::min(minPos, vertices[indices[i] - indexBase].pos);
+		maxPos = glm::max(maxPos, vertices[indices[i] - indexBase].pos);
+	}
+	glm::vec3 center = (minPos + maxPos) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		radius = glm::max(radius, glm::length(vertices[indices[i] - indexBase].pos - center));
+	}
+	meshlet.boundingSphere = glm::vec4(center, radius);
+
+	// Normal cone of face normals (counter clockwise triangles face outwards)
+	vector<glm::vec3> normals;
+	normals.reserve(triangleCount);
+	glm::vec3 normalSum = glm::vec3(0.0f);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		glm::vec3 p0 = vertices[indices[i * 3] - indexBase].pos;
+		glm::vec3 p1 = vertices[indices[i * 3 + 1] - indexBase].pos;
+		glm::vec3 p2 = vertices[indices[i * 3 + 2] - indexBase].pos;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normals.push_back(normal / length);
+			normalSum += normal / length;
+		}
+	}
+
+	float axisLength = glm::length(normalSum);
+	glm::vec3 axis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+	for (const auto& normal : normals)
+	{
+		minDot = glm::min(minDot, glm::dot(axis, normal));
+	}
+
+	// Cluster is back facing when view direction is within the cone widened by 90 degrees (cutoff is its sine),
+	// nearly flat-spread normals make cone useless
+	float cutoff = minDot > 0.1f ? sqrt(1.0f - minDot * minDot) : 1.0f;
+	meshlet.cone = glm::vec4(axis, cutoff);
+
+	return meshlet;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+// Meshlet limits (cluster culling granularity)
+#define MESHLET_MAX_VERTICES	64
+#define MESHLET_MAX_TRIANGLES	124
+
+struct Vertex;
+
+// Cluster of neighbouring triangles, a contiguous range of mesh index buffer (std430 layout of Meshlet in shaders/cluster_culling.comp)
+struct Meshlet
+{
+	glm::vec4 boundingSphere;			// mesh space center (xyz) and radius (w)
+	glm::vec4 cone;						// mesh space average normal (xyz), cone cutoff (w, 1 when cone can't cull)
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t padding[2];
+};
+
+// Splits triangle lists into meshlets at import time, triangles are reordered so every meshlet is one index range
+class MeshletBuilder
+{
+
+public:
+	// Reorders indices in place, indexBase is subtracted from indices to get vertex (indices may not start at 0)
+	static vector<Meshlet> build(const vector<Vertex>& vertices, vector<uint32_t>* indices, uint32_t indexBase);
+
+private:
+	static Meshlet computeBounds(const vector<Vertex>& vertices, const uint32_t* indices, uint32_t triangleCount, uint32_t indexBase);
+};
@@ -0,0 +1,277 @@
+#include "ParticleSystem.h"
+
+#include <cmath>
+
+ParticleSystem::ParticleSystem()
+{
+	this->physicalDevice = VK_NULL_HANDLE;
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->pipelineManager = nullptr;
+	this->uniformRing = nullptr;
+	this->particleBuffer = VK_NULL_HANDLE;
+	this->particleBufferMemory = VK_NULL_HANDLE;
+	this->stateBuffer = VK_NULL_HANDLE;
+	this->stateBufferMemory = VK_NULL_HANDLE;
+	this->simulationPipelineLayout = VK_NULL_HANDLE;
+	this->simulationDescriptorSet = VK_NULL_HANDLE;
+	this->drawDescriptorSet = VK_NULL_HANDLE;
+	this->params = {};
+	this->emitterOffset = 0;
+}
+
+ParticleSystem::~ParticleSystem()
+{
+}
+
+void ParticleSystem::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+	const string& emitShader, const string& prepareShader, const string& simulateShader, VkDescriptorSetLayout drawSetLayout,
+	ShaderCompiler* shaderCompiler, PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache,
+	DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing)
+{
+	this->physicalDevice = physicalDevice;
+	this->logicalDevice = logicalDevice;
+	this->emitShader = emitShader;
+	this->prepareShader = prepareShader;
+	this->simulateShader = simulateShader;
+	this->pipelineManager = pipelineManager;
+	this->uniformRing = uniformRing;
+
+	// PARTICLE BUFFERS
+	// Particle data is only ever written by emit shader, so it starts uninitialized
+	createBuffer(physicalDevice, logicalDevice, MAX_PARTICLES * 3 * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->particleBuffer, &this->particleBufferMemory);
+	createBuffer(physicalDevice, logicalDevice, getStateBufferSize(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->stateBuffer, &this->stateBufferMemory);
+
+	// Every particle starts free, alive lists start empty (uploaded once, GPU owns the state from now on)
+	VkDeviceSize initialSize = sizeof(ParticleStateHeader) + MAX_PARTICLES * sizeof(uint32_t);
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(physicalDevice, logicalDevice, initialSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(logicalDevice, stagingBufferMemory, 0, initialSize, 0, &data);
+	ParticleStateHeader* header = static_cast<ParticleStateHeader*>(data);
+	*header = {};
+	header->draw.vertexCount = 6;
+	header->dispatch = { 0, 1, 1 };
+	header->deadCount = MAX_PARTICLES;
+	uint32_t* deadList = reinterpret_cast<uint32_t*>(header + 1);
+	for (uint32_t i = 0; i < MAX_PARTICLES; i++)
+	{
+		deadList[i] = i;
+	}
+	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+
+	copyBuffer(logicalDevice, transferQueue, transferCommandPool, stagingBuffer, this->stateBuffer, initialSize);
+
+	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
+	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+
+	// SIMULATION LAYOUT AND SET
+	LayoutOverrides overrides = {};
+	overrides.dynamicStorageBuffers = true;
+
+	ShaderReflection reflection = ShaderReflection::merge({
+		ShaderReflection::reflect(shaderCompiler->compile(emitShader)),
+		ShaderReflection::reflect(shaderCompiler->compile(prepareShader)),
+		ShaderReflection::reflect(shaderCompiler->compile(simulateShader)) });
+	vector<VkDescriptorSetLayout> setLayouts;
+	this->simulationPipelineLayout = layoutCache->getReflectedLayout(reflection, overrides, &setLayouts);
+	if (setLayouts.empty())
+	{
+		throw runtime_error("Failed to create particle simulation layout, shaders must use particle buffers in set 0.");
+	}
+
+	DescriptorBinding particleBinding = {};
+	particleBinding.binding = 0;
+	particleBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	particleBinding.bufferInfo.buffer = this->particleBuffer;
+	particleBinding.bufferInfo.offset = 0;
+	particleBinding.bufferInfo.range = VK_WHOLE_SIZE;
+
+	DescriptorBinding stateBinding = {};
+	stateBinding.binding = 1;
+	stateBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	stateBinding.bufferInfo.buffer = this->stateBuffer;
+	stateBinding.bufferInfo.offset = 0;
+	stateBinding.bufferInfo.range = VK_WHOLE_SIZE;
+
+	DescriptorBinding emitterBinding = {};
+	emitterBinding.binding = 2;
+	emitterBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	emitterBinding.bufferInfo.buffer = uniformRing->getBuffer();
+	emitterBinding.bufferInfo.offset = 0;
+	emitterBinding.bufferInfo.range = MAX_PARTICLE_EMITTERS * sizeof(GpuEmitter);
+
+	this->simulationDescriptorSet = descriptorAllocator->getCachedSet(setLayouts[0], { particleBinding, stateBinding, emitterBinding });
+
+	// Draw set has the layout of renderer's particle set (same bindings, read by vertex shader)
+	this->drawDescriptorSet = descriptorAllocator->getCachedSet(drawSetLayout, { particleBinding, stateBinding });
+
+	// Compiled up front, first frame shouldn't wait for them
+	pipelineManager->getComputePipeline(emitShader, this->simulationPipelineLayout);
+	pipelineManager->getComputePipeline(prepareShader, this->simulationPipelineLayout);
+	pipelineManager->getComputePipeline(simulateShader, this->simulationPipelineLayout);
+}
+
+void ParticleSystem::cleanup()
+{
+	// Layout and sets are owned by layout cache and descriptor allocator, pipelines by pipeline manager
+	if (this->particleBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyBuffer(this->logicalDevice, this->stateBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->stateBufferMemory, nullptr);
+
+	vkDestroyBuffer(this->logicalDevice, this->particleBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->particleBufferMemory, nullptr);
+	this->particleBuffer = VK_NULL_HANDLE;
+}
+
+bool ParticleSystem::addEmitter(int emitterId, const ParticleEmitter& emitter)
+{
+	if (this->emitters.find(emitterId) != this->emitters.end() || this->emitters.size() == MAX_PARTICLE_EMITTERS)
+	{
+		return false;
+	}
+
+	this->emitters[emitterId] = emitter;
+	this->spawnRemainders[emitterId] = 0.0f;
+	return true;
+}
+
+bool ParticleSystem::updateEmitter(int emitterId, const ParticleEmitter& emitter)
+{
+	auto existing = this->emitters.find(emitterId);
+	if (existing == this->emitters.end())
+	{
+		return false;
+	}
+
+	existing->second = emitter;
+	return true;
+}
+
+bool ParticleSystem::removeEmitter(int emitterId)
+{
+	this->spawnRemainders.erase(emitterId);
+	return this->emitters.erase(emitterId) > 0;
+}
+
+int ParticleSystem::getEmitterCount()
+{
+	return static_cast<int>(this->emitters.size());
+}
+
+void ParticleSystem::update(float timeStep)
+{
+	// Whole range is allocated, descriptor range covers MAX_PARTICLE_EMITTERS emitters from the dynamic offset
+	RingAllocation allocation = this->uniformRing->allocate(MAX_PARTICLE_EMITTERS * sizeof(GpuEmitter));
+	this->emitterOffset = allocation.offset;
+
+	// Emitters get consecutive ranges of spawn invocations, fractional spawns carry over to next frame
+	GpuEmitter* gpuEmitters = static_cast<GpuEmitter*>(allocation.data);
+	uint32_t spawnCount = 0;
+	uint32_t emitterIndex = 0;
+	for (const auto& emitterKeyValue : this->emitters)
+	{
+		const ParticleEmitter& emitter = emitterKeyValue.second;
+		float& remainder = this->spawnRemainders[emitterKeyValue.first];
+		float spawn = remainder + emitter.rate * timeStep;
+		uint32_t count = std::min(static_cast<uint32_t>(spawn), MAX_PARTICLES - spawnCount);
+		remainder = spawn - floor(spawn);
+
+		GpuEmitter& gpuEmitter = gpuEmitters[emitterIndex++];
+		gpuEmitter.positionRadius = glm::vec4(emitter.position, emitter.radius);
+		gpuEmitter.velocitySpread = glm::vec4(emitter.velocity, emitter.velocitySpread);
+		gpuEmitter.startColor = emitter.startColor;
+		gpuEmitter.endColor = emitter.endColor;
+		gpuEmitter.sizesLifetime = glm::vec4(emitter.startSize, emitter.endSize, emitter.lifetime, emitter.lifetimeSpread);
+		gpuEmitter.spawn = glm::uvec4(spawnCount, count, 0, 0);
+		spawnCount += count;
+	}
+
+	this->params.gravity = glm::vec4(0.0f, PARTICLE_GRAVITY, 0.0f, timeStep);
+	this->params.spawnCount = spawnCount;
+	this->params.emitterCount = emitterIndex;
+	this->params.seed++;
+}
+
+ParticleStreams ParticleSystem::addSimulationPasses(RenderGraph& renderGraph)
+{
+	// Each frame continues from state previous frame left, so its simulation and drawing must be done first
+	VkPipelineStageFlags previousStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+		| VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	ParticleStreams streams = {};
+	streams.particles = renderGraph.importBuffer("particles", this->particleBuffer, VK_WHOLE_SIZE, previousStages, VK_ACCESS_SHADER_WRITE_BIT);
+	streams.state = renderGraph.importBuffer("particleState", this->stateBuffer, VK_WHOLE_SIZE, previousStages, VK_ACCESS_SHADER_WRITE_BIT);
+
+	// Pipelines are requested every frame, so they follow reloads of particle shaders
+	auto bindSimulation = [this](VkCommandBuffer commandBuffer, const string& shader)
+	{
+		VkPipeline pipeline = this->pipelineManager->getComputePipeline(shader, this->simulationPipelineLayout);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+		uint32_t dynamicOffsets[] = { 0, 0, this->emitterOffset };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->simulationPipelineLayout, 0, 1,
+			&this->simulationDescriptorSet, 3, dynamicOffsets);
+		vkCmdPushConstants(commandBuffer, this->simulationPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticleParams), &this->params);
+	};
+
+	// New particles join survivors of the previous frame
+	RenderGraphPass& emitPass = renderGraph.addComputePass("particleEmit");
+	emitPass.writeStorage(streams.particles);
+	emitPass.writeStorage(streams.state);
+	emitPass.setExecute([this, bindSimulation](VkCommandBuffer commandBuffer)
+	{
+		if (this->params.spawnCount == 0)
+		{
+			return;
+		}
+		bindSimulation(commandBuffer, this->emitShader);
+		vkCmdDispatch(commandBuffer, (this->params.spawnCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+	});
+
+	// Alive count is known on GPU only, single invocation turns it into simulation dispatch
+	RenderGraphPass& preparePass = renderGraph.addComputePass("particlePrepare");
+	preparePass.writeStorage(streams.state);
+	preparePass.setExecute([this, bindSimulation](VkCommandBuffer commandBuffer)
+	{
+		bindSimulation(commandBuffer, this->prepareShader);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+	});
+
+	// Survivors are compacted into the other alive list, its length becomes instance count of the draw
+	RenderGraphPass& simulatePass = renderGraph.addComputePass("particleSimulate");
+	simulatePass.readIndirect(streams.state);
+	simulatePass.writeStorage(streams.state);
+	simulatePass.writeStorage(streams.particles);
+	simulatePass.setExecute([this, bindSimulation](VkCommandBuffer commandBuffer)
+	{
+		bindSimulation(commandBuffer, this->simulateShader);
+		vkCmdDispatchIndirect(commandBuffer, this->stateBuffer, offsetof(ParticleStateHeader, dispatch));
+	});
+
+	return streams;
+}
+
+void ParticleSystem::recordDraw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout)
+{
+	uint32_t dynamicOffsets[] = { 0, 0 };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, PARTICLE_DRAW_SET, 1, &this->drawDescriptorSet,
+		2, dynamicOffsets);
+
+	// Six vertices per billboard, one instance per alive particle
+	vkCmdDrawIndirect(commandBuffer, this->stateBuffer, offsetof(ParticleStateHeader, draw), 1, sizeof(VkDrawIndirectCommand));
+}
+
+VkDeviceSize ParticleSystem::getStateBufferSize()
+{
+	// Free list and two alive lists follow the header
+	return sizeof(ParticleStateHeader) + 3 * MAX_PARTICLES * sizeof(uint32_t);
+}
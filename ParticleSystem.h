@@ -0,0 +1,136 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "UniformRingAllocator.h"
+#include "PipelineManager.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "RenderGraph.h"
+
+// Limits of particle system (must match shaders/particles.glsl)
+#define MAX_PARTICLES				262144		// particles alive at once (further spawns are dropped on GPU)
+#define MAX_PARTICLE_EMITTERS		256			// emitters uploaded per frame (range of emitter buffer descriptor)
+#define PARTICLE_GROUP_SIZE			64			// local size of emit and simulate shaders
+#define PARTICLE_DRAW_SET			3			// set of particle buffers in draw shaders (renderer's pipeline layout)
+#define PARTICLE_GRAVITY			-9.81f		// acceleration along world Y
+
+// Emitter in world space, spawns particles at constant rate
+struct ParticleEmitter
+{
+	glm::vec3 position = glm::vec3(0.0f);
+	float radius = 0.0f;									// particles spawn anywhere within this sphere
+	float rate = 100.0f;									// particles per second
+	glm::vec3 velocity = glm::vec3(0.0f, 5.0f, 0.0f);		// initial velocity
+	float velocitySpread = 1.0f;							// random velocity added in any direction
+	glm::vec4 startColor = glm::vec4(1.0f);					// color and size are interpolated over particle's life
+	glm::vec4 endColor = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	float startSize = 0.2f;									// half size of billboard
+	float endSize = 0.05f;
+	float lifetime = 2.0f;									// seconds
+	float lifetimeSpread = 0.5f;							// random seconds added
+};
+
+// Particle system resources in graph of current frame
+struct ParticleStreams
+{
+	RenderGraphResource particles;				// particle data, read by draw's vertex shader
+	RenderGraphResource state;					// lists and draw arguments, read by draw as indirect buffer too
+};
+
+// Particles live in device memory only: emission, simulation and compaction of survivors are compute passes
+// (free and alive lists are maintained with atomics) and survivors are drawn with one indirect instanced draw,
+// so CPU work per frame depends on emitter count only
+class ParticleSystem
+{
+
+public:
+	ParticleSystem();
+	~ParticleSystem();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+		const string& emitShader, const string& prepareShader, const string& simulateShader, VkDescriptorSetLayout drawSetLayout,
+		ShaderCompiler* shaderCompiler, PipelineManager* pipelineManager, DescriptorLayoutCache* layoutCache,
+		DescriptorAllocator* descriptorAllocator, UniformRingAllocator* uniformRing);
+	void cleanup();
+
+	bool addEmitter(int emitterId, const ParticleEmitter& emitter);
+	bool updateEmitter(int emitterId, const ParticleEmitter& emitter);
+	bool removeEmitter(int emitterId);
+	int getEmitterCount();
+
+	// Uploads emitters and this frame's spawn counts to uniform ring (call once per frame after ring's beginFrame)
+	void update(float timeStep);
+	// Declares emit, prepare and simulate passes, returned streams have to be read by the pass drawing particles
+	ParticleStreams addSimulationPasses(RenderGraph& renderGraph);
+	// Binds particle set and draws all alive particles (pipeline and camera set are bound by caller)
+	void recordDraw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout);
+
+private:
+	// std430 layout of Emitter in particle_emit.comp
+	struct GpuEmitter
+	{
+		glm::vec4 positionRadius;
+		glm::vec4 velocitySpread;
+		glm::vec4 startColor;
+		glm::vec4 endColor;
+		glm::vec4 sizesLifetime;
+		glm::uvec4 spawn;						// x: first spawned particle, y: count
+	};
+
+	// Must match ParticleParams push constant block of shaders/particle_simulation.glsl
+	struct ParticleParams
+	{
+		glm::vec4 gravity;						// xyz: acceleration, w: time step
+		uint32_t spawnCount;
+		uint32_t emitterCount;
+		uint32_t seed;
+	};
+
+	// Header of particle state buffer (lists follow it)
+	struct ParticleStateHeader
+	{
+		VkDrawIndirectCommand draw;
+		VkDispatchIndirectCommand dispatch;
+		uint32_t aliveCount;
+		uint32_t sourceList;
+		uint32_t targetList;
+		int32_t deadCount;
+		uint32_t padding;
+	};
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice logicalDevice;
+	PipelineManager* pipelineManager;
+	UniformRingAllocator* uniformRing;
+	string emitShader;
+	string prepareShader;
+	string simulateShader;
+
+	std::map<int, ParticleEmitter> emitters;
+	std::map<int, float> spawnRemainders;		// fractions of particles emitters haven't spawned yet
+
+	// Particles and their lists persist across frames (each frame continues simulation of the previous one)
+	VkBuffer particleBuffer;
+	VkDeviceMemory particleBufferMemory;
+	VkBuffer stateBuffer;
+	VkDeviceMemory stateBufferMemory;
+
+	VkPipelineLayout simulationPipelineLayout;	// merged from emit, prepare and simulate shaders
+	VkDescriptorSet simulationDescriptorSet;
+	VkDescriptorSet drawDescriptorSet;
+
+	// Current frame
+	ParticleParams params;
+	uint32_t emitterOffset;						// dynamic offset of emitter buffer
+
+	static VkDeviceSize getStateBufferSize();
+};
@@ -0,0 +1,183 @@
+#include "PipelineCache.h"
+
+PipelineCache::PipelineCache()
+{
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->cache = VK_NULL_HANDLE;
+	this->warm = false;
+	this->deviceHeader = {};
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, string filePath)
+{
+	this->logicalDevice = logicalDevice;
+	this->filePath = filePath;
+
+	// Driver UUID is only available through ID properties
+	VkPhysicalDeviceIDProperties idProperties = {};
+	idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 deviceProperties2 = {};
+	deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	deviceProperties2.pNext = &idProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
+
+	this->deviceHeader.magic = PIPELINE_CACHE_MAGIC;
+	this->deviceHeader.fileVersion = PIPELINE_CACHE_FILE_VERSION;
+	this->deviceHeader.vendorID = deviceProperties2.properties.vendorID;
+	this->deviceHeader.deviceID = deviceProperties2.properties.deviceID;
+	this->deviceHeader.driverVersion = deviceProperties2.properties.driverVersion;
+	memcpy(this->deviceHeader.driverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+	memcpy(this->deviceHeader.pipelineCacheUUID, deviceProperties2.properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	vector<char> cacheData = loadCacheData();
+	this->warm = !cacheData.empty();
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = cacheData.size();
+	createInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	VkResult result = vkCreatePipelineCache(this->logicalDevice, &createInfo, nullptr, &this->cache);
+	if (result != VK_SUCCESS && this->warm)
+	{
+		// Driver rejected data that passed our checks, start with empty cache instead of failing
+		this->warm = false;
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(this->logicalDevice, &createInfo, nullptr, &this->cache);
+	}
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create Pipeline Cache.");
+	}
+}
+
+void PipelineCache::save()
+{
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(this->logicalDevice, this->cache, &dataSize, nullptr);
+	if (result != VK_SUCCESS || dataSize == 0)
+	{
+		return;
+	}
+
+	vector<char> data(dataSize);
+	result = vkGetPipelineCacheData(this->logicalDevice, this->cache, &dataSize, data.data());
+	if (result != VK_SUCCESS)
+	{
+		printf("Failed to retrieve pipeline cache data, cache is not saved.\n");
+		return;
+	}
+
+	PipelineCacheFileHeader header = this->deviceHeader;
+	header.dataSize = dataSize;
+	header.dataHash = hashBytes(data.data(), dataSize);
+
+	string tempPath = this->filePath + ".tmp";
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (!file.is_open())
+		{
+			printf("Failed to open %s, pipeline cache is not saved.\n", tempPath.c_str());
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), dataSize);
+		if (!file.good())
+		{
+			printf("Failed to write %s, pipeline cache is not saved.\n", tempPath.c_str());
+			return;
+		}
+	}
+
+	// Replace previous cache only once new one is completely written
+	remove(this->filePath.c_str());
+	if (rename(tempPath.c_str(), this->filePath.c_str()) != 0)
+	{
+		printf("Failed to replace %s, pipeline cache is not saved.\n", this->filePath.c_str());
+	}
+}
+
+void PipelineCache::cleanup()
+{
+	vkDestroyPipelineCache(this->logicalDevice, this->cache, nullptr);
+	this->cache = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::getCache()
+{
+	return this->cache;
+}
+
+bool PipelineCache::isWarm()
+{
+	return this->warm;
+}
+
+vector<char> PipelineCache::loadCacheData()
+{
+	ifstream file(this->filePath, ios::binary | ios::ate);
+	if (!file.is_open())
+	{
+		return {};
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	if (fileSize < sizeof(PipelineCacheFileHeader))
+	{
+		printf("Pipeline cache %s is truncated, ignoring it.\n", this->filePath.c_str());
+		return {};
+	}
+
+	PipelineCacheFileHeader header;
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	// Cache made by other device, driver or file format is useless (or even harmful) for this run
+	bool headerMatches = header.magic == this->deviceHeader.magic
+		&& header.fileVersion == this->deviceHeader.fileVersion
+		&& header.vendorID == this->deviceHeader.vendorID
+		&& header.deviceID == this->deviceHeader.deviceID
+		&& header.driverVersion == this->deviceHeader.driverVersion
+		&& memcmp(header.driverUUID, this->deviceHeader.driverUUID, VK_UUID_SIZE) == 0
+		&& memcmp(header.pipelineCacheUUID, this->deviceHeader.pipelineCacheUUID, VK_UUID_SIZE) == 0
+		&& header.dataSize == fileSize - sizeof(PipelineCacheFileHeader);
+	if (!headerMatches)
+	{
+		printf("Pipeline cache %s was created by other device/driver, ignoring it.\n", this->filePath.c_str());
+		return {};
+	}
+
+	vector<char> data(header.dataSize);
+	file.read(data.data(), header.dataSize);
+
+	if (!file.good() || hashBytes(data.data(), data.size()) != header.dataHash || !isDriverHeaderValid(data))
+	{
+		printf("Pipeline cache %s is corrupted, ignoring it.\n", this->filePath.c_str());
+		return {};
+	}
+
+	return data;
+}
+
+bool PipelineCache::isDriverHeaderValid(const vector<char>& data)
+{
+	if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne))
+	{
+		return false;
+	}
+
+	VkPipelineCacheHeaderVersionOne driverHeader;
+	memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+
+	return driverHeader.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne)
+		&& driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& driverHeader.vendorID == this->deviceHeader.vendorID
+		&& driverHeader.deviceID == this->deviceHeader.deviceID
+		&& memcmp(driverHeader.pipelineCacheUUID, this->deviceHeader.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+using namespace std;
+
+#define PIPELINE_CACHE_MAGIC			0x43505056		// "VPPC"
+#define PIPELINE_CACHE_FILE_VERSION		1
+
+// Header written in front of driver's cache data. Driver validates its own header too,
+// but a driver update may keep cache UUID while changing behaviour, so driver version/UUID are checked as well.
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t fileVersion;
+	uint64_t dataSize;							// size of driver cache data following the header
+	uint64_t dataHash;							// FNV-1a of driver cache data (detects truncated/corrupted files)
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t driverUUID[VK_UUID_SIZE];
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+// VkPipelineCache persisted between application runs
+class PipelineCache
+{
+
+public:
+	PipelineCache();
+	~PipelineCache();
+
+	// Creates cache, pre-filled from file if file exists and was created by the same device and driver
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, string filePath);
+	// Writes current cache content to file (through temporary file so a crash never leaves half written cache)
+	void save();
+	void cleanup();
+
+	VkPipelineCache getCache();
+	bool isWarm();					// true if cache was loaded from disk
+
+private:
+	VkDevice logicalDevice;
+	VkPipelineCache cache;
+	string filePath;
+	bool warm;
+
+	PipelineCacheFileHeader deviceHeader;		// header values of current device
+
+	vector<char> loadCacheData();
+	bool isDriverHeaderValid(const vector<char>& data);
+};
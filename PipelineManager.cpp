@@ -0,0 +1,589 @@
+#include "PipelineManager.h"
+
+bool PipelineState::operator==(const PipelineState& other) const
+{
+	if (vertexLayout.stride != other.vertexLayout.stride || vertexLayout.attributes.size() != other.vertexLayout.attributes.size())
+	{
+		return false;
+	}
+	for (int i = 0; i < vertexLayout.attributes.size(); i++)
+	{
+		const auto& a = vertexLayout.attributes[i];
+		const auto& b = other.vertexLayout.attributes[i];
+		if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset)
+		{
+			return false;
+		}
+	}
+
+	return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader
+		&& topology == other.topology && polygonMode == other.polygonMode
+		&& cullMode == other.cullMode && frontFace == other.frontFace
+		&& blendEnable == other.blendEnable && colorAttachmentCount == other.colorAttachmentCount
+		&& depthTestEnable == other.depthTestEnable && depthWriteEnable == other.depthWriteEnable
+		&& depthCompareOp == other.depthCompareOp
+		&& depthBiasConstant == other.depthBiasConstant && depthBiasSlope == other.depthBiasSlope
+		&& layout == other.layout && renderPass == other.renderPass && subpass == other.subpass
+		&& specializationConstants == other.specializationConstants;
+}
+
+size_t PipelineStateHash::operator()(const PipelineState& state) const
+{
+	size_t seed = 0;
+	hashCombine(seed, state.vertexShader);
+	hashCombine(seed, state.fragmentShader);
+	hashCombine(seed, state.vertexLayout.stride);
+	for (const auto& attribute : state.vertexLayout.attributes)
+	{
+		hashCombine(seed, attribute.location);
+		hashCombine(seed, attribute.format);
+		hashCombine(seed, attribute.offset);
+	}
+	hashCombine(seed, state.topology);
+	hashCombine(seed, state.polygonMode);
+	hashCombine(seed, state.cullMode);
+	hashCombine(seed, state.frontFace);
+	hashCombine(seed, state.blendEnable);
+	hashCombine(seed, state.colorAttachmentCount);
+	hashCombine(seed, state.depthTestEnable);
+	hashCombine(seed, state.depthWriteEnable);
+	hashCombine(seed, state.depthCompareOp);
+	hashCombine(seed, state.depthBiasConstant);
+	hashCombine(seed, state.depthBiasSlope);
+	hashCombine(seed, state.layout);
+	hashCombine(seed, state.renderPass);
+	hashCombine(seed, state.subpass);
+	for (int32_t constant : state.specializationConstants)
+	{
+		hashCombine(seed, constant);
+	}
+	return seed;
+}
+
+PipelineManager::PipelineManager()
+{
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->pipelineCache = nullptr;
+	this->shaderCompiler = nullptr;
+	this->stopWorkers = false;
+}
+
+PipelineManager::~PipelineManager()
+{
+}
+
+void PipelineManager::init(VkDevice logicalDevice, PipelineCache* pipelineCache, ShaderCompiler* shaderCompiler, uint32_t workerCount)
+{
+	this->logicalDevice = logicalDevice;
+	this->pipelineCache = pipelineCache;
+	this->shaderCompiler = shaderCompiler;
+	this->stopWorkers = false;
+
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		this->workers.emplace_back(&PipelineManager::workerLoop, this);
+	}
+}
+
+void PipelineManager::cleanup()
+{
+	{
+		lock_guard<mutex> lock(this->entriesMutex);
+		this->stopWorkers = true;
+		this->compileQueue.clear();
+	}
+	this->compileCondition.notify_all();
+	for (auto& worker : this->workers)
+	{
+		worker.join();
+	}
+	this->workers.clear();
+
+	for (auto& entry : this->entries)
+	{
+		vkDestroyPipeline(this->logicalDevice, entry.second.pipeline, nullptr);
+	}
+	this->entries.clear();
+
+	for (auto& entry : this->computeEntries)
+	{
+		vkDestroyPipeline(this->logicalDevice, entry.second.pipeline, nullptr);
+	}
+	this->computeEntries.clear();
+
+	for (auto pipeline : this->retiredPipelines)
+	{
+		vkDestroyPipeline(this->logicalDevice, pipeline, nullptr);
+	}
+	this->retiredPipelines.clear();
+	this->shaderCode.clear();
+}
+
+VkPipeline PipelineManager::getPipelineBlocking(const PipelineState& state)
+{
+	{
+		lock_guard<mutex> lock(this->entriesMutex);
+		auto entry = this->entries.find(state);
+		if (entry != this->entries.end() && entry->second.pipeline != VK_NULL_HANDLE)
+		{
+			return entry->second.pipeline;
+		}
+	}
+
+	// Compiled outside of the lock, if worker compiles the same state meanwhile its result is discarded
+	VkPipeline pipeline = compilePipeline(state);
+
+	lock_guard<mutex> lock(this->entriesMutex);
+	PipelineEntry& entry = this->entries[state];
+	if (entry.pipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(this->logicalDevice, pipeline, nullptr);
+		return entry.pipeline;
+	}
+	entry.pipeline = pipeline;
+	return pipeline;
+}
+
+VkPipeline PipelineManager::getPipeline(const PipelineState& state, VkPipeline fallback)
+{
+	lock_guard<mutex> lock(this->entriesMutex);
+
+	PipelineEntry& entry = this->entries[state];
+	if (entry.pipeline != VK_NULL_HANDLE)
+	{
+		return entry.pipeline;
+	}
+
+	if (!entry.pending && !entry.failed)
+	{
+		entry.pending = true;
+		this->compileQueue.push_back(state);
+		this->compileCondition.notify_one();
+	}
+
+	return fallback;
+}
+
+void PipelineManager::prewarm(const PipelineState& state)
+{
+	getPipeline(state, VK_NULL_HANDLE);
+}
+
+VkPipeline PipelineManager::getComputePipeline(const string& computeShader, VkPipelineLayout layout, const vector<int32_t>& specializationConstants)
+{
+	uint64_t key = hashBytes(computeShader.data(), computeShader.size());
+	key = hashBytes(&layout, sizeof(layout), key);
+	key = hashBytes(specializationConstants.data(), specializationConstants.size() * sizeof(int32_t), key);
+
+	VkPipeline oldPipeline = VK_NULL_HANDLE;
+	{
+		lock_guard<mutex> lock(this->entriesMutex);
+		auto entry = this->computeEntries.find(key);
+		if (entry != this->computeEntries.end())
+		{
+			if (!entry->second.stale)
+			{
+				return entry->second.pipeline;
+			}
+			oldPipeline = entry->second.pipeline;
+		}
+	}
+
+	VkPipeline pipeline;
+	try
+	{
+		pipeline = compileComputePipeline(computeShader, layout, specializationConstants);
+	}
+	catch (const runtime_error& e)
+	{
+		if (oldPipeline == VK_NULL_HANDLE)
+		{
+			throw;
+		}
+
+		// Broken reload keeps previous pipeline until shader is changed again
+		printf("ERROR: %s\n", e.what());
+		pipeline = oldPipeline;
+		oldPipeline = VK_NULL_HANDLE;
+	}
+
+	lock_guard<mutex> lock(this->entriesMutex);
+	if (oldPipeline != VK_NULL_HANDLE)
+	{
+		this->retiredPipelines.push_back(oldPipeline);
+	}
+	ComputeEntry& entry = this->computeEntries[key];
+	entry.shaderPath = computeShader;
+	entry.pipeline = pipeline;
+	entry.stale = false;
+	return pipeline;
+}
+
+void PipelineManager::reloadShader(const string& shaderPath)
+{
+	lock_guard<mutex> lock(this->entriesMutex);
+
+	// Next compilation reads the source again
+	this->shaderCode.erase(shaderPath);
+
+	for (auto& entry : this->entries)
+	{
+		const PipelineState& state = entry.first;
+		if (state.vertexShader != shaderPath && state.fragmentShader != shaderPath)
+		{
+			continue;
+		}
+
+		entry.second.failed = false;
+		if (!entry.second.pending)
+		{
+			entry.second.pending = true;
+			this->compileQueue.push_back(state);
+		}
+	}
+	this->compileCondition.notify_all();
+
+	for (auto& entry : this->computeEntries)
+	{
+		entry.second.stale = entry.second.stale || entry.second.shaderPath == shaderPath;
+	}
+}
+
+vector<VkPipeline> PipelineManager::takeRetiredPipelines()
+{
+	lock_guard<mutex> lock(this->entriesMutex);
+
+	vector<VkPipeline> retired;
+	retired.swap(this->retiredPipelines);
+	return retired;
+}
+
+int PipelineManager::getPipelineCount()
+{
+	lock_guard<mutex> lock(this->entriesMutex);
+
+	int count = 0;
+	for (const auto& entry : this->entries)
+	{
+		count += entry.second.pipeline != VK_NULL_HANDLE;
+	}
+	return count;
+}
+
+int PipelineManager::getPendingCount()
+{
+	lock_guard<mutex> lock(this->entriesMutex);
+
+	int count = 0;
+	for (const auto& entry : this->entries)
+	{
+		count += entry.second.pending;
+	}
+	return count;
+}
+
+void PipelineManager::workerLoop()
+{
+	while (true)
+	{
+		PipelineState state;
+		{
+			unique_lock<mutex> lock(this->entriesMutex);
+			this->compileCondition.wait(lock, [this] { return this->stopWorkers || !this->compileQueue.empty(); });
+			if (this->stopWorkers)
+			{
+				return;
+			}
+
+			state = this->compileQueue.front();
+			this->compileQueue.pop_front();
+		}
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		try
+		{
+			pipeline = compilePipeline(state);
+		}
+		catch (const runtime_error& e)
+		{
+			// Previous pipeline (or fallback) keeps being used, compile is retried once shader is reloaded
+			printf("ERROR: %s\n", e.what());
+
+			lock_guard<mutex> lock(this->entriesMutex);
+			PipelineEntry& entry = this->entries[state];
+			entry.pending = false;
+			entry.failed = true;
+			continue;
+		}
+
+		lock_guard<mutex> lock(this->entriesMutex);
+		PipelineEntry& entry = this->entries[state];
+		if (entry.pipeline != VK_NULL_HANDLE)
+		{
+			// Reloaded pipeline replaces old one, which may still be used by frames in flight
+			this->retiredPipelines.push_back(entry.pipeline);
+		}
+		entry.pipeline = pipeline;
+		entry.pending = false;
+	}
+}
+
+VkPipeline PipelineManager::compilePipeline(const PipelineState& state)
+{
+	vector<uint32_t> vertexCode = getShaderCode(state.vertexShader);
+	bool hasFragmentShader = !state.fragmentShader.empty();
+	vector<uint32_t> fragmentCode = hasFragmentShader ? getShaderCode(state.fragmentShader) : vector<uint32_t>();
+
+	// Only attributes vertex shader actually reads are passed to pipeline
+	vector<VkVertexInputAttributeDescription> attributes = getVertexAttributes(state, ShaderReflection::reflect(vertexCode));
+
+	// Modules are only needed during pipeline creation, so they live just for this call
+	VkShaderModule vertexShaderModule = createShaderModule(this->logicalDevice, vertexCode);
+	VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+	try
+	{
+		if (hasFragmentShader)
+		{
+			fragmentShaderModule = createShaderModule(this->logicalDevice, fragmentCode);
+		}
+	}
+	catch (const runtime_error&)
+	{
+		vkDestroyShaderModule(this->logicalDevice, vertexShaderModule, nullptr);
+		throw;
+	}
+
+	// SPECIALIZATION CONSTANTS
+	// Constant N is read from element N, same data is given to both stages (unused constants are ignored by stage)
+	vector<VkSpecializationMapEntry> specializationEntries(state.specializationConstants.size());
+	for (uint32_t i = 0; i < specializationEntries.size(); i++)
+	{
+		specializationEntries[i].constantID = i;
+		specializationEntries[i].offset = i * sizeof(int32_t);
+		specializationEntries[i].size = sizeof(int32_t);
+	}
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+	specializationInfo.pMapEntries = specializationEntries.data();
+	specializationInfo.dataSize = state.specializationConstants.size() * sizeof(int32_t);
+	specializationInfo.pData = state.specializationConstants.data();
+
+	// VERTEX STAGE CREATION
+	VkPipelineShaderStageCreateInfo vertexShaderStageCreateInfo = {};
+	vertexShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertexShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;			// shader stage name
+	vertexShaderStageCreateInfo.module = vertexShaderModule;				// shader module to be used
+	vertexShaderStageCreateInfo.pName = "main";								// shader enter function
+	vertexShaderStageCreateInfo.pSpecializationInfo = &specializationInfo;
+
+	// FRAGMENT STAGE CREATION (skipped by depth only pipelines, rasterizer still writes depth)
+	VkPipelineShaderStageCreateInfo fragmentShaderStageCreateInfo = {};
+	fragmentShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragmentShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;		// shader stage name
+	fragmentShaderStageCreateInfo.module = fragmentShaderModule;				// shader module to be used
+	fragmentShaderStageCreateInfo.pName = "main";								// shader enter function
+	fragmentShaderStageCreateInfo.pSpecializationInfo = &specializationInfo;
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageCreateInfo, fragmentShaderStageCreateInfo };
+
+	// VERTEX INPUT
+	VkVertexInputBindingDescription bindingDescription = {};
+	bindingDescription.binding = 0;
+	bindingDescription.stride = state.vertexLayout.stride;
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
+	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	// Shaders generating their vertices (e.g. fullscreen triangle) read no vertex buffer
+	vertexInputCreateInfo.vertexBindingDescriptionCount = attributes.empty() ? 0 : 1;
+	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+	vertexInputCreateInfo.pVertexAttributeDescriptions = attributes.data();
+
+	// INPUT ASSEMBLY
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = state.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// VIEWPORT & SCISSORS (set on command buffer, so pipeline doesn't depend on swapchain extent)
+	VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
+	viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportStateCreateInfo.viewportCount = 1;
+	viewportStateCreateInfo.scissorCount = 1;
+
+	// DYNAMIC STATES
+	std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
+
+	// RASTERIZER
+	VkPipelineRasterizationStateCreateInfo rastCreateInfo = {};
+	rastCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rastCreateInfo.depthClampEnable = VK_FALSE;
+	rastCreateInfo.rasterizerDiscardEnable = VK_FALSE;
+	rastCreateInfo.polygonMode = state.polygonMode;
+	rastCreateInfo.lineWidth = 1.0f;
+	rastCreateInfo.cullMode = state.cullMode;
+	rastCreateInfo.frontFace = state.frontFace;
+	rastCreateInfo.depthBiasEnable = state.depthBiasConstant != 0.0f || state.depthBiasSlope != 0.0f;
+	rastCreateInfo.depthBiasConstantFactor = state.depthBiasConstant;
+	rastCreateInfo.depthBiasSlopeFactor = state.depthBiasSlope;
+
+	// MULTI SAMPLING
+	VkPipelineMultisampleStateCreateInfo multisamplingCreateInfo = {};
+	multisamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisamplingCreateInfo.sampleShadingEnable = VK_FALSE;
+	multisamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// BLENDING
+	// (new color alpha * new color) + ((1 - new color alpha) * old color), alpha is replaced by new one
+	VkPipelineColorBlendAttachmentState colorState = {};
+	colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+		| VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorState.blendEnable = state.blendEnable ? VK_TRUE : VK_FALSE;
+	colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorState.colorBlendOp = VK_BLEND_OP_ADD;
+	colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorState.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendingCreateInfo = {};
+	colorBlendingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendingCreateInfo.logicOpEnable = VK_FALSE;
+	vector<VkPipelineColorBlendAttachmentState> colorStates(state.colorAttachmentCount, colorState);
+	colorBlendingCreateInfo.attachmentCount = static_cast<uint32_t>(colorStates.size());
+	colorBlendingCreateInfo.pAttachments = colorStates.data();
+
+	// DEPTH STENCIL
+	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
+	depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilCreateInfo.depthTestEnable = state.depthTestEnable ? VK_TRUE : VK_FALSE;
+	depthStencilCreateInfo.depthWriteEnable = state.depthWriteEnable ? VK_TRUE : VK_FALSE;
+	depthStencilCreateInfo.depthCompareOp = state.depthCompareOp;
+	depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;
+	depthStencilCreateInfo.stencilTestEnable = VK_FALSE;
+
+	// -- GRAPHICS PIPELINE CREATION --
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stageCount = hasFragmentShader ? 2 : 1;
+	pipelineCreateInfo.pStages = shaderStages;
+	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;
+	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+	pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+	pipelineCreateInfo.pRasterizationState = &rastCreateInfo;
+	pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
+	pipelineCreateInfo.pColorBlendState = &colorBlendingCreateInfo;
+	pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
+	pipelineCreateInfo.layout = state.layout;
+	pipelineCreateInfo.renderPass = state.renderPass;
+	pipelineCreateInfo.subpass = state.subpass;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	// Pipeline cache is internally synchronized, so workers share it
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(this->logicalDevice, this->pipelineCache->getCache(), 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+	if (fragmentShaderModule != VK_NULL_HANDLE)
+	{
+		vkDestroyShaderModule(this->logicalDevice, fragmentShaderModule, nullptr);
+	}
+	vkDestroyShaderModule(this->logicalDevice, vertexShaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create a Graphics Pipeline!");
+	}
+
+	return pipeline;
+}
+
+VkPipeline PipelineManager::compileComputePipeline(const string& computeShader, VkPipelineLayout layout, const vector<int32_t>& specializationConstants)
+{
+	VkShaderModule computeShaderModule = createShaderModule(this->logicalDevice, getShaderCode(computeShader));
+
+	vector<VkSpecializationMapEntry> specializationEntries(specializationConstants.size());
+	for (uint32_t i = 0; i < specializationEntries.size(); i++)
+	{
+		specializationEntries[i].constantID = i;
+		specializationEntries[i].offset = i * sizeof(int32_t);
+		specializationEntries[i].size = sizeof(int32_t);
+	}
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+	specializationInfo.pMapEntries = specializationEntries.data();
+	specializationInfo.dataSize = specializationConstants.size() * sizeof(int32_t);
+	specializationInfo.pData = specializationConstants.data();
+
+	VkPipelineShaderStageCreateInfo computeShaderStageCreateInfo = {};
+	computeShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computeShaderStageCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeShaderStageCreateInfo.module = computeShaderModule;
+	computeShaderStageCreateInfo.pName = "main";
+	computeShaderStageCreateInfo.pSpecializationInfo = &specializationInfo;
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage = computeShaderStageCreateInfo;
+	pipelineCreateInfo.layout = layout;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateComputePipelines(this->logicalDevice, this->pipelineCache->getCache(), 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+	vkDestroyShaderModule(this->logicalDevice, computeShaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create a Compute Pipeline for " + computeShader + "!");
+	}
+
+	return pipeline;
+}
+
+vector<uint32_t> PipelineManager::getShaderCode(const string& filePath)
+{
+	{
+		lock_guard<mutex> lock(this->entriesMutex);
+		auto cached = this->shaderCode.find(filePath);
+		if (cached != this->shaderCode.end())
+		{
+			return cached->second;
+		}
+	}
+
+	// Compiled outside of the lock (compiler has its own disk cache, so this is cheap unless source changed)
+	vector<uint32_t> code = this->shaderCompiler->compile(filePath);
+
+	lock_guard<mutex> lock(this->entriesMutex);
+	this->shaderCode[filePath] = code;
+	return code;
+}
+
+vector<VkVertexInputAttributeDescription> PipelineManager::getVertexAttributes(const PipelineState& state, const ShaderReflection& vertexReflection)
+{
+	// Vertex layout describes everything mesh provides, shader may read any subset of it (matched by location)
+	vector<VkVertexInputAttributeDescription> attributes;
+	for (const auto& input : vertexReflection.inputs)
+	{
+		auto attribute = find_if(state.vertexLayout.attributes.begin(), state.vertexLayout.attributes.end(),
+			[&input](const VkVertexInputAttributeDescription& a) { return a.location == input.location; });
+		if (attribute == state.vertexLayout.attributes.end())
+		{
+			throw runtime_error("Failed to create pipeline, " + state.vertexShader + " reads vertex input at location "
+				+ to_string(input.location) + " which vertex layout doesn't provide.");
+		}
+		attributes.push_back(*attribute);
+	}
+	return attributes;
+}
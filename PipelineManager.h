@@ -0,0 +1,124 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "PipelineCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+
+#define PIPELINE_COMPILE_THREADS 2
+
+// Layout of single interleaved vertex buffer (binding 0), attributes not read by vertex shader are skipped
+struct VertexLayout
+{
+	uint32_t stride;
+	vector<VkVertexInputAttributeDescription> attributes;
+};
+
+// Everything that makes graphics pipelines different (viewport and scissor are dynamic, so extent is not part of it)
+struct PipelineState
+{
+	string vertexShader;								// GLSL source paths
+	string fragmentShader;								// empty for depth only pipelines
+	VertexLayout vertexLayout;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	bool blendEnable = false;
+	uint32_t colorAttachmentCount = 1;					// color attachments of the subpass (0 for depth only passes)
+	bool depthTestEnable = true;
+	bool depthWriteEnable = true;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+	float depthBiasConstant = 0.0f;						// depth bias is enabled when any factor is non zero (shadow maps)
+	float depthBiasSlope = 0.0f;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	vector<int32_t> specializationConstants;			// value of constant_id N is element N (visible to all stages)
+
+	bool operator==(const PipelineState& other) const;
+};
+
+struct PipelineStateHash
+{
+	size_t operator()(const PipelineState& state) const;
+};
+
+// Caches pipelines by their state, missing variants are compiled by worker threads without stalling the caller
+class PipelineManager
+{
+
+public:
+	PipelineManager();
+	~PipelineManager();
+
+	void init(VkDevice logicalDevice, PipelineCache* pipelineCache, ShaderCompiler* shaderCompiler, uint32_t workerCount = PIPELINE_COMPILE_THREADS);
+	void cleanup();
+
+	// Returns ready pipeline or compiles it right away on calling thread (for pipelines frame can't go without)
+	VkPipeline getPipelineBlocking(const PipelineState& state);
+	// Returns ready pipeline, otherwise queues compilation and returns fallback
+	VkPipeline getPipeline(const PipelineState& state, VkPipeline fallback);
+	// Queues compilation of pipeline that is going to be needed soon
+	void prewarm(const PipelineState& state);
+	// Compute pipelines are cheap to compile, they are created on calling thread (also after reload of their shader)
+	VkPipeline getComputePipeline(const string& computeShader, VkPipelineLayout layout,
+		const vector<int32_t>& specializationConstants = {});
+
+	// Recompiles (in background) all pipelines that use given shader, old pipelines are used until new ones are ready
+	void reloadShader(const string& shaderPath);
+	// Pipelines replaced by reload, caller destroys them once GPU no longer uses them
+	vector<VkPipeline> takeRetiredPipelines();
+
+	int getPipelineCount();
+	int getPendingCount();
+
+private:
+	struct PipelineEntry
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		bool pending = false;						// queued or being compiled
+		bool failed = false;						// last compilation failed (not retried until shader is reloaded)
+	};
+
+	struct ComputeEntry
+	{
+		string shaderPath;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		bool stale = false;							// shader was reloaded, pipeline is recreated on next request
+	};
+
+	VkDevice logicalDevice;
+	PipelineCache* pipelineCache;
+	ShaderCompiler* shaderCompiler;
+
+	mutex entriesMutex;
+	unordered_map<PipelineState, PipelineEntry, PipelineStateHash> entries;
+	unordered_map<uint64_t, ComputeEntry> computeEntries;	// by hash of shader path, layout and constants
+	unordered_map<string, vector<uint32_t>> shaderCode;		// compiled SPIR-V by source path
+	vector<VkPipeline> retiredPipelines;
+
+	// Compile queue served by worker threads
+	deque<PipelineState> compileQueue;
+	condition_variable compileCondition;
+	vector<thread> workers;
+	bool stopWorkers;
+
+	void workerLoop();
+	VkPipeline compilePipeline(const PipelineState& state);
+	VkPipeline compileComputePipeline(const string& computeShader, VkPipelineLayout layout, const vector<int32_t>& specializationConstants);
+	vector<uint32_t> getShaderCode(const string& filePath);
+	vector<VkVertexInputAttributeDescription> getVertexAttributes(const PipelineState& state, const ShaderReflection& vertexReflection);
+};
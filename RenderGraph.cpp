@@ -0,0 +1,1519 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <map>
+
+#define RENDER_GRAPH_WRITE_ACCESS (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT \
+	| VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT)
+
+// -- PASS DECLARATION --
+
+RenderGraphPass::RenderGraphPass(const string& name, bool graphics)
+{
+	this->name = name;
+	this->graphics = graphics;
+}
+
+void RenderGraphPass::writeColor(RenderGraphResource image)
+{
+	addAccess(image, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+}
+
+void RenderGraphPass::writeColor(RenderGraphResource image, VkClearColorValue clearColor)
+{
+	VkClearValue clearValue = {};
+	clearValue.color = clearColor;
+	addAccess(image, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, true, clearValue);
+}
+
+void RenderGraphPass::writeDepth(RenderGraphResource image)
+{
+	addAccess(image, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
+}
+
+void RenderGraphPass::writeDepth(RenderGraphResource image, float clearDepth)
+{
+	VkClearValue clearValue = {};
+	clearValue.depthStencil.depth = clearDepth;
+	clearValue.depthStencil.stencil = 0;
+	addAccess(image, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		true, clearValue);
+}
+
+void RenderGraphPass::readDepth(RenderGraphResource image)
+{
+	addAccess(image, RENDER_GRAPH_ACCESS_DEPTH_READ, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
+}
+
+void RenderGraphPass::readInputAttachment(RenderGraphResource image)
+{
+	addAccess(image, RENDER_GRAPH_ACCESS_INPUT_ATTACHMENT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+void RenderGraphPass::readTexture(RenderGraphResource image, VkPipelineStageFlags stages)
+{
+	addAccess(image, RENDER_GRAPH_ACCESS_SAMPLED, stages);
+}
+
+void RenderGraphPass::readStorage(RenderGraphResource resource, VkPipelineStageFlags stages)
+{
+	addAccess(resource, RENDER_GRAPH_ACCESS_STORAGE_READ, stages);
+}
+
+void RenderGraphPass::writeStorage(RenderGraphResource resource, VkPipelineStageFlags stages)
+{
+	addAccess(resource, RENDER_GRAPH_ACCESS_STORAGE_WRITE, stages);
+}
+
+void RenderGraphPass::readIndirect(RenderGraphResource buffer)
+{
+	addAccess(buffer, RENDER_GRAPH_ACCESS_INDIRECT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+}
+
+void RenderGraphPass::readVertexBuffer(RenderGraphResource buffer)
+{
+	addAccess(buffer, RENDER_GRAPH_ACCESS_VERTEX_INPUT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+}
+
+void RenderGraphPass::readTransfer(RenderGraphResource resource)
+{
+	addAccess(resource, RENDER_GRAPH_ACCESS_TRANSFER_SRC, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
+
+void RenderGraphPass::writeTransfer(RenderGraphResource resource)
+{
+	addAccess(resource, RENDER_GRAPH_ACCESS_TRANSFER_DST, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
+
+void RenderGraphPass::setSideEffects()
+{
+	this->sideEffects = true;
+}
+
+void RenderGraphPass::setExecute(function<void(VkCommandBuffer)> execute)
+{
+	this->execute = execute;
+}
+
+const string& RenderGraphPass::getName() const
+{
+	return this->name;
+}
+
+void RenderGraphPass::addAccess(RenderGraphResource resource, RenderGraphAccessType type, VkPipelineStageFlags stages, bool clear, VkClearValue clearValue)
+{
+	if (resource == RENDER_GRAPH_NO_RESOURCE)
+	{
+		throw runtime_error("Render graph pass " + this->name + " uses invalid resource.");
+	}
+
+	RenderGraphAccess access = {};
+	access.resource = resource;
+	access.type = type;
+	access.stages = stages;
+	access.clear = clear;
+	access.clearValue = clearValue;
+	this->accesses.push_back(access);
+}
+
+// Whether access depends on previous content of resource (attachments that are cleared or transfer targets don't)
+static bool readsContent(const RenderGraphAccess& access)
+{
+	switch (access.type)
+	{
+	case RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+	case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+		return !access.clear;
+	case RENDER_GRAPH_ACCESS_TRANSFER_DST:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static bool writesContent(const RenderGraphAccess& access)
+{
+	switch (access.type)
+	{
+	case RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+	case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+	case RENDER_GRAPH_ACCESS_STORAGE_WRITE:
+	case RENDER_GRAPH_ACCESS_TRANSFER_DST:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// -- GRAPH --
+
+size_t RenderGraph::VectorHash::operator()(const vector<uint64_t>& key) const
+{
+	return static_cast<size_t>(hashBytes(key.data(), key.size() * sizeof(uint64_t)));
+}
+
+RenderGraph::RenderGraph()
+{
+	this->physicalDevice = VK_NULL_HANDLE;
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->frameScheduler = nullptr;
+	this->memoryProperties = {};
+	this->transientStages = 0;
+	this->transientWriteAccess = 0;
+	this->transientMemorySize = 0;
+	this->transientRequestedSize = 0;
+}
+
+RenderGraph::~RenderGraph()
+{
+}
+
+void RenderGraph::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, FrameScheduler* frameScheduler)
+{
+	this->physicalDevice = physicalDevice;
+	this->logicalDevice = logicalDevice;
+	this->frameScheduler = frameScheduler;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &this->memoryProperties);
+}
+
+void RenderGraph::cleanup()
+{
+	// GPU is idle at this point, nothing has to be deferred
+	this->frameScheduler = nullptr;
+	destroyTransients();
+
+	for (auto& renderPass : this->renderPassCache)
+	{
+		vkDestroyRenderPass(this->logicalDevice, renderPass.second, nullptr);
+	}
+	this->renderPassCache.clear();
+
+	reset();
+	this->groups.clear();
+	this->passRenderPasses.clear();
+}
+
+void RenderGraph::reset()
+{
+	this->resources.clear();
+	this->passes.clear();
+}
+
+RenderGraphResource RenderGraph::createImage(const string& name, const RenderGraphImageDesc& desc)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.image = true;
+	resource.imported = false;
+	resource.desc = desc;
+	this->resources.push_back(resource);
+	return static_cast<RenderGraphResource>(this->resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importImage(const string& name, VkImage image, VkImageView imageView, const RenderGraphImageDesc& desc,
+	VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags previousStages, VkAccessFlags previousAccess)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.image = true;
+	resource.imported = true;
+	resource.desc = desc;
+	resource.vkImage = image;
+	resource.vkImageView = imageView;
+	resource.initialLayout = initialLayout;
+	resource.finalLayout = finalLayout;
+	resource.previousStages = previousStages;
+	resource.previousAccess = previousAccess;
+	this->resources.push_back(resource);
+	return static_cast<RenderGraphResource>(this->resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importBuffer(const string& name, VkBuffer buffer, VkDeviceSize size,
+	VkPipelineStageFlags previousStages, VkAccessFlags previousAccess)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.image = false;
+	resource.imported = true;
+	resource.vkBuffer = buffer;
+	resource.size = size;
+	resource.previousStages = previousStages;
+	resource.previousAccess = previousAccess;
+	this->resources.push_back(resource);
+	return static_cast<RenderGraphResource>(this->resources.size() - 1);
+}
+
+RenderGraphPass& RenderGraph::addGraphicsPass(const string& name)
+{
+	this->passes.emplace_back(name, true);
+	return this->passes.back();
+}
+
+RenderGraphPass& RenderGraph::addComputePass(const string& name)
+{
+	this->passes.emplace_back(name, false);
+	return this->passes.back();
+}
+
+void RenderGraph::compile()
+{
+	for (const auto& pass : this->passes)
+	{
+		for (const auto& access : pass.accesses)
+		{
+			if (access.resource >= this->resources.size())
+			{
+				throw runtime_error("Render graph pass " + pass.name + " uses resource that doesn't exist.");
+			}
+		}
+	}
+
+	cullPasses();
+	groupPasses();
+	planTransients();
+	planBarriers();
+
+	this->passRenderPasses.clear();
+	for (auto& group : this->groups)
+	{
+		if (!group.graphics)
+		{
+			continue;
+		}
+		group.renderPass = createRenderPass(group);
+		for (uint32_t subpass = 0; subpass < group.passes.size(); subpass++)
+		{
+			this->passRenderPasses[this->passes[group.passes[subpass]].name] = { group.renderPass, subpass };
+		}
+	}
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walking backwards, pass is kept if it has side effects or writes something later (kept) pass or outside world needs
+	vector<bool> needed(this->resources.size(), false);
+	for (int i = 0; i < this->resources.size(); i++)
+	{
+		needed[i] = this->resources[i].imported;
+	}
+
+	vector<bool> alive(this->passes.size(), false);
+	for (int i = static_cast<int>(this->passes.size()) - 1; i >= 0; i--)
+	{
+		const RenderGraphPass& pass = this->passes[i];
+		alive[i] = pass.sideEffects;
+		for (const auto& access : pass.accesses)
+		{
+			alive[i] = alive[i] || (writesContent(access) && needed[access.resource]);
+		}
+		if (!alive[i])
+		{
+			continue;
+		}
+		for (const auto& access : pass.accesses)
+		{
+			if (readsContent(access))
+			{
+				needed[access.resource] = true;
+			}
+		}
+	}
+
+	this->passOrder.clear();
+	vector<bool> written(this->resources.size(), false);
+	for (int i = 0; i < this->passes.size(); i++)
+	{
+		if (!alive[i])
+		{
+			continue;
+		}
+
+		// Declaration order is execution order, so transient must be written by an earlier pass before anything reads it
+		for (const auto& access : this->passes[i].accesses)
+		{
+			const Resource& resource = this->resources[access.resource];
+			if (!resource.imported && readsContent(access) && !written[access.resource])
+			{
+				throw runtime_error("Render graph pass " + this->passes[i].name + " reads " + resource.name + " before any pass writes it.");
+			}
+		}
+		for (const auto& access : this->passes[i].accesses)
+		{
+			written[access.resource] = written[access.resource] || writesContent(access);
+		}
+		this->passOrder.push_back(i);
+	}
+}
+
+void RenderGraph::groupPasses()
+{
+	this->groups.clear();
+
+	for (int passIndex : this->passOrder)
+	{
+		const RenderGraphPass& pass = this->passes[passIndex];
+
+		VkExtent2D extent = {};
+		bool hasAttachment = false;
+		for (const auto& access : pass.accesses)
+		{
+			if (isAttachmentAccess(access.type))
+			{
+				extent = this->resources[access.resource].desc.extent;
+				hasAttachment = true;
+				break;
+			}
+		}
+		if (pass.graphics && !hasAttachment)
+		{
+			throw runtime_error("Render graph graphics pass " + pass.name + " has no attachments.");
+		}
+
+		// Pass becomes next subpass if it has the same size and touches resources of the render pass only as attachments
+		// (everything else needs barriers that can't be placed inside a render pass)
+		bool merge = pass.graphics && !this->groups.empty() && this->groups.back().graphics
+			&& this->groups.back().extent.width == extent.width && this->groups.back().extent.height == extent.height;
+		if (merge)
+		{
+			const PassGroup& group = this->groups.back();
+			for (const auto& access : pass.accesses)
+			{
+				bool usedByGroup = false;
+				for (int groupPass : group.passes)
+				{
+					for (const auto& groupAccess : this->passes[groupPass].accesses)
+					{
+						if (groupAccess.resource == access.resource)
+						{
+							usedByGroup = usedByGroup || !isAttachmentAccess(groupAccess.type) || writesContent(groupAccess);
+						}
+					}
+				}
+				if (usedByGroup && !isAttachmentAccess(access.type))
+				{
+					merge = false;
+					break;
+				}
+			}
+		}
+
+		if (!merge)
+		{
+			PassGroup group = {};
+			group.graphics = pass.graphics;
+			group.extent = extent;
+			this->groups.push_back(group);
+		}
+
+		PassGroup& group = this->groups.back();
+		group.passes.push_back(passIndex);
+		for (const auto& access : pass.accesses)
+		{
+			if (isAttachmentAccess(access.type)
+				&& find(group.attachments.begin(), group.attachments.end(), access.resource) == group.attachments.end())
+			{
+				group.attachments.push_back(access.resource);
+				group.clearValues.push_back(access.clearValue);
+			}
+		}
+	}
+}
+
+void RenderGraph::planTransients()
+{
+	// LIFETIMES AND USAGE
+	this->transientStages = 0;
+	this->transientWriteAccess = 0;
+	for (auto& resource : this->resources)
+	{
+		resource.usage = 0;
+		resource.firstPass = -1;
+		resource.lastPass = -1;
+		resource.physicalImage = -1;
+	}
+	for (int position = 0; position < this->passOrder.size(); position++)
+	{
+		for (const auto& access : this->passes[this->passOrder[position]].accesses)
+		{
+			Resource& resource = this->resources[access.resource];
+			VkImageLayout layout;
+			VkPipelineStageFlags stages;
+			VkAccessFlags accessFlags;
+			bool write;
+			VkImageUsageFlags usage;
+			getAccessInfo(access, &layout, &stages, &accessFlags, &write, &usage);
+
+			resource.usage |= usage;
+			resource.firstPass = resource.firstPass < 0 ? position : resource.firstPass;
+			resource.lastPass = position;
+			if (!resource.imported)
+			{
+				this->transientStages |= stages;
+				this->transientWriteAccess |= write ? accessFlags & RENDER_GRAPH_WRITE_ACCESS : 0;
+			}
+		}
+	}
+
+	// Transient images are recreated only if their descriptions or aliasing changed (normally never after first frame).
+	// Pass positions shift whenever a pass that runs only some frames (shadows, skinning) comes or goes, so lifetimes are
+	// keyed only by which transients overlap each other, the one thing memory aliasing depends on
+	vector<RenderGraphResource> transients;
+	for (RenderGraphResource i = 0; i < this->resources.size(); i++)
+	{
+		const Resource& resource = this->resources[i];
+		if (!resource.imported && resource.firstPass >= 0)
+		{
+			transients.push_back(i);
+		}
+	}
+	vector<uint64_t> planKey;
+	size_t overlapWords = (transients.size() + 63) / 64;
+	for (int i = 0; i < transients.size(); i++)
+	{
+		const Resource& resource = this->resources[transients[i]];
+		planKey.insert(planKey.end(), { (uint64_t)resource.desc.format, resource.desc.extent.width, resource.desc.extent.height,
+			(uint64_t)resource.desc.samples, resource.usage });
+
+		// Bit j is set when lifetime of transient j overlaps this one
+		size_t overlapStart = planKey.size();
+		planKey.resize(overlapStart + overlapWords, 0);
+		for (int j = 0; j < transients.size(); j++)
+		{
+			const Resource& other = this->resources[transients[j]];
+			if (resource.firstPass <= other.lastPass && other.firstPass <= resource.lastPass)
+			{
+				planKey[overlapStart + j / 64] |= 1ull << (j % 64);
+			}
+		}
+	}
+
+	if (planKey == this->transientPlanKey && this->transientImages.size() == transients.size())
+	{
+		for (int i = 0; i < transients.size(); i++)
+		{
+			this->resources[transients[i]].physicalImage = i;
+		}
+		return;
+	}
+
+	destroyTransients();
+	this->transientPlanKey = planKey;
+
+	// IMAGE CREATION
+	const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+		| VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+	vector<bool> lazy(transients.size(), false);
+	for (int i = 0; i < transients.size(); i++)
+	{
+		Resource& resource = this->resources[transients[i]];
+		resource.physicalImage = i;
+
+		// Images never leaving render pass don't need backing memory on tiled GPUs
+		lazy[i] = (resource.usage & ~attachmentUsage) == 0;
+
+		VkImageCreateInfo imageCreateInfo = {};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.extent.width = resource.desc.extent.width;
+		imageCreateInfo.extent.height = resource.desc.extent.height;
+		imageCreateInfo.extent.depth = 1;
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.format = resource.desc.format;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCreateInfo.usage = resource.usage | (lazy[i] ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+		imageCreateInfo.samples = resource.desc.samples;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		TransientImage transient = {};
+		VkResult result = vkCreateImage(this->logicalDevice, &imageCreateInfo, nullptr, &transient.image);
+		if (result != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create render graph image " + resource.name + ".");
+		}
+		vkGetImageMemoryRequirements(this->logicalDevice, transient.image, &transient.memoryRequirements);
+		this->transientImages.push_back(transient);
+	}
+
+	// MEMORY ALIASING
+	// Images of the same memory type share one allocation, images whose lifetimes don't overlap may share its ranges
+	this->transientMemorySize = 0;
+	this->transientRequestedSize = 0;
+	map<uint32_t, vector<int>> aliasGroups;
+	for (int i = 0; i < transients.size(); i++)
+	{
+		TransientImage& transient = this->transientImages[i];
+		this->transientRequestedSize += transient.memoryRequirements.size;
+
+		bool lazyFound = false;
+		uint32_t lazyType = lazy[i] ? findMemoryType(transient.memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyFound) : 0;
+		if (lazyFound)
+		{
+			// Lazily allocated memory is committed only if tile memory doesn't suffice, so there is nothing to alias
+			VkMemoryAllocateInfo allocateInfo = {};
+			allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocateInfo.allocationSize = transient.memoryRequirements.size;
+			allocateInfo.memoryTypeIndex = lazyType;
+
+			VkDeviceMemory memory;
+			if (vkAllocateMemory(this->logicalDevice, &allocateInfo, nullptr, &memory) != VK_SUCCESS)
+			{
+				throw runtime_error("Failed to allocate render graph image memory.");
+			}
+			vkBindImageMemory(this->logicalDevice, transient.image, memory, 0);
+			transient.memoryBlock = static_cast<int>(this->transientMemory.size());
+			this->transientMemory.push_back(memory);
+			continue;
+		}
+
+		bool found = false;
+		uint32_t memoryType = findMemoryType(transient.memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &found);
+		if (!found)
+		{
+			throw runtime_error("Failed to find memory type for render graph image " + this->resources[transients[i]].name + ".");
+		}
+		aliasGroups[memoryType].push_back(i);
+	}
+
+	for (auto& aliasGroup : aliasGroups)
+	{
+		vector<int>& images = aliasGroup.second;
+
+		// Largest first, each image takes lowest offset not used by images alive at the same time
+		sort(images.begin(), images.end(), [this](int a, int b) {
+			return this->transientImages[a].memoryRequirements.size > this->transientImages[b].memoryRequirements.size;
+		});
+
+		VkDeviceSize blockSize = 0;
+		vector<int> placed;
+		for (int image : images)
+		{
+			const Resource& resource = this->resources[transients[image]];
+			const VkMemoryRequirements& requirements = this->transientImages[image].memoryRequirements;
+
+			vector<pair<VkDeviceSize, VkDeviceSize>> busyRanges;
+			for (int other : placed)
+			{
+				const Resource& otherResource = this->resources[transients[other]];
+				bool overlap = resource.firstPass <= otherResource.lastPass && otherResource.firstPass <= resource.lastPass;
+				if (overlap)
+				{
+					const TransientImage& otherImage = this->transientImages[other];
+					busyRanges.push_back({ otherImage.offset, otherImage.offset + otherImage.memoryRequirements.size });
+				}
+			}
+			sort(busyRanges.begin(), busyRanges.end());
+
+			VkDeviceSize offset = 0;
+			for (const auto& range : busyRanges)
+			{
+				if (offset + requirements.size <= range.first)
+				{
+					break;
+				}
+				offset = std::max(offset, (range.second + requirements.alignment - 1) / requirements.alignment * requirements.alignment);
+			}
+
+			this->transientImages[image].offset = offset;
+			blockSize = std::max(blockSize, offset + requirements.size);
+			placed.push_back(image);
+		}
+
+		VkMemoryAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = blockSize;
+		allocateInfo.memoryTypeIndex = aliasGroup.first;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(this->logicalDevice, &allocateInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to allocate render graph image memory.");
+		}
+		for (int image : images)
+		{
+			vkBindImageMemory(this->logicalDevice, this->transientImages[image].image, memory, this->transientImages[image].offset);
+			this->transientImages[image].memoryBlock = static_cast<int>(this->transientMemory.size());
+		}
+		this->transientMemory.push_back(memory);
+		this->transientMemorySize += blockSize;
+	}
+
+	// IMAGE VIEWS
+	for (int i = 0; i < transients.size(); i++)
+	{
+		const Resource& resource = this->resources[transients[i]];
+
+		VkImageViewCreateInfo viewCreateInfo = {};
+		viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewCreateInfo.image = this->transientImages[i].image;
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCreateInfo.format = resource.desc.format;
+		viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewCreateInfo.subresourceRange.aspectMask = getAspectFlags(resource.desc.format) & ~VK_IMAGE_ASPECT_STENCIL_BIT;
+		viewCreateInfo.subresourceRange.baseMipLevel = 0;
+		viewCreateInfo.subresourceRange.levelCount = 1;
+		viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+		viewCreateInfo.subresourceRange.layerCount = 1;
+
+		VkResult result = vkCreateImageView(this->logicalDevice, &viewCreateInfo, nullptr, &this->transientImages[i].imageView);
+		if (result != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create render graph image view " + resource.name + ".");
+		}
+	}
+}
+
+void RenderGraph::planBarriers()
+{
+	vector<ResourceState> states(this->resources.size());
+	for (int i = 0; i < this->resources.size(); i++)
+	{
+		states[i].layout = this->resources[i].imported ? this->resources[i].initialLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+
+	// Transient used last before each transient in memory they share, its writes must land before the new image overwrites them
+	vector<int> previousAliases(this->resources.size(), -1);
+	for (RenderGraphResource i = 0; i < this->resources.size(); i++)
+	{
+		const Resource& resource = this->resources[i];
+		if (resource.physicalImage < 0)
+		{
+			continue;
+		}
+		const TransientImage& image = this->transientImages[resource.physicalImage];
+		for (RenderGraphResource j = 0; j < this->resources.size(); j++)
+		{
+			const Resource& other = this->resources[j];
+			if (other.physicalImage < 0 || other.lastPass >= resource.firstPass
+				|| (previousAliases[i] >= 0 && other.lastPass <= this->resources[previousAliases[i]].lastPass))
+			{
+				continue;
+			}
+			const TransientImage& otherImage = this->transientImages[other.physicalImage];
+			if (otherImage.memoryBlock == image.memoryBlock && otherImage.offset < image.offset + image.memoryRequirements.size
+				&& image.offset < otherImage.offset + otherImage.memoryRequirements.size)
+			{
+				previousAliases[i] = j;
+			}
+		}
+	}
+
+	for (auto& group : this->groups)
+	{
+		group.barriers.clear();
+
+		// Within render pass only first use of each resource needs barrier, later subpasses are synchronized by subpass dependencies
+		vector<bool> seen(this->resources.size(), false);
+		for (int passIndex : group.passes)
+		{
+			// Accesses of the same resource in one pass are combined into single state change
+			map<RenderGraphResource, RenderGraphAccess> combined;
+			map<RenderGraphResource, VkImageLayout> layouts;
+			map<RenderGraphResource, VkAccessFlags> accessMasks;
+			map<RenderGraphResource, bool> writes;
+			for (const auto& access : this->passes[passIndex].accesses)
+			{
+				VkImageLayout layout;
+				VkPipelineStageFlags stages;
+				VkAccessFlags accessFlags;
+				bool write;
+				VkImageUsageFlags usage;
+				getAccessInfo(access, &layout, &stages, &accessFlags, &write, &usage);
+
+				if (combined.count(access.resource) == 0)
+				{
+					combined[access.resource] = access;
+					layouts[access.resource] = layout;
+					accessMasks[access.resource] = accessFlags;
+					writes[access.resource] = write;
+					continue;
+				}
+
+				// Depth tested and read as input attachment in the same subpass has to stay in read only depth layout
+				if (layouts[access.resource] != layout)
+				{
+					layouts[access.resource] = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+				}
+				combined[access.resource].stages |= stages;
+				accessMasks[access.resource] |= accessFlags;
+				writes[access.resource] = writes[access.resource] || write;
+			}
+
+			for (const auto& entry : combined)
+			{
+				RenderGraphResource resource = entry.first;
+				ResourceState& state = states[resource];
+				VkImageLayout layout = this->resources[resource].image ? layouts[resource] : VK_IMAGE_LAYOUT_UNDEFINED;
+
+				if (group.graphics && seen[resource])
+				{
+					// Transition is done by render pass itself
+					state.layout = layout;
+					if (writes[resource])
+					{
+						state.writeStages = entry.second.stages;
+						state.writeAccess = accessMasks[resource] & RENDER_GRAPH_WRITE_ACCESS;
+						state.readStages = 0;
+					}
+					else
+					{
+						state.readStages |= entry.second.stages;
+					}
+					continue;
+				}
+
+				seen[resource] = true;
+				const ResourceState* aliasState = previousAliases[resource] >= 0 ? &states[previousAliases[resource]] : nullptr;
+				addBarrier(group.barriers, resource, state, aliasState, layout, entry.second.stages, accessMasks[resource], writes[resource]);
+			}
+		}
+	}
+
+	// Imported images are left in layout their owner expects (e.g. present)
+	this->finalBarriers.clear();
+	for (RenderGraphResource i = 0; i < this->resources.size(); i++)
+	{
+		const Resource& resource = this->resources[i];
+		if (!resource.imported || !resource.image || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || states[i].layout == resource.finalLayout)
+		{
+			continue;
+		}
+
+		Barrier barrier = {};
+		barrier.resource = i;
+		barrier.oldLayout = states[i].layout;
+		barrier.newLayout = resource.finalLayout;
+		barrier.srcStages = states[i].writeStages | states[i].readStages;
+		barrier.srcStages = barrier.srcStages != 0 ? barrier.srcStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		barrier.srcAccess = states[i].writeAccess;
+		barrier.dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		barrier.dstAccess = 0;
+		this->finalBarriers.push_back(barrier);
+	}
+}
+
+void RenderGraph::addBarrier(vector<Barrier>& barriers, RenderGraphResource resource, ResourceState& state,
+	const ResourceState* aliasState, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags accessFlags, bool write)
+{
+	const Resource& graphResource = this->resources[resource];
+	bool layoutChange = graphResource.image && state.layout != layout;
+
+	Barrier barrier = {};
+	barrier.resource = resource;
+	barrier.oldLayout = state.layout;
+	barrier.newLayout = layout;
+	barrier.dstStages = stages;
+	barrier.dstAccess = accessFlags;
+
+	bool needed;
+	if (!state.used)
+	{
+		if (!graphResource.imported)
+		{
+			// First use of transient in this frame, content is discarded but the image placed before it in the same memory
+			// may still use it and its writes have to land first (write after write). Without one earlier in this frame,
+			// memory was last used by some transient of previous frame
+			needed = true;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (aliasState != nullptr && (aliasState->writeStages | aliasState->readStages) != 0)
+			{
+				barrier.srcStages = aliasState->writeStages | aliasState->readStages;
+				barrier.srcAccess = aliasState->writeAccess;
+			}
+			else
+			{
+				barrier.srcStages = this->transientStages;
+				barrier.srcAccess = this->transientWriteAccess;
+			}
+		}
+		else if (graphResource.previousStages != 0)
+		{
+			// Content kept from earlier frames, overwriting it must wait until their reads are done
+			// (and reading it until their writes are, if earlier frames wrote it)
+			needed = layoutChange || write || graphResource.previousAccess != 0;
+			barrier.srcStages = graphResource.previousStages;
+			barrier.srcAccess = graphResource.previousAccess;
+		}
+		else
+		{
+			// Imported resource is synchronized by its owner (e.g. acquire semaphore waits on the same stage)
+			needed = layoutChange;
+			barrier.srcStages = stages;
+			barrier.srcAccess = 0;
+		}
+	}
+	else
+	{
+		bool hazard = (write && (state.writeStages | state.readStages) != 0)				// write after read/write
+			|| (!write && state.writeStages != 0 && (stages & ~state.readStages) != 0);	// read after write by new stage
+		needed = layoutChange || hazard;
+		barrier.srcStages = state.writeStages | (write || layoutChange ? state.readStages : 0);
+		barrier.srcStages = barrier.srcStages != 0 ? barrier.srcStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		barrier.srcAccess = state.writeAccess;
+	}
+
+	if (needed)
+	{
+		barriers.push_back(barrier);
+	}
+
+	state.used = true;
+	state.layout = layout;
+	if (write)
+	{
+		state.writeStages = stages;
+		state.writeAccess = accessFlags & RENDER_GRAPH_WRITE_ACCESS;
+		state.readStages = 0;
+	}
+	else
+	{
+		state.readStages |= stages;
+	}
+}
+
+VkRenderPass RenderGraph::createRenderPass(PassGroup& group)
+{
+	int groupStart = static_cast<int>(find(this->passOrder.begin(), this->passOrder.end(), group.passes.front()) - this->passOrder.begin());
+	int groupEnd = groupStart + static_cast<int>(group.passes.size()) - 1;
+
+	// ATTACHMENTS
+	vector<VkAttachmentDescription> attachments(group.attachments.size());
+	for (int a = 0; a < group.attachments.size(); a++)
+	{
+		const Resource& resource = this->resources[group.attachments[a]];
+
+		const RenderGraphAccess* firstAccess = nullptr;
+		VkImageLayout firstLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout lastLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		for (int passIndex : group.passes)
+		{
+			for (const auto& access : this->passes[passIndex].accesses)
+			{
+				if (access.resource != group.attachments[a] || !isAttachmentAccess(access.type))
+				{
+					continue;
+				}
+				VkImageLayout layout;
+				VkPipelineStageFlags stages;
+				VkAccessFlags accessFlags;
+				bool write;
+				VkImageUsageFlags usage;
+				getAccessInfo(access, &layout, &stages, &accessFlags, &write, &usage);
+
+				if (firstAccess == nullptr)
+				{
+					firstAccess = &access;
+					firstLayout = layout;
+				}
+				lastLayout = layout;
+			}
+		}
+
+		// Content is loaded only if something before this render pass produced it, stored only if something after needs it
+		bool hasContent = resource.firstPass < groupStart || (resource.imported && resource.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+		VkAttachmentLoadOp loadOp = firstAccess->clear ? VK_ATTACHMENT_LOAD_OP_CLEAR
+			: hasContent ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		VkAttachmentStoreOp storeOp = resource.imported || resource.lastPass > groupEnd
+			? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		bool stencil = (getAspectFlags(resource.desc.format) & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+
+		attachments[a].format = resource.desc.format;
+		attachments[a].samples = resource.desc.samples;
+		attachments[a].loadOp = loadOp;
+		attachments[a].storeOp = storeOp;
+		attachments[a].stencilLoadOp = stencil ? loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[a].stencilStoreOp = stencil ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		// Layouts before and after render pass are handled by graph barriers, so render pass does no external transitions
+		attachments[a].initialLayout = firstLayout;
+		attachments[a].finalLayout = lastLayout;
+	}
+
+	// SUBPASSES
+	vector<vector<VkAttachmentReference>> colorReferences(group.passes.size());
+	vector<vector<VkAttachmentReference>> inputReferences(group.passes.size());
+	vector<VkAttachmentReference> depthReferences(group.passes.size());
+	vector<vector<uint32_t>> preserveReferences(group.passes.size());
+	vector<VkSubpassDescription> subpasses(group.passes.size());
+
+	for (int subpass = 0; subpass < group.passes.size(); subpass++)
+	{
+		const RenderGraphPass& pass = this->passes[group.passes[subpass]];
+		bool hasDepth = false;
+		vector<bool> usedHere(group.attachments.size(), false);
+
+		for (const auto& access : pass.accesses)
+		{
+			if (!isAttachmentAccess(access.type))
+			{
+				continue;
+			}
+			uint32_t attachment = static_cast<uint32_t>(find(group.attachments.begin(), group.attachments.end(), access.resource) - group.attachments.begin());
+			usedHere[attachment] = true;
+
+			VkImageLayout layout;
+			VkPipelineStageFlags stages;
+			VkAccessFlags accessFlags;
+			bool write;
+			VkImageUsageFlags usage;
+			getAccessInfo(access, &layout, &stages, &accessFlags, &write, &usage);
+
+			switch (access.type)
+			{
+			case RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+				colorReferences[subpass].push_back({ attachment, layout });
+				break;
+			case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+			case RENDER_GRAPH_ACCESS_DEPTH_READ:
+				depthReferences[subpass] = { attachment, layout };
+				hasDepth = true;
+				break;
+			case RENDER_GRAPH_ACCESS_INPUT_ATTACHMENT:
+				inputReferences[subpass].push_back({ attachment, layout });
+				break;
+			default:
+				break;
+			}
+		}
+
+		// Depth read as input attachment while depth tested stays in read only depth layout in both references
+		if (hasDepth)
+		{
+			for (auto& input : inputReferences[subpass])
+			{
+				if (input.attachment == depthReferences[subpass].attachment)
+				{
+					input.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+					depthReferences[subpass].layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+				}
+			}
+		}
+
+		// Attachments skipped by this subpass but used by earlier and later ones have to keep content
+		for (uint32_t attachment = 0; attachment < group.attachments.size(); attachment++)
+		{
+			if (usedHere[attachment])
+			{
+				continue;
+			}
+			bool usedBefore = false;
+			bool usedAfter = false;
+			for (int other = 0; other < group.passes.size(); other++)
+			{
+				for (const auto& access : this->passes[group.passes[other]].accesses)
+				{
+					if (access.resource == group.attachments[attachment] && isAttachmentAccess(access.type))
+					{
+						usedBefore = usedBefore || other < subpass;
+						usedAfter = usedAfter || other > subpass;
+					}
+				}
+			}
+			if (usedBefore && usedAfter)
+			{
+				preserveReferences[subpass].push_back(attachment);
+			}
+		}
+
+		subpasses[subpass] = {};
+		subpasses[subpass].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[subpass].colorAttachmentCount = static_cast<uint32_t>(colorReferences[subpass].size());
+		subpasses[subpass].pColorAttachments = colorReferences[subpass].data();
+		subpasses[subpass].inputAttachmentCount = static_cast<uint32_t>(inputReferences[subpass].size());
+		subpasses[subpass].pInputAttachments = inputReferences[subpass].data();
+		subpasses[subpass].pDepthStencilAttachment = hasDepth ? &depthReferences[subpass] : nullptr;
+		subpasses[subpass].preserveAttachmentCount = static_cast<uint32_t>(preserveReferences[subpass].size());
+		subpasses[subpass].pPreserveAttachments = preserveReferences[subpass].data();
+	}
+
+	// SUBPASS DEPENDENCIES
+	// Every subpass waits for the latest earlier subpass that wrote (or, for writes, read) the same attachment
+	map<pair<uint32_t, uint32_t>, VkSubpassDependency> dependencyMap;
+	for (uint32_t dst = 1; dst < group.passes.size(); dst++)
+	{
+		for (const auto& dstAccess : this->passes[group.passes[dst]].accesses)
+		{
+			VkImageLayout dstLayout;
+			VkPipelineStageFlags dstStages;
+			VkAccessFlags dstFlags;
+			bool dstWrite;
+			VkImageUsageFlags usage;
+			getAccessInfo(dstAccess, &dstLayout, &dstStages, &dstFlags, &dstWrite, &usage);
+
+			for (int src = static_cast<int>(dst) - 1; src >= 0; src--)
+			{
+				VkPipelineStageFlags srcStages = 0;
+				VkAccessFlags srcFlags = 0;
+				bool srcWrite = false;
+				for (const auto& srcAccess : this->passes[group.passes[src]].accesses)
+				{
+					if (srcAccess.resource != dstAccess.resource)
+					{
+						continue;
+					}
+					VkImageLayout layout;
+					VkPipelineStageFlags stages;
+					VkAccessFlags accessFlags;
+					bool write;
+					getAccessInfo(srcAccess, &layout, &stages, &accessFlags, &write, &usage);
+					srcStages |= stages;
+					srcFlags |= write ? accessFlags & RENDER_GRAPH_WRITE_ACCESS : 0;
+					srcWrite = srcWrite || write;
+				}
+				if (srcStages == 0 || (!srcWrite && !dstWrite))
+				{
+					continue;
+				}
+
+				VkSubpassDependency& dependency = dependencyMap[{ (uint32_t)src, dst }];
+				dependency.srcSubpass = src;
+				dependency.dstSubpass = dst;
+				dependency.srcStageMask |= srcStages;
+				dependency.srcAccessMask |= srcFlags;
+				dependency.dstStageMask |= dstStages;
+				dependency.dstAccessMask |= dstFlags;
+				dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;			// attachments are read at the same pixel
+				break;
+			}
+		}
+	}
+	vector<VkSubpassDependency> dependencies;
+	for (const auto& dependency : dependencyMap)
+	{
+		dependencies.push_back(dependency.second);
+	}
+
+	// CACHE LOOKUP
+	// Everything that makes render pass different is flattened into the key
+	vector<uint64_t> key;
+	for (const auto& attachment : attachments)
+	{
+		key.insert(key.end(), { (uint64_t)attachment.format, (uint64_t)attachment.samples, (uint64_t)attachment.loadOp, (uint64_t)attachment.storeOp,
+			(uint64_t)attachment.stencilLoadOp, (uint64_t)attachment.stencilStoreOp, (uint64_t)attachment.initialLayout, (uint64_t)attachment.finalLayout });
+	}
+	for (int subpass = 0; subpass < subpasses.size(); subpass++)
+	{
+		key.push_back(0xFFFFFFFF00000000ull | colorReferences[subpass].size() | (inputReferences[subpass].size() << 8) | (preserveReferences[subpass].size() << 16));
+		for (const auto& reference : colorReferences[subpass])
+		{
+			key.push_back(((uint64_t)reference.attachment << 32) | reference.layout);
+		}
+		for (const auto& reference : inputReferences[subpass])
+		{
+			key.push_back(((uint64_t)reference.attachment << 32) | reference.layout);
+		}
+		key.push_back(subpasses[subpass].pDepthStencilAttachment != nullptr
+			? ((uint64_t)depthReferences[subpass].attachment << 32) | depthReferences[subpass].layout : UINT64_MAX);
+		for (uint32_t preserve : preserveReferences[subpass])
+		{
+			key.push_back(preserve);
+		}
+	}
+	for (const auto& dependency : dependencies)
+	{
+		key.insert(key.end(), { ((uint64_t)dependency.srcSubpass << 32) | dependency.dstSubpass,
+			((uint64_t)dependency.srcStageMask << 32) | dependency.dstStageMask,
+			((uint64_t)dependency.srcAccessMask << 32) | dependency.dstAccessMask, dependency.dependencyFlags });
+	}
+
+	auto cached = this->renderPassCache.find(key);
+	if (cached != this->renderPassCache.end())
+	{
+		return cached->second;
+	}
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCreateInfo.pAttachments = attachments.data();
+	renderPassCreateInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+	renderPassCreateInfo.pSubpasses = subpasses.data();
+	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassCreateInfo.pDependencies = dependencies.data();
+
+	VkRenderPass renderPass;
+	VkResult result = vkCreateRenderPass(this->logicalDevice, &renderPassCreateInfo, nullptr, &renderPass);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create a Render Pass for " + this->passes[group.passes.front()].name + ".");
+	}
+
+	this->renderPassCache[key] = renderPass;
+	return renderPass;
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(const PassGroup& group)
+{
+	vector<VkImageView> views;
+	vector<uint64_t> key = { (uint64_t)group.renderPass, group.extent.width, group.extent.height };
+	for (RenderGraphResource attachment : group.attachments)
+	{
+		views.push_back(getImageView(attachment));
+		key.push_back((uint64_t)views.back());
+	}
+
+	auto cached = this->framebufferCache.find(key);
+	if (cached != this->framebufferCache.end())
+	{
+		return cached->second;
+	}
+
+	VkFramebufferCreateInfo framebufferCreateInfo = {};
+	framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferCreateInfo.renderPass = group.renderPass;
+	framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(views.size());
+	framebufferCreateInfo.pAttachments = views.data();
+	framebufferCreateInfo.width = group.extent.width;
+	framebufferCreateInfo.height = group.extent.height;
+	framebufferCreateInfo.layers = 1;
+
+	VkFramebuffer framebuffer;
+	VkResult result = vkCreateFramebuffer(this->logicalDevice, &framebufferCreateInfo, nullptr, &framebuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create a Framebuffer.");
+	}
+
+	this->framebufferCache[key] = framebuffer;
+	return framebuffer;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer)
+{
+	for (const auto& group : this->groups)
+	{
+		recordBarriers(commandBuffer, group.barriers);
+
+		if (!group.graphics)
+		{
+			const RenderGraphPass& pass = this->passes[group.passes.front()];
+			if (pass.execute)
+			{
+				pass.execute(commandBuffer);
+			}
+			continue;
+		}
+
+		VkRenderPassBeginInfo renderPassBeginInfo = {};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = group.renderPass;
+		renderPassBeginInfo.framebuffer = getFramebuffer(group);
+		renderPassBeginInfo.renderArea.offset = { 0, 0 };
+		renderPassBeginInfo.renderArea.extent = group.extent;
+		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(group.clearValues.size());
+		renderPassBeginInfo.pClearValues = group.clearValues.data();
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		for (int subpass = 0; subpass < group.passes.size(); subpass++)
+		{
+			if (subpass > 0)
+			{
+				vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+			}
+
+			// Viewport and scissor are dynamic pipeline state, set to cover whole render area
+			VkViewport viewport = {};
+			viewport.x = 0.0f;
+			viewport.y = 0.0f;
+			viewport.width = (float)group.extent.width;
+			viewport.height = (float)group.extent.height;
+			viewport.minDepth = 0.0f;
+			viewport.maxDepth = 1.0f;
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+			VkRect2D scissor = {};
+			scissor.offset = { 0, 0 };
+			scissor.extent = group.extent;
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+			const RenderGraphPass& pass = this->passes[group.passes[subpass]];
+			if (pass.execute)
+			{
+				pass.execute(commandBuffer);
+			}
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	recordBarriers(commandBuffer, this->finalBarriers);
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const vector<Barrier>& barriers)
+{
+	if (barriers.empty())
+	{
+		return;
+	}
+
+	// All barriers before a group go into single command
+	VkPipelineStageFlags srcStages = 0;
+	VkPipelineStageFlags dstStages = 0;
+	vector<VkImageMemoryBarrier> imageBarriers;
+	vector<VkBufferMemoryBarrier> bufferBarriers;
+
+	for (const auto& barrier : barriers)
+	{
+		srcStages |= barrier.srcStages;
+		dstStages |= barrier.dstStages;
+
+		const Resource& resource = this->resources[barrier.resource];
+		if (!resource.image)
+		{
+			VkBufferMemoryBarrier bufferBarrier = {};
+			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarrier.srcAccessMask = barrier.srcAccess;
+			bufferBarrier.dstAccessMask = barrier.dstAccess;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = resource.vkBuffer;
+			bufferBarrier.offset = 0;
+			bufferBarrier.size = resource.size;
+			bufferBarriers.push_back(bufferBarrier);
+			continue;
+		}
+
+		VkImageMemoryBarrier imageBarrier = {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = barrier.srcAccess;
+		imageBarrier.dstAccessMask = barrier.dstAccess;
+		imageBarrier.oldLayout = barrier.oldLayout;
+		imageBarrier.newLayout = barrier.newLayout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = getImage(barrier.resource);
+		imageBarrier.subresourceRange.aspectMask = getAspectFlags(resource.desc.format);
+		imageBarrier.subresourceRange.baseMipLevel = 0;
+		imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		imageBarrier.subresourceRange.baseArrayLayer = 0;
+		imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		imageBarriers.push_back(imageBarrier);
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0,
+		0, nullptr,
+		static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::destroyTransients()
+{
+	this->transientPlanKey.clear();
+	this->transientMemorySize = 0;
+	this->transientRequestedSize = 0;
+	if (this->transientImages.empty() && this->framebufferCache.empty())
+	{
+		return;
+	}
+
+	vector<VkImage> images;
+	vector<VkImageView> imageViews;
+	for (const auto& transient : this->transientImages)
+	{
+		images.push_back(transient.image);
+		imageViews.push_back(transient.imageView);
+	}
+	vector<VkFramebuffer> framebuffers;
+	for (const auto& framebuffer : this->framebufferCache)
+	{
+		framebuffers.push_back(framebuffer.second);
+	}
+	vector<VkDeviceMemory> memory = this->transientMemory;
+
+	this->transientImages.clear();
+	this->transientMemory.clear();
+	this->framebufferCache.clear();
+
+	VkDevice logicalDevice = this->logicalDevice;
+	auto destroy = [logicalDevice, images, imageViews, framebuffers, memory]() {
+		for (auto framebuffer : framebuffers)
+		{
+			vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+		}
+		for (auto imageView : imageViews)
+		{
+			vkDestroyImageView(logicalDevice, imageView, nullptr);
+		}
+		for (auto image : images)
+		{
+			vkDestroyImage(logicalDevice, image, nullptr);
+		}
+		for (auto block : memory)
+		{
+			vkFreeMemory(logicalDevice, block, nullptr);
+		}
+	};
+
+	// Frames in flight may still render to old images
+	if (this->frameScheduler != nullptr)
+	{
+		this->frameScheduler->deferDestroy(destroy);
+	}
+	else
+	{
+		destroy();
+	}
+}
+
+VkRenderPass RenderGraph::getRenderPass(const string& passName)
+{
+	auto pass = this->passRenderPasses.find(passName);
+	if (pass == this->passRenderPasses.end())
+	{
+		throw runtime_error("Render graph has no compiled graphics pass " + passName + ".");
+	}
+	return pass->second.first;
+}
+
+uint32_t RenderGraph::getSubpass(const string& passName)
+{
+	auto pass = this->passRenderPasses.find(passName);
+	if (pass == this->passRenderPasses.end())
+	{
+		throw runtime_error("Render graph has no compiled graphics pass " + passName + ".");
+	}
+	return pass->second.second;
+}
+
+VkImage RenderGraph::getImage(RenderGraphResource resource)
+{
+	const Resource& graphResource = this->resources[resource];
+	if (graphResource.imported)
+	{
+		return graphResource.vkImage;
+	}
+	return graphResource.physicalImage >= 0 ? this->transientImages[graphResource.physicalImage].image : VK_NULL_HANDLE;
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphResource resource)
+{
+	const Resource& graphResource = this->resources[resource];
+	if (graphResource.imported)
+	{
+		return graphResource.vkImageView;
+	}
+	return graphResource.physicalImage >= 0 ? this->transientImages[graphResource.physicalImage].imageView : VK_NULL_HANDLE;
+}
+
+int RenderGraph::getRenderPassCount()
+{
+	return static_cast<int>(this->renderPassCache.size());
+}
+
+VkDeviceSize RenderGraph::getTransientMemorySize()
+{
+	return this->transientMemorySize;
+}
+
+VkDeviceSize RenderGraph::getTransientRequestedSize()
+{
+	return this->transientRequestedSize;
+}
+
+uint32_t RenderGraph::findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties, bool* found)
+{
+	for (uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; i++)
+	{
+		if ((allowedTypes & (1 << i)) && (this->memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			*found = true;
+			return i;
+		}
+	}
+	*found = false;
+	return 0;
+}
+
+void RenderGraph::getAccessInfo(const RenderGraphAccess& access, VkImageLayout* layout, VkPipelineStageFlags* stages,
+	VkAccessFlags* accessFlags, bool* write, VkImageUsageFlags* usage)
+{
+	*stages = access.stages;
+	*write = writesContent(access);
+
+	switch (access.type)
+	{
+	case RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+		*layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		*accessFlags = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		*usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+		*layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		*accessFlags = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		*usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_DEPTH_READ:
+		*layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		*accessFlags = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		*usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_INPUT_ATTACHMENT:
+		*layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		*accessFlags = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		*usage = VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_SAMPLED:
+		*layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		*accessFlags = VK_ACCESS_SHADER_READ_BIT;
+		*usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_STORAGE_READ:
+		*layout = VK_IMAGE_LAYOUT_GENERAL;
+		*accessFlags = VK_ACCESS_SHADER_READ_BIT;
+		*usage = VK_IMAGE_USAGE_STORAGE_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_STORAGE_WRITE:
+		*layout = VK_IMAGE_LAYOUT_GENERAL;
+		*accessFlags = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		*usage = VK_IMAGE_USAGE_STORAGE_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_INDIRECT:
+		*layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		*accessFlags = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		*usage = 0;
+		break;
+	case RENDER_GRAPH_ACCESS_VERTEX_INPUT:
+		*layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		*accessFlags = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		*usage = 0;
+		break;
+	case RENDER_GRAPH_ACCESS_TRANSFER_SRC:
+		*layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		*accessFlags = VK_ACCESS_TRANSFER_READ_BIT;
+		*usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		break;
+	case RENDER_GRAPH_ACCESS_TRANSFER_DST:
+		*layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		*accessFlags = VK_ACCESS_TRANSFER_WRITE_BIT;
+		*usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		break;
+	}
+}
+
+bool RenderGraph::isAttachmentAccess(RenderGraphAccessType type)
+{
+	return type == RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT || type == RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT
+		|| type == RENDER_GRAPH_ACCESS_DEPTH_READ || type == RENDER_GRAPH_ACCESS_INPUT_ATTACHMENT;
+}
+
+VkImageAspectFlags RenderGraph::getAspectFlags(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT;
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	default:
+		return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <stdexcept>
+#include "VulkanUtils.h"
+#include "FrameScheduler.h"
+
+typedef uint32_t RenderGraphResource;
+#define RENDER_GRAPH_NO_RESOURCE UINT32_MAX
+
+// How pass uses a resource, decides layout, pipeline stages and access flags of barriers
+enum RenderGraphAccessType
+{
+	RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT,			// written as color attachment
+	RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT,			// depth tested and written
+	RENDER_GRAPH_ACCESS_DEPTH_READ,					// depth tested only
+	RENDER_GRAPH_ACCESS_INPUT_ATTACHMENT,			// read by subpassLoad in a later subpass of the same render pass
+	RENDER_GRAPH_ACCESS_SAMPLED,					// sampled image
+	RENDER_GRAPH_ACCESS_STORAGE_READ,				// storage image/buffer read
+	RENDER_GRAPH_ACCESS_STORAGE_WRITE,				// storage image/buffer write (read-modify-write included)
+	RENDER_GRAPH_ACCESS_INDIRECT,					// indirect draw/dispatch arguments
+	RENDER_GRAPH_ACCESS_VERTEX_INPUT,				// vertex buffer fetched by input assembly
+	RENDER_GRAPH_ACCESS_TRANSFER_SRC,
+	RENDER_GRAPH_ACCESS_TRANSFER_DST
+};
+
+struct RenderGraphImageDesc
+{
+	VkFormat format;
+	VkExtent2D extent;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+struct RenderGraphAccess
+{
+	RenderGraphResource resource;
+	RenderGraphAccessType type;
+	VkPipelineStageFlags stages;					// shader stages for sampled/storage access, fixed for the rest
+	bool clear = false;								// attachment is cleared instead of loaded
+	VkClearValue clearValue = {};
+};
+
+// Declares what pass reads and writes, graph derives ordering and synchronization from it
+class RenderGraphPass
+{
+
+public:
+	RenderGraphPass(const string& name, bool graphics);
+
+	void writeColor(RenderGraphResource image);									// keeps previous content
+	void writeColor(RenderGraphResource image, VkClearColorValue clearColor);
+	void writeDepth(RenderGraphResource image);
+	void writeDepth(RenderGraphResource image, float clearDepth);
+	void readDepth(RenderGraphResource image);
+	void readInputAttachment(RenderGraphResource image);
+	void readTexture(RenderGraphResource image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	void readStorage(RenderGraphResource resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	void writeStorage(RenderGraphResource resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	void readIndirect(RenderGraphResource buffer);
+	void readVertexBuffer(RenderGraphResource buffer);
+	void readTransfer(RenderGraphResource resource);
+	void writeTransfer(RenderGraphResource resource);
+
+	// Pass is executed even when nothing reads its results (e.g. readback, queries)
+	void setSideEffects();
+	// Records pass commands, graphics passes are called inside their subpass with viewport and scissor set
+	void setExecute(function<void(VkCommandBuffer)> execute);
+
+	const string& getName() const;
+
+private:
+	friend class RenderGraph;
+
+	string name;
+	bool graphics;
+	bool sideEffects = false;
+	vector<RenderGraphAccess> accesses;
+	function<void(VkCommandBuffer)> execute;
+
+	void addAccess(RenderGraphResource resource, RenderGraphAccessType type, VkPipelineStageFlags stages, bool clear = false, VkClearValue clearValue = {});
+};
+
+// Frame described as passes with declared resource usage, compiled into render passes (adjacent compatible
+// graphics passes become subpasses), minimal barriers and layout transitions and aliased transient images
+class RenderGraph
+{
+
+public:
+	RenderGraph();
+	~RenderGraph();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, FrameScheduler* frameScheduler);
+	void cleanup();
+
+	// Starts new graph declaration (compiled objects and transient images are kept for reuse)
+	void reset();
+
+	// Image that lives only within the graph, its memory may be shared with transients that are not alive at the same time
+	RenderGraphResource createImage(const string& name, const RenderGraphImageDesc& desc);
+	// Image owned outside of graph, it is transitioned from initial layout and left in final layout.
+	// Images kept across frames pass stages that used them in earlier frames, first write waits for those.
+	// Images written by earlier frames pass the write access too, then first read waits as well.
+	RenderGraphResource importImage(const string& name, VkImage image, VkImageView imageView, const RenderGraphImageDesc& desc,
+		VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags previousStages = 0, VkAccessFlags previousAccess = 0);
+	// Buffers kept across frames pass stages and writes of earlier frames the same way
+	RenderGraphResource importBuffer(const string& name, VkBuffer buffer, VkDeviceSize size = VK_WHOLE_SIZE,
+		VkPipelineStageFlags previousStages = 0, VkAccessFlags previousAccess = 0);
+
+	RenderGraphPass& addGraphicsPass(const string& name);
+	RenderGraphPass& addComputePass(const string& name);
+
+	// Culls unused passes, merges subpasses, plans barriers and (re)creates transient images if their usage changed
+	void compile();
+	void execute(VkCommandBuffer commandBuffer);
+
+	// Compiled objects of graphics pass (for pipeline creation)
+	VkRenderPass getRenderPass(const string& passName);
+	uint32_t getSubpass(const string& passName);
+	VkImage getImage(RenderGraphResource resource);
+	VkImageView getImageView(RenderGraphResource resource);
+
+	int getRenderPassCount();
+	VkDeviceSize getTransientMemorySize();				// memory actually allocated for transient images
+	VkDeviceSize getTransientRequestedSize();			// memory transient images would need without aliasing
+
+private:
+	struct Resource
+	{
+		string name;
+		bool image = true;
+		bool imported = false;
+		RenderGraphImageDesc desc = {};
+		VkImage vkImage = VK_NULL_HANDLE;
+		VkImageView vkImageView = VK_NULL_HANDLE;
+		VkBuffer vkBuffer = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags previousStages = 0;		// stages of earlier submissions using imported resource
+		VkAccessFlags previousAccess = 0;				// writes of earlier submissions
+
+		// Compile results
+		VkImageUsageFlags usage = 0;
+		int firstPass = -1;								// indices into compiled pass order
+		int lastPass = -1;
+		int physicalImage = -1;							// index into transient images
+	};
+
+	// Synchronization state of resource while barriers are planned
+	struct ResourceState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0;			// stages that read since last write
+		bool used = false;
+	};
+
+	struct Barrier
+	{
+		RenderGraphResource resource;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkPipelineStageFlags srcStages;
+		VkAccessFlags srcAccess;
+		VkPipelineStageFlags dstStages;
+		VkAccessFlags dstAccess;
+	};
+
+	// Adjacent graphics passes merged into one render pass, or single compute pass
+	struct PassGroup
+	{
+		vector<int> passes;								// indices into declared passes
+		bool graphics = false;
+		VkExtent2D extent = {};
+		vector<RenderGraphResource> attachments;
+		vector<VkClearValue> clearValues;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		vector<Barrier> barriers;						// recorded before the group
+	};
+
+	struct TransientImage
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView imageView = VK_NULL_HANDLE;
+		VkMemoryRequirements memoryRequirements = {};
+		VkDeviceSize offset = 0;
+		int memoryBlock = -1;
+	};
+
+	struct VectorHash
+	{
+		size_t operator()(const vector<uint64_t>& key) const;
+	};
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice logicalDevice;
+	FrameScheduler* frameScheduler;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+
+	// Declaration (rebuilt every frame)
+	vector<Resource> resources;
+	deque<RenderGraphPass> passes;
+
+	// Compile results
+	vector<int> passOrder;								// alive passes in execution order
+	vector<PassGroup> groups;
+	vector<Barrier> finalBarriers;
+	VkPipelineStageFlags transientStages;				// stages touching transient images (previous frame and aliases must be done)
+	VkAccessFlags transientWriteAccess;					// writes to transient images (previous frame's ones must land)
+	unordered_map<string, pair<VkRenderPass, uint32_t>> passRenderPasses;
+
+	// Persistent objects reused between frames
+	unordered_map<vector<uint64_t>, VkRenderPass, VectorHash> renderPassCache;
+	unordered_map<vector<uint64_t>, VkFramebuffer, VectorHash> framebufferCache;
+	vector<uint64_t> transientPlanKey;
+	vector<TransientImage> transientImages;
+	vector<VkDeviceMemory> transientMemory;
+	VkDeviceSize transientMemorySize;
+	VkDeviceSize transientRequestedSize;
+
+	void cullPasses();
+	void groupPasses();
+	void planTransients();
+	void planBarriers();
+	VkRenderPass createRenderPass(PassGroup& group);
+	VkFramebuffer getFramebuffer(const PassGroup& group);
+	void destroyTransients();
+
+	// aliasState is state of transient used before this one in the same memory (nullptr if none in this frame)
+	void addBarrier(vector<Barrier>& barriers, RenderGraphResource resource, ResourceState& state,
+		const ResourceState* aliasState, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags accessFlags, bool write);
+	void recordBarriers(VkCommandBuffer commandBuffer, const vector<Barrier>& barriers);
+	uint32_t findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties, bool* found);
+
+	static void getAccessInfo(const RenderGraphAccess& access, VkImageLayout* layout, VkPipelineStageFlags* stages,
+		VkAccessFlags* accessFlags, bool* write, VkImageUsageFlags* usage);
+	static bool isAttachmentAccess(RenderGraphAccessType type);
+	static VkImageAspectFlags getAspectFlags(VkFormat format);
+};
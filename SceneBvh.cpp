@@ -0,0 +1,591 @@
+#include "SceneBvh.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#define SCENE_BVH_FREE_NODE			-2			// left child of nodes in free list
+#define SCENE_BVH_MIN_DIRECTION		1e-12f		// smaller direction components are clamped, so inverse stays finite
+
+SceneBvh::SceneBvh()
+{
+	this->root = SCENE_BVH_NULL_NODE;
+	this->objectCount = 0;
+}
+
+SceneBvh::~SceneBvh()
+{
+}
+
+int SceneBvh::addObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint64_t userData)
+{
+	int leaf = allocateNode();
+	Node& node = this->nodes[leaf];
+	glm::vec3 margin = (boundsMax - boundsMin) * SCENE_BVH_MARGIN;
+	node.boundsMin = boundsMin - margin;
+	node.boundsMax = boundsMax + margin;
+	node.objectMin = boundsMin;
+	node.objectMax = boundsMax;
+	node.userData = userData;
+	insertLeaf(leaf);
+	this->objectCount++;
+	return leaf;
+}
+
+void SceneBvh::updateObject(int proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	if (proxy < 0 || proxy >= (int)this->nodes.size() || this->nodes[proxy].left != SCENE_BVH_NULL_NODE)
+	{
+		throw runtime_error("Failed to update scene object, proxy " + to_string(proxy) + " is not an object.");
+	}
+
+	Node& node = this->nodes[proxy];
+	node.objectMin = boundsMin;
+	node.objectMax = boundsMax;
+	if (glm::all(glm::greaterThanEqual(boundsMin, node.boundsMin)) && glm::all(glm::lessThanEqual(boundsMax, node.boundsMax)))
+	{
+		return;
+	}
+
+	// Ancestors grow right away, the leaf may now sit far from its best place until optimize reinserts it
+	glm::vec3 margin = (boundsMax - boundsMin) * SCENE_BVH_MARGIN;
+	node.boundsMin = boundsMin - margin;
+	node.boundsMax = boundsMax + margin;
+	refit(node.parent);
+	if (!node.queued)
+	{
+		node.queued = true;
+		this->reinsertQueue.push_back(proxy);
+	}
+}
+
+void SceneBvh::removeObject(int proxy)
+{
+	if (proxy < 0 || proxy >= (int)this->nodes.size() || this->nodes[proxy].left != SCENE_BVH_NULL_NODE)
+	{
+		throw runtime_error("Failed to remove scene object, proxy " + to_string(proxy) + " is not an object.");
+	}
+
+	if (this->nodes[proxy].queued)
+	{
+		this->reinsertQueue.erase(std::find(this->reinsertQueue.begin(), this->reinsertQueue.end(), proxy));
+	}
+	removeLeaf(proxy);
+	this->nodes[proxy].left = SCENE_BVH_FREE_NODE;
+	this->freeNodes.push_back(proxy);
+	this->objectCount--;
+}
+
+void SceneBvh::optimize(uint32_t maxReinserts)
+{
+	for (uint32_t i = 0; i < maxReinserts && !this->reinsertQueue.empty(); i++)
+	{
+		int leaf = this->reinsertQueue.front();
+		this->reinsertQueue.pop_front();
+		this->nodes[leaf].queued = false;
+		removeLeaf(leaf);
+		insertLeaf(leaf);
+	}
+}
+
+void SceneBvh::rebuild()
+{
+	if (this->root == SCENE_BVH_NULL_NODE)
+	{
+		return;
+	}
+
+	// Leaves keep their indices (proxies stay valid), inner nodes are freed and built again
+	vector<int> leaves;
+	leaves.reserve(this->objectCount);
+	vector<int> stack;
+	stack.push_back(this->root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		Node& node = this->nodes[index];
+		if (node.left == SCENE_BVH_NULL_NODE)
+		{
+			node.queued = false;
+			leaves.push_back(index);
+			continue;
+		}
+		stack.push_back(node.left);
+		stack.push_back(node.right);
+		node.left = SCENE_BVH_FREE_NODE;
+		this->freeNodes.push_back(index);
+	}
+	this->reinsertQueue.clear();
+
+	this->root = buildNode(leaves.data(), static_cast<uint32_t>(leaves.size()), 0);
+	this->nodes[this->root].parent = SCENE_BVH_NULL_NODE;
+}
+
+void SceneBvh::clear()
+{
+	this->nodes.clear();
+	this->freeNodes.clear();
+	this->reinsertQueue.clear();
+	this->root = SCENE_BVH_NULL_NODE;
+	this->objectCount = 0;
+}
+
+uint64_t SceneBvh::getUserData(int proxy)
+{
+	if (proxy < 0 || proxy >= (int)this->nodes.size() || this->nodes[proxy].left != SCENE_BVH_NULL_NODE)
+	{
+		throw runtime_error("Failed to get scene object, proxy " + to_string(proxy) + " is not an object.");
+	}
+	return this->nodes[proxy].userData;
+}
+
+uint32_t SceneBvh::getObjectCount()
+{
+	return this->objectCount;
+}
+
+uint32_t SceneBvh::getNodeCount()
+{
+	return static_cast<uint32_t>(this->nodes.size() - this->freeNodes.size());
+}
+
+void SceneBvh::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, const SceneRayCallback& callback) const
+{
+	if (this->root == SCENE_BVH_NULL_NODE)
+	{
+		return;
+	}
+
+	glm::vec3 inverseDirection;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float component = fabsf(direction[axis]) < SCENE_BVH_MIN_DIRECTION ? copysignf(SCENE_BVH_MIN_DIRECTION, direction[axis]) : direction[axis];
+		inverseDirection[axis] = 1.0f / component;
+	}
+
+	// Nodes keep their entry distance on the stack, ones entered behind a hit found meanwhile are skipped
+	float closest = maxDistance;
+	vector<pair<int, float>> stack;
+	stack.reserve(64);
+	float rootDistance = intersectBounds(this->nodes[this->root].boundsMin, this->nodes[this->root].boundsMax, origin, inverseDirection, closest);
+	if (rootDistance != FLT_MAX)
+	{
+		stack.push_back({ this->root, rootDistance });
+	}
+	while (!stack.empty())
+	{
+		pair<int, float> entry = stack.back();
+		stack.pop_back();
+		if (entry.second > closest)
+		{
+			continue;
+		}
+
+		const Node& node = this->nodes[entry.first];
+		if (node.left == SCENE_BVH_NULL_NODE)
+		{
+			float objectDistance = intersectBounds(node.objectMin, node.objectMax, origin, inverseDirection, closest);
+			if (objectDistance != FLT_MAX)
+			{
+				closest = std::min(closest, callback(node.userData, objectDistance));
+			}
+			continue;
+		}
+
+		// Farther child is pushed first, so the nearer one is visited next
+		const Node& left = this->nodes[node.left];
+		const Node& right = this->nodes[node.right];
+		float leftDistance = intersectBounds(left.boundsMin, left.boundsMax, origin, inverseDirection, closest);
+		float rightDistance = intersectBounds(right.boundsMin, right.boundsMax, origin, inverseDirection, closest);
+		bool leftNear = leftDistance <= rightDistance;
+		if (std::max(leftDistance, rightDistance) != FLT_MAX)
+		{
+			stack.push_back(leftNear ? make_pair(node.right, rightDistance) : make_pair(node.left, leftDistance));
+		}
+		if (std::min(leftDistance, rightDistance) != FLT_MAX)
+		{
+			stack.push_back(leftNear ? make_pair(node.left, leftDistance) : make_pair(node.right, rightDistance));
+		}
+	}
+}
+
+void SceneBvh::queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, vector<uint64_t>* objects) const
+{
+	if (this->root == SCENE_BVH_NULL_NODE)
+	{
+		return;
+	}
+
+	vector<int> stack;
+	stack.reserve(64);
+	stack.push_back(this->root);
+	while (!stack.empty())
+	{
+		const Node& node = this->nodes[stack.back()];
+		stack.pop_back();
+		bool leaf = node.left == SCENE_BVH_NULL_NODE;
+		const glm::vec3& nodeMin = leaf ? node.objectMin : node.boundsMin;
+		const glm::vec3& nodeMax = leaf ? node.objectMax : node.boundsMax;
+		if (glm::any(glm::lessThan(nodeMax, boundsMin)) || glm::any(glm::greaterThan(nodeMin, boundsMax)))
+		{
+			continue;
+		}
+
+		if (leaf)
+		{
+			objects->push_back(node.userData);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void SceneBvh::queryFrustum(const glm::mat4& viewProjection, vector<uint64_t>* objects) const
+{
+	if (this->root == SCENE_BVH_NULL_NODE)
+	{
+		return;
+	}
+
+	// Planes (inside when dot >= 0) from rows of view projection: -w <= x <= w, -w <= y <= w, 0 <= z <= w.
+	// Infinite reverse Z far plane comes out as constant positive plane, which keeps everything
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	const glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2]
+	};
+
+	vector<int> stack;
+	stack.reserve(64);
+	stack.push_back(this->root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		const Node& node = this->nodes[index];
+		bool leaf = node.left == SCENE_BVH_NULL_NODE;
+		const glm::vec3& nodeMin = leaf ? node.objectMin : node.boundsMin;
+		const glm::vec3& nodeMax = leaf ? node.objectMax : node.boundsMax;
+
+		// Corner farthest along plane normal decides if box is outside, nearest one if it's entirely inside
+		bool outside = false;
+		bool inside = true;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			glm::vec3 normal = glm::vec3(planes[p]);
+			glm::vec3 farCorner = glm::vec3(normal.x >= 0.0f ? nodeMax.x : nodeMin.x, normal.y >= 0.0f ? nodeMax.y : nodeMin.y,
+				normal.z >= 0.0f ? nodeMax.z : nodeMin.z);
+			glm::vec3 nearCorner = nodeMin + nodeMax - farCorner;
+			outside = glm::dot(normal, farCorner) + planes[p].w < 0.0f;
+			inside = inside && glm::dot(normal, nearCorner) + planes[p].w >= 0.0f;
+		}
+		if (outside)
+		{
+			continue;
+		}
+
+		if (leaf)
+		{
+			objects->push_back(node.userData);
+		}
+		else if (inside)
+		{
+			// Enlarged leaf boxes contain their objects, so everything below is inside as well
+			collectObjects(index, objects);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+int SceneBvh::allocateNode()
+{
+	int index;
+	if (!this->freeNodes.empty())
+	{
+		index = this->freeNodes.back();
+		this->freeNodes.pop_back();
+	}
+	else
+	{
+		index = static_cast<int>(this->nodes.size());
+		this->nodes.push_back({});
+	}
+
+	Node& node = this->nodes[index];
+	node.parent = SCENE_BVH_NULL_NODE;
+	node.left = SCENE_BVH_NULL_NODE;
+	node.right = SCENE_BVH_NULL_NODE;
+	node.queued = false;
+	node.userData = 0;
+	return index;
+}
+
+void SceneBvh::insertLeaf(int leaf)
+{
+	if (this->root == SCENE_BVH_NULL_NODE)
+	{
+		this->root = leaf;
+		this->nodes[leaf].parent = SCENE_BVH_NULL_NODE;
+		return;
+	}
+
+	// Pairing leaf with a sibling adds area of their union (new parent) plus growth of every ancestor of the sibling.
+	// Growth down to a node is a lower bound for its whole subtree, so subtrees that can't beat best sibling are skipped
+	glm::vec3 leafMin = this->nodes[leaf].boundsMin;
+	glm::vec3 leafMax = this->nodes[leaf].boundsMax;
+	float leafArea = getSurfaceArea(leafMin, leafMax);
+	int bestSibling = this->root;
+	float bestCost = FLT_MAX;
+	this->searchHeap.clear();
+	this->searchHeap.push_back({ 0.0f, this->root });
+	while (!this->searchHeap.empty())
+	{
+		std::pop_heap(this->searchHeap.begin(), this->searchHeap.end(), std::greater<pair<float, int>>());
+		pair<float, int> candidate = this->searchHeap.back();
+		this->searchHeap.pop_back();
+		if (candidate.first + leafArea >= bestCost)
+		{
+			break;
+		}
+
+		const Node& node = this->nodes[candidate.second];
+		float unionArea = getSurfaceArea(glm::min(node.boundsMin, leafMin), glm::max(node.boundsMax, leafMax));
+		float cost = candidate.first + unionArea;
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestSibling = candidate.second;
+		}
+
+		if (node.left != SCENE_BVH_NULL_NODE)
+		{
+			float childInherited = candidate.first + unionArea - getSurfaceArea(node.boundsMin, node.boundsMax);
+			if (childInherited + leafArea < bestCost)
+			{
+				this->searchHeap.push_back({ childInherited, node.left });
+				std::push_heap(this->searchHeap.begin(), this->searchHeap.end(), std::greater<pair<float, int>>());
+				this->searchHeap.push_back({ childInherited, node.right });
+				std::push_heap(this->searchHeap.begin(), this->searchHeap.end(), std::greater<pair<float, int>>());
+			}
+		}
+	}
+
+	// New parent takes sibling's place
+	int oldParent = this->nodes[bestSibling].parent;
+	int newParent = allocateNode();
+	Node& parent = this->nodes[newParent];
+	parent.parent = oldParent;
+	parent.left = bestSibling;
+	parent.right = leaf;
+	parent.boundsMin = glm::min(this->nodes[bestSibling].boundsMin, leafMin);
+	parent.boundsMax = glm::max(this->nodes[bestSibling].boundsMax, leafMax);
+	this->nodes[bestSibling].parent = newParent;
+	this->nodes[leaf].parent = newParent;
+	if (oldParent == SCENE_BVH_NULL_NODE)
+	{
+		this->root = newParent;
+	}
+	else
+	{
+		Node& grandparent = this->nodes[oldParent];
+		(grandparent.left == bestSibling ? grandparent.left : grandparent.right) = newParent;
+		refit(oldParent);
+	}
+}
+
+void SceneBvh::removeLeaf(int leaf)
+{
+	if (leaf == this->root)
+	{
+		this->root = SCENE_BVH_NULL_NODE;
+		return;
+	}
+
+	// Sibling takes parent's place, parent is freed
+	int parent = this->nodes[leaf].parent;
+	int grandparent = this->nodes[parent].parent;
+	int sibling = this->nodes[parent].left == leaf ? this->nodes[parent].right : this->nodes[parent].left;
+	this->nodes[sibling].parent = grandparent;
+	if (grandparent == SCENE_BVH_NULL_NODE)
+	{
+		this->root = sibling;
+	}
+	else
+	{
+		Node& node = this->nodes[grandparent];
+		(node.left == parent ? node.left : node.right) = sibling;
+		refit(grandparent);
+	}
+
+	this->nodes[parent].left = SCENE_BVH_FREE_NODE;
+	this->freeNodes.push_back(parent);
+	this->nodes[leaf].parent = SCENE_BVH_NULL_NODE;
+}
+
+void SceneBvh::refit(int node)
+{
+	while (node != SCENE_BVH_NULL_NODE)
+	{
+		Node& current = this->nodes[node];
+		current.boundsMin = glm::min(this->nodes[current.left].boundsMin, this->nodes[current.right].boundsMin);
+		current.boundsMax = glm::max(this->nodes[current.left].boundsMax, this->nodes[current.right].boundsMax);
+		node = current.parent;
+	}
+}
+
+int SceneBvh::buildNode(int* leaves, uint32_t leafCount, uint32_t depth)
+{
+	if (leafCount == 1)
+	{
+		return leaves[0];
+	}
+
+	// Leaves are binned by box centers along axis of their largest spread
+	glm::vec3 centroidMin = glm::vec3(FLT_MAX);
+	glm::vec3 centroidMax = glm::vec3(-FLT_MAX);
+	for (uint32_t i = 0; i < leafCount; i++)
+	{
+		glm::vec3 centroid = (this->nodes[leaves[i]].boundsMin + this->nodes[leaves[i]].boundsMax) * 0.5f;
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+	glm::vec3 extent = centroidMax - centroidMin;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	auto getCentroid = [&](int leaf) { return (this->nodes[leaf].boundsMin[axis] + this->nodes[leaf].boundsMax[axis]) * 0.5f; };
+
+	uint32_t splitCount = 0;
+	if (depth < SCENE_BVH_MAX_SAH_DEPTH && extent[axis] > 0.0f)
+	{
+		float binScale = SCENE_BVH_BIN_COUNT / extent[axis];
+		auto getBin = [&](int leaf) { return std::min(static_cast<int>((getCentroid(leaf) - centroidMin[axis]) * binScale), SCENE_BVH_BIN_COUNT - 1); };
+
+		uint32_t binCounts[SCENE_BVH_BIN_COUNT] = {};
+		glm::vec3 binMins[SCENE_BVH_BIN_COUNT];
+		glm::vec3 binMaxs[SCENE_BVH_BIN_COUNT];
+		for (int b = 0; b < SCENE_BVH_BIN_COUNT; b++)
+		{
+			binMins[b] = glm::vec3(FLT_MAX);
+			binMaxs[b] = glm::vec3(-FLT_MAX);
+		}
+		for (uint32_t i = 0; i < leafCount; i++)
+		{
+			int bin = getBin(leaves[i]);
+			binCounts[bin]++;
+			binMins[bin] = glm::min(binMins[bin], this->nodes[leaves[i]].boundsMin);
+			binMaxs[bin] = glm::max(binMaxs[bin], this->nodes[leaves[i]].boundsMax);
+		}
+
+		// Split b puts bins below b left, right side is swept first
+		float rightAreas[SCENE_BVH_BIN_COUNT];
+		uint32_t rightCounts[SCENE_BVH_BIN_COUNT];
+		glm::vec3 sideMin = glm::vec3(FLT_MAX);
+		glm::vec3 sideMax = glm::vec3(-FLT_MAX);
+		uint32_t sideCount = 0;
+		for (int b = SCENE_BVH_BIN_COUNT - 1; b > 0; b--)
+		{
+			sideMin = glm::min(sideMin, binMins[b]);
+			sideMax = glm::max(sideMax, binMaxs[b]);
+			sideCount += binCounts[b];
+			rightAreas[b] = sideCount > 0 ? getSurfaceArea(sideMin, sideMax) : 0.0f;
+			rightCounts[b] = sideCount;
+		}
+
+		int bestSplit = 0;
+		float bestCost = FLT_MAX;
+		sideMin = glm::vec3(FLT_MAX);
+		sideMax = glm::vec3(-FLT_MAX);
+		sideCount = 0;
+		for (int b = 1; b < SCENE_BVH_BIN_COUNT; b++)
+		{
+			sideMin = glm::min(sideMin, binMins[b - 1]);
+			sideMax = glm::max(sideMax, binMaxs[b - 1]);
+			sideCount += binCounts[b - 1];
+			if (sideCount == 0 || rightCounts[b] == 0)
+			{
+				continue;
+			}
+			float cost = sideCount * getSurfaceArea(sideMin, sideMax) + rightCounts[b] * rightAreas[b];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+
+		if (bestSplit > 0)
+		{
+			splitCount = static_cast<uint32_t>(std::partition(leaves, leaves + leafCount,
+				[&](int leaf) { return getBin(leaf) < bestSplit; }) - leaves);
+		}
+	}
+
+	// Too deep or all centers in one place, halves keep depth logarithmic
+	if (splitCount == 0 || splitCount == leafCount)
+	{
+		splitCount = leafCount / 2;
+		std::nth_element(leaves, leaves + splitCount, leaves + leafCount,
+			[&](int a, int b) { return getCentroid(a) < getCentroid(b); });
+	}
+
+	int left = buildNode(leaves, splitCount, depth + 1);
+	int right = buildNode(leaves + splitCount, leafCount - splitCount, depth + 1);
+	int index = allocateNode();
+	Node& node = this->nodes[index];
+	node.left = left;
+	node.right = right;
+	node.boundsMin = glm::min(this->nodes[left].boundsMin, this->nodes[right].boundsMin);
+	node.boundsMax = glm::max(this->nodes[left].boundsMax, this->nodes[right].boundsMax);
+	this->nodes[left].parent = index;
+	this->nodes[right].parent = index;
+	return index;
+}
+
+void SceneBvh::collectObjects(int node, vector<uint64_t>* objects) const
+{
+	vector<int> stack;
+	stack.reserve(64);
+	stack.push_back(node);
+	while (!stack.empty())
+	{
+		const Node& current = this->nodes[stack.back()];
+		stack.pop_back();
+		if (current.left == SCENE_BVH_NULL_NODE)
+		{
+			objects->push_back(current.userData);
+		}
+		else
+		{
+			stack.push_back(current.left);
+			stack.push_back(current.right);
+		}
+	}
+}
+
+float SceneBvh::getSurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 extent = boundsMax - boundsMin;
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+float SceneBvh::intersectBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin,
+	const glm::vec3& inverseDirection, float maxDistance)
+{
+	glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+	glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return entry <= exit ? entry : FLT_MAX;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+#define SCENE_BVH_NULL_NODE			-1
+#define SCENE_BVH_MARGIN			0.1f		// leaf boxes are enlarged by this part of object's extent, moves inside them don't touch the tree
+#define SCENE_BVH_BIN_COUNT			16			// SAH split candidates of full rebuild
+#define SCENE_BVH_MAX_SAH_DEPTH		32			// deeper nodes of full rebuild are split at the median (bounds depth of lopsided scenes)
+#define SCENE_BVH_REINSERTS			32			// moved objects reinserted by one optimize call
+
+// Called for every object whose box the ray enters before current max distance (near boxes are visited first), boxDistance
+// is where the ray enters object's box. Returns new max distance, so exact hit shortens the ray and farther objects are skipped
+typedef std::function<float(uint64_t userData, float boxDistance)> SceneRayCallback;
+
+// Dynamic bounding volume hierarchy over world space boxes of scene objects for picking and region queries.
+// Objects are inserted next to the node giving the lowest SAH cost (branch and bound search). Moved objects refit their
+// ancestors at once, so queries are always exact, and are queued for reinsertion which optimize performs a few at a time,
+// tree quality recovers over frames instead of by full rebuild. rebuild builds whole tree with binned SAH (after bulk loading)
+class SceneBvh
+{
+
+public:
+	SceneBvh();
+	~SceneBvh();
+
+	// Returns proxy of new object (stays valid until object is removed)
+	int addObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint64_t userData);
+	void updateObject(int proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void removeObject(int proxy);
+	// Reinserts up to maxReinserts objects moved since they were last placed, oldest moves first
+	void optimize(uint32_t maxReinserts = SCENE_BVH_REINSERTS);
+	void rebuild();
+	void clear();
+
+	uint64_t getUserData(int proxy);
+	uint32_t getObjectCount();
+	uint32_t getNodeCount();
+
+	// Direction doesn't have to be normalized, distances are in units of direction length
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, const SceneRayCallback& callback) const;
+	// Objects whose boxes overlap box or frustum (planes of Vulkan clip space, view projection may use reverse or infinite depth)
+	void queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, vector<uint64_t>* objects) const;
+	void queryFrustum(const glm::mat4& viewProjection, vector<uint64_t>* objects) const;
+
+private:
+	// Leaves have no children, their bounds are object's box enlarged by SCENE_BVH_MARGIN
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		int parent;
+		glm::vec3 boundsMax;
+		int left;								// SCENE_BVH_NULL_NODE for leaves
+		int right;
+		bool queued;							// leaf waits in reinsert queue
+		glm::vec3 objectMin;					// exact box of leaf's object
+		glm::vec3 objectMax;
+		uint64_t userData;
+	};
+
+	vector<Node> nodes;
+	vector<int> freeNodes;
+	int root;
+	uint32_t objectCount;
+	deque<int> reinsertQueue;
+	vector<pair<float, int>> searchHeap;		// candidate siblings of insertLeaf (lowest inherited cost on top)
+
+	int allocateNode();
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	// Recomputes bounds of node and all its ancestors from their children
+	void refit(int node);
+	int buildNode(int* leaves, uint32_t leafCount, uint32_t depth);
+	void collectObjects(int node, vector<uint64_t>* objects) const;
+	static float getSurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	// Entry distance of ray into box, FLT_MAX when ray misses it within max distance
+	static float intersectBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin,
+		const glm::vec3& inverseDirection, float maxDistance);
+};
@@ -0,0 +1,378 @@
+#include "ShaderCompiler.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+// Resolves #include "file" relative to including file (and <file> relative to shader root)
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+	ShaderIncluder(const string& rootDirectory) : rootDirectory(rootDirectory) {}
+
+	shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type type,
+		const char* requestingSource, size_t) override
+	{
+		filesystem::path basePath = type == shaderc_include_type_relative
+			? filesystem::path(requestingSource).parent_path()
+			: filesystem::path(this->rootDirectory);
+
+		// Name and content have to outlive the call, they are released in ReleaseInclude
+		auto* data = new array<string, 2>();
+		(*data)[0] = (basePath / requestedSource).lexically_normal().generic_string();
+
+		ifstream file((*data)[0], ios::binary);
+		if (file.is_open())
+		{
+			(*data)[1].assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+		}
+		else
+		{
+			// Empty source name signals failed include, content holds the error message
+			(*data)[1] = "Failed to open included file " + (*data)[0];
+			(*data)[0].clear();
+		}
+
+		auto* result = new shaderc_include_result();
+		result->source_name = (*data)[0].c_str();
+		result->source_name_length = (*data)[0].size();
+		result->content = (*data)[1].c_str();
+		result->content_length = (*data)[1].size();
+		result->user_data = data;
+		return result;
+	}
+
+	void ReleaseInclude(shaderc_include_result* result) override
+	{
+		delete static_cast<array<string, 2>*>(result->user_data);
+		delete result;
+	}
+
+private:
+	string rootDirectory;
+};
+
+ShaderCompiler::ShaderCompiler()
+{
+#ifdef __linux__
+	this->inotifyFd = -1;
+	this->watchFd = -1;
+#endif
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+}
+
+void ShaderCompiler::init(string cacheDirectory)
+{
+	this->cacheDirectory = cacheDirectory;
+	filesystem::create_directories(this->cacheDirectory);
+}
+
+void ShaderCompiler::cleanup()
+{
+#ifdef __linux__
+	if (this->inotifyFd >= 0)
+	{
+		close(this->inotifyFd);
+		this->inotifyFd = -1;
+	}
+#endif
+}
+
+vector<uint32_t> ShaderCompiler::compile(const string& sourcePath)
+{
+	string rootPath = normalizePath(sourcePath);
+	shaderc_shader_kind kind = getShaderKind(rootPath);
+
+	// Gather shader with all its includes, key of cached SPIR-V is hash of all of their contents
+	string rootDirectory = filesystem::path(rootPath).parent_path().generic_string();
+	set<string> visited;
+	vector<string> sources;
+	collectSources(rootPath, rootDirectory, visited, sources);
+
+	uint64_t hash = hashBytes(&kind, sizeof(kind));
+	uint32_t cacheVersion = SHADER_CACHE_VERSION;
+	hash = hashBytes(&cacheVersion, sizeof(cacheVersion), hash);
+	for (const auto& source : sources)
+	{
+		hash = hashBytes(source.data(), source.size(), hash);
+	}
+
+	{
+		lock_guard<mutex> lock(this->dependencyMutex);
+		this->dependencies[rootPath] = visited;
+	}
+
+	char hashName[17];
+	snprintf(hashName, sizeof(hashName), "%016llx", (unsigned long long)hash);
+	string cachePath = this->cacheDirectory + "/" + hashName + ".spv";
+
+	// CACHED SPIR-V
+	ifstream cachedFile(cachePath, ios::binary | ios::ate);
+	if (cachedFile.is_open())
+	{
+		size_t fileSize = (size_t)cachedFile.tellg();
+		if (fileSize > 0 && fileSize % sizeof(uint32_t) == 0)
+		{
+			vector<uint32_t> spirv(fileSize / sizeof(uint32_t));
+			cachedFile.seekg(0);
+			cachedFile.read(reinterpret_cast<char*>(spirv.data()), fileSize);
+			if (cachedFile.good())
+			{
+				return spirv;
+			}
+		}
+	}
+
+	// COMPILATION
+	shaderc::Compiler compiler;
+	shaderc::CompileOptions options;
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	options.SetIncluder(make_unique<ShaderIncluder>(rootDirectory));
+
+	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(sources[0], kind, rootPath.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+	{
+		throw runtime_error("Failed to compile shader " + rootPath + ":\n" + result.GetErrorMessage());
+	}
+
+	vector<uint32_t> spirv(result.cbegin(), result.cend());
+
+	// Written through temporary file, so other process never reads partially written SPIR-V
+	string tempPath = cachePath + ".tmp" + to_string(std::hash<thread::id>{}(this_thread::get_id()));
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		file.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+	}
+	error_code renameError;
+	filesystem::rename(tempPath, cachePath, renameError);
+
+	return spirv;
+}
+
+void ShaderCompiler::watch(const string& directory)
+{
+	this->watchDirectory = directory;
+
+#ifdef __linux__
+	this->inotifyFd = inotify_init1(IN_NONBLOCK);
+	if (this->inotifyFd >= 0)
+	{
+		// Editors often save by writing temp file and moving it over original, so both events are needed
+		this->watchFd = inotify_add_watch(this->inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (this->watchFd >= 0)
+		{
+			return;
+		}
+		close(this->inotifyFd);
+		this->inotifyFd = -1;
+	}
+#endif
+
+	// POLLING FALLBACK, remember current modification times
+	for (const auto& entry : filesystem::directory_iterator(directory))
+	{
+		if (entry.is_regular_file())
+		{
+			this->fileTimes[normalizePath(entry.path().string())] = entry.last_write_time();
+		}
+	}
+	this->lastPollTime = chrono::steady_clock::now();
+}
+
+vector<string> ShaderCompiler::pollChangedShaders()
+{
+	vector<string> changedFiles = pollChangedFiles();
+	if (changedFiles.empty())
+	{
+		return {};
+	}
+
+	lock_guard<mutex> lock(this->dependencyMutex);
+
+	vector<string> changedShaders;
+	for (const auto& dependency : this->dependencies)
+	{
+		for (const auto& file : changedFiles)
+		{
+			if (dependency.second.count(file) > 0)
+			{
+				changedShaders.push_back(dependency.first);
+				break;
+			}
+		}
+	}
+	return changedShaders;
+}
+
+vector<string> ShaderCompiler::pollChangedFiles()
+{
+	vector<string> changedFiles;
+	if (this->watchDirectory.empty())
+	{
+		return changedFiles;
+	}
+
+#ifdef __linux__
+	if (this->inotifyFd >= 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(this->inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* ptr = buffer; ptr < buffer + length; )
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+				if (event->len > 0)
+				{
+					changedFiles.push_back(normalizePath(this->watchDirectory + "/" + event->name));
+				}
+				ptr += sizeof(inotify_event) + event->len;
+			}
+		}
+		return changedFiles;
+	}
+#endif
+
+	// POLLING FALLBACK, directory is scanned at most every SHADER_WATCH_POLL_INTERVAL
+	auto now = chrono::steady_clock::now();
+	if (chrono::duration<double>(now - this->lastPollTime).count() < SHADER_WATCH_POLL_INTERVAL)
+	{
+		return changedFiles;
+	}
+	this->lastPollTime = now;
+
+	error_code error;
+	for (const auto& entry : filesystem::directory_iterator(this->watchDirectory, error))
+	{
+		if (!entry.is_regular_file())
+		{
+			continue;
+		}
+
+		string path = normalizePath(entry.path().string());
+		auto writeTime = entry.last_write_time(error);
+		auto knownTime = this->fileTimes.find(path);
+		if (knownTime == this->fileTimes.end() || knownTime->second != writeTime)
+		{
+			this->fileTimes[path] = writeTime;
+			changedFiles.push_back(path);
+		}
+	}
+	return changedFiles;
+}
+
+void ShaderCompiler::collectSources(const string& filePath, const string& rootDirectory, set<string>& visited, vector<string>& sources)
+{
+	if (!visited.insert(filePath).second)
+	{
+		return;
+	}
+
+	string source = readSource(filePath);
+	sources.push_back(source);
+
+	// Includes are resolved the same way ShaderIncluder resolves them, directives inside comments are ignored
+	string code = stripComments(source);
+	filesystem::path directory = filesystem::path(filePath).parent_path();
+	size_t lineStart = 0;
+	while (lineStart < code.size())
+	{
+		size_t lineEnd = code.find('\n', lineStart);
+		if (lineEnd == string::npos)
+		{
+			lineEnd = code.size();
+		}
+
+		// # include "file" or # include <file>, whitespace is allowed around #
+		size_t position = code.find_first_not_of(" \t", lineStart);
+		if (position < lineEnd && code[position] == '#')
+		{
+			position = code.find_first_not_of(" \t", position + 1);
+			if (position < lineEnd && code.compare(position, 7, "include") == 0)
+			{
+				size_t open = code.find_first_not_of(" \t", position + 7);
+				char closing = open < lineEnd ? (code[open] == '"' ? '"' : code[open] == '<' ? '>' : 0) : 0;
+				size_t close = closing != 0 ? code.find(closing, open + 1) : string::npos;
+				if (close < lineEnd)
+				{
+					filesystem::path basePath = closing == '"' ? directory : filesystem::path(rootDirectory);
+					string includePath = normalizePath((basePath / code.substr(open + 1, close - open - 1)).string());
+					collectSources(includePath, rootDirectory, visited, sources);
+				}
+			}
+		}
+
+		lineStart = lineEnd + 1;
+	}
+}
+
+string ShaderCompiler::readSource(const string& filePath)
+{
+	ifstream file(filePath, ios::binary);
+	if (!file.is_open())
+	{
+		throw runtime_error("Failed to open shader source " + filePath);
+	}
+	return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+string ShaderCompiler::stripComments(const string& source)
+{
+	// Comments become spaces and line breaks inside block comments are kept, so directives stay on their own lines
+	string code = source;
+	size_t i = 0;
+	while (i + 1 < code.size())
+	{
+		if (code[i] == '/' && code[i + 1] == '/')
+		{
+			for (; i < code.size() && code[i] != '\n'; i++)
+			{
+				code[i] = ' ';
+			}
+		}
+		else if (code[i] == '/' && code[i + 1] == '*')
+		{
+			code[i] = code[i + 1] = ' ';
+			for (i += 2; i < code.size() && !(code[i] == '*' && i + 1 < code.size() && code[i + 1] == '/'); i++)
+			{
+				if (code[i] != '\n')
+				{
+					code[i] = ' ';
+				}
+			}
+			for (size_t end = std::min(i + 2, code.size()); i < end; i++)
+			{
+				code[i] = ' ';
+			}
+		}
+		else
+		{
+			i++;
+		}
+	}
+	return code;
+}
+
+shaderc_shader_kind ShaderCompiler::getShaderKind(const string& filePath)
+{
+	string extension = filesystem::path(filePath).extension().string();
+	if (extension == ".vert") return shaderc_vertex_shader;
+	if (extension == ".frag") return shaderc_fragment_shader;
+	if (extension == ".comp") return shaderc_compute_shader;
+	if (extension == ".geom") return shaderc_geometry_shader;
+	if (extension == ".tesc") return shaderc_tess_control_shader;
+	if (extension == ".tese") return shaderc_tess_evaluation_shader;
+
+	throw runtime_error("Unknown shader stage of " + filePath);
+}
+
+string ShaderCompiler::normalizePath(const string& filePath)
+{
+	return filesystem::path(filePath).lexically_normal().generic_string();
+}
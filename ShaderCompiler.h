@@ -0,0 +1,65 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <shaderc/shaderc.hpp>
+#include <vector>
+#include <string>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+#define SHADER_CACHE_DIRECTORY		"shader_cache"
+#define SHADER_CACHE_VERSION		1			// bump to invalidate cached SPIR-V (e.g. on compile options change)
+#define SHADER_WATCH_POLL_INTERVAL	0.5			// seconds between modification time checks (when inotify is not available)
+
+// Compiles GLSL to SPIR-V at runtime, caches results on disk by content hash and watches sources for changes
+class ShaderCompiler
+{
+
+public:
+	ShaderCompiler();
+	~ShaderCompiler();
+
+	void init(string cacheDirectory = SHADER_CACHE_DIRECTORY);
+	void cleanup();
+
+	// Returns SPIR-V of given shader (stage is taken from file extension), throws with compiler log on error
+	vector<uint32_t> compile(const string& sourcePath);
+
+	// Starts watching directory with shader sources
+	void watch(const string& directory);
+	// Returns shaders compiled before that have to be recompiled because they or their includes changed
+	vector<string> pollChangedShaders();
+
+private:
+	string cacheDirectory;
+
+	// Files each compiled shader was built from (itself and everything it includes)
+	mutex dependencyMutex;
+	unordered_map<string, set<string>> dependencies;
+
+	// Watching
+	string watchDirectory;
+#ifdef __linux__
+	int inotifyFd;
+	int watchFd;
+#endif
+	unordered_map<string, filesystem::file_time_type> fileTimes;
+	chrono::steady_clock::time_point lastPollTime;
+
+	vector<string> pollChangedFiles();
+	// Quoted includes are relative to including file, <> includes relative to root shader's directory
+	void collectSources(const string& filePath, const string& rootDirectory, set<string>& visited, vector<string>& sources);
+
+	static string readSource(const string& filePath);
+	static string stripComments(const string& source);
+	static shaderc_shader_kind getShaderKind(const string& filePath);
+	static string normalizePath(const string& filePath);
+};
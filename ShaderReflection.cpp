@@ -0,0 +1,428 @@
+#include "ShaderReflection.h"
+
+#include <algorithm>
+
+// SPIR-V values used by reflection (see SPIR-V specification, spirv.h is not needed for these few)
+#define SPIRV_MAGIC 0x07230203
+
+enum SpirvOp
+{
+	SPIRV_OP_ENTRY_POINT = 15,
+	SPIRV_OP_TYPE_BOOL = 20,
+	SPIRV_OP_TYPE_INT = 21,
+	SPIRV_OP_TYPE_FLOAT = 22,
+	SPIRV_OP_TYPE_VECTOR = 23,
+	SPIRV_OP_TYPE_MATRIX = 24,
+	SPIRV_OP_TYPE_IMAGE = 25,
+	SPIRV_OP_TYPE_SAMPLER = 26,
+	SPIRV_OP_TYPE_SAMPLED_IMAGE = 27,
+	SPIRV_OP_TYPE_ARRAY = 28,
+	SPIRV_OP_TYPE_RUNTIME_ARRAY = 29,
+	SPIRV_OP_TYPE_STRUCT = 30,
+	SPIRV_OP_TYPE_POINTER = 32,
+	SPIRV_OP_CONSTANT = 43,
+	SPIRV_OP_VARIABLE = 59,
+	SPIRV_OP_DECORATE = 71,
+	SPIRV_OP_MEMBER_DECORATE = 72
+};
+
+enum SpirvDecoration
+{
+	SPIRV_DECORATION_BLOCK = 2,
+	SPIRV_DECORATION_BUFFER_BLOCK = 3,
+	SPIRV_DECORATION_ARRAY_STRIDE = 6,
+	SPIRV_DECORATION_MATRIX_STRIDE = 7,
+	SPIRV_DECORATION_BUILT_IN = 11,
+	SPIRV_DECORATION_LOCATION = 30,
+	SPIRV_DECORATION_BINDING = 33,
+	SPIRV_DECORATION_DESCRIPTOR_SET = 34,
+	SPIRV_DECORATION_OFFSET = 35
+};
+
+enum SpirvStorageClass
+{
+	SPIRV_STORAGE_UNIFORM_CONSTANT = 0,
+	SPIRV_STORAGE_INPUT = 1,
+	SPIRV_STORAGE_UNIFORM = 2,
+	SPIRV_STORAGE_PUSH_CONSTANT = 9,
+	SPIRV_STORAGE_STORAGE_BUFFER = 12
+};
+
+#define SPIRV_DIM_BUFFER 5
+#define SPIRV_DIM_SUBPASS_DATA 6
+
+// Everything reflection needs to know about single result id
+struct SpirvId
+{
+	uint32_t opcode = 0;
+	vector<uint32_t> operands;						// operands of defining instruction (result id included)
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	uint32_t location = 0;
+	uint32_t arrayStride = 0;
+	bool hasBinding = false;
+	bool hasLocation = false;
+	bool builtIn = false;
+	bool block = false;
+	bool bufferBlock = false;
+	vector<uint32_t> memberOffsets;
+	vector<uint32_t> memberMatrixStrides;
+};
+
+static VkShaderStageFlagBits getExecutionModelStage(uint32_t executionModel)
+{
+	switch (executionModel)
+	{
+	case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+	case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+	case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+	case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+	case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+	case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	throw runtime_error("Failed to reflect shader, unsupported execution model.");
+}
+
+// Size of type laid out in buffer block (offsets and strides come from decorations made by compiler)
+static uint32_t getTypeSize(const vector<SpirvId>& ids, uint32_t typeId, uint32_t matrixStride = 0)
+{
+	const SpirvId& type = ids[typeId];
+	switch (type.opcode)
+	{
+	case SPIRV_OP_TYPE_BOOL:
+		return 4;
+	case SPIRV_OP_TYPE_INT:
+	case SPIRV_OP_TYPE_FLOAT:
+		return type.operands[1] / 8;
+	case SPIRV_OP_TYPE_VECTOR:
+		return type.operands[2] * getTypeSize(ids, type.operands[1]);
+	case SPIRV_OP_TYPE_MATRIX:
+		return type.operands[2] * (matrixStride > 0 ? matrixStride : getTypeSize(ids, type.operands[1]));
+	case SPIRV_OP_TYPE_ARRAY:
+	{
+		uint32_t length = ids[type.operands[2]].operands[2];
+		uint32_t stride = type.arrayStride > 0 ? type.arrayStride : getTypeSize(ids, type.operands[1], matrixStride);
+		return length * stride;
+	}
+	case SPIRV_OP_TYPE_STRUCT:
+	{
+		uint32_t size = 0;
+		for (uint32_t member = 0; member + 1 < type.operands.size(); member++)
+		{
+			uint32_t offset = member < type.memberOffsets.size() ? type.memberOffsets[member] : 0;
+			uint32_t memberStride = member < type.memberMatrixStrides.size() ? type.memberMatrixStrides[member] : 0;
+			size = std::max(size, offset + getTypeSize(ids, type.operands[member + 1], memberStride));
+		}
+		return size;
+	}
+	}
+	return 0;
+}
+
+static VkFormat getInputFormat(const vector<SpirvId>& ids, uint32_t typeId)
+{
+	const SpirvId& type = ids[typeId];
+	uint32_t componentCount = 1;
+	const SpirvId* component = &type;
+	if (type.opcode == SPIRV_OP_TYPE_VECTOR)
+	{
+		componentCount = type.operands[2];
+		component = &ids[type.operands[1]];
+	}
+
+	static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+	static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+	if (componentCount < 1 || componentCount > 4)
+	{
+		return VK_FORMAT_UNDEFINED;
+	}
+	if (component->opcode == SPIRV_OP_TYPE_FLOAT && component->operands[1] == 32)
+	{
+		return floatFormats[componentCount - 1];
+	}
+	if (component->opcode == SPIRV_OP_TYPE_INT && component->operands[1] == 32)
+	{
+		return component->operands[2] ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+	}
+	return VK_FORMAT_UNDEFINED;						// matrices and 64-bit inputs are not used by this renderer
+}
+
+static bool getDescriptorType(const vector<SpirvId>& ids, uint32_t storageClass, uint32_t typeId, VkDescriptorType* descriptorType)
+{
+	const SpirvId& type = ids[typeId];
+
+	if (storageClass == SPIRV_STORAGE_STORAGE_BUFFER)
+	{
+		*descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		return true;
+	}
+	if (storageClass == SPIRV_STORAGE_UNIFORM)
+	{
+		// Before SPIR-V 1.3 storage buffers were uniform blocks decorated as BufferBlock
+		*descriptorType = type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		return true;
+	}
+	if (storageClass != SPIRV_STORAGE_UNIFORM_CONSTANT)
+	{
+		return false;
+	}
+
+	switch (type.opcode)
+	{
+	case SPIRV_OP_TYPE_SAMPLER:
+		*descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		return true;
+	case SPIRV_OP_TYPE_SAMPLED_IMAGE:
+		*descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		return true;
+	case SPIRV_OP_TYPE_IMAGE:
+	{
+		uint32_t dim = type.operands[2];
+		uint32_t sampled = type.operands[6];		// 1 - used with sampler, 2 - storage image
+		if (dim == SPIRV_DIM_SUBPASS_DATA)
+		{
+			*descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		}
+		else if (dim == SPIRV_DIM_BUFFER)
+		{
+			*descriptorType = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		}
+		else
+		{
+			*descriptorType = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		return true;
+	}
+	}
+	return false;
+}
+
+uint32_t ShaderReflection::getSetCount() const
+{
+	uint32_t setCount = 0;
+	for (const auto& binding : this->bindings)
+	{
+		setCount = std::max(setCount, binding.set + 1);
+	}
+	return setCount;
+}
+
+ShaderReflection ShaderReflection::reflect(const vector<uint32_t>& code)
+{
+	if (code.size() < 5 || code[0] != SPIRV_MAGIC)
+	{
+		throw runtime_error("Failed to reflect shader, code is not SPIR-V.");
+	}
+
+	ShaderReflection reflection;
+	uint32_t idBound = code[3];
+	vector<SpirvId> ids(idBound);
+
+	// PARSE INSTRUCTIONS (header has 5 words, each instruction starts with its word count and opcode)
+	size_t position = 5;
+	while (position < code.size())
+	{
+		uint32_t wordCount = code[position] >> 16;
+		uint32_t opcode = code[position] & 0xFFFF;
+		if (wordCount == 0 || position + wordCount > code.size())
+		{
+			throw runtime_error("Failed to reflect shader, SPIR-V is truncated.");
+		}
+
+		vector<uint32_t> operands(code.begin() + position + 1, code.begin() + position + wordCount);
+		position += wordCount;
+
+		switch (opcode)
+		{
+		case SPIRV_OP_ENTRY_POINT:
+			reflection.stageFlags |= getExecutionModelStage(operands[0]);
+			break;
+
+		case SPIRV_OP_DECORATE:
+		{
+			if (operands[0] >= idBound)
+			{
+				break;
+			}
+			SpirvId& target = ids[operands[0]];
+			uint32_t value = operands.size() > 2 ? operands[2] : 0;
+			switch (operands[1])
+			{
+			case SPIRV_DECORATION_BLOCK: target.block = true; break;
+			case SPIRV_DECORATION_BUFFER_BLOCK: target.bufferBlock = true; break;
+			case SPIRV_DECORATION_ARRAY_STRIDE: target.arrayStride = value; break;
+			case SPIRV_DECORATION_BUILT_IN: target.builtIn = true; break;
+			case SPIRV_DECORATION_LOCATION: target.location = value; target.hasLocation = true; break;
+			case SPIRV_DECORATION_BINDING: target.binding = value; target.hasBinding = true; break;
+			case SPIRV_DECORATION_DESCRIPTOR_SET: target.set = value; break;
+			}
+			break;
+		}
+
+		case SPIRV_OP_MEMBER_DECORATE:
+		{
+			if (operands[0] >= idBound || operands.size() < 4)
+			{
+				break;
+			}
+			SpirvId& target = ids[operands[0]];
+			uint32_t member = operands[1];
+			if (operands[2] == SPIRV_DECORATION_OFFSET)
+			{
+				target.memberOffsets.resize(std::max((uint32_t)target.memberOffsets.size(), member + 1));
+				target.memberOffsets[member] = operands[3];
+			}
+			else if (operands[2] == SPIRV_DECORATION_MATRIX_STRIDE)
+			{
+				target.memberMatrixStrides.resize(std::max((uint32_t)target.memberMatrixStrides.size(), member + 1));
+				target.memberMatrixStrides[member] = operands[3];
+			}
+			break;
+		}
+
+		case SPIRV_OP_TYPE_BOOL:
+		case SPIRV_OP_TYPE_INT:
+		case SPIRV_OP_TYPE_FLOAT:
+		case SPIRV_OP_TYPE_VECTOR:
+		case SPIRV_OP_TYPE_MATRIX:
+		case SPIRV_OP_TYPE_IMAGE:
+		case SPIRV_OP_TYPE_SAMPLER:
+		case SPIRV_OP_TYPE_SAMPLED_IMAGE:
+		case SPIRV_OP_TYPE_ARRAY:
+		case SPIRV_OP_TYPE_RUNTIME_ARRAY:
+		case SPIRV_OP_TYPE_STRUCT:
+		case SPIRV_OP_TYPE_POINTER:
+			// Types define their result id as first operand
+			if (!operands.empty() && operands[0] < idBound)
+			{
+				ids[operands[0]].opcode = opcode;
+				ids[operands[0]].operands = operands;
+			}
+			break;
+
+		case SPIRV_OP_CONSTANT:
+		case SPIRV_OP_VARIABLE:
+			// Result type comes first, then result id
+			if (operands.size() > 2 && operands[1] < idBound)
+			{
+				ids[operands[1]].opcode = opcode;
+				ids[operands[1]].operands = operands;
+			}
+			break;
+		}
+	}
+
+	// COLLECT INTERFACE VARIABLES
+	for (const auto& variable : ids)
+	{
+		if (variable.opcode != SPIRV_OP_VARIABLE)
+		{
+			continue;
+		}
+
+		uint32_t storageClass = variable.operands[2];
+		const SpirvId& pointer = ids[variable.operands[0]];
+		if (pointer.opcode != SPIRV_OP_TYPE_POINTER)
+		{
+			continue;
+		}
+		uint32_t typeId = pointer.operands[2];
+
+		if (storageClass == SPIRV_STORAGE_INPUT)
+		{
+			if ((reflection.stageFlags & VK_SHADER_STAGE_VERTEX_BIT) && variable.hasLocation && !variable.builtIn)
+			{
+				reflection.inputs.push_back({ variable.location, getInputFormat(ids, typeId) });
+			}
+			continue;
+		}
+
+		if (storageClass == SPIRV_STORAGE_PUSH_CONSTANT)
+		{
+			reflection.pushConstantRange.stageFlags = reflection.stageFlags;
+			reflection.pushConstantRange.offset = 0;
+			reflection.pushConstantRange.size = getTypeSize(ids, typeId);
+			continue;
+		}
+
+		if (!variable.hasBinding)
+		{
+			continue;
+		}
+
+		// Arrays of resources are single binding with multiple descriptors
+		uint32_t count = 1;
+		if (ids[typeId].opcode == SPIRV_OP_TYPE_ARRAY)
+		{
+			count = ids[ids[typeId].operands[2]].operands[2];
+			typeId = ids[typeId].operands[1];
+		}
+		else if (ids[typeId].opcode == SPIRV_OP_TYPE_RUNTIME_ARRAY)
+		{
+			count = 0;
+			typeId = ids[typeId].operands[1];
+		}
+
+		VkDescriptorType descriptorType;
+		if (getDescriptorType(ids, storageClass, typeId, &descriptorType))
+		{
+			reflection.bindings.push_back({ variable.set, variable.binding, descriptorType, count, reflection.stageFlags });
+		}
+	}
+
+	sort(reflection.bindings.begin(), reflection.bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+	sort(reflection.inputs.begin(), reflection.inputs.end(), [](const ReflectedInput& a, const ReflectedInput& b) {
+		return a.location < b.location;
+	});
+
+	return reflection;
+}
+
+ShaderReflection ShaderReflection::merge(const vector<ShaderReflection>& stages)
+{
+	ShaderReflection merged;
+	for (const auto& stage : stages)
+	{
+		merged.stageFlags |= stage.stageFlags;
+
+		for (const auto& binding : stage.bindings)
+		{
+			auto existing = find_if(merged.bindings.begin(), merged.bindings.end(), [&binding](const ReflectedBinding& other) {
+				return other.set == binding.set && other.binding == binding.binding;
+			});
+			if (existing == merged.bindings.end())
+			{
+				merged.bindings.push_back(binding);
+				continue;
+			}
+			if (existing->type != binding.type || existing->count != binding.count)
+			{
+				throw runtime_error("Failed to merge shader reflections, stages declare different resources at set "
+					+ to_string(binding.set) + " binding " + to_string(binding.binding) + ".");
+			}
+			existing->stageFlags |= binding.stageFlags;
+		}
+
+		// Single range visible to every stage that uses push constants (all stages share one block here)
+		if (stage.pushConstantRange.size > 0)
+		{
+			merged.pushConstantRange.stageFlags |= stage.pushConstantRange.stageFlags;
+			merged.pushConstantRange.size = std::max(merged.pushConstantRange.size, stage.pushConstantRange.size);
+		}
+
+		if (stage.stageFlags & VK_SHADER_STAGE_VERTEX_BIT)
+		{
+			merged.inputs = stage.inputs;
+		}
+	}
+
+	sort(merged.bindings.begin(), merged.bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+
+	return merged;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+// Descriptor binding used by shader
+struct ReflectedBinding
+{
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType type;
+	uint32_t count;									// array size, 0 for runtime sized arrays
+	VkShaderStageFlags stageFlags;
+};
+
+// Vertex shader input
+struct ReflectedInput
+{
+	uint32_t location;
+	VkFormat format;
+};
+
+// Interface of shader module(s) read directly from SPIR-V
+struct ShaderReflection
+{
+	VkShaderStageFlags stageFlags = 0;
+	vector<ReflectedBinding> bindings;				// sorted by set and binding
+	VkPushConstantRange pushConstantRange = {};		// size 0 if push constants are not used
+	vector<ReflectedInput> inputs;					// vertex inputs sorted by location (empty for other stages)
+
+	uint32_t getSetCount() const;
+
+	// Parses SPIR-V module, throws if code is not valid SPIR-V
+	static ShaderReflection reflect(const vector<uint32_t>& code);
+	// Combines reflections of all stages of one pipeline
+	static ShaderReflection merge(const vector<ShaderReflection>& stages);
+};
@@ -0,0 +1,471 @@
+#include "SoftwareOcclusion.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// SSE2 is baseline on x64 (and default target of 32 bit MSVC builds), other targets use scalar loops
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFTWARE_OCCLUSION_SSE
+#endif
+
+#define CLIP_PLANE_COUNT		5			// near plane and four guard band planes
+#define CLIP_MAX_VERTICES		(3 + CLIP_PLANE_COUNT)	// every plane adds at most one vertex
+
+SoftwareOcclusion::SoftwareOcclusion()
+{
+	this->viewProjection = glm::mat4(1.0f);
+	this->nearPlane = 0.0f;
+	this->depth.assign(SOFTWARE_OCCLUSION_WIDTH * SOFTWARE_OCCLUSION_HEIGHT, 0.0f);
+	this->tileBins.resize(SOFTWARE_OCCLUSION_TILE_COUNT);
+	this->jobGeneration = 0;
+	this->finishedTiles = 0;
+	this->nextTile = SOFTWARE_OCCLUSION_TILE_COUNT;
+	this->stopWorkers = false;
+}
+
+SoftwareOcclusion::~SoftwareOcclusion()
+{
+}
+
+void SoftwareOcclusion::init(uint32_t workerCount)
+{
+	this->stopWorkers = false;
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		this->workers.emplace_back(&SoftwareOcclusion::workerLoop, this);
+	}
+}
+
+void SoftwareOcclusion::cleanup()
+{
+	{
+		lock_guard<mutex> lock(this->jobMutex);
+		this->stopWorkers = true;
+	}
+	this->jobCondition.notify_all();
+	for (auto& worker : this->workers)
+	{
+		worker.join();
+	}
+	this->workers.clear();
+	this->occluders.clear();
+}
+
+bool SoftwareOcclusion::addOccluder(int occluderId, const vector<glm::vec3>& positions, const vector<uint32_t>& indices, uint32_t indexBase)
+{
+	if (this->occluders.find(occluderId) != this->occluders.end())
+	{
+		return false;
+	}
+
+	Occluder occluder;
+	occluder.positions = positions;
+	occluder.transform = glm::mat4(1.0f);
+	occluder.indices.reserve(indices.size() - indices.size() % 3);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			uint32_t index = indices[i + j];
+			if (index < indexBase || index - indexBase >= positions.size())
+			{
+				throw runtime_error("Failed to add occluder, index " + to_string(index) + " is out of vertex range.");
+			}
+			occluder.indices.push_back(index - indexBase);
+		}
+	}
+	this->occluders[occluderId] = std::move(occluder);
+	return true;
+}
+
+bool SoftwareOcclusion::setOccluderTransform(int occluderId, const glm::mat4& transform)
+{
+	auto occluder = this->occluders.find(occluderId);
+	if (occluder == this->occluders.end())
+	{
+		return false;
+	}
+	occluder->second.transform = transform;
+	return true;
+}
+
+bool SoftwareOcclusion::removeOccluder(int occluderId)
+{
+	return this->occluders.erase(occluderId) > 0;
+}
+
+void SoftwareOcclusion::rasterize(const glm::mat4& viewProjection, float nearPlane)
+{
+	this->viewProjection = viewProjection;
+	this->nearPlane = nearPlane;
+
+	// SETUP
+	// Triangles are culled, clipped and binned on calling thread, tiles then only read them
+	this->triangles.clear();
+	for (auto& bin : this->tileBins)
+	{
+		bin.clear();
+	}
+	for (const auto& occluderKeyValue : this->occluders)
+	{
+		const Occluder& occluder = occluderKeyValue.second;
+		glm::mat4 mvp = viewProjection * occluder.transform;
+		this->clipVertices.resize(occluder.positions.size());
+		for (size_t i = 0; i < occluder.positions.size(); i++)
+		{
+			glm::vec4 clip = mvp * glm::vec4(occluder.positions[i], 1.0f);
+			this->clipVertices[i] = { clip.x, clip.y, clip.w };
+		}
+
+		for (size_t i = 0; i < occluder.indices.size() && this->triangles.size() < SOFTWARE_OCCLUSION_MAX_TRIANGLES; i += 3)
+		{
+			ClipVertex vertices[3] = { this->clipVertices[occluder.indices[i]], this->clipVertices[occluder.indices[i + 1]],
+				this->clipVertices[occluder.indices[i + 2]] };
+			addTriangle(vertices);
+		}
+	}
+
+	// RASTER
+	{
+		lock_guard<mutex> lock(this->jobMutex);
+		this->finishedTiles = 0;
+		this->nextTile = 0;
+		this->jobGeneration++;
+	}
+	this->jobCondition.notify_all();
+	rasterizeTiles();
+
+	unique_lock<mutex> lock(this->jobMutex);
+	this->doneCondition.wait(lock, [this] { return this->finishedTiles == SOFTWARE_OCCLUSION_TILE_COUNT; });
+}
+
+bool SoftwareOcclusion::isVisible(const glm::mat4& model, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	// Screen rectangle and nearest depth of box corners, boxes reaching in front of near plane are always visible
+	glm::mat4 mvp = this->viewProjection * model;
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float nearestDepth = 0.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 position((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = mvp * glm::vec4(position, 1.0f);
+		if (clip.w < this->nearPlane)
+		{
+			return true;
+		}
+		float inverseW = 1.0f / clip.w;
+		float x = (clip.x * inverseW * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_WIDTH;
+		float y = (clip.y * inverseW * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_HEIGHT;
+		minX = std::min(minX, x);
+		minY = std::min(minY, y);
+		maxX = std::max(maxX, x);
+		maxY = std::max(maxY, y);
+		nearestDepth = std::max(nearestDepth, inverseW);
+	}
+	if (maxX < 0.0f || maxY < 0.0f || minX >= SOFTWARE_OCCLUSION_WIDTH || minY >= SOFTWARE_OCCLUSION_HEIGHT)
+	{
+		return false;
+	}
+
+	// Every pixel the rectangle touches has to hold an occluder nearer than the box
+	int firstX = std::max(0, (int)floorf(minX));
+	int firstY = std::max(0, (int)floorf(minY));
+	int lastX = std::min(SOFTWARE_OCCLUSION_WIDTH - 1, (int)floorf(maxX));
+	int lastY = std::min(SOFTWARE_OCCLUSION_HEIGHT - 1, (int)floorf(maxY));
+	float threshold = nearestDepth * (1.0f + SOFTWARE_OCCLUSION_DEPTH_BIAS);
+	for (int y = firstY; y <= lastY; y++)
+	{
+		const float* row = &this->depth[y * SOFTWARE_OCCLUSION_WIDTH];
+		int x = firstX;
+#ifdef SOFTWARE_OCCLUSION_SSE
+		__m128 thresholds = _mm_set1_ps(threshold);
+		for (; x + 3 <= lastX; x += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), thresholds)) != 0)
+			{
+				return true;
+			}
+		}
+#endif
+		for (; x <= lastX; x++)
+		{
+			if (row[x] <= threshold)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+uint32_t SoftwareOcclusion::getTriangleCount()
+{
+	return static_cast<uint32_t>(this->triangles.size());
+}
+
+const vector<float>& SoftwareOcclusion::getDepth()
+{
+	return this->depth;
+}
+
+void SoftwareOcclusion::workerLoop()
+{
+	uint64_t generation = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(this->jobMutex);
+			this->jobCondition.wait(lock, [&] { return this->stopWorkers || this->jobGeneration != generation; });
+			if (this->stopWorkers)
+			{
+				return;
+			}
+			generation = this->jobGeneration;
+		}
+		rasterizeTiles();
+	}
+}
+
+void SoftwareOcclusion::rasterizeTiles()
+{
+	// Tiles cover disjoint pixels, so workers write depth without synchronization
+	uint32_t rasterizedTiles = 0;
+	for (uint32_t tile = this->nextTile++; tile < SOFTWARE_OCCLUSION_TILE_COUNT; tile = this->nextTile++)
+	{
+		rasterizeTile(tile);
+		rasterizedTiles++;
+	}
+
+	if (rasterizedTiles > 0)
+	{
+		lock_guard<mutex> lock(this->jobMutex);
+		this->finishedTiles += rasterizedTiles;
+		if (this->finishedTiles == SOFTWARE_OCCLUSION_TILE_COUNT)
+		{
+			this->doneCondition.notify_all();
+		}
+	}
+}
+
+void SoftwareOcclusion::rasterizeTile(uint32_t tile)
+{
+	int tileX = (int)(tile % SOFTWARE_OCCLUSION_TILES_X) * SOFTWARE_OCCLUSION_TILE_WIDTH;
+	int tileY = (int)(tile / SOFTWARE_OCCLUSION_TILES_X) * SOFTWARE_OCCLUSION_TILE_HEIGHT;
+	for (int y = tileY; y < tileY + SOFTWARE_OCCLUSION_TILE_HEIGHT; y++)
+	{
+		std::fill_n(&this->depth[y * SOFTWARE_OCCLUSION_WIDTH + tileX], SOFTWARE_OCCLUSION_TILE_WIDTH, 0.0f);
+	}
+
+	for (uint32_t triangleIndex : this->tileBins[tile])
+	{
+		const ScreenTriangle& triangle = this->triangles[triangleIndex];
+		int firstY = std::max(triangle.minY, tileY);
+		int lastY = std::min(triangle.maxY, tileY + SOFTWARE_OCCLUSION_TILE_HEIGHT - 1);
+		// Groups of 4 pixels start at multiples of 4, tile width keeps them inside the tile
+		int firstX = std::max(triangle.minX, tileX) & ~3;
+		int lastX = std::min(triangle.maxX, tileX + SOFTWARE_OCCLUSION_TILE_WIDTH - 1);
+
+#ifdef SOFTWARE_OCCLUSION_SSE
+		__m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 zero = _mm_setzero_ps();
+		__m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+		__m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+		__m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+		__m128 depthA = _mm_set1_ps(triangle.depthA);
+		for (int y = firstY; y <= lastY; y++)
+		{
+			// Row constant part of edge functions and depth plane
+			float pixelY = (float)y + 0.5f;
+			__m128 rowEdge0 = _mm_set1_ps(triangle.edgeB[0] * pixelY + triangle.edgeC[0]);
+			__m128 rowEdge1 = _mm_set1_ps(triangle.edgeB[1] * pixelY + triangle.edgeC[1]);
+			__m128 rowEdge2 = _mm_set1_ps(triangle.edgeB[2] * pixelY + triangle.edgeC[2]);
+			__m128 rowDepth = _mm_set1_ps(triangle.depthB * pixelY + triangle.depthC);
+			float* row = &this->depth[y * SOFTWARE_OCCLUSION_WIDTH];
+			for (int x = firstX; x <= lastX; x += 4)
+			{
+				__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+				__m128 edge0 = _mm_add_ps(_mm_mul_ps(edgeA0, pixelX), rowEdge0);
+				__m128 edge1 = _mm_add_ps(_mm_mul_ps(edgeA1, pixelX), rowEdge1);
+				__m128 edge2 = _mm_add_ps(_mm_mul_ps(edgeA2, pixelX), rowEdge2);
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+
+				// Nearer depth is greater, covered lanes take max of stored and triangle depth
+				__m128 triangleDepth = _mm_add_ps(_mm_mul_ps(depthA, pixelX), rowDepth);
+				__m128 stored = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_max_ps(stored, triangleDepth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+			}
+		}
+#else
+		for (int y = firstY; y <= lastY; y++)
+		{
+			float pixelY = (float)y + 0.5f;
+			float* row = &this->depth[y * SOFTWARE_OCCLUSION_WIDTH];
+			for (int x = firstX; x <= lastX; x++)
+			{
+				float pixelX = (float)x + 0.5f;
+				bool inside = true;
+				for (int edge = 0; edge < 3; edge++)
+				{
+					inside = inside && triangle.edgeA[edge] * pixelX + triangle.edgeB[edge] * pixelY + triangle.edgeC[edge] >= 0.0f;
+				}
+				if (inside)
+				{
+					row[x] = std::max(row[x], triangle.depthA * pixelX + triangle.depthB * pixelY + triangle.depthC);
+				}
+			}
+		}
+#endif
+	}
+}
+
+void SoftwareOcclusion::addTriangle(const ClipVertex* vertices)
+{
+	// Triangles outside of one plane are dropped, only those crossing a plane are clipped
+	bool allInside = true;
+	for (int plane = 0; plane < CLIP_PLANE_COUNT; plane++)
+	{
+		int outside = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			outside += getPlaneDistance(vertices[i], plane, this->nearPlane) < 0.0f ? 1 : 0;
+		}
+		if (outside == 3)
+		{
+			return;
+		}
+		allInside = allInside && outside == 0;
+	}
+	if (allInside)
+	{
+		addScreenTriangle(vertices[0], vertices[1], vertices[2]);
+		return;
+	}
+
+	// Clipped polygon is convex, fan keeps winding of the triangle
+	ClipVertex polygon[CLIP_MAX_VERTICES];
+	std::copy(vertices, vertices + 3, polygon);
+	int vertexCount = clipPolygon(polygon, 3, this->nearPlane);
+	for (int i = 2; i < vertexCount; i++)
+	{
+		addScreenTriangle(polygon[0], polygon[i - 1], polygon[i]);
+	}
+}
+
+void SoftwareOcclusion::addScreenTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+{
+	if (this->triangles.size() >= SOFTWARE_OCCLUSION_MAX_TRIANGLES)
+	{
+		return;
+	}
+
+	// Pixel coordinates follow Vulkan viewport transform (NDC y grows downwards in framebuffer)
+	const ClipVertex* clipVertices[3] = { &v0, &v1, &v2 };
+	float x[3];
+	float y[3];
+	float z[3];
+	for (int i = 0; i < 3; i++)
+	{
+		z[i] = 1.0f / clipVertices[i]->w;
+		x[i] = (clipVertices[i]->x * z[i] * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_WIDTH;
+		y[i] = (clipVertices[i]->y * z[i] * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_HEIGHT;
+	}
+
+	// Front faces (counter clockwise with VK_FRONT_FACE_COUNTER_CLOCKWISE) have negative area in framebuffer coordinates
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if (!(area < 0.0f))
+	{
+		return;
+	}
+
+	// Only pixels whose centers lie inside bounds can be covered
+	ScreenTriangle triangle;
+	triangle.minX = std::max(0, (int)ceilf(std::min(x[0], std::min(x[1], x[2])) - 0.5f));
+	triangle.minY = std::max(0, (int)ceilf(std::min(y[0], std::min(y[1], y[2])) - 0.5f));
+	triangle.maxX = std::min(SOFTWARE_OCCLUSION_WIDTH - 1, (int)floorf(std::max(x[0], std::max(x[1], x[2])) - 0.5f));
+	triangle.maxY = std::min(SOFTWARE_OCCLUSION_HEIGHT - 1, (int)floorf(std::max(y[0], std::max(y[1], y[2])) - 0.5f));
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+	{
+		return;
+	}
+
+	// Edge i runs from vertex i to vertex i + 1, front face interior is on its non-negative side
+	for (int i = 0; i < 3; i++)
+	{
+		int next = (i + 1) % 3;
+		triangle.edgeA[i] = y[next] - y[i];
+		triangle.edgeB[i] = x[i] - x[next];
+		triangle.edgeC[i] = -(x[i] * triangle.edgeA[i] + y[i] * triangle.edgeB[i]);
+	}
+
+	// 1/w is linear in screen space
+	triangle.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	triangle.depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+	triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+
+	uint32_t triangleIndex = static_cast<uint32_t>(this->triangles.size());
+	this->triangles.push_back(triangle);
+	for (int tileY = triangle.minY / SOFTWARE_OCCLUSION_TILE_HEIGHT; tileY <= triangle.maxY / SOFTWARE_OCCLUSION_TILE_HEIGHT; tileY++)
+	{
+		for (int tileX = triangle.minX / SOFTWARE_OCCLUSION_TILE_WIDTH; tileX <= triangle.maxX / SOFTWARE_OCCLUSION_TILE_WIDTH; tileX++)
+		{
+			this->tileBins[tileY * SOFTWARE_OCCLUSION_TILES_X + tileX].push_back(triangleIndex);
+		}
+	}
+}
+
+int SoftwareOcclusion::clipPolygon(ClipVertex* vertices, int vertexCount, float nearPlane)
+{
+	ClipVertex clipped[CLIP_MAX_VERTICES];
+	for (int plane = 0; plane < CLIP_PLANE_COUNT && vertexCount > 0; plane++)
+	{
+		int clippedCount = 0;
+		for (int i = 0; i < vertexCount; i++)
+		{
+			const ClipVertex& current = vertices[i];
+			const ClipVertex& next = vertices[(i + 1) % vertexCount];
+			float currentDistance = getPlaneDistance(current, plane, nearPlane);
+			float nextDistance = getPlaneDistance(next, plane, nearPlane);
+			if (currentDistance >= 0.0f)
+			{
+				clipped[clippedCount++] = current;
+			}
+			// Edge crossing the plane adds its intersection
+			if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			{
+				float t = currentDistance / (currentDistance - nextDistance);
+				clipped[clippedCount++] = { current.x + (next.x - current.x) * t, current.y + (next.y - current.y) * t,
+					current.w + (next.w - current.w) * t };
+			}
+		}
+		std::copy(clipped, clipped + clippedCount, vertices);
+		vertexCount = clippedCount;
+	}
+	return vertexCount;
+}
+
+float SoftwareOcclusion::getPlaneDistance(const ClipVertex& vertex, int plane, float nearPlane)
+{
+	switch (plane)
+	{
+	case 0:
+		return vertex.w - nearPlane;
+	case 1:
+		return SOFTWARE_OCCLUSION_GUARD_BAND * vertex.w - vertex.x;
+	case 2:
+		return SOFTWARE_OCCLUSION_GUARD_BAND * vertex.w + vertex.x;
+	case 3:
+		return SOFTWARE_OCCLUSION_GUARD_BAND * vertex.w - vertex.y;
+	default:
+		return SOFTWARE_OCCLUSION_GUARD_BAND * vertex.w + vertex.y;
+	}
+}
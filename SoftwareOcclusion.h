@@ -0,0 +1,115 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+// Occlusion depth buffer (whole screen, other aspect ratios than 16:9 just stretch its pixels)
+#define SOFTWARE_OCCLUSION_WIDTH		320			// multiple of 4 (SIMD lanes)
+#define SOFTWARE_OCCLUSION_HEIGHT		180
+#define SOFTWARE_OCCLUSION_TILE_WIDTH	64			// multiple of 4, divides width
+#define SOFTWARE_OCCLUSION_TILE_HEIGHT	36			// divides height
+#define SOFTWARE_OCCLUSION_TILES_X		(SOFTWARE_OCCLUSION_WIDTH / SOFTWARE_OCCLUSION_TILE_WIDTH)
+#define SOFTWARE_OCCLUSION_TILES_Y		(SOFTWARE_OCCLUSION_HEIGHT / SOFTWARE_OCCLUSION_TILE_HEIGHT)
+#define SOFTWARE_OCCLUSION_TILE_COUNT	(SOFTWARE_OCCLUSION_TILES_X * SOFTWARE_OCCLUSION_TILES_Y)
+
+#define SOFTWARE_OCCLUSION_THREADS		3			// workers besides the thread calling rasterize
+#define SOFTWARE_OCCLUSION_MAX_TRIANGLES	65536	// triangles rasterized per frame, further occluder triangles are skipped
+#define SOFTWARE_OCCLUSION_GUARD_BAND	2.0f		// triangles are clipped to this multiple of NDC range
+#define SOFTWARE_OCCLUSION_DEPTH_BIAS	0.001f		// relative, boxes touching occluder surfaces stay visible
+
+// CPU occlusion culling: occluder meshes are rasterized into a small depth buffer each frame (triangles binned into screen
+// tiles, tiles rasterized 4 pixels at a time by worker threads), then bounding boxes of draws are tested against it before
+// commands are recorded. Unlike GPU queries or Hi-Z of previous frame the result is for the frame being built.
+// Depth buffer stores 1/w (0 where no occluder was drawn), so it works with either depth convention of the renderer.
+// Occluders have to lie inside the surfaces they stand for (simplified hulls or whole meshes), and like main passes
+// back faces (counter clockwise front faces) are culled
+class SoftwareOcclusion
+{
+
+public:
+	SoftwareOcclusion();
+	~SoftwareOcclusion();
+
+	void init(uint32_t workerCount = SOFTWARE_OCCLUSION_THREADS);
+	void cleanup();
+
+	// Occluder geometry in model space, indexBase is subtracted from indices to get vertex
+	bool addOccluder(int occluderId, const vector<glm::vec3>& positions, const vector<uint32_t>& indices, uint32_t indexBase);
+	bool setOccluderTransform(int occluderId, const glm::mat4& transform);
+	bool removeOccluder(int occluderId);
+
+	// Rasterizes all occluders seen through viewProjection, returns once the whole depth buffer is complete
+	void rasterize(const glm::mat4& viewProjection, float nearPlane);
+	// False when box (model space, placed by model) is hidden behind occluders of last rasterize or off screen
+	bool isVisible(const glm::mat4& model, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	uint32_t getTriangleCount();				// triangles binned by last rasterize (after culling and clipping)
+	const vector<float>& getDepth();			// row major, 1/w of nearest occluder
+
+private:
+	struct Occluder
+	{
+		vector<glm::vec3> positions;
+		vector<uint32_t> indices;				// 0-based
+		glm::mat4 transform;
+	};
+
+	// Clip space vertex (z is not needed, depth is 1/w)
+	struct ClipVertex
+	{
+		float x;
+		float y;
+		float w;
+	};
+
+	// Edge functions (inside when all are >= 0) and depth plane in pixel coordinates, bounds are inclusive pixel ranges
+	struct ScreenTriangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+	};
+
+	map<int, Occluder> occluders;
+	glm::mat4 viewProjection;
+	float nearPlane;
+
+	vector<float> depth;
+	vector<ClipVertex> clipVertices;			// vertices of occluder being set up
+	vector<ScreenTriangle> triangles;
+	vector<vector<uint32_t>> tileBins;			// triangles overlapping each tile
+
+	// Tiles of current rasterize are taken by workers and calling thread through nextTile
+	vector<thread> workers;
+	mutex jobMutex;
+	condition_variable jobCondition;			// new rasterize started or workers stop
+	condition_variable doneCondition;			// all tiles finished
+	uint64_t jobGeneration;
+	uint32_t finishedTiles;
+	std::atomic<uint32_t> nextTile;
+	bool stopWorkers;
+
+	void workerLoop();
+	void rasterizeTiles();
+	void rasterizeTile(uint32_t tile);
+	void addTriangle(const ClipVertex* vertices);
+	void addScreenTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+	// Clips polygon against near plane and guard band (Sutherland-Hodgman), returns new vertex count
+	static int clipPolygon(ClipVertex* vertices, int vertexCount, float nearPlane);
+	// Signed distance to clip plane (near plane, then guard band sides), inside when >= 0
+	static float getPlaneDistance(const ClipVertex& vertex, int plane, float nearPlane);
+};
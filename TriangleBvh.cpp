@@ -0,0 +1,514 @@
+#include "TriangleBvh.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// SSE2 is baseline on x64 (and default target of 32 bit MSVC builds), other targets use scalar loops
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BVH_SSE
+#endif
+
+#define BVH_TRAVERSAL_COST		1.0f		// SAH cost of visiting a node relative to one triangle test
+#define BVH_MIN_DIRECTION		1e-12f		// smaller direction components are clamped, so inverse stays finite
+
+TriangleBvh::TriangleBvh()
+{
+}
+
+TriangleBvh::~TriangleBvh()
+{
+}
+
+void TriangleBvh::addTriangles(const vector<glm::vec3>& positions, const vector<uint32_t>& indices, uint32_t indexBase,
+	const glm::mat4& transform)
+{
+	uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			uint32_t index = indices[i + j];
+			if (index < indexBase || index - indexBase >= vertexCount)
+			{
+				throw runtime_error("Failed to add triangles to BVH, index " + to_string(index) + " is out of vertex range.");
+			}
+			this->positions.push_back(glm::vec3(transform * glm::vec4(positions[index - indexBase], 1.0f)));
+		}
+	}
+}
+
+void TriangleBvh::build()
+{
+	uint32_t triangleCount = static_cast<uint32_t>(this->positions.size() / 3);
+	this->nodes.clear();
+	this->triangles.clear();
+	this->triangleIds.clear();
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	vector<glm::vec3> centroids(triangleCount);
+	vector<glm::vec3> boundsMins(triangleCount);
+	vector<glm::vec3> boundsMaxs(triangleCount);
+	vector<uint32_t> triangleIndices(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		const glm::vec3* v = &this->positions[i * 3];
+		boundsMins[i] = glm::min(glm::min(v[0], v[1]), v[2]);
+		boundsMaxs[i] = glm::max(glm::max(v[0], v[1]), v[2]);
+		centroids[i] = (v[0] + v[1] + v[2]) / 3.0f;
+		triangleIndices[i] = i;
+	}
+
+	// Binary tree has fewer than 2n nodes
+	this->nodes.reserve(triangleCount * 2);
+
+	Node root = {};
+	root.firstIndex = 0;
+	root.triangleCount = triangleCount;
+	this->nodes.push_back(root);
+
+	// Nodes waiting for split and their depth
+	vector<pair<uint32_t, uint32_t>> pending = { { 0, 0 } };
+	while (!pending.empty())
+	{
+		uint32_t nodeIndex = pending.back().first;
+		uint32_t depth = pending.back().second;
+		pending.pop_back();
+
+		Node node = this->nodes[nodeIndex];
+		node.boundsMin = glm::vec3(FLT_MAX);
+		node.boundsMax = glm::vec3(-FLT_MAX);
+		for (uint32_t i = 0; i < node.triangleCount; i++)
+		{
+			uint32_t triangle = triangleIndices[node.firstIndex + i];
+			node.boundsMin = glm::min(node.boundsMin, boundsMins[triangle]);
+			node.boundsMax = glm::max(node.boundsMax, boundsMaxs[triangle]);
+		}
+		this->nodes[nodeIndex] = node;
+
+		if (node.triangleCount <= BVH_MAX_LEAF_TRIANGLES || depth >= BVH_MAX_DEPTH)
+		{
+			continue;
+		}
+
+		int splitAxis;
+		float splitPosition;
+		uint32_t* first = triangleIndices.data() + node.firstIndex;
+		if (!findSplit(centroids, boundsMins, boundsMaxs, first, node.triangleCount, node, &splitAxis, &splitPosition))
+		{
+			continue;
+		}
+		uint32_t* middle = std::partition(first, first + node.triangleCount,
+			[&](uint32_t triangle) { return centroids[triangle][splitAxis] < splitPosition; });
+		uint32_t leftCount = static_cast<uint32_t>(middle - first);
+		if (leftCount == 0 || leftCount == node.triangleCount)
+		{
+			continue;
+		}
+
+		// Children are allocated next to each other, node turns into an inner node
+		uint32_t leftIndex = static_cast<uint32_t>(this->nodes.size());
+		Node left = {};
+		left.firstIndex = node.firstIndex;
+		left.triangleCount = leftCount;
+		Node right = {};
+		right.firstIndex = node.firstIndex + leftCount;
+		right.triangleCount = node.triangleCount - leftCount;
+		this->nodes.push_back(left);
+		this->nodes.push_back(right);
+		this->nodes[nodeIndex].firstIndex = leftIndex;
+		this->nodes[nodeIndex].triangleCount = 0;
+
+		pending.push_back({ leftIndex, depth + 1 });
+		pending.push_back({ leftIndex + 1, depth + 1 });
+	}
+
+	// Triangles in leaf order, so every leaf reads one contiguous range
+	this->triangles.resize(triangleCount);
+	this->triangleIds = triangleIndices;
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		const glm::vec3* v = &this->positions[triangleIndices[i] * 3];
+		this->triangles[i].vertex = v[0];
+		this->triangles[i].edge1 = v[1] - v[0];
+		this->triangles[i].edge2 = v[2] - v[0];
+	}
+	this->positions.clear();
+	this->positions.shrink_to_fit();
+}
+
+void TriangleBvh::clear()
+{
+	this->nodes.clear();
+	this->triangles.clear();
+	this->triangleIds.clear();
+	this->positions.clear();
+}
+
+uint32_t TriangleBvh::getTriangleCount()
+{
+	return static_cast<uint32_t>(this->triangles.size());
+}
+
+uint32_t TriangleBvh::getNodeCount()
+{
+	return static_cast<uint32_t>(this->nodes.size());
+}
+
+void TriangleBvh::getBounds(glm::vec3* boundsMin, glm::vec3* boundsMax)
+{
+	*boundsMin = this->nodes.empty() ? glm::vec3(0.0f) : this->nodes[0].boundsMin;
+	*boundsMax = this->nodes.empty() ? glm::vec3(0.0f) : this->nodes[0].boundsMax;
+}
+
+uint32_t TriangleBvh::occluded(const RayPacket& packet, uint32_t activeMask) const
+{
+	uint32_t hitMask = 0;
+	if (this->nodes.empty() || activeMask == 0)
+	{
+		return hitMask;
+	}
+
+	// Inverse directions for slab tests
+	float inverseX[BVH_PACKET_SIZE];
+	float inverseY[BVH_PACKET_SIZE];
+	float inverseZ[BVH_PACKET_SIZE];
+	for (int i = 0; i < BVH_PACKET_SIZE; i++)
+	{
+		inverseX[i] = 1.0f / (fabsf(packet.directionX[i]) < BVH_MIN_DIRECTION ? copysignf(BVH_MIN_DIRECTION, packet.directionX[i]) : packet.directionX[i]);
+		inverseY[i] = 1.0f / (fabsf(packet.directionY[i]) < BVH_MIN_DIRECTION ? copysignf(BVH_MIN_DIRECTION, packet.directionY[i]) : packet.directionY[i]);
+		inverseZ[i] = 1.0f / (fabsf(packet.directionZ[i]) < BVH_MIN_DIRECTION ? copysignf(BVH_MIN_DIRECTION, packet.directionZ[i]) : packet.directionZ[i]);
+	}
+
+#ifdef BVH_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 minDeterminant = _mm_set1_ps(FLT_MIN);
+	__m128 ox = _mm_loadu_ps(packet.originX);
+	__m128 oy = _mm_loadu_ps(packet.originY);
+	__m128 oz = _mm_loadu_ps(packet.originZ);
+	__m128 dx = _mm_loadu_ps(packet.directionX);
+	__m128 dy = _mm_loadu_ps(packet.directionY);
+	__m128 dz = _mm_loadu_ps(packet.directionZ);
+	__m128 ix = _mm_loadu_ps(inverseX);
+	__m128 iy = _mm_loadu_ps(inverseY);
+	__m128 iz = _mm_loadu_ps(inverseZ);
+	__m128 maxDistance = _mm_loadu_ps(packet.maxDistance);
+#endif
+
+	// Depth of tree is limited, so stack can't overflow
+	uint32_t stack[BVH_MAX_DEPTH + 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const Node& node = this->nodes[stack[--stackSize]];
+		uint32_t pendingMask = activeMask & ~hitMask;
+
+		// SLAB TEST
+		uint32_t boundsMask = 0;
+#ifdef BVH_SSE
+		__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), ox), ix);
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), ox), ix);
+		__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), oy), iy);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), oy), iy);
+		__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), oz), iz);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), oz), iz);
+		__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), zero));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), maxDistance));
+		boundsMask = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)));
+#else
+		for (int i = 0; i < BVH_PACKET_SIZE; i++)
+		{
+			float t0x = (node.boundsMin.x - packet.originX[i]) * inverseX[i];
+			float t1x = (node.boundsMax.x - packet.originX[i]) * inverseX[i];
+			float t0y = (node.boundsMin.y - packet.originY[i]) * inverseY[i];
+			float t1y = (node.boundsMax.y - packet.originY[i]) * inverseY[i];
+			float t0z = (node.boundsMin.z - packet.originZ[i]) * inverseZ[i];
+			float t1z = (node.boundsMax.z - packet.originZ[i]) * inverseZ[i];
+			float tNear = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), 0.0f));
+			float tFar = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), packet.maxDistance[i]));
+			boundsMask |= tNear <= tFar ? 1u << i : 0u;
+		}
+#endif
+		if ((boundsMask & pendingMask) == 0)
+		{
+			continue;
+		}
+
+		if (node.triangleCount == 0)
+		{
+			stack[stackSize++] = node.firstIndex;
+			stack[stackSize++] = node.firstIndex + 1;
+			continue;
+		}
+
+		// TRIANGLE TESTS (two sided, any hit ends the ray)
+		for (uint32_t t = 0; t < node.triangleCount; t++)
+		{
+			const Triangle& triangle = this->triangles[node.firstIndex + t];
+			uint32_t triangleMask = 0;
+#ifdef BVH_SSE
+			__m128 e1x = _mm_set1_ps(triangle.edge1.x);
+			__m128 e1y = _mm_set1_ps(triangle.edge1.y);
+			__m128 e1z = _mm_set1_ps(triangle.edge1.z);
+			__m128 e2x = _mm_set1_ps(triangle.edge2.x);
+			__m128 e2y = _mm_set1_ps(triangle.edge2.y);
+			__m128 e2z = _mm_set1_ps(triangle.edge2.z);
+
+			// p = d x e2, determinant = e1 . p
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 inverseDeterminant = _mm_div_ps(one, determinant);
+
+			// s = o - v0, u = (s . p) / determinant
+			__m128 sx = _mm_sub_ps(ox, _mm_set1_ps(triangle.vertex.x));
+			__m128 sy = _mm_sub_ps(oy, _mm_set1_ps(triangle.vertex.y));
+			__m128 sz = _mm_sub_ps(oz, _mm_set1_ps(triangle.vertex.z));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+
+			// q = s x e1, v = (d . q) / determinant, t = (e2 . q) / determinant
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDeterminant);
+			__m128 distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+
+			__m128 hit = _mm_cmpgt_ps(_mm_and_ps(determinant, absMask), minDeterminant);
+			hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+			hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+			hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			hit = _mm_and_ps(hit, _mm_cmpgt_ps(distance, zero));
+			hit = _mm_and_ps(hit, _mm_cmplt_ps(distance, maxDistance));
+			triangleMask = static_cast<uint32_t>(_mm_movemask_ps(hit));
+#else
+			for (int i = 0; i < BVH_PACKET_SIZE; i++)
+			{
+				glm::vec3 origin(packet.originX[i], packet.originY[i], packet.originZ[i]);
+				glm::vec3 direction(packet.directionX[i], packet.directionY[i], packet.directionZ[i]);
+				glm::vec3 p = glm::cross(direction, triangle.edge2);
+				float determinant = glm::dot(triangle.edge1, p);
+				if (fabsf(determinant) <= FLT_MIN)
+				{
+					continue;
+				}
+				float inverseDeterminant = 1.0f / determinant;
+				glm::vec3 s = origin - triangle.vertex;
+				float u = glm::dot(s, p) * inverseDeterminant;
+				glm::vec3 q = glm::cross(s, triangle.edge1);
+				float v = glm::dot(direction, q) * inverseDeterminant;
+				float distance = glm::dot(triangle.edge2, q) * inverseDeterminant;
+				if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance > 0.0f && distance < packet.maxDistance[i])
+				{
+					triangleMask |= 1u << i;
+				}
+			}
+#endif
+			hitMask |= triangleMask & pendingMask;
+			if ((activeMask & ~hitMask) == 0)
+			{
+				return hitMask;
+			}
+		}
+	}
+
+	return hitMask;
+}
+
+bool TriangleBvh::intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit* hit) const
+{
+	if (this->nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverseDirection;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float component = fabsf(direction[axis]) < BVH_MIN_DIRECTION ? copysignf(BVH_MIN_DIRECTION, direction[axis]) : direction[axis];
+		inverseDirection[axis] = 1.0f / component;
+	}
+
+	// Found hit shortens the ray, so nodes behind it are skipped
+	float closest = maxDistance;
+	uint32_t closestTriangle = UINT32_MAX;
+	float closestU = 0.0f;
+	float closestV = 0.0f;
+
+	uint32_t stack[BVH_MAX_DEPTH + 2];
+	uint32_t stackSize = 0;
+	if (intersectBounds(this->nodes[0], origin, inverseDirection, closest) != FLT_MAX)
+	{
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0)
+	{
+		const Node& node = this->nodes[stack[--stackSize]];
+		if (node.triangleCount == 0)
+		{
+			// Farther child is pushed first, so the nearer one is visited next
+			float leftDistance = intersectBounds(this->nodes[node.firstIndex], origin, inverseDirection, closest);
+			float rightDistance = intersectBounds(this->nodes[node.firstIndex + 1], origin, inverseDirection, closest);
+			uint32_t nearChild = leftDistance <= rightDistance ? node.firstIndex : node.firstIndex + 1;
+			float farDistance = std::max(leftDistance, rightDistance);
+			if (farDistance != FLT_MAX)
+			{
+				stack[stackSize++] = nearChild == node.firstIndex ? node.firstIndex + 1 : node.firstIndex;
+			}
+			if (std::min(leftDistance, rightDistance) != FLT_MAX)
+			{
+				stack[stackSize++] = nearChild;
+			}
+			continue;
+		}
+
+		for (uint32_t t = 0; t < node.triangleCount; t++)
+		{
+			const Triangle& triangle = this->triangles[node.firstIndex + t];
+			glm::vec3 p = glm::cross(direction, triangle.edge2);
+			float determinant = glm::dot(triangle.edge1, p);
+			if (fabsf(determinant) <= FLT_MIN)
+			{
+				continue;
+			}
+			float inverseDeterminant = 1.0f / determinant;
+			glm::vec3 s = origin - triangle.vertex;
+			float u = glm::dot(s, p) * inverseDeterminant;
+			glm::vec3 q = glm::cross(s, triangle.edge1);
+			float v = glm::dot(direction, q) * inverseDeterminant;
+			float distance = glm::dot(triangle.edge2, q) * inverseDeterminant;
+			if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance > 0.0f && distance < closest)
+			{
+				closest = distance;
+				closestTriangle = node.firstIndex + t;
+				closestU = u;
+				closestV = v;
+			}
+		}
+	}
+
+	if (closestTriangle == UINT32_MAX)
+	{
+		return false;
+	}
+
+	const Triangle& triangle = this->triangles[closestTriangle];
+	hit->distance = closest;
+	hit->triangle = this->triangleIds[closestTriangle];
+	hit->u = closestU;
+	hit->v = closestV;
+	hit->normal = glm::normalize(glm::cross(triangle.edge1, triangle.edge2));
+	return true;
+}
+
+bool TriangleBvh::findSplit(const vector<glm::vec3>& centroids, const vector<glm::vec3>& boundsMins, const vector<glm::vec3>& boundsMaxs,
+	const uint32_t* triangleIndices, uint32_t triangleCount, const Node& node, int* splitAxis, float* splitPosition)
+{
+	struct Bin
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		uint32_t triangleCount;
+	};
+
+	glm::vec3 centroidMin(FLT_MAX);
+	glm::vec3 centroidMax(-FLT_MAX);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		centroidMin = glm::min(centroidMin, centroids[triangleIndices[i]]);
+		centroidMax = glm::max(centroidMax, centroids[triangleIndices[i]]);
+	}
+
+	// Split has to beat testing all triangles of a leaf, including the cost of traversing one more node
+	float bestCost = ((float)triangleCount - BVH_TRAVERSAL_COST) * getSurfaceArea(node.boundsMin, node.boundsMax);
+	bool found = false;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		Bin bins[BVH_BIN_COUNT];
+		for (int b = 0; b < BVH_BIN_COUNT; b++)
+		{
+			bins[b].boundsMin = glm::vec3(FLT_MAX);
+			bins[b].boundsMax = glm::vec3(-FLT_MAX);
+			bins[b].triangleCount = 0;
+		}
+		float binScale = BVH_BIN_COUNT / extent;
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			uint32_t triangle = triangleIndices[i];
+			int b = std::min(BVH_BIN_COUNT - 1, (int)((centroids[triangle][axis] - centroidMin[axis]) * binScale));
+			bins[b].boundsMin = glm::min(bins[b].boundsMin, boundsMins[triangle]);
+			bins[b].boundsMax = glm::max(bins[b].boundsMax, boundsMaxs[triangle]);
+			bins[b].triangleCount++;
+		}
+
+		// Sweep from the right collects areas of right sides, sweep from the left evaluates every plane between bins
+		float rightAreas[BVH_BIN_COUNT];
+		uint32_t rightCounts[BVH_BIN_COUNT];
+		glm::vec3 rightMin(FLT_MAX);
+		glm::vec3 rightMax(-FLT_MAX);
+		uint32_t rightCount = 0;
+		for (int b = BVH_BIN_COUNT - 1; b > 0; b--)
+		{
+			rightMin = glm::min(rightMin, bins[b].boundsMin);
+			rightMax = glm::max(rightMax, bins[b].boundsMax);
+			rightCount += bins[b].triangleCount;
+			rightAreas[b] = rightCount > 0 ? getSurfaceArea(rightMin, rightMax) : 0.0f;
+			rightCounts[b] = rightCount;
+		}
+
+		glm::vec3 leftMin(FLT_MAX);
+		glm::vec3 leftMax(-FLT_MAX);
+		uint32_t leftCount = 0;
+		for (int b = 0; b < BVH_BIN_COUNT - 1; b++)
+		{
+			leftMin = glm::min(leftMin, bins[b].boundsMin);
+			leftMax = glm::max(leftMax, bins[b].boundsMax);
+			leftCount += bins[b].triangleCount;
+			if (leftCount == 0 || rightCounts[b + 1] == 0)
+			{
+				continue;
+			}
+
+			float cost = (float)leftCount * getSurfaceArea(leftMin, leftMax) + (float)rightCounts[b + 1] * rightAreas[b + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				*splitAxis = axis;
+				*splitPosition = centroidMin[axis] + (float)(b + 1) / binScale;
+				found = true;
+			}
+		}
+	}
+
+	return found;
+}
+
+float TriangleBvh::getSurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 extent = boundsMax - boundsMin;
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+float TriangleBvh::intersectBounds(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+{
+	glm::vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+	glm::vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+	glm::vec3 tMin = glm::min(t0, t1);
+	glm::vec3 tMax = glm::max(t0, t1);
+	float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+	float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+	return tNear <= tFar ? tNear : FLT_MAX;
+}
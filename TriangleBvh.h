@@ -0,0 +1,91 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdexcept>
+#include "VulkanUtils.h"
+
+// Build limits of triangle BVH
+#define BVH_BIN_COUNT				16			// SAH split candidates per axis
+#define BVH_MAX_LEAF_TRIANGLES		4
+#define BVH_MAX_DEPTH				48			// deeper nodes become leaves, bounds traversal stack
+#define BVH_PACKET_SIZE				4			// rays traced together (one SIMD lane each)
+
+// Rays traced together in structure of arrays layout, every lane is one ray. Directions don't have to be normalized,
+// distances are in units of direction length
+struct RayPacket
+{
+	float originX[BVH_PACKET_SIZE];
+	float originY[BVH_PACKET_SIZE];
+	float originZ[BVH_PACKET_SIZE];
+	float directionX[BVH_PACKET_SIZE];
+	float directionY[BVH_PACKET_SIZE];
+	float directionZ[BVH_PACKET_SIZE];
+	float maxDistance[BVH_PACKET_SIZE];
+};
+
+// Closest intersection found by TriangleBvh::intersect
+struct RayHit
+{
+	float distance;
+	uint32_t triangle;							// in order triangles were added
+	float u;									// barycentrics of second and third vertex
+	float v;
+	glm::vec3 normal;							// normalized geometric normal (winding order, may face away from ray)
+};
+
+// Bounding volume hierarchy over triangles for CPU ray queries (binned SAH build, triangles are stored in leaf order).
+// Queries only read the hierarchy, so any number of threads may trace against one BVH
+class TriangleBvh
+{
+
+public:
+	TriangleBvh();
+	~TriangleBvh();
+
+	// Adds triangles of one mesh transformed by transform, indexBase is subtracted from indices to get vertex
+	void addTriangles(const vector<glm::vec3>& positions, const vector<uint32_t>& indices, uint32_t indexBase,
+		const glm::mat4& transform);
+	// Builds hierarchy over all added triangles (triangles added later require another build)
+	void build();
+	void clear();
+
+	uint32_t getTriangleCount();
+	uint32_t getNodeCount();
+	void getBounds(glm::vec3* boundsMin, glm::vec3* boundsMax);
+
+	// Bit i is set when ray i of packet hits any triangle closer than its max distance (rays not in activeMask are skipped)
+	uint32_t occluded(const RayPacket& packet, uint32_t activeMask) const;
+	// Closest triangle along single ray within max distance, near children are visited first
+	bool intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit* hit) const;
+
+private:
+	// Inner nodes store their left child at firstIndex (right one follows it), leaves their first triangle
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		uint32_t firstIndex;
+		glm::vec3 boundsMax;
+		uint32_t triangleCount;					// 0 for inner nodes
+	};
+
+	// Precomputed for Moller-Trumbore intersection
+	struct Triangle
+	{
+		glm::vec3 vertex;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	vector<Node> nodes;
+	vector<Triangle> triangles;
+	vector<uint32_t> triangleIds;				// added index of every triangle in leaf order
+	vector<glm::vec3> positions;				// added triangles, 3 vertices each (dropped by build)
+
+	// Split of node's triangle range, returns false when leaf is cheaper than any split
+	static bool findSplit(const vector<glm::vec3>& centroids, const vector<glm::vec3>& boundsMins, const vector<glm::vec3>& boundsMaxs,
+		const uint32_t* triangleIndices, uint32_t triangleCount, const Node& node, int* splitAxis, float* splitPosition);
+	static float getSurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	// Entry distance of ray into node bounds, FLT_MAX when ray misses them within max distance
+	static float intersectBounds(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance);
+};
@@ -0,0 +1,93 @@
+#include "UniformRingAllocator.h"
+
+UniformRingAllocator::UniformRingAllocator()
+{
+	this->logicalDevice = VK_NULL_HANDLE;
+	this->buffer = VK_NULL_HANDLE;
+	this->bufferMemory = VK_NULL_HANDLE;
+	this->mappedData = nullptr;
+	this->alignment = 1;
+	this->frameSize = 0;
+	this->frameCount = 0;
+	this->frameStart = 0;
+	this->frameHead = 0;
+}
+
+UniformRingAllocator::~UniformRingAllocator()
+{
+}
+
+void UniformRingAllocator::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize frameSize, uint32_t frameCount, VkDeviceSize alignment)
+{
+	this->logicalDevice = logicalDevice;
+	this->alignment = alignment;
+	this->frameCount = frameCount;
+
+	// Slices must start at aligned offsets as well
+	this->frameSize = (frameSize + alignment - 1) & ~(alignment - 1);
+
+	createBuffer(physicalDevice, logicalDevice, this->frameSize * frameCount,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &this->buffer, &this->bufferMemory);
+
+	// Memory is coherent, so it stays mapped for the whole lifetime and no flushes are needed
+	VkResult result = vkMapMemory(logicalDevice, this->bufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&this->mappedData);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to map uniform ring buffer memory.");
+	}
+
+	this->frameStart = 0;
+	this->frameHead = 0;
+}
+
+void UniformRingAllocator::cleanup()
+{
+	vkUnmapMemory(this->logicalDevice, this->bufferMemory);
+	vkDestroyBuffer(this->logicalDevice, this->buffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->bufferMemory, nullptr);
+	this->mappedData = nullptr;
+}
+
+void UniformRingAllocator::beginFrame(uint32_t frameIndex)
+{
+	this->frameStart = this->frameSize * frameIndex;
+	this->frameHead = 0;
+}
+
+RingAllocation UniformRingAllocator::allocate(VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = (size + this->alignment - 1) & ~(this->alignment - 1);
+	if (this->frameHead + alignedSize > this->frameSize)
+	{
+		throw runtime_error("Uniform ring buffer frame slice is out of memory.");
+	}
+
+	RingAllocation allocation = {};
+	allocation.offset = static_cast<uint32_t>(this->frameStart + this->frameHead);
+	allocation.data = this->mappedData + allocation.offset;
+
+	this->frameHead += alignedSize;
+
+	return allocation;
+}
+
+VkBuffer UniformRingAllocator::getBuffer()
+{
+	return this->buffer;
+}
+
+VkDeviceSize UniformRingAllocator::getAlignment()
+{
+	return this->alignment;
+}
+
+VkDeviceSize UniformRingAllocator::getFrameSize()
+{
+	return this->frameSize;
+}
+
+VkDeviceSize UniformRingAllocator::getFrameUsage()
+{
+	return this->frameHead;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include "VulkanUtils.h"
+
+// Sub-allocation inside ring buffer
+struct RingAllocation
+{
+	void* data;				// persistently mapped pointer to write data to
+	uint32_t offset;		// offset from buffer start (usable as dynamic offset)
+};
+
+// Linear allocator of uniform/storage data over one persistently mapped buffer.
+// Buffer is split into slices (one per frame in flight), each slice is reset when its frame starts.
+class UniformRingAllocator
+{
+
+public:
+	UniformRingAllocator();
+	~UniformRingAllocator();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize frameSize, uint32_t frameCount, VkDeviceSize alignment);
+	void cleanup();
+
+	// Starts allocating from the slice of given frame (frame's previous submission must be completed)
+	void beginFrame(uint32_t frameIndex);
+	RingAllocation allocate(VkDeviceSize size);
+
+	// Copies value to the current slice and returns its offset
+	template <typename T>
+	uint32_t push(const T& value)
+	{
+		RingAllocation allocation = allocate(sizeof(T));
+		memcpy(allocation.data, &value, sizeof(T));
+		return allocation.offset;
+	}
+
+	VkBuffer getBuffer();
+	VkDeviceSize getAlignment();
+	VkDeviceSize getFrameSize();
+	VkDeviceSize getFrameUsage();
+
+private:
+	VkDevice logicalDevice;
+
+	VkBuffer buffer;
+	VkDeviceMemory bufferMemory;
+	uint8_t* mappedData;
+
+	VkDeviceSize alignment;
+	VkDeviceSize frameSize;
+	uint32_t frameCount;
+
+	VkDeviceSize frameStart;		// start of current frame slice
+	VkDeviceSize frameHead;			// next free byte inside current frame slice
+};
@@ -1,15 +1,28 @@
 #include "VkMesh.h"
 
+#include <cstring>
+
 VkMesh::VkMesh()
 {
 	this->indexCount = 0;
 	this->vertexCount = 0;
 	this->vertexBuffer = VK_NULL_HANDLE;
 	this->vertexBufferMemory = VK_NULL_HANDLE;
+	this->positionBuffer = VK_NULL_HANDLE;
+	this->positionBufferMemory = VK_NULL_HANDLE;
 	this->indexBuffer = VK_NULL_HANDLE;
 	this->indexBufferMemory = VK_NULL_HANDLE;
 	this->physicalDevice = VK_NULL_HANDLE;
 	this->logicalDevice = VK_NULL_HANDLE;
+	this->boundsCenter = glm::vec3(0.0f);
+	this->boundsRadius = 0.0f;
+	this->boundsMin = glm::vec3(0.0f);
+	this->boundsMax = glm::vec3(0.0f);
+	this->meshletOffset = 0;
+	this->skinIndex = -1;
+	this->lightmapTexture = -1;
+	this->lightmapScale = 1.0f;
+	this->sceneProxy = -1;
 }
 
 VkMesh::VkMesh(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue transferQueue,
@@ -20,7 +33,16 @@ VkMesh::VkMesh(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue
 	this->physicalDevice = physicalDevice;
 	this->logicalDevice = logicalDevice;
 	this->textureIndex = textureIndex;
+	this->meshletOffset = 0;
+	this->skinIndex = -1;
+	this->lightmapTexture = -1;
+	this->lightmapScale = 1.0f;
+	this->sceneProxy = -1;
+	computeBounds(vertices);
+	// Before index upload, builder reorders triangles into meshlet ranges
+	this->meshlets = MeshletBuilder::build(*vertices, indices, MESH_INDEX_BASE);
 	createVertexBuffer(transferQueue, transferCommandPool, vertices);
+	createPositionBuffer(transferQueue, transferCommandPool, vertices);
 	createIndexBuffer(transferQueue, transferCommandPool, indices);
 }
 
@@ -36,6 +58,11 @@ VkBuffer VkMesh::getVertexBuffer()
 	return this->vertexBuffer;
 }
 
+VkBuffer VkMesh::getPositionBuffer()
+{
+	return this->positionBuffer;
+}
+
 int VkMesh::getIndexCount()
 {
 	return this->indexCount;
@@ -51,12 +78,120 @@ int VkMesh::getTextureIndex()
 	return this->textureIndex;
 }
 
+glm::vec3 VkMesh::getBoundsCenter()
+{
+	return this->boundsCenter;
+}
+
+float VkMesh::getBoundsRadius()
+{
+	return this->boundsRadius;
+}
+
+glm::vec3 VkMesh::getBoundsMin()
+{
+	return this->boundsMin;
+}
+
+glm::vec3 VkMesh::getBoundsMax()
+{
+	return this->boundsMax;
+}
+
+const std::vector<Meshlet>& VkMesh::getMeshlets()
+{
+	return this->meshlets;
+}
+
+uint32_t VkMesh::getMeshletCount()
+{
+	return static_cast<uint32_t>(this->meshlets.size());
+}
+
+uint32_t VkMesh::getMeshletOffset()
+{
+	return this->meshletOffset;
+}
+
+void VkMesh::setMeshletOffset(uint32_t meshletOffset)
+{
+	this->meshletOffset = meshletOffset;
+}
+
+int VkMesh::getSkinIndex()
+{
+	return this->skinIndex;
+}
+
+void VkMesh::setSkinIndex(int skinIndex)
+{
+	this->skinIndex = skinIndex;
+}
+
+void VkMesh::setLightmap(int lightmapTexture, float lightmapScale)
+{
+	this->lightmapTexture = lightmapTexture;
+	this->lightmapScale = lightmapScale;
+}
+
+int VkMesh::getLightmapTexture()
+{
+	return this->lightmapTexture;
+}
+
+float VkMesh::getLightmapScale()
+{
+	return this->lightmapScale;
+}
+
+int VkMesh::getSceneProxy()
+{
+	return this->sceneProxy;
+}
+
+void VkMesh::setSceneProxy(int sceneProxy)
+{
+	this->sceneProxy = sceneProxy;
+}
+
+void VkMesh::computeBounds(std::vector<Vertex>* vertices)
+{
+	this->boundsCenter = glm::vec3(0.0f);
+	this->boundsRadius = 0.0f;
+	this->boundsMin = glm::vec3(0.0f);
+	this->boundsMax = glm::vec3(0.0f);
+	if (vertices->empty())
+	{
+		return;
+	}
+
+	// Sphere around bounding box center, not the tightest one but good enough for sorting and culling
+	glm::vec3 minPos = (*vertices)[0].pos;
+	glm::vec3 maxPos = (*vertices)[0].pos;
+	for (const auto& vertex : *vertices)
+	{
+		minPos = glm::min(minPos, vertex.pos);
+		maxPos = glm::max(maxPos, vertex.pos);
+	}
+	this->boundsMin = minPos;
+	this->boundsMax = maxPos;
+	this->boundsCenter = (minPos + maxPos) * 0.5f;
+
+	for (const auto& vertex : *vertices)
+	{
+		this->boundsRadius = glm::max(this->boundsRadius, glm::length(vertex.pos - this->boundsCenter));
+	}
+}
+
 
 void VkMesh::destroyDataBuffers()
 {
 	vkDestroyBuffer(this->logicalDevice, this->indexBuffer, nullptr);
 	vkFreeMemory(this->logicalDevice, this->indexBufferMemory, nullptr);
 
+	vkDestroyBuffer(this->logicalDevice, this->positionBuffer, nullptr);
+	vkFreeMemory(this->logicalDevice, this->positionBufferMemory, nullptr);
+
 	vkDestroyBuffer(this->logicalDevice, this->vertexBuffer, nullptr);
 	vkFreeMemory(this->logicalDevice, this->vertexBufferMemory, nullptr);
 }
@@ -100,6 +235,37 @@ void VkMesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCom
 	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
 }
 
+void VkMesh::createPositionBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+{
+	// Positions are extracted from interleaved vertices into tightly packed stream
+	std::vector<glm::vec3> positions(vertices->size());
+	for (size_t i = 0; i < vertices->size(); i++)
+	{
+		positions[i] = (*vertices)[i].pos;
+	}
+	VkDeviceSize bufferSize = sizeof(glm::vec3) * positions.size();
+
+	// Temporary buffer to stage position data before transferring to GPU
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(physicalDevice, logicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&stagingBuffer, &stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, positions.data(), (size_t)(bufferSize));
+	vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+
+	createBuffer(physicalDevice, logicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->positionBuffer, &this->positionBufferMemory);
+
+	copyBuffer(logicalDevice, transferQueue, transferCommandPool, stagingBuffer, this->positionBuffer, bufferSize);
+
+	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
+	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+}
+
 void VkMesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
 {
 	// Size of buffer needed for indices
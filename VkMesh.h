@@ -6,6 +6,10 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include "VulkanUtils.h"
+#include "MeshletBuilder.h"
+
+// Imported indices are 1-based, draws start at vertex offset -MESH_INDEX_BASE
+#define MESH_INDEX_BASE 1
 
 struct Vertex
 {
@@ -13,6 +17,8 @@ struct Vertex
 	glm::vec3 color;
 	glm::vec3 normal;
 	glm::vec2 uv;
+	float occlusion;			// baked ambient occlusion, 1 for unoccluded
+	glm::vec2 lightmapUv;		// second UV set, only meaningful for meshes with lightmap
 };
 
 class VkMesh
@@ -27,10 +33,26 @@ public:
 
 	int getVertexCount();
 	VkBuffer getVertexBuffer();
+	VkBuffer getPositionBuffer();
 	int getIndexCount();
 	VkBuffer getIndexBuffer();
 	int getTextureIndex();
 	glm::mat4 getTransformMat();
+	glm::vec3 getBoundsCenter();				// bounding sphere in mesh space
+	float getBoundsRadius();
+	glm::vec3 getBoundsMin();					// bounding box in mesh space
+	glm::vec3 getBoundsMax();
+	const std::vector<Meshlet>& getMeshlets();
+	uint32_t getMeshletCount();
+	uint32_t getMeshletOffset();				// index of first meshlet in renderer's meshlet buffer
+	void setMeshletOffset(uint32_t meshletOffset);
+	int getSkinIndex();							// skin in renderer's GPU skinning, -1 for static meshes
+	void setSkinIndex(int skinIndex);
+	void setLightmap(int lightmapTexture, float lightmapScale);
+	int getLightmapTexture();					// bindless index of baked lightmap, -1 for meshes without one
+	float getLightmapScale();					// irradiance of lightmap texel value 1
+	int getSceneProxy();						// object in renderer's scene BVH, -1 before the mesh is indexed
+	void setSceneProxy(int sceneProxy);
 
 	void setTransformMat(glm::mat4 transform);
 
@@ -42,19 +64,41 @@ private:
 	VkBuffer vertexBuffer;
 	VkDeviceMemory vertexBufferMemory;
 
+	// Positions only (depth prepass fetches 12 bytes per vertex instead of whole Vertex)
+	VkBuffer positionBuffer;
+	VkDeviceMemory positionBufferMemory;
+
 	int indexCount;
 	VkBuffer indexBuffer; 
 	VkDeviceMemory indexBufferMemory;
 
 	int textureIndex;
 
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	// Index buffer is ordered by meshlets, each meshlet is one index range
+	std::vector<Meshlet> meshlets;
+	uint32_t meshletOffset;
+
+	int skinIndex;
+
+	int lightmapTexture;
+	float lightmapScale;
+
+	int sceneProxy;
+
 	VkPhysicalDevice physicalDevice;
 	VkDevice logicalDevice;
 
 	// Transform
 	glm::mat4 transformMat;
 
+	void computeBounds(std::vector<Vertex>* vertices);
 	void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices);
+	void createPositionBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices);
 	void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices);
 };
 
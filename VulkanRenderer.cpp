@@ -16,21 +16,48 @@ int VulkanRenderer::init(GLFWwindow* window)
 		printPhysicalDeviceInfo(this->vkPhysicalDevice);
 		createLogicalDevice();
 		createSwapChain();
-		createDepthBuffer();
-		createRenderPass();
-		createDescriptorSetLayout();
+		// Frame scheduler has to exist before render graph, which defers destruction of replaced transients to it
+		createSyncTools();
+		createRenderGraph();
 		createTextureSampler();
-		createPushConstantRange();
+		this->shaderCompiler.init();
+		this->shaderCompiler.watch(SHADER_DIRECTORY);
+		createPipelineLayout();
+		this->pipelineCache.init(this->vkPhysicalDevice, this->vkLogicalDevice, PIPELINE_CACHE_FILE);
+		auto pipelineStart = chrono::steady_clock::now();
 		createGraphicsPipeline();
-		createFramebuffers();
+		double pipelineTime = chrono::duration<double, milli>(chrono::steady_clock::now() - pipelineStart).count();
+		printf("Graphics pipeline created in %.2f ms (%s pipeline cache)\n", pipelineTime, this->pipelineCache.isWarm() ? "warm" : "cold");
 		createCommandPool();
-		createCommandBuffers();
 		createUniformBuffers();
 		createDescriptorPool();
+		this->clusteredLighting.init(this->vkPhysicalDevice, this->vkLogicalDevice, SHADER_DIRECTORY "/light_clustering.comp", &this->shaderCompiler,
+			&this->pipelineManager, &this->layoutCache, &this->descriptorAllocator, &this->uniformRing);
+		this->clusterCulling.init(this->vkPhysicalDevice, this->vkLogicalDevice, this->vkGraphicsQueue, this->vkGraphicsCommandPool,
+			this->swapChainExtent, REVERSE_Z_DEPTH, SHADER_DIRECTORY "/cluster_culling.comp", SHADER_DIRECTORY "/hiz_downsample.comp",
+			&this->shaderCompiler, &this->pipelineManager, &this->layoutCache, &this->descriptorAllocator, &this->uniformRing);
+		this->clusterCulling.setObjectBuffer(this->vkObjectBuffer, this->objectCapacity * sizeof(ObjectData));
+		this->skinning.init(this->vkPhysicalDevice, this->vkLogicalDevice, this->vkGraphicsQueue, this->vkGraphicsCommandPool,
+			SHADER_DIRECTORY "/skinning.comp", &this->shaderCompiler, &this->pipelineManager, &this->layoutCache,
+			&this->descriptorAllocator, &this->uniformRing);
+		this->particleSystem.init(this->vkPhysicalDevice, this->vkLogicalDevice, this->vkGraphicsQueue, this->vkGraphicsCommandPool,
+			SHADER_DIRECTORY "/particle_emit.comp", SHADER_DIRECTORY "/particle_prepare.comp", SHADER_DIRECTORY "/particle_simulate.comp",
+			this->vkParticleDescriptorSetLayout, &this->shaderCompiler, &this->pipelineManager, &this->layoutCache,
+			&this->descriptorAllocator, &this->uniformRing);
+		this->softwareOcclusion.init();
+		this->impostorBaker.init(this->vkPhysicalDevice, this->vkLogicalDevice, this->vkGraphicsQueue, this->vkGraphicsCommandPool,
+			this->depthFormat, SHADER_DIRECTORY "/impostor_bake.vert", SHADER_DIRECTORY "/impostor_bake.frag", this->maxBindlessTextures,
+			&this->shaderCompiler, &this->pipelineManager, &this->layoutCache);
 		createDescriptorSets();
-		createSyncTools();
-
-		this->projectionMat = glm::perspective(glm::radians(75.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 200.0f);
+		createBindlessDescriptorSet();
+		createQueryPool();
+
+		float aspect = (float)swapChainExtent.width / (float)swapChainExtent.height;
+#if REVERSE_Z_DEPTH
+		this->projectionMat = perspectiveReverseZ(glm::radians(CAMERA_FOV), aspect, CAMERA_NEAR_PLANE);
+#else
+		this->projectionMat = glm::perspective(glm::radians(CAMERA_FOV), aspect, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+#endif
 		this->viewMat = glm::lookAt(glm::vec3(0.0f, 0.0f, 100.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
 		// Seems like Vulkan flips Y coordinate (which is weird).
@@ -52,8 +79,11 @@ void VulkanRenderer::cleanup()
 	// Wait until there is nothing on a queue 
 	vkDeviceWaitIdle(this->vkLogicalDevice);
 
-	vkDestroyDescriptorSetLayout(this->vkLogicalDevice, this->vkSamplerDescriptorSetLayout, nullptr); 
 	vkDestroySampler(this->vkLogicalDevice, this->vkTextureSampler, nullptr);
+	if (this->vkStatisticsQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(this->vkLogicalDevice, this->vkStatisticsQueryPool, nullptr);
+	}
 	for (int i = 0; i < textureImages.size(); i++)
 	{
 		vkDestroyImageView(this->vkLogicalDevice, this->textureImageViews[i], nullptr);
@@ -61,24 +91,17 @@ void VulkanRenderer::cleanup()
 		vkFreeMemory(this->vkLogicalDevice, textureImageMemory[i], nullptr);
 	}
 
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	//_aligned_free(modelTransferSpace);
-	vkDestroyImageView(this->vkLogicalDevice, this->depthBufferImageView, nullptr);
-	vkDestroyImage(this->vkLogicalDevice, this->depthBufferImage, nullptr);
-	vkFreeMemory(this->vkLogicalDevice, depthBufferImageMemory, nullptr);
-
-	vkFreeDescriptorSets(this->vkLogicalDevice, this->vkDescriptorPool, this->vkDescriptorSets.size(), this->vkDescriptorSets.data());
-	vkDestroyDescriptorPool(this->vkLogicalDevice, this->vkDescriptorPool, nullptr);
-	for (int i = 0; i < swapchainImages.size(); i++)
-	{
-		vkDestroyBuffer(this->vkLogicalDevice, uniformBuffers[i], nullptr);
-		vkFreeMemory(this->vkLogicalDevice, uniformBuffersMemory[i], nullptr);	
-		
-		// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-		//vkDestroyBuffer(this->vkLogicalDevice, uniformBuffersDynamic[i], nullptr);
-		//vkFreeMemory(this->vkLogicalDevice, uniformBuffersMemoryDynamic[i], nullptr);
-	}
-	vkDestroyDescriptorSetLayout(this->vkLogicalDevice, this->vkDescriptorSetLayout, nullptr);
+	this->clusteredLighting.cleanup();
+	this->clusterCulling.cleanup();
+	this->skinning.cleanup();
+	this->particleSystem.cleanup();
+	this->impostorBaker.cleanup();
+	this->softwareOcclusion.cleanup();
+	this->cascadedShadows.cleanup();
+	this->descriptorAllocator.cleanup();
+	vkDestroyDescriptorPool(this->vkLogicalDevice, this->vkBindlessDescriptorPool, nullptr);
+	this->uniformRing.cleanup();
+	destroyObjectBuffer();
 	
 	for (auto modelKeyValue : modelsToRender)
 	{
@@ -89,21 +112,22 @@ void VulkanRenderer::cleanup()
 	}
 	this->modelsToRender.clear();
 
-	for (int i = 0; i < MAX_FRAME_DRAWS; i++)
+	this->frameScheduler.cleanup();
+	for (auto semaphore : this->vkSemRenderFinished)
 	{
-		vkDestroySemaphore(this->vkLogicalDevice, this->vkSemRenderFinished[i], nullptr);
-		vkDestroySemaphore(this->vkLogicalDevice, this->vkSemImageAvailable[i], nullptr);
-		vkDestroyFence(this->vkLogicalDevice, this->vkDrawFences[i], nullptr);
+		vkDestroySemaphore(this->vkLogicalDevice, semaphore, nullptr);
 	}
 
 	vkDestroyCommandPool(this->vkLogicalDevice, vkGraphicsCommandPool, nullptr);
-	for (auto framebuffer : vkSwapchainFramebuffers)
-	{
-		vkDestroyFramebuffer(this->vkLogicalDevice, framebuffer, nullptr);
-	}
-	vkDestroyPipeline(this->vkLogicalDevice, this->vkGraphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(this->vkLogicalDevice, this->vkPipelineLayout, nullptr);
-	vkDestroyRenderPass(this->vkLogicalDevice, this->vkRenderPass, nullptr);
+	// Render passes, framebuffers and transient images are owned by render graph
+	this->renderGraph.cleanup();
+	this->pipelineManager.cleanup();
+	// Pipelines compiled this run are stored for the next one
+	this->pipelineCache.save();
+	this->pipelineCache.cleanup();
+	this->shaderCompiler.cleanup();
+	// Pipeline layout and descriptor set layouts are owned by layout cache
+	this->layoutCache.cleanup();
 	for (auto image : swapchainImages)
 	{
 		vkDestroyImageView(this->vkLogicalDevice, image.imageView, nullptr);
@@ -212,10 +236,24 @@ void VulkanRenderer::retrievePhysicalDevice()
 		this->vkPhysicalDevice = devices[0];
 	}
 
-	VkPhysicalDeviceProperties deviceProperties;
-	vkGetPhysicalDeviceProperties(this->vkPhysicalDevice, &deviceProperties);
-	
-	minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
+	// Descriptor indexing limits are part of Vulkan 1.2 properties, so chain them into properties query
+	VkPhysicalDeviceVulkan12Properties vulkan12Properties = {};
+	vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 deviceProperties2 = {};
+	deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	deviceProperties2.pNext = &vulkan12Properties;
+	vkGetPhysicalDeviceProperties2(this->vkPhysicalDevice, &deviceProperties2);
+
+	minUniformBufferOffset = deviceProperties2.properties.limits.minUniformBufferOffsetAlignment;
+	minStorageBufferOffset = deviceProperties2.properties.limits.minStorageBufferOffsetAlignment;
+
+	// Bindless texture array can't be bigger than any of the update-after-bind limits (combined image sampler counts as both sampler and image)
+	maxBindlessTextures = std::min({ (uint32_t)MAX_BINDLESS_TEXTURES,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages });
 }
 
 void VulkanRenderer::createLogicalDevice()
@@ -248,12 +286,32 @@ void VulkanRenderer::createLogicalDevice()
 	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());	// the number of Logical Devices Extensions (not the same extensions as ones for Vulkan Instance!)
 	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(this->vkPhysicalDevice, &supportedFeatures);
+	this->pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+	this->textureCompressionBCSupported = supportedFeatures.textureCompressionBC == VK_TRUE;
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;	// optional, only for overdraw statistics
+	deviceFeatures.multiDrawIndirect = VK_TRUE;					// cluster culled draws draw up to all of their meshlets
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE;			// indirect commands select object through first instance
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;		// optional, lightmaps are decoded on CPU without it
 	// Physical Devices features that Logical Device is going to use
-	// TEMP: Empty (default) for now
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
+	// Descriptor indexing features (Vulkan 1.2 core) required for bindless textures
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+	vulkan12Features.descriptorIndexing = VK_TRUE;
+	vulkan12Features.runtimeDescriptorArray = VK_TRUE;							// allows unsized sampler2D array in shader
+	vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;					// not every array element has to hold a valid descriptor
+	vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;		// size of array is given on set allocation
+	vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;	// new textures can be written while set is bound
+	vulkan12Features.timelineSemaphore = VK_TRUE;								// frame scheduling
+	vulkan12Features.drawIndirectCount = VK_TRUE;								// culling pass decides draw count
+	deviceCreateInfo.pNext = &vulkan12Features;
+
 	VkResult result = vkCreateDevice(this->vkPhysicalDevice, &deviceCreateInfo, nullptr, &this->vkLogicalDevice);
 	if (result != VK_SUCCESS)
 	{
@@ -365,323 +423,400 @@ void VulkanRenderer::createSwapChain()
 	}
 }
 
-void VulkanRenderer::createRenderPass()
-{
-	// ATTACHMENNTS
-	// color attachment of render pass
-	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = swapChainImageFormat;						// Format to use for attachment
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;					// Number of samples to write for multisampling
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;				// Describes what to do with attachment before rendering
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;			// Describes what to do with attachment after rendering
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;	// Describes what to do with stencil before rendering
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;	// Describes what to do with stencil after rendering
-
-	// Framebuffer data will be stored as an image, but images can be given different data layouts
-	// to give optimal use for certain operations
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;			// Image data layout before render pass starts
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;		// Image data layout after render pass (to change to)
-
-	// Attachment reference uses an attachment index that refers to index in the attachment list passed to renderPassCreateInfo
-	VkAttachmentReference colorAttachmentReference = {};
-	colorAttachmentReference.attachment = 0;
-	colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	// Depth attachment of render pass
-	VkAttachmentDescription depthAttachment = {};
-	depthAttachment.format = depthFormat;
-	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentReference depthAttachmentReference = {};
-	depthAttachmentReference.attachment = 1;
-	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	// Information about a particular subpass the Render Pass is using
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;		// Pipeline type subpass is to be bound to
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentReference;
-	subpass.pDepthStencilAttachment = &depthAttachmentReference;
-
-	// Need to determine when layout transitions occur using subpass dependencies
-	std::array<VkSubpassDependency, 2> subpassDependencies;
-
-	// Conversion from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-	// Transition must happen after...
-	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;						// Subpass index (VK_SUBPASS_EXTERNAL = Special value meaning outside of renderpass)
-	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;		// Pipeline stage
-	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;				// Stage access mask (memory access)
-	// But must happen before...
-	subpassDependencies[0].dstSubpass = 0;
-	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	subpassDependencies[0].dependencyFlags = 0;
-
-
-	// Conversion from VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-	// Transition must happen after...
-	subpassDependencies[1].srcSubpass = 0;
-	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;;
-	// But must happen before...
-	subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	subpassDependencies[1].dependencyFlags = 0;
-
-	std::array<VkAttachmentDescription, 2> renderPassAttachments = { colorAttachment, depthAttachment };
-
-	// Create info for Render Pass
-	VkRenderPassCreateInfo renderPassCreateInfo = {};
-	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(renderPassAttachments.size());
-	renderPassCreateInfo.pAttachments = renderPassAttachments.data();
-	renderPassCreateInfo.subpassCount = 1;
-	renderPassCreateInfo.pSubpasses = &subpass;
-	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
-	renderPassCreateInfo.pDependencies = subpassDependencies.data();
-
-	VkResult result = vkCreateRenderPass(this->vkLogicalDevice, &renderPassCreateInfo, nullptr, &this->vkRenderPass);
-	if (result != VK_SUCCESS)
+void VulkanRenderer::createRenderGraph()
+{
+	// Get supported format for depth buffer
+#if REVERSE_Z_DEPTH
+	// Reverse Z only pays off with float depth (fixed point has uniform precision, reversing gives nothing)
+	depthFormat = defineSupportedFormat(
+		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+#else
+	// (depth only formats first, deferred lighting reads depth as input attachment and its view can't have stencil aspect)
+	depthFormat = defineSupportedFormat(
+		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+#endif
+
+	// Shadow atlas is sampled, plain depth formats are used (sampling depth of combined depth/stencil needs separate view)
+	VkFormat shadowFormat = defineSupportedFormat(
+		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	// Atlas outlives graph transients, graph only attaches it
+	this->cascadedShadows.init(this->vkPhysicalDevice, this->vkLogicalDevice, shadowFormat, &this->uniformRing);
+
+	this->renderGraph.init(this->vkPhysicalDevice, this->vkLogicalDevice, &this->frameScheduler);
+
+	// Graph is compiled once up front in every mode, so pipelines can be created against its render passes (frames reuse them)
+	// (all cascades are due before first frame, so shadow pass is declared as well)
+	// (cluster culling only adds compute passes, so it doesn't change render passes and isn't initialized yet)
+	buildRenderGraph(0, RENDER_PATH_DEFERRED, false, false);
+	this->vkDeferredRenderPass = this->renderGraph.getRenderPass("gbuffer");
+	this->deferredParticleSubpass = this->renderGraph.getSubpass("particles");
+	buildRenderGraph(0, RENDER_PATH_FORWARD, true, false);
+	this->vkPrepassRenderPass = this->renderGraph.getRenderPass("main");
+	this->prepassParticleSubpass = this->renderGraph.getSubpass("particles");
+	this->vkShadowRenderPass = this->renderGraph.getRenderPass("shadows");
+	buildRenderGraph(0, RENDER_PATH_FORWARD, false, false);
+	this->vkRenderPass = this->renderGraph.getRenderPass("main");
+	this->particleSubpass = this->renderGraph.getSubpass("particles");
+
+	printf("Render graph: %d render passes, transient memory %.2f MB (%.2f MB without aliasing)\n", this->renderGraph.getRenderPassCount(),
+		this->renderGraph.getTransientMemorySize() / (1024.0 * 1024.0), this->renderGraph.getTransientRequestedSize() / (1024.0 * 1024.0));
+}
+
+void VulkanRenderer::buildRenderGraph(uint32_t imageIndex, RenderPath renderPath, bool depthPrepass, bool clusterCulling)
+{
+	this->renderGraph.reset();
+
+	// Swapchain image comes from presentation engine undefined and goes back ready to present
+	RenderGraphImageDesc colorDesc = {};
+	colorDesc.format = this->swapChainImageFormat;
+	colorDesc.extent = this->swapChainExtent;
+	RenderGraphResource backbuffer = this->renderGraph.importImage("backbuffer", this->swapchainImages[imageIndex].image,
+		this->swapchainImages[imageIndex].imageView, colorDesc, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	RenderGraphImageDesc depthDesc = {};
+	depthDesc.format = this->depthFormat;
+	depthDesc.extent = this->swapChainExtent;
+	RenderGraphResource depth = this->renderGraph.createImage("depth", depthDesc);
+
+	// Atlas keeps cached cascades between frames, so rewriting it has to wait for previous frames' lookups
+	RenderGraphImageDesc shadowDesc = {};
+	shadowDesc.format = this->cascadedShadows.getAtlasFormat();
+	shadowDesc.extent = { SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE };
+	RenderGraphResource shadowAtlas = this->renderGraph.importImage("shadowAtlas", this->cascadedShadows.getAtlasImage(),
+		this->cascadedShadows.getAtlasImageView(), shadowDesc, this->cascadedShadows.getAtlasLayout(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+	// Skinned meshes are skinned once, before the first pass drawing them (shadows, prepass and color pass read the same output)
+	bool skinned = this->skinning.getDrawCount() > 0;
+	SkinnedStreams skinnedStreams = {};
+	if (skinned)
+	{
+		skinnedStreams = this->skinning.addSkinningPass(this->renderGraph);
+	}
+
+	// Pass exists only when some cascade changed, each cascade clears its own tile (cached tiles are loaded untouched)
+	if (this->cascadedShadows.hasDirtyCascades())
+	{
+		RenderGraphPass& shadowPass = this->renderGraph.addGraphicsPass("shadows");
+		shadowPass.writeDepth(shadowAtlas);
+		if (skinned)
+		{
+			shadowPass.readVertexBuffer(skinnedStreams.positions);
+		}
+		shadowPass.setExecute([this](VkCommandBuffer commandBuffer) { recordShadows(commandBuffer); });
+	}
+
+	// Light lists are rebuilt first, compute pass between prepass and color pass would keep them from merging into one render pass
+	RenderGraphResource lightClusters = this->clusteredLighting.addClusteringPass(this->renderGraph);
+	RenderGraphResource clusterCommands = clusterCulling ? this->clusterCulling.addCullingPass(this->renderGraph) : RENDER_GRAPH_NO_RESOURCE;
+	ParticleStreams particles = this->particleSystem.addSimulationPasses(this->renderGraph);
+
+	auto backgroundColor = getRGBANormalized(BACKGROUND_COLOR);
+	VkClearColorValue backgroundClear = { backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3] };
+
+	// G-buffer is produced and consumed within one render pass (lighting reads it as input attachments), so graph
+	// makes its images transient attachments in lazily allocated memory and they never have to be stored
+	if (renderPath == RENDER_PATH_DEFERRED)
+	{
+		RenderGraphImageDesc albedoDesc = {};
+		albedoDesc.format = GBUFFER_ALBEDO_FORMAT;
+		albedoDesc.extent = this->swapChainExtent;
+		RenderGraphResource albedo = this->renderGraph.createImage("gbufferAlbedo", albedoDesc);
+
+		RenderGraphImageDesc normalDesc = {};
+		normalDesc.format = GBUFFER_NORMAL_FORMAT;
+		normalDesc.extent = this->swapChainExtent;
+		RenderGraphResource normal = this->renderGraph.createImage("gbufferNormal", normalDesc);
+
+		RenderGraphImageDesc lightingDesc = {};
+		lightingDesc.format = GBUFFER_LIGHTING_FORMAT;
+		lightingDesc.extent = this->swapChainExtent;
+		RenderGraphResource lighting = this->renderGraph.createImage("gbufferLighting", lightingDesc);
+
+		RenderGraphPass& gbufferPass = this->renderGraph.addGraphicsPass("gbuffer");
+		gbufferPass.writeColor(albedo, { 0.0f, 0.0f, 0.0f, 0.0f });
+		gbufferPass.writeColor(normal, { 0.0f, 0.0f, 0.0f, 0.0f });
+		gbufferPass.writeColor(lighting, { 0.0f, 0.0f, 0.0f, 0.0f });
+		gbufferPass.writeDepth(depth, DEPTH_CLEAR_VALUE);
+		if (clusterCulling)
+		{
+			gbufferPass.readIndirect(clusterCommands);
+		}
+		if (skinned)
+		{
+			gbufferPass.readVertexBuffer(skinnedStreams.vertices);
+		}
+		gbufferPass.setExecute([this](VkCommandBuffer commandBuffer) { recordScene(commandBuffer); });
+
+		// Input attachment order gives input_attachment_index of deferred_lighting.frag
+		RenderGraphPass& lightingPass = this->renderGraph.addGraphicsPass("deferredLighting");
+		lightingPass.writeColor(backbuffer, backgroundClear);
+		lightingPass.readInputAttachment(albedo);
+		lightingPass.readInputAttachment(normal);
+		lightingPass.readInputAttachment(lighting);
+		lightingPass.readInputAttachment(depth);
+		lightingPass.readStorage(lightClusters, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		lightingPass.readTexture(shadowAtlas, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		lightingPass.setExecute([this, albedo, normal, lighting, depth](VkCommandBuffer commandBuffer)
+		{
+			recordDeferredLighting(commandBuffer, albedo, normal, lighting, depth);
+		});
+		addParticlePass(particles, backbuffer, depth, renderPath, depthPrepass);
+
+		// Pyramid for next frame's occlusion culling is built from final depth (depth is then no longer transient only)
+		if (clusterCulling)
+		{
+			this->clusterCulling.addHiZPass(this->renderGraph, depth);
+		}
+
+		this->renderGraph.compile();
+		return;
+	}
+
+	// With prepass, color pass only tests depth, both passes end up as subpasses of one render pass
+	if (depthPrepass)
 	{
-		throw std::runtime_error("Failed to create a Render Pass.");
+		RenderGraphPass& prepass = this->renderGraph.addGraphicsPass("depthPrepass");
+		prepass.writeDepth(depth, DEPTH_CLEAR_VALUE);
+		if (skinned)
+		{
+			prepass.readVertexBuffer(skinnedStreams.positions);
+		}
+		prepass.setExecute([this](VkCommandBuffer commandBuffer) { recordDepthPrepass(commandBuffer); });
 	}
+
+	RenderGraphPass& mainPass = this->renderGraph.addGraphicsPass("main");
+	mainPass.writeColor(backbuffer, backgroundClear);
+	if (depthPrepass)
+	{
+		mainPass.readDepth(depth);
+	}
+	else
+	{
+		mainPass.writeDepth(depth, DEPTH_CLEAR_VALUE);
+	}
+	mainPass.readStorage(lightClusters, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	mainPass.readTexture(shadowAtlas, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	if (clusterCulling)
+	{
+		mainPass.readIndirect(clusterCommands);
+	}
+	if (skinned)
+	{
+		mainPass.readVertexBuffer(skinnedStreams.vertices);
+	}
+	mainPass.setExecute([this](VkCommandBuffer commandBuffer) { recordScene(commandBuffer); });
+	addParticlePass(particles, backbuffer, depth, renderPath, depthPrepass);
+
+	if (clusterCulling)
+	{
+		this->clusterCulling.addHiZPass(this->renderGraph, depth);
+	}
+
+	this->renderGraph.compile();
 }
 
 void VulkanRenderer::createGraphicsPipeline()
 {
-	// read SPIR-V shader code
-	auto vertexShaderCode = readFile("shaders/vert.spv");
-	auto fragmentShaderCode = readFile("shaders/frag.spv");
-
-	// build shader modules to link to graphics pipeline
-	VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
-	VkShaderModule fragmentShaderModule = createShaderModule(fragmentShaderCode);
-
-	// VERTEX STAGE CREATION
-	VkPipelineShaderStageCreateInfo vertexShaderStageCreateInfo = {};
-	vertexShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertexShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;			// shader stage name
-	vertexShaderStageCreateInfo.module = vertexShaderModule;				// shader module to be used
-	vertexShaderStageCreateInfo.pName = "main";								// shader enter function
-
-	// FRAGMENT STAGE CREATION
-	VkPipelineShaderStageCreateInfo fragmentShaderStageCreateInfo = {};
-	fragmentShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragmentShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;		// shader stage name
-	fragmentShaderStageCreateInfo.module = fragmentShaderModule;				// shader module to be used
-	fragmentShaderStageCreateInfo.pName = "main";								// shader enter function
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageCreateInfo, fragmentShaderStageCreateInfo };
-
-	// Describing vertex data layout
-	VkVertexInputBindingDescription bindingDescription = {};
-	bindingDescription.binding = 0;
-	bindingDescription.stride = sizeof(Vertex);
-	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-	array<VkVertexInputAttributeDescription, 4> attributes;
-	attributes[0].binding = 0;										// should be same as above
-	attributes[0].location = 0;
-	attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributes[0].offset = offsetof(Vertex, pos);
-
-	attributes[1].binding = 0;										// should be same as above
-	attributes[1].location = 1;
-	attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributes[1].offset = offsetof(Vertex, color);	
-
-	attributes[2].binding = 0;										// should be same as above
-	attributes[2].location = 2;
-	attributes[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributes[2].offset = offsetof(Vertex, normal);
-	
-	attributes[3].binding = 0;										// should be same as above
-	attributes[3].location = 3;
-	attributes[3].format = VK_FORMAT_R32G32_SFLOAT;
-	attributes[3].offset = offsetof(Vertex, uv);
-
-	// VERTEX INPUT
-	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
-	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputCreateInfo.vertexBindingDescriptionCount = 1;
-	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;					// list of vertex binding descriptions (data spacing/stride information)
-	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
-	vertexInputCreateInfo.pVertexAttributeDescriptions = attributes.data();				// list of vertex attribute descriptions (data format and where to bind to/from)
-
-	// INPUT ASSEMBLY
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	// VIEWPORT & SCISSORS
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)this->swapChainExtent.width;
-	viewport.height = (float)this->swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0,0 };
-	scissor.extent = this->swapChainExtent;
-
-	VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
-	viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportStateCreateInfo.viewportCount = 1;
-	viewportStateCreateInfo.pViewports = &viewport;
-	viewportStateCreateInfo.scissorCount = 1;
-	viewportStateCreateInfo.pScissors = &scissor;
-
-	/*
-	// DYNAMIC STATES
-	// Dynamic states to enable
-	vector<VkDynamicState> dynamicStatesEnables;
-	dynamicStatesEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);	// allows to change viewport on runtime using vkCmdSetViewport
-	dynamicStatesEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);
-
-	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStatesEnables.size());
-	dynamicStateCreateInfo.pDynamicStates = dynamicStatesEnables.data();
-	*/
-
-	// RASTERIZER
-	VkPipelineRasterizationStateCreateInfo rastCreateInfo = {};
-	rastCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rastCreateInfo.depthClampEnable = VK_FALSE;
-	rastCreateInfo.rasterizerDiscardEnable = VK_FALSE;
-	rastCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-	rastCreateInfo.lineWidth = 1.0f;
-	rastCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-	rastCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rastCreateInfo.depthBiasEnable = VK_FALSE;				// whether to add depth bias to fragments (good for stopping "shadow acne" in shadow mapping)
-
-	// MULTI SAMPLING
-	VkPipelineMultisampleStateCreateInfo multisamplingCreateInfo = {};
-	multisamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisamplingCreateInfo.sampleShadingEnable = VK_FALSE;
-	multisamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-	// BLENDING
-	// Blending decides how to blend a new color being written to a fragment, with the old value
-
-	// Blend Attachment State (how blending is handled)
-	VkPipelineColorBlendAttachmentState colorState = {};
-	colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT	// colors to apply blending to
-		| VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorState.blendEnable = VK_TRUE;													// Enable blending
-
-	// Blending uses equation: (srcColorBlendFactor * new color) colorBlendOp (dstColorBlendFactor * old color)
-	colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorState.colorBlendOp = VK_BLEND_OP_ADD;
-
-	// Summarised: (VK_BLEND_FACTOR_SRC_ALPHA * new color) + (VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA * old color)
-	//			   (new color alpha * new color) + ((1 - new color alpha) * old color)
-
-	colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorState.alphaBlendOp = VK_BLEND_OP_ADD;
-	// Summarised: (1 * new alpha) + (0 * old alpha) = new alpha
-
-	VkPipelineColorBlendStateCreateInfo colorBlendingCreateInfo = {};
-	colorBlendingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendingCreateInfo.logicOpEnable = VK_FALSE;
-	colorBlendingCreateInfo.attachmentCount = 1;
-	colorBlendingCreateInfo.pAttachments = &colorState;
-
-	// PIPELINE LAYOUT
-	std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { this->vkDescriptorSetLayout, this->vkSamplerDescriptorSetLayout };
-
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-	pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-	pipelineLayoutCreateInfo.pPushConstantRanges = &this->vkPushConstantRange;
-
-	// Create Pipeline Layout
-	VkResult result = vkCreatePipelineLayout(this->vkLogicalDevice, &pipelineLayoutCreateInfo, nullptr, &vkPipelineLayout);
-	if (result != VK_SUCCESS)
+	// Describing vertex data layout (everything Vertex provides, pipelines take locations their vertex shader reads)
+	VertexLayout vertexLayout = {};
+	vertexLayout.stride = sizeof(Vertex);
+	vertexLayout.attributes = {
+		{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) },		// location, binding, format, offset
+		{ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) },
+		{ 2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) },
+		{ 3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) },
+		{ 4, 0, VK_FORMAT_R32_SFLOAT, offsetof(Vertex, occlusion) },
+		{ 5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, lightmapUv) }
+	};
+
+	// Main opaque pass state, material variants differ only by specialization constants
+	this->defaultPipelineState.vertexShader = SHADER_DIRECTORY "/shader.vert";
+	this->defaultPipelineState.fragmentShader = SHADER_DIRECTORY "/shader.frag";
+	this->defaultPipelineState.vertexLayout = vertexLayout;
+	this->defaultPipelineState.cullMode = VK_CULL_MODE_BACK_BIT;
+	this->defaultPipelineState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	this->defaultPipelineState.blendEnable = true;
+	this->defaultPipelineState.depthCompareOp = DEPTH_COMPARE_OP;
+	this->defaultPipelineState.layout = this->vkPipelineLayout;
+	this->defaultPipelineState.renderPass = this->vkRenderPass;
+	this->defaultPipelineState.subpass = 0;
+	this->defaultPipelineState.specializationConstants = { MATERIAL_VARIANT_GENERIC };
+
+	// Color pass after depth prepass, depth is final already so only equal fragments are shaded
+	this->prepassPipelineState = this->defaultPipelineState;
+	this->prepassPipelineState.depthWriteEnable = false;
+	this->prepassPipelineState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+	this->prepassPipelineState.renderPass = this->vkPrepassRenderPass;
+	this->prepassPipelineState.subpass = 1;
+
+	// Depth prepass reads tightly packed positions and has no fragment shader
+	VertexLayout positionLayout = {};
+	positionLayout.stride = sizeof(glm::vec3);
+	positionLayout.attributes = { { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 } };
+
+	this->depthPipelineState = this->defaultPipelineState;
+	this->depthPipelineState.vertexShader = SHADER_DIRECTORY "/depth.vert";
+	this->depthPipelineState.fragmentShader = "";
+	this->depthPipelineState.vertexLayout = positionLayout;
+	this->depthPipelineState.blendEnable = false;
+	this->depthPipelineState.colorAttachmentCount = 0;
+	this->depthPipelineState.renderPass = this->vkPrepassRenderPass;
+	this->depthPipelineState.subpass = 0;
+	this->depthPipelineState.specializationConstants = {};
+
+	// Shadow casters use the same depth only shaders, light camera comes in place of view projection
+	this->shadowPipelineState = this->depthPipelineState;
+	this->shadowPipelineState.depthCompareOp = VK_COMPARE_OP_LESS;			// orthographic light projection, regular Z
+	this->shadowPipelineState.depthBiasConstant = SHADOW_DEPTH_BIAS_CONSTANT;
+	this->shadowPipelineState.depthBiasSlope = SHADOW_DEPTH_BIAS_SLOPE;
+	this->shadowPipelineState.renderPass = this->vkShadowRenderPass;
+	this->shadowPipelineState.subpass = 0;
+
+	// G-buffer pass runs material shaders into three targets, lighting is one full screen triangle in the next subpass
+	this->gbufferPipelineState = this->defaultPipelineState;
+	this->gbufferPipelineState.fragmentShader = SHADER_DIRECTORY "/gbuffer.frag";
+	this->gbufferPipelineState.blendEnable = false;
+	this->gbufferPipelineState.colorAttachmentCount = 3;
+	this->gbufferPipelineState.renderPass = this->vkDeferredRenderPass;
+	this->gbufferPipelineState.subpass = 0;
+
+	this->deferredLightingPipelineState = this->defaultPipelineState;
+	this->deferredLightingPipelineState.vertexShader = SHADER_DIRECTORY "/fullscreen.vert";
+	this->deferredLightingPipelineState.fragmentShader = SHADER_DIRECTORY "/deferred_lighting.frag";
+	this->deferredLightingPipelineState.vertexLayout = {};
+	this->deferredLightingPipelineState.cullMode = VK_CULL_MODE_NONE;
+	this->deferredLightingPipelineState.blendEnable = false;
+	this->deferredLightingPipelineState.depthTestEnable = false;
+	this->deferredLightingPipelineState.depthWriteEnable = false;
+	this->deferredLightingPipelineState.renderPass = this->vkDeferredRenderPass;
+	this->deferredLightingPipelineState.subpass = 1;
+	this->deferredLightingPipelineState.specializationConstants = { REVERSE_Z_DEPTH ? 1 : 0 };
+
+	// Particles are camera facing quads built from vertex and instance index, blended over shaded scene without writing depth
+	this->particlePipelineState = this->defaultPipelineState;
+	this->particlePipelineState.vertexShader = SHADER_DIRECTORY "/particle.vert";
+	this->particlePipelineState.fragmentShader = SHADER_DIRECTORY "/particle.frag";
+	this->particlePipelineState.vertexLayout = {};
+	this->particlePipelineState.cullMode = VK_CULL_MODE_NONE;
+	this->particlePipelineState.depthWriteEnable = false;
+	this->particlePipelineState.subpass = this->particleSubpass;
+	this->particlePipelineState.specializationConstants = {};
+
+	this->prepassParticlePipelineState = this->particlePipelineState;
+	this->prepassParticlePipelineState.renderPass = this->vkPrepassRenderPass;
+	this->prepassParticlePipelineState.subpass = this->prepassParticleSubpass;
+
+	this->deferredParticlePipelineState = this->particlePipelineState;
+	this->deferredParticlePipelineState.renderPass = this->vkDeferredRenderPass;
+	this->deferredParticlePipelineState.subpass = this->deferredParticleSubpass;
+
+	// Impostors are camera facing quads as well, alpha tested against baked coverage so they write depth like meshes
+	this->impostorPipelineState = this->defaultPipelineState;
+	this->impostorPipelineState.vertexShader = SHADER_DIRECTORY "/impostor.vert";
+	this->impostorPipelineState.fragmentShader = SHADER_DIRECTORY "/impostor.frag";
+	this->impostorPipelineState.vertexLayout = {};
+	this->impostorPipelineState.cullMode = VK_CULL_MODE_NONE;
+	this->impostorPipelineState.blendEnable = false;
+	this->impostorPipelineState.specializationConstants = {};
+
+	// Prepass needs coverage of impostors too, otherwise equal test of color pass rejects them
+	this->impostorDepthPipelineState = this->impostorPipelineState;
+	this->impostorDepthPipelineState.fragmentShader = SHADER_DIRECTORY "/impostor_depth.frag";
+	this->impostorDepthPipelineState.colorAttachmentCount = 0;
+	this->impostorDepthPipelineState.renderPass = this->vkPrepassRenderPass;
+	this->impostorDepthPipelineState.subpass = 0;
+
+	this->prepassImpostorPipelineState = this->impostorPipelineState;
+	this->prepassImpostorPipelineState.depthWriteEnable = false;
+	this->prepassImpostorPipelineState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+	this->prepassImpostorPipelineState.renderPass = this->vkPrepassRenderPass;
+	this->prepassImpostorPipelineState.subpass = 1;
+
+	this->gbufferImpostorPipelineState = this->impostorPipelineState;
+	this->gbufferImpostorPipelineState.fragmentShader = SHADER_DIRECTORY "/impostor_gbuffer.frag";
+	this->gbufferImpostorPipelineState.colorAttachmentCount = 3;
+	this->gbufferImpostorPipelineState.renderPass = this->vkDeferredRenderPass;
+	this->gbufferImpostorPipelineState.subpass = 0;
+
+	this->pipelineManager.init(this->vkLogicalDevice, &this->pipelineCache, &this->shaderCompiler);
+
+	// Generic variant renders every material, so frame never has to wait for specialized ones
+	this->vkGraphicsPipeline = this->pipelineManager.getPipelineBlocking(this->defaultPipelineState);
+	// Prepass mode can be switched on any frame, its pipelines must be ready as well
+	this->vkPrepassGraphicsPipeline = this->pipelineManager.getPipelineBlocking(this->prepassPipelineState);
+	this->vkDepthPipeline = this->pipelineManager.getPipelineBlocking(this->depthPipelineState);
+	this->vkShadowPipeline = this->pipelineManager.getPipelineBlocking(this->shadowPipelineState);
+	// Render path can be switched on any frame as well
+	this->vkGBufferPipeline = this->pipelineManager.getPipelineBlocking(this->gbufferPipelineState);
+	this->vkDeferredLightingPipeline = this->pipelineManager.getPipelineBlocking(this->deferredLightingPipelineState);
+	this->vkParticlePipeline = this->pipelineManager.getPipelineBlocking(this->particlePipelineState);
+	this->vkPrepassParticlePipeline = this->pipelineManager.getPipelineBlocking(this->prepassParticlePipelineState);
+	this->vkDeferredParticlePipeline = this->pipelineManager.getPipelineBlocking(this->deferredParticlePipelineState);
+	this->vkImpostorPipeline = this->pipelineManager.getPipelineBlocking(this->impostorPipelineState);
+	this->vkImpostorDepthPipeline = this->pipelineManager.getPipelineBlocking(this->impostorDepthPipelineState);
+	this->vkPrepassImpostorPipeline = this->pipelineManager.getPipelineBlocking(this->prepassImpostorPipelineState);
+	this->vkGBufferImpostorPipeline = this->pipelineManager.getPipelineBlocking(this->gbufferImpostorPipelineState);
+
+	// Specialized variants are compiled in background right away
+	getMaterialPipeline(-1);
+	getMaterialPipeline(0);
+}
+
+VkPipeline VulkanRenderer::getMaterialPipeline(int textureIndex)
+{
+	// Material shaders write G-buffer in deferred path, prepass applies to forward path only
+	PipelineState state = this->defaultPipelineState;
+	VkPipeline fallback = this->vkGraphicsPipeline;
+	if (this->renderPath == RENDER_PATH_DEFERRED)
 	{
-		throw runtime_error("Failed to create Pipeline Layout!");
-	}
-
-	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
-	depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilCreateInfo.depthTestEnable = VK_TRUE;
-	depthStencilCreateInfo.depthWriteEnable = VK_TRUE;
-	depthStencilCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-	depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE; 
-	depthStencilCreateInfo.stencilTestEnable = VK_FALSE;
-
-
-	// -- GRAPHICS PIPELINE CREATION --
-	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineCreateInfo.stageCount = 2;									// Number of shader stages
-	pipelineCreateInfo.pStages = shaderStages;							// List of shader stages
-	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;		// All the fixed function pipeline states
-	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-	pipelineCreateInfo.pDynamicState = nullptr;
-	pipelineCreateInfo.pRasterizationState = &rastCreateInfo;
-	pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
-	pipelineCreateInfo.pColorBlendState = &colorBlendingCreateInfo;
-	pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
-	pipelineCreateInfo.layout = this->vkPipelineLayout;							// Pipeline Layout pipeline should use
-	pipelineCreateInfo.renderPass = this->vkRenderPass;							// Render pass description the pipeline is compatible with
-	pipelineCreateInfo.subpass = 0;							 			// Subpass of render pass to use with pipeline
-
-	// Pipeline Derivatives : Can create multiple pipelines that derive from one another for optimisation
-	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;	// Existing pipeline to derive from...
-	pipelineCreateInfo.basePipelineIndex = -1;				// or index of pipeline being created to derive from (in case creating multiple at once)
-
-	// Create Graphics Pipeline
-	result = vkCreateGraphicsPipelines(this->vkLogicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &this->vkGraphicsPipeline);
-	if (result != VK_SUCCESS)
+		state = this->gbufferPipelineState;
+		fallback = this->vkGBufferPipeline;
+	}
+	else if (this->depthPrepassEnabled)
 	{
-		throw std::runtime_error("Failed to create a Graphics Pipeline!");
+		state = this->prepassPipelineState;
+		fallback = this->vkPrepassGraphicsPipeline;
 	}
+	state.specializationConstants = { textureIndex >= 0 ? MATERIAL_VARIANT_TEXTURED : MATERIAL_VARIANT_COLORED };
 
-
-	vkDestroyShaderModule(this->vkLogicalDevice, fragmentShaderModule, nullptr);
-	vkDestroyShaderModule(this->vkLogicalDevice, vertexShaderModule, nullptr);
+	return this->pipelineManager.getPipeline(state, fallback);
 }
 
-void VulkanRenderer::createFramebuffers()
+void VulkanRenderer::reloadChangedShaders()
 {
-	vkSwapchainFramebuffers.resize(swapchainImages.size());
-	for (int i = 0; i < vkSwapchainFramebuffers.size(); i++)
+	for (const auto& shaderPath : this->shaderCompiler.pollChangedShaders())
 	{
-		array<VkImageView, 2> attachments = {
-			swapchainImages[i].imageView,
-			depthBufferImageView
-		};
+		printf("Shader %s changed, recompiling pipelines\n", shaderPath.c_str());
+		this->pipelineManager.reloadShader(shaderPath);
+	}
 
-		VkFramebufferCreateInfo framebufferCreateInfo = {};
-		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferCreateInfo.renderPass = this->vkRenderPass;
-		framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-		framebufferCreateInfo.pAttachments = attachments.data();								// list of attachements 1:1 with render pass
-		framebufferCreateInfo.width = swapChainExtent.width;
-		framebufferCreateInfo.height = swapChainExtent.height;
-		framebufferCreateInfo.layers = 1;
-
-		VkResult result = vkCreateFramebuffer(this->vkLogicalDevice, &framebufferCreateInfo, nullptr, &vkSwapchainFramebuffers[i]);
-		if (result != VK_SUCCESS)
-		{
-			throw runtime_error("Failed to create framebuffers.");
-		}
+	// Generic variants are replaced as well once their reload finishes
+	this->vkGraphicsPipeline = this->pipelineManager.getPipeline(this->defaultPipelineState, this->vkGraphicsPipeline);
+	this->vkPrepassGraphicsPipeline = this->pipelineManager.getPipeline(this->prepassPipelineState, this->vkPrepassGraphicsPipeline);
+	this->vkDepthPipeline = this->pipelineManager.getPipeline(this->depthPipelineState, this->vkDepthPipeline);
+	this->vkShadowPipeline = this->pipelineManager.getPipeline(this->shadowPipelineState, this->vkShadowPipeline);
+	this->vkGBufferPipeline = this->pipelineManager.getPipeline(this->gbufferPipelineState, this->vkGBufferPipeline);
+	this->vkDeferredLightingPipeline = this->pipelineManager.getPipeline(this->deferredLightingPipelineState, this->vkDeferredLightingPipeline);
+	this->vkParticlePipeline = this->pipelineManager.getPipeline(this->particlePipelineState, this->vkParticlePipeline);
+	this->vkPrepassParticlePipeline = this->pipelineManager.getPipeline(this->prepassParticlePipelineState, this->vkPrepassParticlePipeline);
+	this->vkDeferredParticlePipeline = this->pipelineManager.getPipeline(this->deferredParticlePipelineState, this->vkDeferredParticlePipeline);
+	this->vkImpostorPipeline = this->pipelineManager.getPipeline(this->impostorPipelineState, this->vkImpostorPipeline);
+	this->vkImpostorDepthPipeline = this->pipelineManager.getPipeline(this->impostorDepthPipelineState, this->vkImpostorDepthPipeline);
+	this->vkPrepassImpostorPipeline = this->pipelineManager.getPipeline(this->prepassImpostorPipelineState, this->vkPrepassImpostorPipeline);
+	this->vkGBufferImpostorPipeline = this->pipelineManager.getPipeline(this->gbufferImpostorPipelineState, this->vkGBufferImpostorPipeline);
+
+	// Replaced pipelines can still be used by frames in flight
+	for (auto pipeline : this->pipelineManager.takeRetiredPipelines())
+	{
+		VkDevice logicalDevice = this->vkLogicalDevice;
+		this->frameScheduler.deferDestroy([logicalDevice, pipeline]() { vkDestroyPipeline(logicalDevice, pipeline, nullptr); });
 	}
 }
 
@@ -699,250 +834,231 @@ void VulkanRenderer::createCommandPool()
 	}
 }
 
-void VulkanRenderer::createCommandBuffers()
-{
-	this->vkCommandBuffers.resize(vkSwapchainFramebuffers.size());
-
-	VkCommandBufferAllocateInfo cbAllocInfo = {};
-	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cbAllocInfo.commandPool = vkGraphicsCommandPool;
-	cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;					// VK_COMMAND_BUFFER_LEVEL_PRIMARY		: buffer you submit directly to the queue. Can't be called by other buffers
-																			// VK_COMMAND_BUFFER_LEVEL_SECONDARY	: buffer can't be called directly. Can be called from other buffers via vkCmdExecuteCommands when recording commands in primary buffer
-	cbAllocInfo.commandBufferCount = static_cast<uint32_t>(this->vkCommandBuffers.size());
-
-	VkResult result = vkAllocateCommandBuffers(this->vkLogicalDevice, &cbAllocInfo, this->vkCommandBuffers.data());
-	if (result != VK_SUCCESS)
-	{
-		throw runtime_error("Failed to allocate command buffers");
-	}
-}
-
 void VulkanRenderer::createSyncTools()
 {
-	this->vkSemImageAvailable.resize(MAX_FRAME_DRAWS);
-	this->vkSemRenderFinished.resize(MAX_FRAME_DRAWS);
-	this->vkDrawFences.resize(MAX_FRAME_DRAWS);
+	// Frame slots (command buffers, acquire semaphores) are paced by timeline semaphore inside scheduler
+	this->frameScheduler.init(this->vkLogicalDevice, getQueueFamilies(this->vkPhysicalDevice).graphicsFamily, DEFAULT_FRAMES_IN_FLIGHT);
+
+	this->vkSemRenderFinished.resize(swapchainImages.size());
 
 	VkSemaphoreCreateInfo semCreateInfo = {};
 	semCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	for (int i = 0; i < MAX_FRAME_DRAWS; i++)
+	for (int i = 0; i < swapchainImages.size(); i++)
 	{
-		if (vkCreateSemaphore(this->vkLogicalDevice, &semCreateInfo, nullptr, &vkSemImageAvailable[i]) != VK_SUCCESS
-			|| vkCreateSemaphore(this->vkLogicalDevice, &semCreateInfo, nullptr, &vkSemRenderFinished[i]) != VK_SUCCESS
-			|| vkCreateFence(this->vkLogicalDevice, &fenceCreateInfo, nullptr, &this->vkDrawFences[i]) != VK_SUCCESS)
+		if (vkCreateSemaphore(this->vkLogicalDevice, &semCreateInfo, nullptr, &vkSemRenderFinished[i]) != VK_SUCCESS)
 		{
-			throw runtime_error("Failed to create semaphores and/or fence.");
+			throw runtime_error("Failed to create semaphores.");
 		}
 	}
 }
 
-void VulkanRenderer::createDescriptorSetLayout()
+void VulkanRenderer::createQueryPool()
 {
-	// UNIFORM VALUES DESCRIPTOR SET LAYOUT
-	// View Projection binding info
-	VkDescriptorSetLayoutBinding viewProjectionBinding;
-	viewProjectionBinding.binding = 0;												// bindings specified in shader
-	viewProjectionBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;		// type of descriptor (simple uniform in this case)
-	viewProjectionBinding.descriptorCount = 1;										// number of binded values
-	viewProjectionBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;					// specifies shader stage
-	viewProjectionBinding.pImmutableSamplers = nullptr;							// for textures
-
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	//// Model binding info (dynamic)
-	//VkDescriptorSetLayoutBinding modelBinding = {};
-	//modelBinding.binding = 1;
-	//modelBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	//modelBinding.descriptorCount = 1;
-	//modelBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	//modelBinding.pImmutableSamplers = nullptr;	
-	//std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { viewProjectionBinding, modelBinding };
-
-	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { viewProjectionBinding };
-
-	// Create descriptor set layout with given bindings
-	VkDescriptorSetLayoutCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	createInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
-	createInfo.pBindings = layoutBindings.data();
-
-	VkResult result = vkCreateDescriptorSetLayout(this->vkLogicalDevice, &createInfo, nullptr, &this->vkDescriptorSetLayout);
-	if (result != VK_SUCCESS)
+	if (!this->pipelineStatisticsSupported)
 	{
-		throw runtime_error("Failed to create Uniform Descriptor Set Layout.");
+		printf("Pipeline statistics queries are not supported, overdraw statistics are disabled\n");
+		return;
 	}
 
-	// TEXTURE SAMPLER DESCRIPTOR SET LAYOUT
-	VkDescriptorSetLayoutBinding samplerBinding = {};
-	samplerBinding.binding = 0;
-	samplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerBinding.descriptorCount = 1;
-	samplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	samplerBinding.pImmutableSamplers = nullptr;
-
-	VkDescriptorSetLayoutCreateInfo samplerDescriptorLayoutCreateInfo = {};
-	samplerDescriptorLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	samplerDescriptorLayoutCreateInfo.bindingCount = 1;
-	samplerDescriptorLayoutCreateInfo.pBindings = &samplerBinding;
+	// One query per possible frame in flight, so changing frames in flight never recreates pool
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	queryPoolCreateInfo.queryCount = MAX_FRAMES_IN_FLIGHT;
+	queryPoolCreateInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
 
-	result = vkCreateDescriptorSetLayout(this->vkLogicalDevice, &samplerDescriptorLayoutCreateInfo, 
-		nullptr, &this->vkSamplerDescriptorSetLayout);
+	VkResult result = vkCreateQueryPool(this->vkLogicalDevice, &queryPoolCreateInfo, nullptr, &this->vkStatisticsQueryPool);
 	if (result != VK_SUCCESS)
 	{
-		throw runtime_error("Failed to create Texture Sampler Descriptor Set Layout.");
+		throw runtime_error("Failed to create pipeline statistics Query Pool.");
 	}
+	this->statisticsQueryWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
 }
 
-void VulkanRenderer::createUniformBuffers()
+void VulkanRenderer::createPipelineLayout()
 {
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	//allocateDynamicBufferTransferSpace();
-
-	// Buffer size should be the size of data we pass as uniforms
-	VkDeviceSize bufferSize = sizeof(UboProjectionView);
-
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	// Model Buffer size
-	//VkDeviceSize modelBufferSize = modelUniformAlignment * MAX_OBJECTS;
+	// Layouts are derived from main shaders, so they can't get out of sync with bindings declared in GLSL
+	// (forward and deferred shaders are merged into one layout, so bound sets stay valid when render path changes)
+	ShaderReflection reflection = ShaderReflection::merge({
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/shader.vert")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/shader.frag")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/gbuffer.frag")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/fullscreen.vert")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/deferred_lighting.frag")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/particle.vert")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/particle.frag")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/impostor.vert")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/impostor.frag")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/impostor_gbuffer.frag")),
+		ShaderReflection::reflect(this->shaderCompiler.compile(SHADER_DIRECTORY "/impostor_depth.frag")) });
+
+	// Uniform and object buffers point into uniform ring (dynamic offsets), runtime sized texture array is bindless table
+	// (push constant range covers PushModel of mesh draws and larger PushImpostor of impostor draws)
+	LayoutOverrides overrides = {};
+	overrides.dynamicUniformBuffers = true;
+	overrides.dynamicStorageBuffers = true;
+	overrides.maxRuntimeArraySize = this->maxBindlessTextures;
+
+	this->layoutCache.init(this->vkLogicalDevice);
+
+	vector<VkDescriptorSetLayout> setLayouts;
+	this->vkPipelineLayout = this->layoutCache.getReflectedLayout(reflection, overrides, &setLayouts);
+	if (setLayouts.size() <= PARTICLE_DRAW_SET)
+	{
+		throw runtime_error("Failed to create Pipeline Layout, main shaders must use uniform set 0, texture set 1, G-buffer set 2 and particle set 3.");
+	}
+
+	this->vkDescriptorSetLayout = setLayouts[0];
+	this->vkSamplerDescriptorSetLayout = setLayouts[1];
+	this->vkGBufferDescriptorSetLayout = setLayouts[2];
+	this->vkParticleDescriptorSetLayout = setLayouts[PARTICLE_DRAW_SET];
+	this->vkPushConstantRange = reflection.pushConstantRange;
+}
 
-	// one uniform buffer for each image
-	uniformBuffers.resize(swapchainImages.size());
-	uniformBuffersMemory.resize(swapchainImages.size());
+void VulkanRenderer::createUniformBuffers()
+{
+	// One persistently mapped buffer for all frames in flight, sub-allocations must satisfy both uniform and storage alignment
+	VkDeviceSize alignment = std::max(minUniformBufferOffset, minStorageBufferOffset);
+	// Slices for max frames in flight are reserved, so changing frames in flight never recreates buffer (and its descriptor set)
+	this->uniformRing.init(this->vkPhysicalDevice, this->vkLogicalDevice, UNIFORM_RING_FRAME_SIZE, MAX_FRAMES_IN_FLIGHT, alignment);
+	createObjectBuffer(MIN_DRAW_OBJECTS);
+}
 
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	//uniformBuffersDynamic.resize(swapchainImages.size());
-	//uniformBuffersMemoryDynamic.resize(swapchainImages.size());
+void VulkanRenderer::createObjectBuffer(uint32_t capacity)
+{
+	// Slices start at aligned offsets, so slice offset is valid as dynamic storage offset
+	this->objectCapacity = capacity;
+	this->objectSliceSize = (capacity * sizeof(ObjectData) + minStorageBufferOffset - 1) / minStorageBufferOffset * minStorageBufferOffset;
+	createBuffer(this->vkPhysicalDevice, this->vkLogicalDevice, this->objectSliceSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &this->vkObjectBuffer, &this->vkObjectBufferMemory);
 
-	for (int i = 0; i < uniformBuffers.size(); i++)
+	VkResult result = vkMapMemory(this->vkLogicalDevice, this->vkObjectBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&this->objectBufferData);
+	if (result != VK_SUCCESS)
 	{
-		createBuffer(this->vkPhysicalDevice, this->vkLogicalDevice, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers[i], &uniformBuffersMemory[i]);
-
-		// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-		//createBuffer(this->vkPhysicalDevice, this->vkLogicalDevice, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		//	VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffersDynamic[i], &uniformBuffersMemoryDynamic[i]);
+		throw runtime_error("Failed to map object buffer memory.");
 	}
 }
 
-void VulkanRenderer::createDepthBuffer()
+void VulkanRenderer::destroyObjectBuffer()
 {
-	// Get supported format for depth buffer
-	depthFormat = defineSupportedFormat(
-		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	vkUnmapMemory(this->vkLogicalDevice, this->vkObjectBufferMemory);
+	vkDestroyBuffer(this->vkLogicalDevice, this->vkObjectBuffer, nullptr);
+	vkFreeMemory(this->vkLogicalDevice, this->vkObjectBufferMemory, nullptr);
+	this->vkObjectBuffer = VK_NULL_HANDLE;
+	this->objectBufferData = nullptr;
+}
 
-	// Create depth buffer image
-	this->depthBufferImage = createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &this->depthBufferImageMemory);
+void VulkanRenderer::reserveObjects()
+{
+	uint32_t meshCount = 0;
+	for (const auto& modelKeyValue : modelsToRender)
+	{
+		meshCount += static_cast<uint32_t>(modelKeyValue.second.size());
+	}
+	if (meshCount <= this->objectCapacity)
+	{
+		return;
+	}
 
-	this->depthBufferImageView = createImageView(this->depthBufferImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	// Frames in flight read the old buffer through sets bound to it, so GPU has to finish them (only happens when scene grew)
+	vkDeviceWaitIdle(this->vkLogicalDevice);
+	uint32_t capacity = this->objectCapacity;
+	while (capacity < meshCount)
+	{
+		capacity *= 2;
+	}
+	destroyObjectBuffer();
+	createObjectBuffer(capacity);
+	createDescriptorSets();
+	this->clusterCulling.setObjectBuffer(this->vkObjectBuffer, this->objectCapacity * sizeof(ObjectData));
 }
 
 void VulkanRenderer::createDescriptorPool()
 {
-	VkDescriptorPoolSize poolSize = {};
-	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize.descriptorCount = static_cast<uint32_t>(uniformBuffers.size());
-
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	//VkDescriptorPoolSize poolSizeDynamic = {};
-	//poolSizeDynamic.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	//poolSizeDynamic.descriptorCount = static_cast<uint32_t>(uniformBuffersDynamic.size());
-	//std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {poolSize, poolSizeDynamic};
+	// Regular sets are allocated from pools chained on demand, per frame pools are recycled each frame
+	std::vector<DescriptorPoolSizeRatio> poolSizeRatios = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 4.0f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1.0f }
+	};
+	this->descriptorAllocator.init(this->vkLogicalDevice, DEFAULT_FRAMES_IN_FLIGHT, poolSizeRatios);
 
+	// BINDLESS TEXTURE POOL
+	// Holds the only texture set, must be created with UPDATE_AFTER_BIND flag to match the set layout
 	VkDescriptorPoolSize samplerPoolsize = {};
 	samplerPoolsize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerPoolsize.descriptorCount = MAX_OBJECTS;
+	samplerPoolsize.descriptorCount = maxBindlessTextures;
 
-	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { poolSize, samplerPoolsize };
+	VkDescriptorPoolCreateInfo bindlessCreateInfo = {};
+	bindlessCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	bindlessCreateInfo.maxSets = 1;
+	bindlessCreateInfo.poolSizeCount = 1;
+	bindlessCreateInfo.pPoolSizes = &samplerPoolsize;
+	bindlessCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
 
-	VkDescriptorPoolCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	createInfo.maxSets = static_cast<uint32_t>(swapchainImages.size() + MAX_OBJECTS);
-	createInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
-	createInfo.pPoolSizes = descriptorPoolSizes.data();
-	createInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-
-	VkResult result = vkCreateDescriptorPool(this->vkLogicalDevice, &createInfo, nullptr, &this->vkDescriptorPool);
+	VkResult result = vkCreateDescriptorPool(this->vkLogicalDevice, &bindlessCreateInfo, nullptr, &this->vkBindlessDescriptorPool);
 	if (result != VK_SUCCESS)
 	{
-		throw runtime_error("Failed to create descriptor pools.");
+		throw runtime_error("Failed to create bindless texture descriptor pool.");
 	}
 }
 
 void VulkanRenderer::createDescriptorSets()
 {
-	int descriptorSetsCount = swapchainImages.size();
+	// Single set for all frames, ranges cover one element and dynamic offsets select frame slice and draw
+	// View projection binding
+	DescriptorBinding vpBinding = {};
+	vpBinding.binding = 0;											// matches with binding on layout in shader
+	vpBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	vpBinding.bufferInfo.buffer = this->uniformRing.getBuffer();
+	vpBinding.bufferInfo.offset = 0;
+	vpBinding.bufferInfo.range = sizeof(UboProjectionView);
+
+	// Object buffer binding (whole per frame object array, draws index it by instance index)
+	DescriptorBinding objectBinding = {};
+	objectBinding.binding = 1;
+	objectBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectBinding.bufferInfo.buffer = this->vkObjectBuffer;
+	objectBinding.bufferInfo.offset = 0;
+	objectBinding.bufferInfo.range = this->objectCapacity * sizeof(ObjectData);
+
+	// Lights and their cluster lists (same buffers clustering pass uses)
+	DescriptorBinding lightBinding = this->clusteredLighting.getLightBinding(2);
+	DescriptorBinding clusterBinding = this->clusteredLighting.getClusterBinding(3);
+
+	// Cascade matrices and shadow atlas
+	DescriptorBinding shadowDataBinding = this->cascadedShadows.getShadowDataBinding(4);
+	DescriptorBinding shadowAtlasBinding = this->cascadedShadows.getAtlasBinding(5);
+
+	this->vkDescriptorSet = this->descriptorAllocator.getCachedSet(this->vkDescriptorSetLayout,
+		{ vpBinding, objectBinding, lightBinding, clusterBinding, shadowDataBinding, shadowAtlasBinding });
+}
 
-	this->vkDescriptorSets.resize(descriptorSetsCount);
-	vector<VkDescriptorSetLayout> setLayouts(descriptorSetsCount, this->vkDescriptorSetLayout);
+void VulkanRenderer::createBindlessDescriptorSet()
+{
+	// Actual size of the variable sized sampler array
+	VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo = {};
+	variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+	variableCountInfo.descriptorSetCount = 1;
+	variableCountInfo.pDescriptorCounts = &this->maxBindlessTextures;
 
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = this->vkDescriptorPool;										// pool to allocate sets from
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(descriptorSetsCount);		// number of sets to allocate
-	allocInfo.pSetLayouts = setLayouts.data();												// layouts to use to allocate sets (1:1)
+	allocInfo.pNext = &variableCountInfo;
+	allocInfo.descriptorPool = this->vkBindlessDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &this->vkSamplerDescriptorSetLayout;
 
-	VkResult result = vkAllocateDescriptorSets(this->vkLogicalDevice, &allocInfo, this->vkDescriptorSets.data());
+	VkResult result = vkAllocateDescriptorSets(this->vkLogicalDevice, &allocInfo, &this->vkBindlessDescriptorSet);
 	if (result != VK_SUCCESS)
 	{
-		throw runtime_error("Failed to allocate descriptor sets.");
+		throw runtime_error("Failed to allocate bindless texture descriptor set.");
 	}
-
-	// Set binding between buffers and descriptor sets
-	for (int i = 0; i < descriptorSetsCount; i++)
-	{
-		// UNIFORM BUFFER ("STATIC" one currently used for View Projection matrices pass)
-		VkDescriptorBufferInfo vpBufferInfo = {};
-		vpBufferInfo.buffer = uniformBuffers[i];
-		vpBufferInfo.offset = 0;
-		vpBufferInfo.range = sizeof(UboProjectionView);
-
-		VkWriteDescriptorSet vpSetWrite = {};
-		vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		vpSetWrite.dstSet = this->vkDescriptorSets[i];
-		vpSetWrite.dstBinding = 0;											// matches with binding on layout in shader
-		vpSetWrite.dstArrayElement = 0;
-		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		vpSetWrite.descriptorCount = 1;
-		vpSetWrite.pBufferInfo = &vpBufferInfo;
-
-		// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-		// //DYNAMIC UNIFORM BUFFER (used for passing specific model's transform)
-		//VkDescriptorBufferInfo modelBufferInfo = {};
-		//modelBufferInfo.buffer = uniformBuffersDynamic[i];
-		//modelBufferInfo.offset = 0;
-		//modelBufferInfo.range = modelUniformAlignment;
-
-		//VkWriteDescriptorSet modelSetWrite = {};
-		//modelSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		//modelSetWrite.dstSet = this->vkDescriptorSets[i];
-		//modelSetWrite.dstBinding = 1;
-		//modelSetWrite.dstArrayElement = 0;
-		//modelSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-		//modelSetWrite.descriptorCount = 1;
-		//modelSetWrite.pBufferInfo = &modelBufferInfo;
-		//std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite, modelSetWrite };
-
-		std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite};
-
-		vkUpdateDescriptorSets(this->vkLogicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
-	}
-}
-
-void VulkanRenderer::createPushConstantRange()
-{
-	// Defines push constant values
-	this->vkPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	this->vkPushConstantRange.offset = 0;
-	this->vkPushConstantRange.size = sizeof(glm::mat4);
 }
-	
 
 VkSurfaceFormatKHR VulkanRenderer::defineSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats)
 {
@@ -965,133 +1081,368 @@ VkSurfaceFormatKHR VulkanRenderer::defineSurfaceFormat(const std::vector<VkSurfa
 	return formats[0];
 }
 
-void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::updateUniformBuffers()
 {
 	UboProjectionView mvp = {};
 	mvp.projection = this->projectionMat;
 	mvp.view = this->viewMat;
 
-	// Copy uniform data (view projection matrices)
-	void* data;
-	vkMapMemory(this->vkLogicalDevice, uniformBuffersMemory[imageIndex], 0, sizeof(UboProjectionView), 0, &data);
-	memcpy(data, &mvp, sizeof(UboProjectionView));
-	vkUnmapMemory(this->vkLogicalDevice, uniformBuffersMemory[imageIndex]);
-
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	//// Copy dynamic uniform data (model transform matrix)
-	//int modelCount = 0;
-	//for (auto pair : meshesToRender)
-	//{
-	//	VkMesh mesh = pair.second;
-	//	UboModel* thisModel = (UboModel*)((uint64_t)modelTransferSpace + (modelCount * modelUniformAlignment));
-	//	*thisModel = mesh.getModelMatrix();
-	//	modelCount++;
-	//}
-	//vkMapMemory(this->vkLogicalDevice, uniformBuffersMemoryDynamic[imageIndex], 0, modelUniformAlignment * meshesToRender.size(), 0, &data);
-	//memcpy(data, modelTransferSpace, modelUniformAlignment * meshesToRender.size());
-	//vkUnmapMemory(this->vkLogicalDevice, uniformBuffersMemoryDynamic[imageIndex]);
-}
-
-// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-//void VulkanRenderer::allocateDynamicBufferTransferSpace()
-//{
-//	// Calculate alignbment of model data
-//	modelUniformAlignment = (sizeof(UboModel) + minUniformBufferOffset - 1) & ~(minUniformBufferOffset - 1);
-//
-//	// Create space in memory to hold dynamic buffer that is alighned to our required alignment and holds MAX_OBJECTS
-//	modelTransferSpace = (UboModel*)_aligned_malloc(modelUniformAlignment * MAX_OBJECTS, modelUniformAlignment);
-//}
+	// Copy uniform data (view projection matrices) straight to mapped ring memory
+	this->viewProjectionOffset = this->uniformRing.push(mvp);
+}
 
-void VulkanRenderer::recordCommands(uint32_t currentImage)
+void VulkanRenderer::buildDrawList()
 {
-	VkCommandBufferBeginInfo bufferBeginInfo = {};
-	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	// Frame's slice of object buffer holds every mesh of the scene (draw() reserved it), descriptor range covers whole slice
+	uint32_t frameIndex = this->frameScheduler.getFrameIndex();
+	ObjectData* objects = reinterpret_cast<ObjectData*>(this->objectBufferData + frameIndex * this->objectSliceSize);
+	this->objectDataOffset = static_cast<uint32_t>(frameIndex * this->objectSliceSize);
 
-	// Information about how to begin a render pass (only required for graphical apps)
-	VkRenderPassBeginInfo renderPassBeginInfo = {};
-	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = this->vkRenderPass;
-	renderPassBeginInfo.renderArea.offset = { 0,0 };						// start point of render pass
-	renderPassBeginInfo.renderArea.extent = swapChainExtent;
-	
-	auto backgroundColor = getRGBANormalized(BACKGROUND_COLOR);
-	std::array<VkClearValue, 2> clearValues = {};
-	clearValues[0].color = {  backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3] };
-	clearValues[1].depthStencil.depth = 1.0f;
+	float aspect = (float)this->swapChainExtent.width / (float)this->swapChainExtent.height;
+	this->cascadedShadows.beginFrame(this->viewMat, glm::radians(CAMERA_FOV), aspect, CAMERA_NEAR_PLANE);
+	this->clusterCulling.beginFrame();
+	this->skinning.beginFrame(this->frameScheduler.getFrameIndex());
 
-	renderPassBeginInfo.pClearValues = clearValues.data();							// list of clear values
-	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	this->drawList.clear();
+	this->impostorDraws.clear();
 
-	renderPassBeginInfo.framebuffer = this->vkSwapchainFramebuffers[currentImage];
+	// Meshes moved since last frame get better places in scene BVH, a few per frame
+	this->sceneBvh.optimize();
 
-	// Start recording commands to command buffer 
-	VkResult result = vkBeginCommandBuffer(this->vkCommandBuffers[currentImage], &bufferBeginInfo);
-	if (result != VK_SUCCESS)
+	// Occluder depth is complete before the first box test, so hidden meshes are dropped in the frame they get hidden
+	this->occlusionCulledCount = 0;
+	if (this->softwareOcclusionEnabled)
 	{
-		throw runtime_error("Failed to start recording a command buffer.");
+		this->softwareOcclusion.rasterize(this->projectionMat * this->viewMat, CAMERA_NEAR_PLANE);
 	}
-
-	// Begin render pass
-	vkCmdBeginRenderPass(this->vkCommandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);;
-
-	// bind pipeline to be used with render pass
-	vkCmdBindPipeline(this->vkCommandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkGraphicsPipeline);
-
-	int meshCount = 0;
-	for (auto modelKeyValue : modelsToRender)
+	float pixelsPerUnit = this->swapChainExtent.height / (2.0f * std::tan(glm::radians(CAMERA_FOV) * 0.5f));
+	uint32_t objectCount = 0;
+	for (auto& modelKeyValue : modelsToRender)
 	{
-		for (auto meshKeyValue : modelKeyValue.second)
+		// Model whose bounds cover fewer pixels than one baked view is drawn as its impostor (meshes of a model share transform,
+		// impostor takes object data of the first one). Meshes still cast shadows, cached cascades don't redraw them anyway
+		bool drawImpostor = false;
+		auto impostor = this->modelImpostors.find(modelKeyValue.first);
+		if (this->impostorsEnabled && impostor != this->modelImpostors.end() && !modelKeyValue.second.empty())
 		{
-			VkMesh mesh = meshKeyValue.second;
-
-			VkBuffer vertexBuffers[] = { mesh.getVertexBuffer() };															// buffers to bind
-			VkBuffer indexBuffer = mesh.getIndexBuffer();
-			VkDeviceSize offsets[] = { 0 };																					// offsets into buffers being bound
-			vkCmdBindVertexBuffers(this->vkCommandBuffers[currentImage], 0, 1, vertexBuffers, offsets);								// Command to bind vertex buffer before deawing with them
-			vkCmdBindIndexBuffer(this->vkCommandBuffers[currentImage], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
-			// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-			//// Dynamic offset amount
-			//uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAlignment) * meshCount;
-			//vkCmdBindDescriptorSets(this->vkCommandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkPipelineLayout,
-			//	0, 1, &this->vkDescriptorSets[currentImage], 1, &dynamicOffset);
+			glm::mat4 transform = modelKeyValue.second.begin()->second.getTransformMat();
+			glm::vec3 boundsCenter;
+			float boundsRadius;
+			this->impostorBaker.getBounds(impostor->second, &boundsCenter, &boundsRadius);
+			float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+			float viewDepth = -(this->viewMat * transform * glm::vec4(boundsCenter, 1.0f)).z;
+			float radius = boundsRadius * scale;
+			drawImpostor = viewDepth > radius && 2.0f * radius / viewDepth * pixelsPerUnit < IMPOSTOR_SCREEN_SIZE;
+			if (drawImpostor)
+			{
+				this->impostorDraws.push_back({ impostor->second, objectCount, viewDepth });
+			}
+		}
 
-			glm::mat4 meshTransform = mesh.getTransformMat();
-			vkCmdPushConstants(this->vkCommandBuffers[currentImage], this->vkPipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &meshTransform);
+		for (auto& meshKeyValue : modelKeyValue.second)
+		{
+			VkMesh& mesh = meshKeyValue.second;
+			glm::mat4 transform = mesh.getTransformMat();
+			objects[objectCount].model = transform;
+			objects[objectCount].lightmapTexture = this->lightmapsEnabled ? mesh.getLightmapTexture() : -1;
+			objects[objectCount].lightmapScale = mesh.getLightmapScale();
+
+			// Skinned mesh bounds follow its pose
+			int skinIndex = mesh.getSkinIndex();
+			glm::vec3 boundsCenter = mesh.getBoundsCenter();
+			float boundsRadius = mesh.getBoundsRadius();
+			glm::vec3 boundsMin = mesh.getBoundsMin();
+			glm::vec3 boundsMax = mesh.getBoundsMax();
+			if (skinIndex >= 0)
+			{
+				this->skinning.getBounds(skinIndex, &boundsCenter, &boundsRadius);
+				boundsMin = boundsCenter - glm::vec3(boundsRadius);
+				boundsMax = boundsCenter + glm::vec3(boundsRadius);
+				updateSceneBvh(&mesh, boundsMin, boundsMax);
+			}
 
-			if (mesh.getTextureIndex() > -1)
+			// Hidden meshes still cast shadows (and skinned ones are still skinned for them)
+			bool occluded = false;
+			if (this->softwareOcclusionEnabled && !drawImpostor && !this->softwareOcclusion.isVisible(transform, boundsMin, boundsMax))
 			{
-				std::array<VkDescriptorSet, 2> descriptorSets = { this->vkDescriptorSets[currentImage],
-					this->vkSamplerDescriptorSets[mesh.getTextureIndex()] };
+				occluded = true;
+				this->occlusionCulledCount++;
+			}
 
-				vkCmdBindDescriptorSets(this->vkCommandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkPipelineLayout,
-					0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+			// Distance of bounds center along view direction (camera looks down -Z in view space)
+			glm::vec4 viewCenter = this->viewMat * transform * glm::vec4(boundsCenter, 1.0f);
+
+			DrawCommand draw = {};
+			// Specialized material pipeline once compiled, generic one meanwhile (pipelines share layout, so bound sets stay valid)
+			draw.pipeline = getMaterialPipeline(mesh.getTextureIndex());
+			draw.vertexBuffer = mesh.getVertexBuffer();
+			draw.positionBuffer = mesh.getPositionBuffer();
+			draw.indexBuffer = mesh.getIndexBuffer();
+			draw.indexCount = static_cast<uint32_t>(mesh.getIndexCount());
+			draw.vertexOffset = -MESH_INDEX_BASE;
+			draw.textureIndex = mesh.getTextureIndex();
+			draw.objectIndex = objectCount;
+			if (skinIndex >= 0)
+			{
+				// Drawn from this frame's skinning output (meshlet bounds are in bind pose, so skinned draws aren't cluster culled)
+				draw.vertexBuffer = this->skinning.getVertexBuffer();
+				draw.positionBuffer = this->skinning.getPositionBuffer();
+				draw.vertexOffset = this->skinning.addDraw(skinIndex) - MESH_INDEX_BASE;
+			}
+			else if (this->clusterCullingEnabled && !drawImpostor && !occluded)
+			{
+				// Draws past culling capacity of the frame are drawn whole
+				this->clusterCulling.addDraw(&draw, mesh.getMeshletOffset(), mesh.getMeshletCount());
 			}
-			else
+			if (!drawImpostor && !occluded)
 			{
-				vkCmdBindDescriptorSets(this->vkCommandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkPipelineLayout,
-					0, 1, &this->vkDescriptorSets[currentImage], 0, nullptr);
+				this->drawList.add(draw, -viewCenter.z);
 			}
 
-			// execute pipeline
-			vkCmdDrawIndexed(this->vkCommandBuffers[currentImage], static_cast<uint32_t>(mesh.getIndexCount()), 1, 0, -1, 0);
+			// Bounds scaled by largest axis scale of transform
+			float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+			glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(boundsCenter, 1.0f));
+			this->cascadedShadows.addCaster(draw, transform, worldCenter, boundsRadius * scale, skinIndex >= 0);
 
-			meshCount++;
+			objectCount++;
 		}
 	}
 
-	// End render pass
-	vkCmdEndRenderPass(this->vkCommandBuffers[currentImage]);
+	this->drawList.sort();
+	std::sort(this->impostorDraws.begin(), this->impostorDraws.end(),
+		[](const ImpostorDraw& a, const ImpostorDraw& b) { return a.viewDepth < b.viewDepth; });
+	this->cascadedShadows.endFrame();
+	this->skinning.endFrame();
+	if (this->clusterCullingEnabled)
+	{
+		this->clusterCulling.endFrame(this->frameScheduler.getFrameIndex(), this->viewMat, this->projectionMat, CAMERA_NEAR_PLANE, this->objectDataOffset);
+	}
+}
+
+void VulkanRenderer::recordCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	// Start recording commands to command buffer 
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to start recording a command buffer.");
+	}
+
+	// Statistics query of this frame slot is reused, reset must happen outside of render pass
+	if (this->pipelineStatisticsSupported)
+	{
+		vkCmdResetQueryPool(commandBuffer, this->vkStatisticsQueryPool, this->frameScheduler.getFrameIndex(), 1);
+	}
+
+	// Graph is declared per frame (backbuffer differs), barriers and render pass begin/end are recorded by graph
+	buildRenderGraph(imageIndex, this->renderPath, this->depthPrepassEnabled, this->clusterCullingEnabled);
+	this->renderGraph.execute(commandBuffer);
 
 	// Stop recording commands to command buffer 
-	result = vkEndCommandBuffer(this->vkCommandBuffers[currentImage]);
+	result = vkEndCommandBuffer(commandBuffer);
 	if (result != VK_SUCCESS)
 	{
 		throw runtime_error("Failed to stop recording a command buffer.");
 	}
 }
 
+void VulkanRenderer::recordShadows(VkCommandBuffer commandBuffer)
+{
+	for (int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+	{
+		if (!this->cascadedShadows.isCascadeDirty(i))
+		{
+			continue;
+		}
+
+		// Viewport and scissor limit cascade to its tile, so clear and draws leave cached tiles intact
+		VkRect2D rect = this->cascadedShadows.getCascadeRect(i);
+		VkViewport viewport = {};
+		viewport.x = (float)rect.offset.x;
+		viewport.y = (float)rect.offset.y;
+		viewport.width = (float)rect.extent.width;
+		viewport.height = (float)rect.extent.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &rect);
+
+		VkClearAttachment clearAttachment = {};
+		clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		clearAttachment.clearValue.depthStencil = { 1.0f, 0 };
+		VkClearRect clearRect = {};
+		clearRect.rect = rect;
+		clearRect.baseArrayLayer = 0;
+		clearRect.layerCount = 1;
+		vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, 1, &clearRect);
+
+		bindSceneDescriptorSets(commandBuffer, this->cascadedShadows.getCascadeViewProjectionOffset(i));
+		this->cascadedShadows.getCascadeDrawList(i).recordDepth(commandBuffer, this->vkShadowPipeline);
+	}
+}
+
+void VulkanRenderer::recordDepthPrepass(VkCommandBuffer commandBuffer)
+{
+	bindSceneDescriptorSets(commandBuffer, this->viewProjectionOffset);
+	this->drawList.recordDepth(commandBuffer, this->vkDepthPipeline);
+	recordImpostors(commandBuffer, this->vkImpostorDepthPipeline);
+}
+
+void VulkanRenderer::recordScene(VkCommandBuffer commandBuffer)
+{
+	bindSceneDescriptorSets(commandBuffer, this->viewProjectionOffset);
+
+	// Fragment shader invocations show how much overdraw prepass removes
+	uint32_t frameIndex = this->frameScheduler.getFrameIndex();
+	if (this->pipelineStatisticsSupported)
+	{
+		vkCmdBeginQuery(commandBuffer, this->vkStatisticsQueryPool, frameIndex, 0);
+	}
+
+	if (this->clusterCullingEnabled)
+	{
+		IndirectDrawSource indirectSource = this->clusterCulling.getIndirectSource();
+		this->drawList.record(commandBuffer, this->vkPipelineLayout, this->vkPushConstantRange.stageFlags, &indirectSource);
+	}
+	else
+	{
+		this->drawList.record(commandBuffer, this->vkPipelineLayout, this->vkPushConstantRange.stageFlags);
+	}
+
+	// Impostors write the same targets as material pipelines of current mode (G-buffer, color after prepass or plain color)
+	VkPipeline impostorPipeline = this->vkImpostorPipeline;
+	if (this->renderPath == RENDER_PATH_DEFERRED)
+	{
+		impostorPipeline = this->vkGBufferImpostorPipeline;
+	}
+	else if (this->depthPrepassEnabled)
+	{
+		impostorPipeline = this->vkPrepassImpostorPipeline;
+	}
+	recordImpostors(commandBuffer, impostorPipeline);
+
+	if (this->pipelineStatisticsSupported)
+	{
+		vkCmdEndQuery(commandBuffer, this->vkStatisticsQueryPool, frameIndex);
+		this->statisticsQueryWritten[frameIndex] = true;
+	}
+}
+
+void VulkanRenderer::recordDeferredLighting(VkCommandBuffer commandBuffer, RenderGraphResource albedo, RenderGraphResource normal, RenderGraphResource lighting,
+	RenderGraphResource depth)
+{
+	// Views of transient G-buffer change whenever graph replans its transients, so set is written every frame
+	VkDescriptorSet gbufferSet = this->descriptorAllocator.allocateFrame(this->frameScheduler.getFrameIndex(), this->vkGBufferDescriptorSetLayout);
+
+	std::array<RenderGraphResource, 4> gbuffer = { albedo, normal, lighting, depth };
+	std::array<VkDescriptorImageInfo, 4> imageInfos = {};
+	std::array<VkWriteDescriptorSet, 4> setWrites = {};
+	for (uint32_t i = 0; i < gbuffer.size(); i++)
+	{
+		imageInfos[i].imageView = this->renderGraph.getImageView(gbuffer[i]);
+		imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;		// layout graph gives input attachments
+
+		setWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[i].dstSet = gbufferSet;
+		setWrites[i].dstBinding = i;
+		setWrites[i].descriptorCount = 1;
+		setWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		setWrites[i].pImageInfo = &imageInfos[i];
+	}
+	vkUpdateDescriptorSets(this->vkLogicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+	bindSceneDescriptorSets(commandBuffer, this->viewProjectionOffset);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkPipelineLayout,
+		2, 1, &gbufferSet, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkDeferredLightingPipeline);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void VulkanRenderer::addParticlePass(const ParticleStreams& particles, RenderGraphResource backbuffer, RenderGraphResource depth,
+	RenderPath renderPath, bool depthPrepass)
+{
+	// Blended over shaded image and tested against final depth, so pass becomes last subpass of color render pass
+	RenderGraphPass& particlePass = this->renderGraph.addGraphicsPass("particles");
+	particlePass.writeColor(backbuffer);
+	particlePass.readDepth(depth);
+	particlePass.readIndirect(particles.state);
+	particlePass.readStorage(particles.state, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+	particlePass.readStorage(particles.particles, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+	particlePass.setExecute([this, renderPath, depthPrepass](VkCommandBuffer commandBuffer)
+	{
+		recordParticles(commandBuffer, renderPath, depthPrepass);
+	});
+}
+
+void VulkanRenderer::recordParticles(VkCommandBuffer commandBuffer, RenderPath renderPath, bool depthPrepass)
+{
+	VkPipeline pipeline = this->vkParticlePipeline;
+	if (renderPath == RENDER_PATH_DEFERRED)
+	{
+		pipeline = this->vkDeferredParticlePipeline;
+	}
+	else if (depthPrepass)
+	{
+		pipeline = this->vkPrepassParticlePipeline;
+	}
+
+	// Scene set provides camera, particle count is known on GPU only
+	bindSceneDescriptorSets(commandBuffer, this->viewProjectionOffset);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	this->particleSystem.recordDraw(commandBuffer, this->vkPipelineLayout);
+}
+
+void VulkanRenderer::recordImpostors(VkCommandBuffer commandBuffer, VkPipeline pipeline)
+{
+	if (this->impostorDraws.empty())
+	{
+		return;
+	}
+
+	// Scene sets are bound by the pass already, every impostor pushes its bounds and atlases
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	for (const auto& draw : this->impostorDraws)
+	{
+		this->impostorBaker.recordDraw(commandBuffer, this->vkPipelineLayout, this->vkPushConstantRange.stageFlags, draw);
+	}
+}
+
+void VulkanRenderer::bindSceneDescriptorSets(VkCommandBuffer commandBuffer, uint32_t viewProjectionOffset)
+{
+	// Sets are bound once per pass, draws differ only by state the draw list rebinds when it changes
+	// (passes rendering from another camera, e.g. shadow cascades, pass their own view projection)
+	std::array<uint32_t, 5> dynamicOffsets = { viewProjectionOffset, this->objectDataOffset,
+		this->clusteredLighting.getLightBufferOffset(), this->clusteredLighting.getClusterBufferOffset(),
+		this->cascadedShadows.getShadowDataOffset() };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkPipelineLayout,
+		0, 1, &this->vkDescriptorSet, static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+	// All textures are bound once, meshes select their texture through push constant index
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->vkPipelineLayout,
+		1, 1, &this->vkBindlessDescriptorSet, 0, nullptr);
+}
+
+void VulkanRenderer::readPipelineStatistics(uint32_t frameIndex)
+{
+	if (!this->pipelineStatisticsSupported || !this->statisticsQueryWritten[frameIndex])
+	{
+		return;
+	}
+
+	// Frame slot has completed on GPU, so result is available without waiting
+	uint64_t invocations = 0;
+	VkResult result = vkGetQueryPoolResults(this->vkLogicalDevice, this->vkStatisticsQueryPool, frameIndex, 1,
+		sizeof(uint64_t), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result == VK_SUCCESS)
+	{
+		this->fragmentInvocations = invocations;
+	}
+}
+
 VkPresentModeKHR VulkanRenderer::definePresentationMode(const std::vector<VkPresentModeKHR> presentationModes)
 {
 	// Look for Mailbox presentation mode
@@ -1135,6 +1486,120 @@ VkExtent2D VulkanRenderer::defineSwapChainExtent(const VkSurfaceCapabilitiesKHR&
 	}
 }
 
+void VulkanRenderer::waitForCurrentFrame()
+{
+	// Blocks until GPU is done with the frame slot that is going to be drawn next (same wait draw() does)
+	this->frameScheduler.waitForCurrentFrame();
+}
+
+void VulkanRenderer::setFramesInFlight(uint32_t framesInFlight)
+{
+	// More frames in flight gives GPU more queued work (throughput), less frames lowers input to display latency
+	this->frameScheduler.setFramesInFlight(framesInFlight);
+	this->descriptorAllocator.setFrameCount(framesInFlight);
+}
+
+double VulkanRenderer::getCpuWaitTime()
+{
+	return this->frameScheduler.getLastCpuWaitTime();
+}
+
+DrawListStats VulkanRenderer::getDrawStats()
+{
+	return this->drawList.getStats();
+}
+
+void VulkanRenderer::setDepthPrepass(bool enabled)
+{
+	// Takes effect with next recorded frame, both modes have their pipelines ready
+	this->depthPrepassEnabled = enabled;
+}
+
+bool VulkanRenderer::isDepthPrepassEnabled()
+{
+	return this->depthPrepassEnabled;
+}
+
+void VulkanRenderer::setRenderPath(RenderPath renderPath)
+{
+	// Takes effect with next recorded frame, pipelines of both paths are ready
+	this->renderPath = renderPath;
+}
+
+RenderPath VulkanRenderer::getRenderPath()
+{
+	return this->renderPath;
+}
+
+void VulkanRenderer::setClusterCulling(bool enabled)
+{
+	// Takes effect with next recorded frame, pyramid kept from earlier frames is used with the camera it was built with
+	this->clusterCullingEnabled = enabled;
+}
+
+bool VulkanRenderer::isClusterCullingEnabled()
+{
+	return this->clusterCullingEnabled;
+}
+
+void VulkanRenderer::setImpostors(bool enabled)
+{
+	// Takes effect with next draw list, models keep their baked atlases while impostors are off
+	this->impostorsEnabled = enabled;
+}
+
+bool VulkanRenderer::isImpostorsEnabled()
+{
+	return this->impostorsEnabled;
+}
+
+void VulkanRenderer::setLightmaps(bool enabled)
+{
+	// Takes effect with next draw list, lightmapped meshes fall back to dynamic sun and sky while lightmaps are off
+	this->lightmapsEnabled = enabled;
+}
+
+bool VulkanRenderer::isLightmapsEnabled()
+{
+	return this->lightmapsEnabled;
+}
+
+void VulkanRenderer::setSoftwareOcclusion(bool enabled)
+{
+	// Takes effect with next draw list
+	this->softwareOcclusionEnabled = enabled;
+}
+
+bool VulkanRenderer::isSoftwareOcclusionEnabled()
+{
+	return this->softwareOcclusionEnabled;
+}
+
+int VulkanRenderer::getOcclusionCulledCount()
+{
+	return static_cast<int>(this->occlusionCulledCount);
+}
+
+int VulkanRenderer::getImpostorCount()
+{
+	return static_cast<int>(this->impostorDraws.size());
+}
+
+uint64_t VulkanRenderer::getFragmentInvocations()
+{
+	return this->fragmentInvocations;
+}
+
+int VulkanRenderer::getRenderedShadowCascades()
+{
+	return this->cascadedShadows.getRenderedCascadeCount();
+}
+
+void VulkanRenderer::setDirectionalLight(glm::vec3 direction)
+{
+	this->cascadedShadows.setLightDirection(direction);
+}
+
 void VulkanRenderer::draw()
 {
 	// 1 Get next available image to draw to and set something to signal when we're finished with the image (a semaphore)
@@ -1142,55 +1607,47 @@ void VulkanRenderer::draw()
 	// and signals when it ahas finished rendering
 	// 3 Present image to screen when it has signalled finished rendering
 
-	// Wait for given fence to signal open from last draw before continuing
-	vkWaitForFences(this->vkLogicalDevice, 1, &vkDrawFences[currentFrame], VK_TRUE, numeric_limits<uint64_t>::max());
-	// Reset fence
-	vkResetFences(this->vkLogicalDevice, 1, &vkDrawFences[currentFrame]);
+	// Wait until GPU finished previous frame that used this slot (timeline semaphore reached slot's value)
+	FrameContext& frame = this->frameScheduler.beginFrame();
+	uint32_t frameIndex = this->frameScheduler.getFrameIndex();
+
+	// GPU is done with this frame, so its transient descriptor sets and uniform data can be recycled
+	this->descriptorAllocator.resetFrame(frameIndex);
+	this->uniformRing.beginFrame(frameIndex);
+	reserveObjects();
+	readPipelineStatistics(frameIndex);
+
+	reloadChangedShaders();
 
 	// -- 1
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(this->vkLogicalDevice, this->vkSwapchain, numeric_limits<uint64_t>::max(), this->vkSemImageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	vkAcquireNextImageKHR(this->vkLogicalDevice, this->vkSwapchain, numeric_limits<uint64_t>::max(), frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
 
-	recordCommands(imageIndex);
-	updateUniformBuffers(imageIndex);
+	// Uniforms and draw list first, recorded draws reference their ring offsets
+	updateUniformBuffers();
+	this->clusteredLighting.update(frameIndex, this->viewMat, this->projectionMat, this->swapChainExtent, CAMERA_NEAR_PLANE);
+	this->particleSystem.update(this->particleTimeStep);
+	this->particleTimeStep = 0.0f;
+	buildDrawList();
+	recordCommands(frame.commandBuffer, imageIndex);
 
 	// -- 2
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;									// num of semaphores to wait for
-	submitInfo.pWaitSemaphores = &vkSemImageAvailable[currentFrame];					// list of semaphores
-	VkPipelineStageFlags waitStages[] = {				
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-	};
-	submitInfo.pWaitDstStageMask = waitStages;							// stages to check semaphores at
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &this->vkCommandBuffers[imageIndex];
-	submitInfo.signalSemaphoreCount = 1;								// number of semaphores to signal
-	submitInfo.pSignalSemaphores = &this->vkSemRenderFinished[currentFrame];
-
-	VkResult result = vkQueueSubmit(this->vkGraphicsQueue, 1, &submitInfo, vkDrawFences[currentFrame]);
-	if (result != VK_SUCCESS)
-	{
-		throw runtime_error("Failed to submit Comand buffer to Graphics Queue.");
-	}
+	this->frameScheduler.submitFrame(this->vkGraphicsQueue, this->vkSemRenderFinished[imageIndex], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 
 	// -- 3
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &vkSemRenderFinished[currentFrame];
+	presentInfo.pWaitSemaphores = &vkSemRenderFinished[imageIndex];
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = &this->vkSwapchain;
 	presentInfo.pImageIndices = &imageIndex;					// index of images in swapchain to present
 
-	result = vkQueuePresentKHR(this->vkPresentationQueue, &presentInfo);
+	VkResult result = vkQueuePresentKHR(this->vkPresentationQueue, &presentInfo);
 	if (result != VK_SUCCESS)
 	{
 		throw runtime_error("Failed to present image.");
 	}
-
-	// Get next frame (use % MAX_FRAME_DRAWS to keep value below MAX_FRAME_DRAWS)
-	currentFrame = (currentFrame + 1) % MAX_FRAME_DRAWS;
 }
 
 
@@ -1238,6 +1695,8 @@ bool VulkanRenderer::addToRenderer(int modelId, int meshCount, Mesh* meshList, g
 			auto meshIndices = mesh->getIndices();
 			auto meshTexCoords = mesh->getTexCoords();
 			auto meshNormals = mesh->getNormals();
+			auto meshOcclusion = mesh->getAmbientOcclusion();
+			auto meshLightmapUvs = mesh->getLightmapUvs();
 			for (int i = 0; i < meshVertices.size(); i++)
 			{
 				Vertex vertex = {};
@@ -1245,13 +1704,27 @@ bool VulkanRenderer::addToRenderer(int modelId, int meshCount, Mesh* meshList, g
 				vertex.color = color;
 				vertex.normal = meshNormals[i];
 				vertex.uv = meshTexCoords[i];
+				vertex.occlusion = meshOcclusion.empty() ? 1.0f : meshOcclusion[i];
+				vertex.lightmapUv = meshLightmapUvs.empty() ? glm::vec2(0.0f) : meshLightmapUvs[i];
 				vertices.push_back(vertex);
 			}
 			newMesh = VkMesh(this->vkPhysicalDevice, this->vkLogicalDevice,
 				this->vkGraphicsQueue, this->vkGraphicsCommandPool, &vertices, &meshIndices, -1);
 			newMesh.setTransformMat(glm::identity<glm::mat4>());
+			newMesh.setMeshletOffset(this->clusterCulling.addMeshlets(newMesh.getMeshlets()));
+			if (mesh->hasLightmap())
+			{
+				newMesh.setLightmap(createLightmapTexture(mesh->getLightmap()), mesh->getLightmap().scale);
+			}
+			if (mesh->hasSkin())
+			{
+				newMesh.setSkinIndex(this->skinning.addSkin(vertices, mesh->getJointIndices(), mesh->getJointWeights(),
+					mesh->getSkinJoints(), mesh->getInverseBindMatrices()));
+			}
 			modelsToRender[modelId][mesh->id] = newMesh;
+			addToSceneBvh(modelId, mesh);
 		}
+		createModelImpostor(modelId);
 
 		return true;
 	}
@@ -1273,6 +1746,8 @@ bool VulkanRenderer::addToRendererTextured(int modelId, int meshCount, Mesh* mes
 			auto meshIndices = mesh->getIndices();
 			auto meshTexCoords = mesh->getTexCoords();
 			auto meshNormals = mesh->getNormals();
+			auto meshOcclusion = mesh->getAmbientOcclusion();
+			auto meshLightmapUvs = mesh->getLightmapUvs();
 
 			for (int i = 0; i < meshVertices.size(); i++)
 			{
@@ -1280,6 +1755,8 @@ bool VulkanRenderer::addToRendererTextured(int modelId, int meshCount, Mesh* mes
 				vertex.pos = meshVertices[i];
 				vertex.normal = meshNormals[i];
 				vertex.uv = meshTexCoords[i];
+				vertex.occlusion = meshOcclusion.empty() ? 1.0f : meshOcclusion[i];
+				vertex.lightmapUv = meshLightmapUvs.empty() ? glm::vec2(0.0f) : meshLightmapUvs[i];
 				vertices.push_back(vertex);
 			}
 			int textureDescriptorIndex = -1;
@@ -1290,8 +1767,20 @@ bool VulkanRenderer::addToRendererTextured(int modelId, int meshCount, Mesh* mes
 			newMesh = VkMesh(this->vkPhysicalDevice, this->vkLogicalDevice,
 				this->vkGraphicsQueue, this->vkGraphicsCommandPool, &vertices, &meshIndices, textureDescriptorIndex);
 			newMesh.setTransformMat(glm::identity<glm::mat4>());
+			newMesh.setMeshletOffset(this->clusterCulling.addMeshlets(newMesh.getMeshlets()));
+			if (mesh->hasLightmap())
+			{
+				newMesh.setLightmap(createLightmapTexture(mesh->getLightmap()), mesh->getLightmap().scale);
+			}
+			if (mesh->hasSkin())
+			{
+				newMesh.setSkinIndex(this->skinning.addSkin(vertices, mesh->getJointIndices(), mesh->getJointWeights(),
+					mesh->getSkinJoints(), mesh->getInverseBindMatrices()));
+			}
 			modelsToRender[modelId][mesh->id] = newMesh;
+			addToSceneBvh(modelId, mesh);
 		}
+		createModelImpostor(modelId);
 		return true;
 	}
 
@@ -1306,6 +1795,46 @@ bool VulkanRenderer::updateModelTransform(int modelId, glm::mat4 newTransform)
 		{
 			auto& mesh = meshKeyValue.second;
 			mesh.setTransformMat(newTransform);
+			// Skinned meshes follow their pose bounds, updated while the draw list is built
+			if (mesh.getSkinIndex() < 0)
+			{
+				updateSceneBvh(&mesh, mesh.getBoundsMin(), mesh.getBoundsMax());
+			}
+		}
+		this->softwareOcclusion.setOccluderTransform(modelId, newTransform);
+		return true;
+	}
+
+	return false;
+}
+
+bool VulkanRenderer::setModelOccluder(int modelId, Mesh* occluder)
+{
+	auto model = modelsToRender.find(modelId);
+	if (model == modelsToRender.end() || model->second.empty())
+	{
+		return false;
+	}
+
+	// Occluder stands for the model's surface, so it has to lie inside of it (otherwise visible meshes get culled)
+	this->softwareOcclusion.removeOccluder(modelId);
+	this->softwareOcclusion.addOccluder(modelId, occluder->getVertices(), occluder->getIndices(), MESH_INDEX_BASE);
+	this->softwareOcclusion.setOccluderTransform(modelId, model->second.begin()->second.getTransformMat());
+	return true;
+}
+
+bool VulkanRenderer::updateModelPose(int modelId, const std::vector<glm::mat4>& jointTransforms)
+{
+	if (modelsToRender.find(modelId) != modelsToRender.end())
+	{
+		// Skin matrices are uploaded with the next frame's draw list
+		for (auto& meshKeyValue : modelsToRender[modelId])
+		{
+			auto& mesh = meshKeyValue.second;
+			if (mesh.getSkinIndex() >= 0)
+			{
+				this->skinning.setPose(mesh.getSkinIndex(), jointTransforms);
+			}
 		}
 		return true;
 	}
@@ -1317,13 +1846,183 @@ bool VulkanRenderer::removeFromRenderer(int modelId)
 {
 	if (modelsToRender.find(modelId) != modelsToRender.end())
 	{
+		for (auto& meshKeyValue : modelsToRender[modelId])
+		{
+			if (meshKeyValue.second.getSceneProxy() >= 0)
+			{
+				this->sceneBvh.removeObject(meshKeyValue.second.getSceneProxy());
+			}
+			this->meshTriangleBvhs.erase(getSceneObject(modelId, meshKeyValue.first));
+		}
 		modelsToRender[modelId].clear();
+		modelImpostors.erase(modelId);
+		this->softwareOcclusion.removeOccluder(modelId);
 		return true;
 	}
 
 	return false;
 }
 
+bool VulkanRenderer::pickRay(glm::vec3 origin, glm::vec3 direction, float maxDistance, PickHit* hit)
+{
+	// Boxes are visited near to far, each found hit shortens the ray. Triangles are hit in mesh space, where the ray keeps
+	// its parameter (direction is transformed along with origin and isn't normalized again)
+	bool found = false;
+	this->sceneBvh.queryRay(origin, direction, maxDistance, [&](uint64_t object, float boxDistance)
+	{
+		int modelId = static_cast<int>(object >> 32);
+		int meshId = static_cast<int>(object & UINT32_MAX);
+		float closest = found ? hit->distance : maxDistance;
+		auto triangles = this->meshTriangleBvhs.find(object);
+		if (triangles == this->meshTriangleBvhs.end())
+		{
+			found = true;
+			*hit = { modelId, meshId, boxDistance, glm::vec3(0.0f), -glm::normalize(direction) };
+			return boxDistance;
+		}
+
+		glm::mat4 inverseTransform = glm::inverse(this->modelsToRender[modelId][meshId].getTransformMat());
+		RayHit triangleHit;
+		if (!triangles->second.intersect(glm::vec3(inverseTransform * glm::vec4(origin, 1.0f)), glm::vec3(inverseTransform * glm::vec4(direction, 0.0f)),
+			closest, &triangleHit))
+		{
+			return closest;
+		}
+		found = true;
+		*hit = { modelId, meshId, triangleHit.distance, glm::vec3(0.0f),
+			glm::normalize(glm::transpose(glm::mat3(inverseTransform)) * triangleHit.normal) };
+		return triangleHit.distance;
+	});
+
+	if (found)
+	{
+		hit->position = origin + direction * hit->distance;
+	}
+	return found;
+}
+
+bool VulkanRenderer::pickScreen(glm::vec2 position, PickHit* hit)
+{
+	// Projection is symmetric, pixel's view space direction only needs its scale (Y scale is negative like window Y axis)
+	glm::vec2 ndc = position / glm::vec2(this->swapChainExtent.width, this->swapChainExtent.height) * 2.0f - 1.0f;
+	glm::vec3 viewDirection = glm::vec3(ndc.x / this->projectionMat[0][0], ndc.y / this->projectionMat[1][1], -1.0f);
+	glm::mat4 cameraTransform = glm::inverse(this->viewMat);
+	return pickRay(glm::vec3(cameraTransform[3]), glm::normalize(glm::vec3(cameraTransform * glm::vec4(viewDirection, 0.0f))),
+		std::numeric_limits<float>::max(), hit);
+}
+
+void VulkanRenderer::queryBox(glm::vec3 boundsMin, glm::vec3 boundsMax, std::vector<MeshReference>* meshes)
+{
+	vector<uint64_t> objects;
+	this->sceneBvh.queryBox(boundsMin, boundsMax, &objects);
+	for (uint64_t object : objects)
+	{
+		meshes->push_back({ static_cast<int>(object >> 32), static_cast<int>(object & UINT32_MAX) });
+	}
+}
+
+void VulkanRenderer::queryFrustum(const glm::mat4& viewProjection, std::vector<MeshReference>* meshes)
+{
+	vector<uint64_t> objects;
+	this->sceneBvh.queryFrustum(viewProjection, &objects);
+	for (uint64_t object : objects)
+	{
+		meshes->push_back({ static_cast<int>(object >> 32), static_cast<int>(object & UINT32_MAX) });
+	}
+}
+
+bool VulkanRenderer::addLight(int lightId, const Light& light)
+{
+	return this->clusteredLighting.addLight(lightId, light);
+}
+
+bool VulkanRenderer::updateLight(int lightId, const Light& light)
+{
+	return this->clusteredLighting.updateLight(lightId, light);
+}
+
+bool VulkanRenderer::removeLight(int lightId)
+{
+	return this->clusteredLighting.removeLight(lightId);
+}
+
+bool VulkanRenderer::addParticleEmitter(int emitterId, const ParticleEmitter& emitter)
+{
+	return this->particleSystem.addEmitter(emitterId, emitter);
+}
+
+bool VulkanRenderer::updateParticleEmitter(int emitterId, const ParticleEmitter& emitter)
+{
+	return this->particleSystem.updateEmitter(emitterId, emitter);
+}
+
+bool VulkanRenderer::removeParticleEmitter(int emitterId)
+{
+	return this->particleSystem.removeEmitter(emitterId);
+}
+
+void VulkanRenderer::advanceParticles(float deltaTime)
+{
+	this->particleTimeStep += deltaTime;
+}
+
+void VulkanRenderer::createModelImpostor(int modelId)
+{
+	// Impostor shows model in its rest shape, so skinned models are always drawn whole
+	vector<VkMesh*> meshes;
+	for (auto& meshKeyValue : modelsToRender[modelId])
+	{
+		if (meshKeyValue.second.getSkinIndex() >= 0)
+		{
+			return;
+		}
+		meshes.push_back(&meshKeyValue.second);
+	}
+	if (meshes.empty())
+	{
+		return;
+	}
+
+	// Atlases are sampled from bindless array like any other texture
+	int impostor = this->impostorBaker.bake(meshes, this->vkBindlessDescriptorSet);
+	int albedoTexture = createTextureSamplerDescriptor(this->impostorBaker.getAlbedoView(impostor));
+	int normalTexture = createTextureSamplerDescriptor(this->impostorBaker.getNormalView(impostor));
+	this->impostorBaker.setTextures(impostor, albedoTexture, normalTexture);
+	modelImpostors[modelId] = impostor;
+}
+
+void VulkanRenderer::addToSceneBvh(int modelId, Mesh* mesh)
+{
+	// Static meshes get triangle BVH for exact picking, skinned ones change shape every frame and are picked by bounds
+	VkMesh& vkMesh = modelsToRender[modelId][mesh->id];
+	uint64_t object = getSceneObject(modelId, mesh->id);
+	if (vkMesh.getSkinIndex() < 0)
+	{
+		TriangleBvh& triangles = this->meshTriangleBvhs[object];
+		triangles.clear();
+		triangles.addTriangles(mesh->getVertices(), mesh->getIndices(), MESH_INDEX_BASE, glm::identity<glm::mat4>());
+		triangles.build();
+	}
+
+	// New meshes start at identity transform
+	vkMesh.setSceneProxy(this->sceneBvh.addObject(vkMesh.getBoundsMin(), vkMesh.getBoundsMax(), object));
+}
+
+void VulkanRenderer::updateSceneBvh(VkMesh* mesh, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	// World box around transformed box: center is transformed, half extent grows by absolute values of transform's axes
+	glm::mat4 transform = mesh->getTransformMat();
+	glm::vec3 center = glm::vec3(transform * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+	glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+	glm::vec3 worldHalfExtent = glm::abs(glm::vec3(transform[0])) * halfExtent.x + glm::abs(glm::vec3(transform[1])) * halfExtent.y
+		+ glm::abs(glm::vec3(transform[2])) * halfExtent.z;
+	this->sceneBvh.updateObject(mesh->getSceneProxy(), center - worldHalfExtent, center + worldHalfExtent);
+}
+
+uint64_t VulkanRenderer::getSceneObject(int modelId, int meshId)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(modelId)) << 32) | static_cast<uint32_t>(meshId);
+}
 
 VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
 {
@@ -1512,18 +2211,88 @@ int VulkanRenderer::createTexture(std::string fileName)
 	return descriptorIndex;
 }
 
+int VulkanRenderer::createLightmapTexture(const MeshLightmap& lightmap)
+{
+	// BC1 blocks are uploaded as they are, devices without BC sampling get them decoded to RGBA8 (same sRGB encoding)
+	VkFormat format = LIGHTMAP_FORMAT;
+	vector<uint8_t> decodedTexels;
+	const uint8_t* imageData = lightmap.blocks.data();
+	VkDeviceSize imageSize = lightmap.blocks.size();
+	if (!this->textureCompressionBCSupported)
+	{
+		format = LIGHTMAP_FALLBACK_FORMAT;
+		decodedTexels = LightmapBaker::decodeBlocks(lightmap);
+		imageData = decodedTexels.data();
+		imageSize = decodedTexels.size();
+	}
+
+	VkBuffer imageStagingBuffer;
+	VkDeviceMemory imageStagingBufferMemory;
+	createBuffer(this->vkPhysicalDevice, this->vkLogicalDevice, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &imageStagingBuffer, &imageStagingBufferMemory);
+
+	void* data;
+	vkMapMemory(this->vkLogicalDevice, imageStagingBufferMemory, 0, imageSize, 0, &data);
+	memcpy(data, imageData, static_cast<size_t>(imageSize));
+	vkUnmapMemory(this->vkLogicalDevice, imageStagingBufferMemory);
+
+	VkDeviceMemory texImageMemory;
+	VkImage texImage = createImage(lightmap.width, lightmap.height, format, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMemory);
+
+	// Copy extent is in texels for block compressed formats as well
+	transitionImageLayout(this->vkLogicalDevice, this->vkGraphicsQueue, this->vkGraphicsCommandPool,
+		texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	copyImageBuffer(this->vkLogicalDevice, vkGraphicsQueue, vkGraphicsCommandPool, imageStagingBuffer, texImage, lightmap.width, lightmap.height);
+	transitionImageLayout(this->vkLogicalDevice, this->vkGraphicsQueue, this->vkGraphicsCommandPool,
+		texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	this->textureImages.push_back(texImage);
+	this->textureImageMemory.push_back(texImageMemory);
+
+	vkDestroyBuffer(this->vkLogicalDevice, imageStagingBuffer, nullptr);
+	vkFreeMemory(this->vkLogicalDevice, imageStagingBufferMemory, nullptr);
+
+	VkImageView imageView = createImageView(texImage, format, VK_IMAGE_ASPECT_COLOR_BIT);
+	this->textureImageViews.push_back(imageView);
+
+	return createTextureSamplerDescriptor(imageView);
+}
+
 bool VulkanRenderer::isDeviceSuitable(VkPhysicalDevice device)
 {
-	//VkPhysicalDeviceProperties deviceProperties;
-	//vkGetPhysicalDeviceProperties(device, &deviceProperties);
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(device, &deviceProperties);
 
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+	// Vulkan 1.2 features are needed for descriptor indexing (bindless textures)
+	if (deviceProperties.apiVersion < VK_API_VERSION_1_2)
+	{
+		return false;
+	}
+
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+
+	VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &deviceFeatures2);
+
+	bool supportsBindless = vulkan12Features.descriptorIndexing
+		&& vulkan12Features.runtimeDescriptorArray
+		&& vulkan12Features.descriptorBindingPartiallyBound
+		&& vulkan12Features.descriptorBindingVariableDescriptorCount
+		&& vulkan12Features.descriptorBindingSampledImageUpdateAfterBind;
 
 	return getQueueFamilies(device).isValid()
 		&& isDeviceSupportsRequiredExtensions(device)
 		&& getSwapChainDetails(device).isValid()
-		&& deviceFeatures.samplerAnisotropy;
+		&& deviceFeatures2.features.samplerAnisotropy
+		&& vulkan12Features.timelineSemaphore
+		&& supportsBindless
+		&& deviceFeatures2.features.multiDrawIndirect
+		&& deviceFeatures2.features.drawIndirectFirstInstance
+		&& vulkan12Features.drawIndirectCount;
 }
 
 VkFormat VulkanRenderer::defineSupportedFormat(const vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags)
@@ -1709,18 +2478,12 @@ bool VulkanRenderer::checkValidationLayerSupport()
 
 int VulkanRenderer::createTextureSamplerDescriptor(VkImageView textureImageView)
 {
-	VkDescriptorSet descriptorSet;
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = this->vkDescriptorPool;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = &this->vkSamplerDescriptorSetLayout;
-
-	VkResult result = vkAllocateDescriptorSets(this->vkLogicalDevice, &allocInfo, &descriptorSet);
-	if (result != VK_SUCCESS)
+	// Texture takes next free slot of bindless array
+	if (this->bindlessTextureCount >= this->maxBindlessTextures)
 	{
-		throw runtime_error("Failed to allocate texture sampler descriptor sets.");
+		throw runtime_error("Bindless texture array is full.");
 	}
+	uint32_t textureSlot = this->bindlessTextureCount;
 
 	// texture image info
 	VkDescriptorImageInfo imageInfo = {};
@@ -1732,16 +2495,17 @@ int VulkanRenderer::createTextureSamplerDescriptor(VkImageView textureImageView)
 	setWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	setWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	setWrite.descriptorCount = 1;
-	setWrite.dstSet = descriptorSet;
-	setWrite.dstArrayElement = 0;
+	setWrite.dstSet = this->vkBindlessDescriptorSet;
+	setWrite.dstArrayElement = textureSlot;							// element of sampler array to write to
 	setWrite.dstBinding = 0;
 	setWrite.pImageInfo = &imageInfo;
 
+	// Safe to call while set is bound to pending command buffers thanks to UPDATE_AFTER_BIND
 	vkUpdateDescriptorSets(this->vkLogicalDevice, 1, &setWrite, 0, nullptr);
 
-	this->vkSamplerDescriptorSets.push_back(descriptorSet);
+	this->bindlessTextureCount++;
 
-	return this->vkSamplerDescriptorSets.size() - 1;
+	return textureSlot;
 }
 
 void VulkanRenderer::printPhysicalDeviceInfo(VkPhysicalDevice device, bool printPropertiesFull, bool printFeaturesFull)
@@ -1781,19 +2545,3 @@ stbi_uc* VulkanRenderer::loadTexture(std::string fileName, int* width, int* heig
 	return image;
 }
 
-VkShaderModule VulkanRenderer::createShaderModule(const vector<char>& code)
-{
-	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
-	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shaderModuleCreateInfo.codeSize = code.size();
-	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-	VkShaderModule shaderModule;
-	VkResult result = vkCreateShaderModule(this->vkLogicalDevice, &shaderModuleCreateInfo, nullptr, &shaderModule);
-	if (result != VK_SUCCESS)
-	{
-		throw runtime_error("Failed to create shader module.");
-	}
-
-	return shaderModule;
-}
@@ -12,9 +12,30 @@
 #include <set>
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include "VkMesh.h"
 #include "Mesh.h"
 #include "VulkanUtils.h"
+#include "DescriptorAllocator.h"
+#include "UniformRingAllocator.h"
+#include "FrameScheduler.h"
+#include "PipelineCache.h"
+#include "PipelineManager.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "DescriptorLayoutCache.h"
+#include "RenderGraph.h"
+#include "DrawList.h"
+#include "ClusteredLighting.h"
+#include "CascadedShadows.h"
+#include "ClusterCulling.h"
+#include "GpuSkinning.h"
+#include "ParticleSystem.h"
+#include "ImpostorBaker.h"
+#include "LightmapBaker.h"
+#include "SoftwareOcclusion.h"
+#include "SceneBvh.h"
+#include "TriangleBvh.h"
 #include <map>
 #include "stb_image.h"
 
@@ -31,8 +52,38 @@
 
 #define BACKGROUND_COLOR 0x008B8BFF
 
-#define MAX_FRAME_DRAWS 2
-#define MAX_OBJECTS 100
+// Camera
+#define CAMERA_FOV			75.0f
+#define CAMERA_NEAR_PLANE	0.1f
+#define CAMERA_FAR_PLANE	200.0f			// ignored with reverse Z (far plane is at infinity)
+
+// Reverse Z: float depth buffer cleared to 0, nearer fragments have greater depth
+#define REVERSE_Z_DEPTH		true
+
+#if REVERSE_Z_DEPTH
+#define DEPTH_CLEAR_VALUE	0.0f
+#define DEPTH_COMPARE_OP	VK_COMPARE_OP_GREATER
+#else
+#define DEPTH_CLEAR_VALUE	1.0f
+#define DEPTH_COMPARE_OP	VK_COMPARE_OP_LESS
+#endif
+
+// Deferred path G-buffer (position is reconstructed from depth, so depth is the last G-buffer target)
+#define GBUFFER_ALBEDO_FORMAT	VK_FORMAT_R8G8B8A8_UNORM
+#define GBUFFER_NORMAL_FORMAT	VK_FORMAT_A2B10G10R10_UNORM_PACK32		// view space normal mapped to 0..1, alpha 1 for lightmapped pixels
+#define GBUFFER_LIGHTING_FORMAT	VK_FORMAT_B10G11R11_UFLOAT_PACK32		// baked irradiance times base color
+
+// Baked lightmaps (sRGB encoded, sampler returns linear values)
+#define LIGHTMAP_FORMAT				VK_FORMAT_BC1_RGB_SRGB_BLOCK
+#define LIGHTMAP_FALLBACK_FORMAT	VK_FORMAT_R8G8B8A8_SRGB		// devices without textureCompressionBC
+
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin"
+#define SHADER_DIRECTORY "shaders"				// GLSL sources, watched for changes while running
+
+#define UNIFORM_RING_FRAME_SIZE (1024 * 1024)	// bytes of uniform/storage data available per frame in flight
+#define MAX_BINDLESS_TEXTURES 16384		// upper bound of bindless texture array (clamped by device limits)
+#define MIN_DRAW_OBJECTS 4096			// initial objects per frame in object buffer (capacity doubles when scene has more meshes)
+#define IMPOSTOR_SCREEN_SIZE IMPOSTOR_CELL_SIZE	// models with smaller projected bounds (pixels) are drawn as impostors
 
 
 using namespace std;
@@ -46,13 +97,35 @@ const vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
 };
 
+// How scene is lit: forward shades every drawn fragment, deferred writes G-buffer and shades each pixel once
+enum RenderPath
+{
+	RENDER_PATH_FORWARD,
+	RENDER_PATH_DEFERRED
+};
+
+// Mesh found by scene queries
+struct MeshReference
+{
+	int modelId;
+	int meshId;
+};
+
+// Nearest mesh surface hit by picking ray (skinned meshes are hit at bounds of their current pose)
+struct PickHit
+{
+	int modelId;
+	int meshId;
+	float distance;								// in units of ray direction length
+	glm::vec3 position;
+	glm::vec3 normal;							// world space, faces against the ray for skinned meshes
+};
+
 class VulkanRenderer
 {
 private:
 	GLFWwindow* window;
 
-	int currentFrame = 0;
-
 	// Native Vulkan Components
 	VkInstance vkInstance; 
 	VkPhysicalDevice vkPhysicalDevice;
@@ -63,51 +136,136 @@ private:
 	VkSwapchainKHR vkSwapchain;
 	vector<SwapChainImage> swapchainImages;
 
-	// Graphics pipeline
-	VkRenderPass vkRenderPass;
-	VkPipeline vkGraphicsPipeline;
-	VkPipelineLayout vkPipelineLayout;
-	vector<VkFramebuffer> vkSwapchainFramebuffers;
-	VkCommandPool vkGraphicsCommandPool;
-	vector<VkCommandBuffer> vkCommandBuffers;
-
-	VkImage depthBufferImage;
-	VkDeviceMemory depthBufferImageMemory;
-	VkImageView depthBufferImageView;
+	// Frame graph
+	RenderGraph renderGraph;
 	VkFormat depthFormat;
 
+	// Graphics pipeline
+	VkRenderPass vkRenderPass;						// render pass of main graph pass (owned by render graph)
+	VkPipeline vkGraphicsPipeline;					// generic variant, always available (fallback for variants being compiled)
+	VkPipelineLayout vkPipelineLayout;				// reflected from main shaders
+	DescriptorLayoutCache layoutCache;
+	PipelineCache pipelineCache;
+	ShaderCompiler shaderCompiler;
+	PipelineManager pipelineManager;
+	PipelineState defaultPipelineState;
+
+	// Depth prepass (depth only pass, then color pass testing EQUAL without depth writes)
+	bool depthPrepassEnabled = false;
+	VkRenderPass vkPrepassRenderPass;				// depth prepass and color pass as two subpasses (owned by render graph)
+	VkPipeline vkDepthPipeline;
+	VkPipeline vkPrepassGraphicsPipeline;			// generic variant of color pass after prepass
+	PipelineState depthPipelineState;
+	PipelineState prepassPipelineState;
+
+	// Deferred path (G-buffer and lighting are two subpasses of one render pass, G-buffer never leaves tile memory on tilers)
+	RenderPath renderPath = RENDER_PATH_FORWARD;
+	VkRenderPass vkDeferredRenderPass;				// owned by render graph
+	VkPipeline vkGBufferPipeline;					// generic variant of G-buffer pass
+	VkPipeline vkDeferredLightingPipeline;
+	PipelineState gbufferPipelineState;
+	PipelineState deferredLightingPipelineState;
+
+	// Shadows (cascades of directional light in one atlas, cached cascades are not re-rendered)
+	CascadedShadows cascadedShadows;
+	VkRenderPass vkShadowRenderPass;				// owned by render graph
+	VkPipeline vkShadowPipeline;
+	PipelineState shadowPipelineState;
+
+	// Pipeline statistics (fragment shader invocations of color pass, one query per frame in flight)
+	bool pipelineStatisticsSupported = false;
+	bool textureCompressionBCSupported = false;		// BC lightmaps are sampled directly, otherwise decoded on upload
+	VkQueryPool vkStatisticsQueryPool = VK_NULL_HANDLE;
+	vector<bool> statisticsQueryWritten;
+	uint64_t fragmentInvocations = 0;
+	VkCommandPool vkGraphicsCommandPool;			// used for one time transfer/upload commands, frame commands come from frame scheduler
+
 	// Extension Vulkan Components
 	VkDebugUtilsMessengerEXT debugMessenger;
 
 	// Descriptors
 	VkDescriptorSetLayout vkDescriptorSetLayout;
 	VkDescriptorSetLayout vkSamplerDescriptorSetLayout;
-	VkDescriptorPool vkDescriptorPool;
-	vector<VkDescriptorSet> vkDescriptorSets;
-	vector<VkDescriptorSet> vkSamplerDescriptorSets;
-	vector<VkBuffer> uniformBuffers;
-	vector<VkDeviceMemory> uniformBuffersMemory;
+	VkDescriptorSetLayout vkGBufferDescriptorSetLayout;		// input attachments of deferred lighting
+	DescriptorAllocator descriptorAllocator;
+	VkDescriptorPool vkBindlessDescriptorPool;
+	VkDescriptorSet vkDescriptorSet;
+	VkDescriptorSet vkBindlessDescriptorSet;
+	uint32_t maxBindlessTextures;
+	uint32_t bindlessTextureCount = 0;
+	UniformRingAllocator uniformRing;
+
+	// Per frame object arrays (slice for each of max frames in flight), recreated larger once scene outgrows them
+	VkBuffer vkObjectBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory vkObjectBufferMemory = VK_NULL_HANDLE;
+	uint8_t* objectBufferData = nullptr;			// persistently mapped
+	uint32_t objectCapacity = 0;					// objects per slice
+	VkDeviceSize objectSliceSize = 0;
+	uint32_t viewProjectionOffset;			// dynamic offset of current frame's view projection data in uniform ring
+	uint32_t objectDataOffset;				// dynamic offset of current frame's slice of object buffer
 	VkDeviceSize minUniformBufferOffset;
+	VkDeviceSize minStorageBufferOffset;
 	VkPushConstantRange vkPushConstantRange;
 
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	// UboModel* modelTransferSpace;	
-	// size_t modelUniformAlignment;
-	//vector<VkBuffer> uniformBuffersDynamic;
-	//vector<VkDeviceMemory> uniformBuffersMemoryDynamic;
-	
-
 	// Utility
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
-	vector<VkSemaphore> vkSemImageAvailable;
-	vector<VkSemaphore> vkSemRenderFinished;
-	vector<VkFence> vkDrawFences;
+	FrameScheduler frameScheduler;
+	vector<VkSemaphore> vkSemRenderFinished;		// one per swapchain image (presentation may still wait on it after frame slot is reused)
 
 	// Scene
 	glm::mat4 projectionMat;
 	glm::mat4 viewMat;
 	std::map<uint32_t, std::map<uint32_t, VkMesh>> modelsToRender;
+	DrawList drawList;
+
+	// World bounds of all meshes for picking and region queries, static meshes keep mesh space triangle BVH for exact hits
+	SceneBvh sceneBvh;
+	std::map<uint64_t, TriangleBvh> meshTriangleBvhs;	// by scene object (model id in high 32 bits, mesh id in low ones)
+	ClusteredLighting clusteredLighting;
+
+	// Occluders are rasterized on CPU while the draw list is built, meshes hidden behind them are left out of the frame
+	SoftwareOcclusion softwareOcclusion;
+	bool softwareOcclusionEnabled = true;
+	uint32_t occlusionCulledCount = 0;
+
+	// Meshlets of main pass draws are culled on GPU (frustum, normal cone, Hi-Z), draws become indirect count draws
+	ClusterCulling clusterCulling;
+	bool clusterCullingEnabled = true;
+
+	// Skinned meshes are skinned once per frame, all passes draw the skinned streams
+	GpuSkinning skinning;
+
+	// Particles are simulated on GPU and drawn in the last subpass of color render pass (one pipeline per render pass)
+	ParticleSystem particleSystem;
+	float particleTimeStep = 0.0f;					// time simulated by next frame
+	VkDescriptorSetLayout vkParticleDescriptorSetLayout;
+	VkPipeline vkParticlePipeline;
+	VkPipeline vkPrepassParticlePipeline;
+	VkPipeline vkDeferredParticlePipeline;
+	PipelineState particlePipelineState;
+	PipelineState prepassParticlePipelineState;
+	PipelineState deferredParticlePipelineState;
+	uint32_t particleSubpass;
+	uint32_t prepassParticleSubpass;
+	uint32_t deferredParticleSubpass;
+
+	// Static models are baked into impostor atlases when added, distant ones are drawn as one textured quad instead
+	ImpostorBaker impostorBaker;
+	bool impostorsEnabled = true;
+	std::map<uint32_t, int> modelImpostors;			// impostor of model (skinned models have none)
+	vector<ImpostorDraw> impostorDraws;				// this frame's impostors, front to back
+
+	// Meshes baked by LightmapBaker keep their lightmap in the bindless texture table
+	bool lightmapsEnabled = true;
+	VkPipeline vkImpostorPipeline;
+	VkPipeline vkImpostorDepthPipeline;				// depth prepass
+	VkPipeline vkPrepassImpostorPipeline;			// color pass after prepass
+	VkPipeline vkGBufferImpostorPipeline;
+	PipelineState impostorPipelineState;
+	PipelineState impostorDepthPipelineState;
+	PipelineState prepassImpostorPipelineState;
+	PipelineState gbufferImpostorPipelineState;
 
 	// Textures
 	VkSampler vkTextureSampler;
@@ -120,11 +278,45 @@ public:
 
 	int init(GLFWwindow* window);
 	void draw();
+	void waitForCurrentFrame();
+	void setFramesInFlight(uint32_t framesInFlight);
+	double getCpuWaitTime();
+	DrawListStats getDrawStats();
+	void setDepthPrepass(bool enabled);
+	bool isDepthPrepassEnabled();
+	void setRenderPath(RenderPath renderPath);
+	RenderPath getRenderPath();
+	void setClusterCulling(bool enabled);
+	bool isClusterCullingEnabled();
+	void setImpostors(bool enabled);
+	bool isImpostorsEnabled();
+	void setLightmaps(bool enabled);			// baked sun and sky of lightmapped meshes instead of dynamic ones
+	bool isLightmapsEnabled();
+	void setSoftwareOcclusion(bool enabled);
+	bool isSoftwareOcclusionEnabled();
+	int getOcclusionCulledCount();				// meshes hidden behind occluders in last draw list
+	int getImpostorCount();						// models drawn as impostors in last frame
+	uint64_t getFragmentInvocations();			// of color pass in last completed frame (0 if queries aren't supported)
+	int getRenderedShadowCascades();			// cascades re-rendered in last frame (others were cached)
+	void setDirectionalLight(glm::vec3 direction);
 	//bool addToRenderer(Mesh* mesh, glm::vec3 color);
 	bool addToRenderer(int modelId, int meshCount, Mesh* mesh, glm::vec3 color);
 	bool addToRendererTextured(int modelId, int meshCount, Mesh* mesh, std::vector<std::string> textureFiles);
 	bool updateModelTransform(int modelId, glm::mat4 newTransform);
+	bool setModelOccluder(int modelId, Mesh* occluder);		// occluder geometry (model space) follows model transform
+	bool updateModelPose(int modelId, const std::vector<glm::mat4>& jointTransforms);	// model space transforms of skeleton joints
 	bool removeFromRenderer(int modelId);	
+	bool pickRay(glm::vec3 origin, glm::vec3 direction, float maxDistance, PickHit* hit);	// world space ray
+	bool pickScreen(glm::vec2 position, PickHit* hit);		// ray from camera through window pixel
+	void queryBox(glm::vec3 boundsMin, glm::vec3 boundsMax, std::vector<MeshReference>* meshes);		// world space box
+	void queryFrustum(const glm::mat4& viewProjection, std::vector<MeshReference>* meshes);
+	bool addLight(int lightId, const Light& light);
+	bool updateLight(int lightId, const Light& light);
+	bool removeLight(int lightId);
+	bool addParticleEmitter(int emitterId, const ParticleEmitter& emitter);
+	bool updateParticleEmitter(int emitterId, const ParticleEmitter& emitter);
+	bool removeParticleEmitter(int emitterId);
+	void advanceParticles(float deltaTime);		// time is simulated by next drawn frame
 	void cleanup();
 
 	~VulkanRenderer();
@@ -136,22 +328,28 @@ private:
 	void createLogicalDevice();
 	void createSurface();
 	void createSwapChain();
-	void createRenderPass();
+	void createRenderGraph();
+	void createQueryPool();
 	void createGraphicsPipeline();
-	void createDepthBuffer();
-	void createFramebuffers();
 	void createCommandPool();
-	void createCommandBuffers();
 	void createSyncTools();
-	void createDescriptorSetLayout();
+	void createPipelineLayout();
 	void createUniformBuffers();
+	void createObjectBuffer(uint32_t capacity);
+	void destroyObjectBuffer();
+	void reserveObjects();						// grows object buffer to every mesh of the scene (waits for GPU when it grows)
 	void createDescriptorPool();
 	void createDescriptorSets();
-	void createPushConstantRange();
+	void createBindlessDescriptorSet();
 	void createTextureSampler();
 	int createTextureSamplerDescriptor(VkImageView textureImageView);
 	int createTextureImage(std::string fileName);
 	int createTexture(std::string fileName);
+	int createLightmapTexture(const MeshLightmap& lightmap);
+	void createModelImpostor(int modelId);
+	void addToSceneBvh(int modelId, Mesh* mesh);
+	void updateSceneBvh(VkMesh* mesh, glm::vec3 boundsMin, glm::vec3 boundsMax);	// mesh space bounds placed by mesh transform
+	static uint64_t getSceneObject(int modelId, int meshId);		// user data of mesh in scene BVH
 
 	void setupDebugMessenger();
 
@@ -162,12 +360,22 @@ private:
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
 	VkImage createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags userFlags,
 		VkMemoryPropertyFlags propertyFlags, VkDeviceMemory* imageMemory);
-	VkShaderModule createShaderModule(const vector<char>& code);
-	void recordCommands(uint32_t currentImage);
-	void updateUniformBuffers(uint32_t imageIndex);
-	
-	// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-	//void allocateDynamicBufferTransferSpace();
+	void buildRenderGraph(uint32_t imageIndex, RenderPath renderPath, bool depthPrepass, bool clusterCulling);
+	void recordCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordShadows(VkCommandBuffer commandBuffer);
+	void recordDepthPrepass(VkCommandBuffer commandBuffer);
+	void recordScene(VkCommandBuffer commandBuffer);
+	void recordDeferredLighting(VkCommandBuffer commandBuffer, RenderGraphResource albedo, RenderGraphResource normal, RenderGraphResource lighting,
+		RenderGraphResource depth);
+	void addParticlePass(const ParticleStreams& particles, RenderGraphResource backbuffer, RenderGraphResource depth, RenderPath renderPath, bool depthPrepass);
+	void recordParticles(VkCommandBuffer commandBuffer, RenderPath renderPath, bool depthPrepass);
+	void recordImpostors(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+	void bindSceneDescriptorSets(VkCommandBuffer commandBuffer, uint32_t viewProjectionOffset);
+	void readPipelineStatistics(uint32_t frameIndex);
+	VkPipeline getMaterialPipeline(int textureIndex);
+	void updateUniformBuffers();
+	void buildDrawList();
+	void reloadChangedShaders();
 
 	bool isInstanceExtensionsSupported(vector<const char*>* extensions);
 	bool isDeviceSupportsRequiredExtensions(VkPhysicalDevice device);
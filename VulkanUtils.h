@@ -2,10 +2,12 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
 #include <vector>
 #include <fstream>
 #include <iostream>
 #include <array>
+#include <functional>
 
 using namespace std;
 
@@ -19,6 +21,30 @@ struct UboProjectionView
 	glm::mat4 view;
 };
 
+// Per object data, element of object storage buffer indexed by instance index (must match ObjectData in scene.glsl and
+// cluster_culling.comp, std430 layout)
+struct ObjectData
+{
+	glm::mat4 model;
+	int32_t lightmapTexture;	// bindless index of baked lightmap (-1 when object is lit dynamically only)
+	float lightmapScale;		// lightmap texel value 1 in irradiance
+	int32_t padding[2];
+};
+
+// Pipeline variants of main shader (MATERIAL_VARIANT specialization constant in fragment shader)
+enum MaterialVariant
+{
+	MATERIAL_VARIANT_GENERIC = 0,		// texture usage decided per draw (fallback while specialized variant compiles)
+	MATERIAL_VARIANT_COLORED = 1,		// vertex color only
+	MATERIAL_VARIANT_TEXTURED = 2		// bindless texture only
+};
+
+// Per draw data passed through push constants (must match PushModel block in fragment shader)
+struct PushModel
+{
+	int textureIndex;			// index into bindless texture array (-1 if mesh is not textured)
+};
+
 const vector<glm::vec3> meshVertices = {
 	{-1, -1, 0.0},
 	{1,  -1, 0.0},
@@ -78,6 +104,40 @@ static std::array<float, 4> getRGBANormalized(uint32_t color) {
 	};
 }
 
+// Perspective projection with depth 1 at near plane and 0 at infinity (reverse Z, zero to one clip depth).
+// Float depth is densest near 0, which reverse Z puts far away, so precision is nearly uniform over distance.
+static glm::mat4 perspectiveReverseZ(float fovY, float aspect, float nearPlane)
+{
+	float f = 1.0f / tan(fovY * 0.5f);
+
+	glm::mat4 projection(0.0f);
+	projection[0][0] = f / aspect;
+	projection[1][1] = f;
+	projection[2][3] = -1.0f;				// w = -z (right handed view space looks down -Z)
+	projection[3][2] = nearPlane;			// z = near, so depth = near / -z
+	return projection;
+}
+
+// Mixes hash of value into seed (used to build keys for cached Vulkan objects)
+template <typename T>
+static void hashCombine(size_t& seed, const T& value)
+{
+	seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// FNV-1a hash of raw bytes, stable between runs (used for on-disk cache keys and checksums)
+static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
 
 static vector<char> readFile(const string &filename)
 {
@@ -99,6 +159,23 @@ static vector<char> readFile(const string &filename)
 	return fileBuffer;
 }
 
+static VkShaderModule createShaderModule(VkDevice logicalDevice, const vector<uint32_t>& code)
+{
+	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCreateInfo.codeSize = code.size() * sizeof(uint32_t);
+	shaderModuleCreateInfo.pCode = code.data();
+
+	VkShaderModule shaderModule;
+	VkResult result = vkCreateShaderModule(logicalDevice, &shaderModuleCreateInfo, nullptr, &shaderModule);
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create shader module.");
+	}
+
+	return shaderModule;
+}
+
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -203,14 +280,14 @@ static void endAndSubmitCommandBuffer(VkDevice device, VkCommandPool commandPool
 }
 
 static void copyBuffer(VkDevice logicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
-	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
+	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize, VkDeviceSize dstOffset = 0)
 {
 	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(logicalDevice, transferCommandPool);
 
 	// Region of data to copy from or to
 	VkBufferCopy bufferCopyRegion = {};
 	bufferCopyRegion.srcOffset = 0;
-	bufferCopyRegion.dstOffset = 0; 
+	bufferCopyRegion.dstOffset = dstOffset;
 	bufferCopyRegion.size = bufferSize;
 
 	// Command to copy src buffer to dst buffer
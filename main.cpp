@@ -7,6 +7,7 @@
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/vec3.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -15,36 +16,205 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <chrono>
 
 #include "VulkanRenderer.h"
+#include "FramePacer.h"
+#include "Animation.h"
+#include "AmbientOcclusionBaker.h"
+#include "LightmapBaker.h"
 
 #define WINDOW_TITLE		"Vulkan Renderer"
 #define WINDOW_WIDTH		1920
 #define WINDOW_HEIGHT		1080
 
-#define FPS_LIMIT			true
 #define TARGET_FPS			60
-#define TARGET_FRAME_TIME	(1000 / TARGET_FPS)
+#define FRAME_PACING_MODE	FramePacingMode::LOW_LATENCY
+
+#define DEPTH_PREPASS_KEY	GLFW_KEY_P		// toggles depth prepass (compare fragment invocations in title)
+#define RENDER_PATH_KEY		GLFW_KEY_G		// switches between forward and deferred shading
+#define CLUSTER_CULLING_KEY	GLFW_KEY_C		// toggles GPU meshlet culling (whole meshes are drawn when off)
+#define NEXT_CLIP_KEY		GLFW_KEY_N		// cross-fades to the next animation clip of the model
+#define IMPOSTOR_KEY		GLFW_KEY_I		// toggles impostors of distant static models
+#define LIGHTMAP_KEY		GLFW_KEY_L		// switches between baked and dynamic sun and sky (lightmaps turn with the model)
+#define OCCLUSION_KEY		GLFW_KEY_O		// toggles CPU occlusion culling (culled meshes in title)
+#define PICK_BUTTON			GLFW_MOUSE_BUTTON_LEFT	// prints mesh under cursor (scene BVH ray pick)
+
+#define CLIP_FADE_TIME		0.3f			// seconds of blending between clips
+
+#define DEMO_POINT_LIGHTS	512				// animated point lights orbiting the model
+#define DEMO_SPOT_LIGHTS	4
+#define DEMO_EMITTERS		4				// particle fountains around the model
 
 using namespace std;
 
 GLFWwindow* window;
 VulkanRenderer vulkanRenderer;
+FramePacer framePacer;
 
 // time and fps
-int previousFrameTime = 0;
-int currentFrameTime = 0;
 float deltaTime = 0;
+float statsTime = 0;
+int statsFrames = 0;
 
 int modelId;
 float angleRot = 0;
+bool depthPrepassKeyDown = false;
+bool renderPathKeyDown = false;
+bool clusterCullingKeyDown = false;
+bool nextClipKeyDown = false;
+bool impostorKeyDown = false;
+bool lightmapKeyDown = false;
+bool occlusionKeyDown = false;
+bool pickButtonDown = false;
+float lightTime = 0;
 
 std::vector<std::string> modelTextures;
 
+// Skeleton and clips of imported model (empty for models without animation)
+Skeleton modelSkeleton;
+std::vector<CompressedAnimationClip> modelClips;
+AnimationSampler animationSampler;
+AnimationPose animationPose;
+AnimationPose fadeOutPose;
+int currentClip = 0;
+int previousClip = -1;						// clip fading out, -1 when none
+float animationTime = 0;
+float previousAnimationTime = 0;
+float fadeTime = 0;
+
+glm::mat4 toGlmMatrix(const aiMatrix4x4& matrix)
+{
+	// Assimp matrices are row major
+	return glm::transpose(glm::make_mat4(&matrix.a1));
+}
+
+// Every node becomes a joint, so meshes and clips can refer to any of them (parents are added before children)
+void importSkeleton(const aiNode* node, int parent, Skeleton* skeleton)
+{
+	int joint = static_cast<int>(skeleton->jointNames.size());
+	skeleton->jointNames.push_back(node->mName.C_Str());
+	skeleton->parents.push_back(parent);
+	skeleton->restTransforms.push_back(toGlmMatrix(node->mTransformation));
+
+	for (int i = 0; i < node->mNumChildren; i++)
+	{
+		importSkeleton(node->mChildren[i], joint, skeleton);
+	}
+}
+
+void importSkin(const aiMesh* meshData, const Skeleton& skeleton, Mesh* mesh)
+{
+	if (!meshData->HasBones())
+	{
+		return;
+	}
+
+	std::vector<glm::uvec4> jointIndices(meshData->mNumVertices, glm::uvec4(0));
+	std::vector<glm::vec4> jointWeights(meshData->mNumVertices, glm::vec4(0.0f));
+	std::vector<int> skinJoints;
+	std::vector<glm::mat4> inverseBindMatrices;
+	for (int i = 0; i < meshData->mNumBones; i++)
+	{
+		auto bone = meshData->mBones[i];
+		int joint = skeleton.findJoint(bone->mName.C_Str());
+		if (joint < 0)
+		{
+			continue;
+		}
+
+		uint32_t skinJoint = static_cast<uint32_t>(skinJoints.size());
+		skinJoints.push_back(joint);
+		inverseBindMatrices.push_back(toGlmMatrix(bone->mOffsetMatrix));
+
+		// Vertex keeps its 4 strongest influences, the weakest one is replaced
+		for (int j = 0; j < bone->mNumWeights; j++)
+		{
+			auto weight = bone->mWeights[j];
+			glm::vec4& weights = jointWeights[weight.mVertexId];
+			int weakest = 0;
+			for (int k = 1; k < 4; k++)
+			{
+				weakest = weights[k] < weights[weakest] ? k : weakest;
+			}
+			if (weight.mWeight > weights[weakest])
+			{
+				weights[weakest] = weight.mWeight;
+				jointIndices[weight.mVertexId][weakest] = skinJoint;
+			}
+		}
+	}
+
+	for (auto& weights : jointWeights)
+	{
+		float sum = weights.x + weights.y + weights.z + weights.w;
+		weights = sum > 0.0f ? weights / sum : weights;
+	}
+
+	mesh->setSkin(jointIndices, jointWeights, skinJoints, inverseBindMatrices);
+}
+
+std::vector<AnimationClip> importAnimations(const aiScene* scene, const Skeleton& skeleton)
+{
+	std::vector<AnimationClip> clips;
+	for (int i = 0; i < scene->mNumAnimations; i++)
+	{
+		auto animation = scene->mAnimations[i];
+		// Key times are in ticks, clips work in seconds
+		float ticksPerSecond = animation->mTicksPerSecond != 0.0 ? (float)animation->mTicksPerSecond : 25.0f;
+
+		std::vector<AnimationChannel> channels;
+		for (int j = 0; j < animation->mNumChannels; j++)
+		{
+			auto nodeAnimation = animation->mChannels[j];
+			AnimationChannel channel = {};
+			channel.joint = skeleton.findJoint(nodeAnimation->mNodeName.C_Str());
+			if (channel.joint < 0)
+			{
+				continue;
+			}
+
+			for (int k = 0; k < nodeAnimation->mNumPositionKeys; k++)
+			{
+				auto key = nodeAnimation->mPositionKeys[k];
+				channel.positionTimes.push_back((float)key.mTime / ticksPerSecond);
+				channel.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (int k = 0; k < nodeAnimation->mNumRotationKeys; k++)
+			{
+				auto key = nodeAnimation->mRotationKeys[k];
+				channel.rotationTimes.push_back((float)key.mTime / ticksPerSecond);
+				channel.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (int k = 0; k < nodeAnimation->mNumScalingKeys; k++)
+			{
+				auto key = nodeAnimation->mScalingKeys[k];
+				channel.scaleTimes.push_back((float)key.mTime / ticksPerSecond);
+				channel.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			channels.push_back(channel);
+		}
+
+		clips.push_back(AnimationClip(animation->mName.C_Str(), (float)animation->mDuration / ticksPerSecond, channels));
+	}
+	return clips;
+}
+
 std::vector<Mesh> importModel(std::string fileName)
 {
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_LimitBoneWeights);
+
+	modelSkeleton = Skeleton();
+	importSkeleton(scene->mRootNode, -1, &modelSkeleton);
+	modelSkeleton.buildRestPose();
+
+	// Only compressed clips are kept, raw keys are dropped with the scene
+	modelClips.clear();
+	for (const auto& clip : importAnimations(scene, modelSkeleton))
+	{
+		modelClips.push_back(CompressedAnimationClip(clip, modelSkeleton, AnimationCompressionSettings()));
+	}
 
 	// Collect all diffuse textures
 	for (int i = 0; i < scene->mNumMaterials; i++)
@@ -80,6 +250,7 @@ std::vector<Mesh> importModel(std::string fileName)
 		}
 
 		Mesh mesh = Mesh(i, meshData->mName.C_Str(), vertices, indices, texCoords, normals);
+		importSkin(meshData, modelSkeleton, &mesh);
 
 		// If mesh has a material assigned and this material has a diffuse texture
 		// we find and save the index of that texture in textures vector
@@ -101,6 +272,69 @@ std::vector<Mesh> importModel(std::string fileName)
 	return model;
 }
 
+// Point lights are spread over rings around the model, their orbit angle is animated in update()
+Light getDemoPointLight(int index, float time)
+{
+	float ring = (float)(index % 8);
+	float angle = index * 2.399963f + time * (0.2f + 0.05f * ring);		// golden angle spreads lights evenly
+	float orbitRadius = 20.0f + ring * 6.0f;
+
+	Light light = {};
+	light.type = LIGHT_TYPE_POINT;
+	light.position = glm::vec3(cos(angle) * orbitRadius, -30.0f + (index % 61), sin(angle) * orbitRadius);
+	light.color = glm::vec3(0.5f + 0.5f * sin(index * 1.3f), 0.5f + 0.5f * sin(index * 1.7f + 2.0f), 0.5f + 0.5f * sin(index * 2.3f + 4.0f));
+	light.intensity = 40.0f;
+	light.radius = 12.0f;
+	return light;
+}
+
+void addDemoLights()
+{
+	for (int i = 0; i < DEMO_POINT_LIGHTS; i++)
+	{
+		vulkanRenderer.addLight(i, getDemoPointLight(i, 0.0f));
+	}
+
+	// Spot lights shine at the model from above
+	for (int i = 0; i < DEMO_SPOT_LIGHTS; i++)
+	{
+		float angle = i * glm::two_pi<float>() / DEMO_SPOT_LIGHTS;
+
+		Light light = {};
+		light.type = LIGHT_TYPE_SPOT;
+		light.position = glm::vec3(cos(angle) * 40.0f, 50.0f, sin(angle) * 40.0f);
+		light.direction = -light.position;
+		light.color = glm::vec3(1.0f, 0.9f, 0.7f);
+		light.intensity = 3000.0f;
+		light.radius = 120.0f;
+		light.innerConeAngle = glm::radians(10.0f);
+		light.outerConeAngle = glm::radians(20.0f);
+		vulkanRenderer.addLight(DEMO_POINT_LIGHTS + i, light);
+	}
+}
+
+void addDemoParticles()
+{
+	for (int i = 0; i < DEMO_EMITTERS; i++)
+	{
+		float angle = i * glm::two_pi<float>() / DEMO_EMITTERS;
+
+		ParticleEmitter emitter = {};
+		emitter.position = glm::vec3(cos(angle) * 30.0f, -10.0f, sin(angle) * 30.0f);
+		emitter.radius = 1.0f;
+		emitter.rate = 5000.0f;
+		emitter.velocity = glm::vec3(0.0f, 15.0f, 0.0f);
+		emitter.velocitySpread = 4.0f;
+		emitter.startColor = glm::vec4(1.0f, 0.6f, 0.2f, 1.0f);
+		emitter.endColor = glm::vec4(0.3f, 0.3f, 1.0f, 0.0f);
+		emitter.startSize = 0.3f;
+		emitter.endSize = 0.1f;
+		emitter.lifetime = 2.5f;
+		emitter.lifetimeSpread = 0.5f;
+		vulkanRenderer.addParticleEmitter(i, emitter);
+	}
+}
+
 void initWindow(string title, const int width, const int height)
 {
 	glfwInit();
@@ -113,6 +347,80 @@ void initWindow(string title, const int width, const int height)
 
 void processInput()
 {
+	// Toggle on press only, not every frame key is held
+	bool keyDown = glfwGetKey(window, DEPTH_PREPASS_KEY) == GLFW_PRESS;
+	if (keyDown && !depthPrepassKeyDown)
+	{
+		vulkanRenderer.setDepthPrepass(!vulkanRenderer.isDepthPrepassEnabled());
+	}
+	depthPrepassKeyDown = keyDown;
+
+	keyDown = glfwGetKey(window, RENDER_PATH_KEY) == GLFW_PRESS;
+	if (keyDown && !renderPathKeyDown)
+	{
+		vulkanRenderer.setRenderPath(vulkanRenderer.getRenderPath() == RENDER_PATH_FORWARD ? RENDER_PATH_DEFERRED : RENDER_PATH_FORWARD);
+	}
+	renderPathKeyDown = keyDown;
+
+	keyDown = glfwGetKey(window, CLUSTER_CULLING_KEY) == GLFW_PRESS;
+	if (keyDown && !clusterCullingKeyDown)
+	{
+		vulkanRenderer.setClusterCulling(!vulkanRenderer.isClusterCullingEnabled());
+	}
+	clusterCullingKeyDown = keyDown;
+
+	keyDown = glfwGetKey(window, NEXT_CLIP_KEY) == GLFW_PRESS;
+	if (keyDown && !nextClipKeyDown && modelClips.size() > 1)
+	{
+		previousClip = currentClip;
+		previousAnimationTime = animationTime;
+		currentClip = (currentClip + 1) % modelClips.size();
+		animationTime = 0.0f;
+		fadeTime = 0.0f;
+	}
+	nextClipKeyDown = keyDown;
+
+	keyDown = glfwGetKey(window, IMPOSTOR_KEY) == GLFW_PRESS;
+	if (keyDown && !impostorKeyDown)
+	{
+		vulkanRenderer.setImpostors(!vulkanRenderer.isImpostorsEnabled());
+	}
+	impostorKeyDown = keyDown;
+
+	keyDown = glfwGetKey(window, LIGHTMAP_KEY) == GLFW_PRESS;
+	if (keyDown && !lightmapKeyDown)
+	{
+		vulkanRenderer.setLightmaps(!vulkanRenderer.isLightmapsEnabled());
+	}
+	lightmapKeyDown = keyDown;
+
+	keyDown = glfwGetKey(window, OCCLUSION_KEY) == GLFW_PRESS;
+	if (keyDown && !occlusionKeyDown)
+	{
+		vulkanRenderer.setSoftwareOcclusion(!vulkanRenderer.isSoftwareOcclusionEnabled());
+	}
+	occlusionKeyDown = keyDown;
+
+	keyDown = glfwGetMouseButton(window, PICK_BUTTON) == GLFW_PRESS;
+	if (keyDown && !pickButtonDown)
+	{
+		double cursorX, cursorY;
+		glfwGetCursorPos(window, &cursorX, &cursorY);
+		PickHit hit;
+		auto pickStart = chrono::steady_clock::now();
+		bool picked = vulkanRenderer.pickScreen(glm::vec2(cursorX, cursorY), &hit);
+		chrono::duration<double, milli> pickTime = chrono::steady_clock::now() - pickStart;
+		if (picked)
+		{
+			cout << "Picked mesh " << hit.meshId << " of model " << hit.modelId << " at distance " << hit.distance
+				<< " (" << pickTime.count() << " ms)" << endl;
+		}
+		else
+		{
+			cout << "Nothing under cursor (" << pickTime.count() << " ms)" << endl;
+		}
+	}
+	pickButtonDown = keyDown;
 }
 
 void update()
@@ -120,6 +428,35 @@ void update()
 	angleRot += 30.0f * deltaTime;
 	glm::mat4 t = glm::rotate(glm::mat4(1.0f), glm::radians(angleRot), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.7f));
 	vulkanRenderer.updateModelTransform(modelId, t);
+
+	// Current clip loops (blended over the previous one while fading in), renderer skins its meshes with the sampled pose
+	if (!modelClips.empty())
+	{
+		animationTime += deltaTime;
+		animationSampler.sample(modelClips[currentClip], animationTime, modelSkeleton, &animationPose);
+		if (previousClip >= 0)
+		{
+			previousAnimationTime += deltaTime;
+			fadeTime += deltaTime;
+			animationSampler.sample(modelClips[previousClip], previousAnimationTime, modelSkeleton, &fadeOutPose);
+			animationSampler.blend(fadeOutPose, animationPose, std::min(fadeTime / CLIP_FADE_TIME, 1.0f), &animationPose);
+			previousClip = fadeTime < CLIP_FADE_TIME ? previousClip : -1;
+		}
+
+		std::vector<glm::mat4> localTransforms;
+		std::vector<glm::mat4> pose;
+		animationPose.toLocalTransforms(&localTransforms);
+		modelSkeleton.computeModelTransforms(localTransforms, &pose);
+		vulkanRenderer.updateModelPose(modelId, pose);
+	}
+
+	vulkanRenderer.advanceParticles(deltaTime);
+
+	lightTime += deltaTime;
+	for (int i = 0; i < DEMO_POINT_LIGHTS; i++)
+	{
+		vulkanRenderer.updateLight(i, getDemoPointLight(i, lightTime));
+	}
 }
 
 void render()
@@ -132,6 +469,20 @@ int main()
 	modelId = 1;
 	auto model = importModel("VulkanCourseApp/assets/SeahawkBlender/SeahawkBlender.obj");
 
+	// Ambient occlusion is baked on CPU before renderer creates vertex buffers
+	auto bakeStart = chrono::steady_clock::now();
+	uint64_t aoRays = AmbientOcclusionBaker::bake(model.data(), model.size(), AmbientOcclusionSettings());
+	chrono::duration<double> bakeTime = chrono::steady_clock::now() - bakeStart;
+	cout << "Baked ambient occlusion (" << aoRays << " rays) in " << bakeTime.count() << " s" << endl;
+
+	// Lightmaps bake the same sun as the renderer's directional light, so both lighting modes match at rest pose
+	LightmapSettings lightmapSettings;
+	bakeStart = chrono::steady_clock::now();
+	LightmapStats lightmapStats = LightmapBaker::bake(model.data(), model.size(), lightmapSettings);
+	bakeTime = chrono::steady_clock::now() - bakeStart;
+	cout << "Baked " << lightmapStats.lightmapCount << " lightmaps (" << lightmapStats.chartCount << " charts, "
+		<< lightmapStats.texelCount << " texels, " << lightmapStats.rayCount << " rays) in " << bakeTime.count() << " s" << endl;
+
 	// Initialize window
 	initWindow(WINDOW_TITLE, WINDOW_WIDTH, WINDOW_HEIGHT);
 	// Create and initialize Vulkan Renderer Instance
@@ -146,23 +497,83 @@ int main()
 		//vulkanRenderer.addToRendererTextured(modelId, model.size(), model.data(), modelTextures);
 	}
 
-	float frameTime = 0;
+	// Mesh with the largest bounds occludes the rest of the model (a mesh never hides itself, its box contains its surface)
+	int occluderMesh = -1;
+	float occluderVolume = 0.0f;
+	for (int i = 0; i < model.size(); i++)
+	{
+		auto vertices = model[i].getVertices();
+		if (vertices.empty() || model[i].hasSkin())
+		{
+			continue;
+		}
+		glm::vec3 boundsMin = vertices[0];
+		glm::vec3 boundsMax = vertices[0];
+		for (const auto& vertex : vertices)
+		{
+			boundsMin = glm::min(boundsMin, vertex);
+			boundsMax = glm::max(boundsMax, vertex);
+		}
+		glm::vec3 extent = boundsMax - boundsMin;
+		if (occluderMesh < 0 || extent.x * extent.y * extent.z > occluderVolume)
+		{
+			occluderMesh = i;
+			occluderVolume = extent.x * extent.y * extent.z;
+		}
+	}
+	if (occluderMesh >= 0)
+	{
+		vulkanRenderer.setModelOccluder(modelId, &model[occluderMesh]);
+	}
+
+	vulkanRenderer.setDirectionalLight(lightmapSettings.sunDirection);
+	addDemoLights();
+	addDemoParticles();
+
+	framePacer.setMode(FRAME_PACING_MODE);
+	framePacer.setTargetFps(TARGET_FPS);
+
 	// Loop until window is closed
 	while (!glfwWindowShouldClose(window))
 	{
-		glfwPollEvents();
-
-		currentFrameTime = glfwGetTime() * 1000.0f;
-		frameTime = currentFrameTime - previousFrameTime;
+		deltaTime = framePacer.beginFrame();
 
-		if (FPS_LIMIT && frameTime < TARGET_FRAME_TIME) continue;
+		// In low latency mode input is sampled only after GPU released the frame we're about to record,
+		// so it isn't getting older while draw() blocks on the fence
+		if (framePacer.isLowLatency())
+		{
+			vulkanRenderer.waitForCurrentFrame();
+		}
 
-		deltaTime = frameTime / 1000.0f;
-		previousFrameTime = currentFrameTime;
+		glfwPollEvents();
 
 		processInput();
 		update();
 		render();
+
+		// Once a second show frame rate and how long CPU was blocked waiting on GPU
+		statsTime += deltaTime;
+		statsFrames++;
+		if (statsTime >= 1.0f)
+		{
+			DrawListStats drawStats = vulkanRenderer.getDrawStats();
+			string title = string(WINDOW_TITLE) + " | FPS: " + to_string(statsFrames)
+				+ " | CPU wait on GPU: " + to_string(vulkanRenderer.getCpuWaitTime() * 1000.0) + " ms"
+				+ " | Draws: " + to_string(drawStats.draws) + ", pipeline binds: " + to_string(drawStats.pipelineBinds)
+				+ ", buffer binds: " + to_string(drawStats.vertexBufferBinds + drawStats.indexBufferBinds)
+				+ ", push constants: " + to_string(drawStats.pushConstantUpdates)
+				+ " | Path: " + (vulkanRenderer.getRenderPath() == RENDER_PATH_DEFERRED ? "deferred" : "forward")
+				+ " | Depth prepass: " + (vulkanRenderer.isDepthPrepassEnabled() ? "on" : "off")
+				+ ", fragment invocations: " + to_string(vulkanRenderer.getFragmentInvocations())
+				+ " | Cluster culling: " + (vulkanRenderer.isClusterCullingEnabled() ? "on" : "off")
+				+ " | Impostors: " + (vulkanRenderer.isImpostorsEnabled() ? "on, " + to_string(vulkanRenderer.getImpostorCount()) + " drawn" : "off")
+				+ " | Lightmaps: " + (vulkanRenderer.isLightmapsEnabled() ? "on" : "off")
+				+ " | CPU occlusion: " + (vulkanRenderer.isSoftwareOcclusionEnabled() ? "on, " + to_string(vulkanRenderer.getOcclusionCulledCount()) + " culled" : "off")
+				+ " | Shadow cascades rendered: " + to_string(vulkanRenderer.getRenderedShadowCascades()) + "/" + to_string(SHADOW_CASCADE_COUNT);
+			glfwSetWindowTitle(window, title.c_str());
+			statsTime = 0.0f;
+			statsFrames = 0;
+		}
 	}
 
 	vulkanRenderer.cleanup();
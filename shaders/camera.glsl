@@ -0,0 +1,6 @@
+// Camera of the pass, shared by scene vertex shaders and full screen passes reconstructing view space positions
+
+layout(set = 0, binding = 0) uniform UboProjectionView {
+    mat4 projection;
+    mat4 view;    
+} uboProjectionView;
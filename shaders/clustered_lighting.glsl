@@ -0,0 +1,81 @@
+// Clustered light lists shared by light clustering compute shader and scene fragment shaders
+// (constants and layouts must match ClusteredLighting.h)
+
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_COUNT (CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z)
+#define MAX_LIGHTS_PER_CLUSTER 128
+
+#define LIGHT_TYPE_POINT 0
+#define LIGHT_TYPE_SPOT 1
+
+struct Light {
+    vec4 positionRadius;        // view space position, range (light has no effect beyond it)
+    vec4 colorIntensity;
+    vec4 directionOuterCos;     // view space spot direction, cosine of outer cone angle
+    vec4 innerCosType;          // x: cosine of inner cone angle, y: light type
+};
+
+layout(set = 0, binding = 2) readonly buffer LightBuffer {
+    uvec4 lightCount;           // x: lights in buffer
+    vec4 tileSize;              // xy: cluster tile size in pixels, zw: 1 / viewport size
+    vec4 projection;            // x: projection[0][0], y: projection[1][1], z: slice scale, w: slice bias
+    vec4 depthRange;            // x: near, y: far distance covered by clusters
+    Light lights[];
+} lightBuffer;
+
+#ifndef CLUSTER_BUFFER_ACCESS
+#define CLUSTER_BUFFER_ACCESS readonly
+#endif
+
+// Every cluster has fixed size slot of light indices, so binning needs no atomics
+layout(set = 0, binding = 3) CLUSTER_BUFFER_ACCESS buffer ClusterBuffer {
+    uint lightCounts[CLUSTER_COUNT];
+    uint lightIndices[CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER];
+} clusterBuffer;
+
+// Slices are exponential in view distance, so clusters keep roughly cubic shape
+uint getClusterIndex(vec2 fragCoord, float viewDistance)
+{
+    uvec2 tile = min(uvec2(fragCoord / lightBuffer.tileSize.xy), uvec2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+    float slice = log(max(viewDistance, lightBuffer.depthRange.x)) * lightBuffer.projection.z + lightBuffer.projection.w;
+    uint z = min(uint(max(slice, 0.0)), uint(CLUSTER_COUNT_Z - 1));
+    return tile.x + tile.y * CLUSTER_COUNT_X + z * CLUSTER_COUNT_X * CLUSTER_COUNT_Y;
+}
+
+#ifndef CLUSTER_BUFFER_WRITE
+vec3 applyClusteredLights(vec3 baseColor, vec2 fragCoord, vec3 viewPos, vec3 viewNormal)
+{
+    uint cluster = getClusterIndex(fragCoord, -viewPos.z);
+    uint count = clusterBuffer.lightCounts[cluster];
+    vec3 N = normalize(viewNormal);
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < count; i++)
+    {
+        Light light = lightBuffer.lights[clusterBuffer.lightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+
+        vec3 toLight = light.positionRadius.xyz - viewPos;
+        float distance = length(toLight);
+        if (distance >= light.positionRadius.w)
+        {
+            continue;
+        }
+        vec3 L = toLight / max(distance, 0.0001);
+
+        // Inverse square falloff windowed to reach zero at light range
+        float ratio = distance / light.positionRadius.w;
+        float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+        float attenuation = window * window / (distance * distance + 1.0);
+
+        if (int(light.innerCosType.y) == LIGHT_TYPE_SPOT)
+        {
+            attenuation *= smoothstep(light.directionOuterCos.w, light.innerCosType.x, dot(-L, light.directionOuterCos.xyz));
+        }
+
+        result += max(dot(N, L), 0.0) * light.colorIntensity.rgb * light.colorIntensity.w * attenuation;
+    }
+    return result * baseColor;
+}
+#endif
@@ -0,0 +1,56 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "camera.glsl"
+#include "lighting.glsl"
+#include "clustered_lighting.glsl"
+#include "shadows.glsl"
+
+layout(location = 0) in vec2 fragNdc;
+
+// 1 when depth buffer is reversed (cleared to 0, far plane at infinity)
+layout(constant_id = 0) const int REVERSE_Z = 0;
+
+// G-buffer written by previous subpass, read at this pixel from tile memory
+layout(input_attachment_index = 0, set = 2, binding = 0) uniform subpassInput gbufferAlbedo;
+layout(input_attachment_index = 1, set = 2, binding = 1) uniform subpassInput gbufferNormal;
+layout(input_attachment_index = 2, set = 2, binding = 2) uniform subpassInput gbufferLighting;
+layout(input_attachment_index = 3, set = 2, binding = 3) uniform subpassInput gbufferDepth;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Pixels no geometry was drawn to keep the clear color
+    float depth = subpassLoad(gbufferDepth).r;
+    if (depth == (REVERSE_Z == 1 ? 0.0 : 1.0))
+    {
+        discard;
+    }
+
+    // View space position from depth: z inverts projection's depth row, xy undo perspective divide
+    mat4 projection = uboProjectionView.projection;
+    float viewZ = -projection[3][2] / (depth + projection[2][2]);
+    vec3 viewPos = vec3(fragNdc.x * -viewZ / projection[0][0], fragNdc.y * -viewZ / projection[1][1], viewZ);
+
+    vec4 albedo = subpassLoad(gbufferAlbedo);
+    vec3 baseColor = albedo.rgb;
+    float occlusion = albedo.a;
+    vec4 normal = subpassLoad(gbufferNormal);
+    vec3 viewNormal = normalize(normal.xyz * 2.0 - 1.0);
+
+    // Same lighting as forward path, shaded once per pixel instead of once per drawn fragment (lightmapped pixels
+    // come with directional light and ambient already baked)
+    vec3 finalColor;
+    if (normal.a > 0.5)
+    {
+        finalColor = subpassLoad(gbufferLighting).rgb;
+    }
+    else
+    {
+        float shadow = getShadow(viewPos, viewNormal);
+        finalColor = applyLighting(baseColor, viewNormal, shadowData.lightDirection.xyz, shadow, occlusion);
+    }
+    finalColor += applyClusteredLights(baseColor, gl_FragCoord.xy, viewPos, viewNormal);
+
+    outColor = vec4(finalColor, 1.0);
+}
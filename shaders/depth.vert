@@ -0,0 +1,11 @@
+#version 450        // GLSL 4.5
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "scene.glsl"
+
+// Position only stream, depth prepass fetches nothing else
+layout(location = 0) in vec3 pos;
+
+void main() {
+    gl_Position = transformPosition(objectBuffer.objects[gl_InstanceIndex].model, pos);
+}
@@ -0,0 +1,10 @@
+#version 450        // GLSL 4.5
+
+// One triangle covering the whole viewport, vertices come from vertex index (no vertex buffer)
+layout(location = 0) out vec2 fragNdc;
+
+void main() {
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    fragNdc = uv * 2.0 - 1.0;
+    gl_Position = vec4(fragNdc, 0.0, 1.0);
+}
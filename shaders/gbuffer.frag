@@ -0,0 +1,27 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require      // runtime sized descriptor arrays
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "material.glsl"
+
+layout(location = 0) in vec3 fragCol;
+layout(location = 1) in vec2 fragUv;
+layout(location = 2) in vec3 fragViewPos;
+layout(location = 3) in vec3 fragViewNormal;
+layout(location = 4) in float fragOcclusion;
+layout(location = 5) in vec2 fragLightmapUv;
+layout(location = 6) flat in int fragLightmap;
+layout(location = 7) flat in float fragLightmapScale;
+
+// G-buffer (formats chosen in VulkanRenderer::buildRenderGraph), position is reconstructed from depth
+layout(location = 0) out vec4 outAlbedo;    // alpha holds baked ambient occlusion
+layout(location = 1) out vec4 outNormal;    // view space normal mapped to 0..1 (unsigned normalized target), alpha 1 when lightmapped
+layout(location = 2) out vec4 outLighting;  // baked irradiance times base color, replaces directional light and ambient
+
+void main() {
+    vec3 baseColor = getBaseColor(fragCol, fragUv);
+    bool lightmapped = fragLightmap >= 0;
+    outAlbedo = vec4(baseColor, fragOcclusion);
+    outNormal = vec4(normalize(fragViewNormal) * 0.5 + 0.5, lightmapped ? 1.0 : 0.0);
+    outLighting = vec4(lightmapped ? getBakedIrradiance(fragLightmap, fragLightmapScale, fragLightmapUv) * baseColor : vec3(0.0), 0.0);
+}
@@ -0,0 +1,30 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require      // runtime sized descriptor arrays
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#define IMPOSTOR_FRAGMENT
+#include "impostor.glsl"
+#include "lighting.glsl"
+#include "clustered_lighting.glsl"
+#include "shadows.glsl"
+
+layout(location = 0) in vec2 fragCellUv;
+layout(location = 1) flat in vec2 fragCell;
+layout(location = 2) in vec3 fragViewPos;
+layout(location = 3) flat in mat3 fragNormalMatrix;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec2 atlasUv = getImpostorAtlasUv(fragCell, fragCellUv);
+    vec3 baseColor = sampleImpostorAlbedo(atlasUv);
+    vec3 viewNormal = normalize(fragNormalMatrix * sampleImpostorNormal(atlasUv));
+
+    // Lit like regular meshes, position is on the quad (impostors are far away, shadow and cluster lookups tolerate it).
+    // Atlases don't keep baked ambient occlusion, so ambient term is unoccluded
+    float shadow = getShadow(fragViewPos, viewNormal);
+    vec3 finalColor = applyLighting(baseColor, viewNormal, shadowData.lightDirection.xyz, shadow, 1.0);
+    finalColor += applyClusteredLights(baseColor, gl_FragCoord.xy, fragViewPos, viewNormal);
+
+    outColor = vec4(finalColor, 1.0);
+}
@@ -0,0 +1,78 @@
+// Impostor atlas layout and per draw parameters shared by impostor shaders (layout must match ImpostorBaker.h),
+// fragment shaders define IMPOSTOR_FRAGMENT to get atlas sampling (vertex shader must not reference texture set)
+
+#define IMPOSTOR_GRID_SIZE 8                // views per atlas side
+#define IMPOSTOR_CELL_SIZE 64               // pixels of one view
+#define IMPOSTOR_ALPHA_CUTOFF 0.5           // coverage below it is outside of model's silhouette
+
+layout(push_constant) uniform PushImpostor {
+    vec4 bounds;                // xyz: center of bounding sphere views were baked around (model space), w: its radius
+    int albedoTexture;          // atlases in bindless texture array
+    int normalTexture;
+} pushImpostor;
+
+// Half size of baked view in model units (views keep one empty texel at their borders)
+float getImpostorExtent()
+{
+    return pushImpostor.bounds.w * IMPOSTOR_CELL_SIZE / (IMPOSTOR_CELL_SIZE - 2.0);
+}
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Octahedral map of the sphere to -1..1, views are baked at cell centers of this map
+vec2 encodeOctahedral(vec3 direction)
+{
+    vec2 encoded = direction.xy / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+    return direction.z < 0.0 ? (1.0 - abs(encoded.yx)) * signNotZero(encoded) : encoded;
+}
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (direction.z < 0.0)
+    {
+        direction.xy = (1.0 - abs(direction.yx)) * signNotZero(direction.xy);
+    }
+    return normalize(direction);
+}
+
+// Image axes of bake camera looking along -direction (glm::lookAt with Y up, Z up near the poles)
+void getImpostorViewAxes(vec3 direction, out vec3 right, out vec3 up)
+{
+    vec3 upAxis = abs(direction.y) > 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    right = normalize(cross(-direction, upAxis));
+    up = cross(right, -direction);
+}
+
+#ifdef IMPOSTOR_FRAGMENT
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// Atlas coordinates of position within view cell, discards positions outside of the cell
+vec2 getImpostorAtlasUv(vec2 cell, vec2 cellUv)
+{
+    if (any(lessThan(cellUv, vec2(0.0))) || any(greaterThan(cellUv, vec2(1.0))))
+    {
+        discard;
+    }
+    return (cell + cellUv) / IMPOSTOR_GRID_SIZE;
+}
+
+// Base color of baked view, alpha tested so impostor can write depth like opaque geometry
+vec3 sampleImpostorAlbedo(vec2 atlasUv)
+{
+    vec4 albedo = texture(textures[pushImpostor.albedoTexture], atlasUv);
+    if (albedo.a < IMPOSTOR_ALPHA_CUTOFF)
+    {
+        discard;
+    }
+    return albedo.rgb;
+}
+
+vec3 sampleImpostorNormal(vec2 atlasUv)
+{
+    return texture(textures[pushImpostor.normalTexture], atlasUv).xyz * 2.0 - 1.0;
+}
+#endif
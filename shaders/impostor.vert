@@ -0,0 +1,39 @@
+#version 450        // GLSL 4.5
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "scene.glsl"
+#include "impostor.glsl"
+
+// Two triangles facing the camera (no vertex buffer), textured with the baked view closest to camera direction
+layout(location = 0) out vec2 fragCellUv;               // position in baked view, 0..1 within the cell
+layout(location = 1) flat out vec2 fragCell;            // baked view in atlas grid
+layout(location = 2) out vec3 fragViewPos;
+layout(location = 3) flat out mat3 fragNormalMatrix;    // model space (baked) normals to view space
+
+const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main() {
+    mat4 modelView = uboProjectionView.view * objectBuffer.objects[gl_InstanceIndex].model;
+    mat4 inverseModelView = inverse(modelView);
+    vec3 center = pushImpostor.bounds.xyz;
+
+    // Camera position in model space picks the view (rotating the model shows its other sides)
+    vec3 direction = normalize(inverseModelView[3].xyz - center);
+    vec2 cell = clamp(floor((encodeOctahedral(direction) * 0.5 + 0.5) * IMPOSTOR_GRID_SIZE), 0.0, IMPOSTOR_GRID_SIZE - 1.0);
+    vec3 right;
+    vec3 up;
+    getImpostorViewAxes(decodeOctahedral((cell + 0.5) / IMPOSTOR_GRID_SIZE * 2.0 - 1.0), right, up);
+
+    // Expanded in view space like particles, covering bounds of the scaled model
+    float scale = max(length(modelView[0].xyz), max(length(modelView[1].xyz), length(modelView[2].xyz)));
+    vec4 viewPos = modelView * vec4(center, 1.0);
+    viewPos.xy += corners[gl_VertexIndex] * pushImpostor.bounds.w * scale;
+
+    // Views were baked orthographically, so quad corner projected onto view's image plane gives its cell position
+    vec3 offset = (inverseModelView * viewPos).xyz - center;
+    fragCellUv = vec2(dot(offset, right), -dot(offset, up)) / getImpostorExtent() * 0.5 + 0.5;
+    fragCell = cell;
+    fragViewPos = viewPos.xyz;
+    fragNormalMatrix = mat3(modelView);
+    gl_Position = uboProjectionView.projection * viewPos;
+}
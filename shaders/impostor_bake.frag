@@ -0,0 +1,18 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require      // runtime sized descriptor arrays
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "material.glsl"
+
+layout(location = 0) in vec3 fragCol;
+layout(location = 1) in vec2 fragUv;
+layout(location = 2) in vec3 fragNormal;
+
+// Impostor atlases (formats chosen in ImpostorBaker.h), lighting is applied when impostor is drawn
+layout(location = 0) out vec4 outAlbedo;        // alpha is coverage
+layout(location = 1) out vec4 outNormal;        // model space normal mapped to 0..1
+
+void main() {
+    outAlbedo = vec4(getBaseColor(fragCol, fragUv), 1.0);
+    outNormal = vec4(normalize(fragNormal) * 0.5 + 0.5, 1.0);
+}
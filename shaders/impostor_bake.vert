@@ -0,0 +1,23 @@
+#version 450        // GLSL 4.5
+
+// Mesh vertices in model space, rendered by ImpostorBaker into one view of the atlas
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 col;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 uv;
+
+layout(push_constant) uniform PushBake {
+    int textureIndex;           // first member is PushModel of material.glsl (fragment stage)
+    mat4 viewProjection;        // orthographic camera of the view being baked
+} pushBake;
+
+layout(location = 0) out vec3 fragCol;
+layout(location = 1) out vec2 fragUv;
+layout(location = 2) out vec3 fragNormal;
+
+void main() {
+    gl_Position = pushBake.viewProjection * vec4(pos, 1.0);
+    fragCol = col;
+    fragUv = uv;
+    fragNormal = normal;
+}
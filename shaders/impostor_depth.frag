@@ -0,0 +1,14 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require      // runtime sized descriptor arrays
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#define IMPOSTOR_FRAGMENT
+#include "impostor.glsl"
+
+layout(location = 0) in vec2 fragCellUv;
+layout(location = 1) flat in vec2 fragCell;
+
+// Depth prepass: only coverage is tested, so color pass finds equal depth exactly where it shades
+void main() {
+    sampleImpostorAlbedo(getImpostorAtlasUv(fragCell, fragCellUv));
+}
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require      // runtime sized descriptor arrays
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#define IMPOSTOR_FRAGMENT
+#include "impostor.glsl"
+
+layout(location = 0) in vec2 fragCellUv;
+layout(location = 1) flat in vec2 fragCell;
+layout(location = 2) in vec3 fragViewPos;
+layout(location = 3) flat in mat3 fragNormalMatrix;
+
+// Same targets as gbuffer.frag
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+layout(location = 2) out vec4 outLighting;
+
+void main() {
+    vec2 atlasUv = getImpostorAtlasUv(fragCell, fragCellUv);
+    outAlbedo = vec4(sampleImpostorAlbedo(atlasUv), 1.0);
+    outNormal = vec4(normalize(fragNormalMatrix * sampleImpostorNormal(atlasUv)) * 0.5 + 0.5, 0.0);
+    outLighting = vec4(0.0);
+}
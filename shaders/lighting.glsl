@@ -0,0 +1,20 @@
+// Shared lighting functions, included by fragment shaders
+
+const vec3 lightColor = vec3(1.0, 1.0, 1.0);
+const float ambientStrength = 0.1;
+
+// Directional light, lightDir points towards the light (same space as normal), shadow is 1 for fully lit,
+// occlusion (baked ambient occlusion, 1 for unoccluded) darkens ambient term only
+vec3 applyLighting(vec3 baseColor, vec3 normal, vec3 lightDir, float shadow, float occlusion)
+{
+    // Normalize normal vector
+    vec3 N = normalize(normal);
+
+    // Calculate diffuse component
+    float diff = max(dot(N, lightDir), 0.0);
+
+    // Calculate final color with ambient and diffuse (ambient is not shadowed)
+    vec3 ambient = ambientStrength * occlusion * lightColor;
+    vec3 diffuse = diff * shadow * lightColor;
+    return (ambient + diffuse) * baseColor;
+}
@@ -0,0 +1,27 @@
+// Base color of scene materials, shared by forward shading and G-buffer fragment shaders
+
+// Pipeline variant: 0 - texture usage decided per draw, 1 - vertex color only, 2 - texture only
+layout(constant_id = 0) const int MATERIAL_VARIANT = 0;
+
+// Bindless texture array, indexed by texture index passed per draw
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform PushModel {
+    int textureIndex;
+} pushModel;
+
+// Textured meshes take base color from their texture, others from vertex color
+vec3 getBaseColor(vec3 vertexColor, vec2 uv)
+{
+    if (MATERIAL_VARIANT == 2 || (MATERIAL_VARIANT == 0 && pushModel.textureIndex >= 0))
+    {
+        return texture(textures[pushModel.textureIndex], uv).rgb;
+    }
+    return vertexColor;
+}
+
+// Irradiance baked by LightmapBaker (sun with its shadows, sky and their bounces), texels are stored divided by scale
+vec3 getBakedIrradiance(int lightmap, float scale, vec2 lightmapUv)
+{
+    return texture(textures[lightmap], lightmapUv).rgb * scale;
+}
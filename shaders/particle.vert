@@ -0,0 +1,29 @@
+#version 450        // GLSL 4.5
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "camera.glsl"
+
+#define PARTICLE_SET 3
+#define PARTICLE_ACCESS readonly
+#include "particles.glsl"
+
+// Instance per alive particle, two triangles facing the camera (no vertex buffer)
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragCorner;
+
+const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main() {
+    uint index = particleState.aliveLists[particleState.targetList * MAX_PARTICLES + gl_InstanceIndex];
+    Particle particle = particleBuffer.particles[index];
+
+    float t = clamp(particle.positionAge.w / particle.velocityLifetime.w, 0.0, 1.0);
+    float size = mix(uintBitsToFloat(particle.appearance.z), uintBitsToFloat(particle.appearance.w), t);
+    fragColor = mix(unpackUnorm4x8(particle.appearance.x), unpackUnorm4x8(particle.appearance.y), t);
+    fragCorner = corners[gl_VertexIndex];
+
+    // Expanded in view space, so quad always faces the camera
+    vec4 viewPosition = uboProjectionView.view * vec4(particle.positionAge.xyz, 1.0);
+    viewPosition.xy += fragCorner * size;
+    gl_Position = uboProjectionView.projection * viewPosition;
+}
@@ -0,0 +1,12 @@
+// Inputs of particle simulation shaders (emit, prepare, simulate), same set and push constants in all of them,
+// so they share one pipeline layout
+
+#define PARTICLE_SET 0
+#include "particles.glsl"
+
+layout(push_constant) uniform ParticleParams {
+    vec4 gravity;               // xyz: acceleration, w: time step
+    uint spawnCount;
+    uint emitterCount;
+    uint seed;
+} params;
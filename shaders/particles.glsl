@@ -0,0 +1,38 @@
+// Particle buffers shared by simulation and drawing, includer defines PARTICLE_SET (and PARTICLE_ACCESS as readonly
+// in vertex shaders, which may not write storage buffers)
+
+#define MAX_PARTICLES 262144
+#define PARTICLE_GROUP_SIZE 64
+
+#ifndef PARTICLE_ACCESS
+#define PARTICLE_ACCESS
+#endif
+
+struct Particle {
+    vec4 positionAge;           // xyz: world position, w: age in seconds
+    vec4 velocityLifetime;      // xyz: velocity, w: lifetime in seconds
+    uvec4 appearance;           // x: start color, y: end color (packed unorm), z: start size, w: end size (float bits)
+};
+
+layout(set = PARTICLE_SET, binding = 0) PARTICLE_ACCESS buffer ParticleBuffer {
+    Particle particles[];
+} particleBuffer;
+
+// Alive particles are listed in one of two lists, simulation moves survivors from source to target list.
+// Draw arguments come first, instance count is the number of particles in target list
+layout(set = PARTICLE_SET, binding = 1) PARTICLE_ACCESS buffer ParticleStateBuffer {
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+    uint groupCountX;           // simulation dispatch
+    uint groupCountY;
+    uint groupCountZ;
+    uint aliveCount;            // particles in source list
+    uint sourceList;
+    uint targetList;
+    int deadCount;
+    uint padding;
+    uint deadList[MAX_PARTICLES];
+    uint aliveLists[2 * MAX_PARTICLES];
+} particleState;
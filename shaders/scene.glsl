@@ -0,0 +1,24 @@
+// Scene inputs shared by vertex shaders of all scene passes, included so every pass transforms positions identically
+
+#include "camera.glsl"
+
+// Data of all objects drawn this frame, draw selects its object with first instance
+struct ObjectData {
+    mat4 model;
+    int lightmapTexture;        // -1 without baked lighting
+    float lightmapScale;
+    int padding0;
+    int padding1;
+};
+
+layout(set = 0, binding = 1) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
+
+// Depth prepass and color pass compare depth with EQUAL, so position must be bit exact in both
+invariant gl_Position;
+
+vec4 transformPosition(mat4 model, vec3 pos)
+{
+    return uboProjectionView.projection * uboProjectionView.view * model * vec4(pos, 1.0);
+}
@@ -1,36 +1,41 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require      // runtime sized descriptor arrays
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "material.glsl"
+#include "lighting.glsl"
+#include "clustered_lighting.glsl"
+#include "shadows.glsl"
 
 layout(location = 0) in vec3 fragCol;
 layout(location = 1) in vec2 fragUv;
-layout(location = 2) in vec3 fragNormal;
-
-layout(set = 1, binding = 0) uniform sampler2D textureSampler;
+layout(location = 2) in vec3 fragViewPos;
+layout(location = 3) in vec3 fragViewNormal;
+layout(location = 4) in float fragOcclusion;
+layout(location = 5) in vec2 fragLightmapUv;
+layout(location = 6) flat in int fragLightmap;
+layout(location = 7) flat in float fragLightmapScale;
 
 
 layout(location = 0) out vec4 outColor;     // final output color
 
 
 void main() {
-    float depth = gl_FragCoord.z;
-    
-    //outColor = texture(textureSampler, fragUv);
-    //outColor = vec4(fragCol, 1.0f);
-
-    // Hard-coded light values
-    vec3 lightDir = normalize(vec3(0.0, 0.0, 1.0));
-    vec3 lightColor = vec3(1.0, 1.0, 1.0);
-    float ambientStrength = 0.1;
-    
-    // Normalize normal vector
-    vec3 N = normalize(fragNormal);
-    
-    // Calculate diffuse component
-    float diff = max(dot(N, lightDir), 0.0);
-    
-    // Calculate final color with ambient and diffuse
-    vec3 ambient = ambientStrength * lightColor;
-    vec3 diffuse = diff * lightColor;
-    vec3 finalColor = (ambient + diffuse) * fragCol;
+    vec3 baseColor = getBaseColor(fragCol, fragUv);
+
+    // Shadowed directional light (baked together with sky for lightmapped objects) plus point/spot lights binned into
+    // this fragment's cluster
+    vec3 finalColor;
+    if (fragLightmap >= 0)
+    {
+        finalColor = getBakedIrradiance(fragLightmap, fragLightmapScale, fragLightmapUv) * baseColor;
+    }
+    else
+    {
+        float shadow = getShadow(fragViewPos, fragViewNormal);
+        finalColor = applyLighting(baseColor, fragViewNormal, shadowData.lightDirection.xyz, shadow, fragOcclusion);
+    }
+    finalColor += applyClusteredLights(baseColor, gl_FragCoord.xy, fragViewPos, fragViewNormal);
 
     outColor = vec4(finalColor, 1.0);
-}
\ No newline at end of file
+}
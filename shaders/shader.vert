@@ -1,32 +1,35 @@
 #version 450        // GLSL 4.5
+#extension GL_GOOGLE_include_directive : require      // #include support (resolved by runtime shader compiler)
+
+#include "scene.glsl"
 
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 col;
 layout(location = 2) in vec3 normal;
 layout(location = 3) in vec2 uv;
-
-layout(set = 0, binding = 0) uniform UboProjectionView {
-    mat4 projection;
-    mat4 view;    
-} uboProjectionView;
-
-// LEFT FOR REFERENCE ON DYNAMIC UNIFORM BUFFERS
-// layout(set = 0, binding = 1) uniform UboModel {
-//     mat4 model;  
-// } uboModel;
-
-layout(push_constant) uniform PushModel {
-    mat4 model;
-} pushModel;
+layout(location = 4) in float occlusion;
+layout(location = 5) in vec2 lightmapUv;
 
 layout(location = 0) out vec3 fragCol;
 layout(location = 1) out vec2 fragUv;
-layout(location = 2) out vec3 fragNormal;
+layout(location = 2) out vec3 fragViewPos;         // view space, lights and shadow lookups work in view space
+layout(location = 3) out vec3 fragViewNormal;
+layout(location = 4) out float fragOcclusion;
+layout(location = 5) out vec2 fragLightmapUv;
+layout(location = 6) flat out int fragLightmap;        // bindless index of object's lightmap, -1 without one
+layout(location = 7) flat out float fragLightmapScale;
 
 void main() {
-    gl_Position = uboProjectionView.projection * uboProjectionView.view * pushModel.model * vec4(pos, 1.0);
+    mat4 model = objectBuffer.objects[gl_InstanceIndex].model;
+    gl_Position = transformPosition(model, pos);
     fragCol = col;
     fragUv = uv;
-    vec4 n = pushModel.model * vec4(normal, 1.0);
-    fragNormal = vec3(n.x, n.y, n.z);
+    fragOcclusion = occlusion;
+    fragLightmapUv = lightmapUv;
+    fragLightmap = objectBuffer.objects[gl_InstanceIndex].lightmapTexture;
+    fragLightmapScale = objectBuffer.objects[gl_InstanceIndex].lightmapScale;
+
+    mat4 modelView = uboProjectionView.view * model;
+    fragViewPos = (modelView * vec4(pos, 1.0)).xyz;
+    fragViewNormal = mat3(modelView) * normal;
 }
\ No newline at end of file
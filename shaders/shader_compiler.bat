@@ -1,3 +0,0 @@
-C:/VulkanSDK/1.4.309.0/Bin/glslangValidator.exe -V shader.vert
-C:/VulkanSDK/1.4.309.0/Bin/glslangValidator.exe -V shader.frag
-pause
\ No newline at end of file
@@ -0,0 +1,52 @@
+// Cascaded shadow lookup of the directional light (constants and layout must match CascadedShadows.h)
+
+#define SHADOW_CASCADE_COUNT 4
+#define SHADOW_NORMAL_OFFSET 1.5        // texels the lookup position is pushed along surface normal
+
+layout(set = 0, binding = 4) uniform ShadowData {
+    mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];     // view space position to atlas uv (xy) and depth (z)
+    vec4 tileRects[SHADOW_CASCADE_COUNT];           // atlas uv min (xy) and max (zw) of cascade tile
+    vec4 splitDistances;                            // far view distance of each cascade
+    vec4 texelSizes;                                // world size of shadow texel of each cascade
+    vec4 lightDirection;                            // view space direction towards the light
+    vec4 atlasTexelSize;                            // x: 1 / atlas size
+} shadowData;
+
+layout(set = 0, binding = 5) uniform sampler2DShadow shadowAtlas;
+
+// 1 for fully lit, 0 for fully shadowed
+float getShadow(vec3 viewPos, vec3 viewNormal)
+{
+    float distance = -viewPos.z;
+    if (distance > shadowData.splitDistances[SHADOW_CASCADE_COUNT - 1])
+    {
+        return 1.0;
+    }
+
+    int cascade = 0;
+    for (int i = 0; i < SHADOW_CASCADE_COUNT - 1; i++)
+    {
+        if (distance > shadowData.splitDistances[i])
+        {
+            cascade = i + 1;
+        }
+    }
+
+    // Offset along normal hides acne on steep slopes without large depth bias
+    vec3 offsetPos = viewPos + normalize(viewNormal) * shadowData.texelSizes[cascade] * SHADOW_NORMAL_OFFSET;
+    vec3 shadowPos = (shadowData.cascadeMatrices[cascade] * vec4(offsetPos, 1.0)).xyz;
+
+    // 3x3 taps of hardware 2x2 PCF, kept inside cascade's tile so neighbouring cascades don't bleed in
+    vec4 tile = shadowData.tileRects[cascade];
+    float texel = shadowData.atlasTexelSize.x;
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            vec2 uv = clamp(shadowPos.xy + vec2(x, y) * texel, tile.xy + texel, tile.zw - texel);
+            lit += texture(shadowAtlas, vec3(uv, shadowPos.z));
+        }
+    }
+    return lit / 9.0;
+}